@@ -10,24 +10,31 @@
 // Our crate name is stupid, for historical reasons.
 #![allow(non_snake_case)]
 
-mod skyrim;
-mod hook_wrappers;
-mod hooks;
-mod settings;
-
 use std::ffi::CStr;
 use std::path::Path;
 
+use alloc_track::Tag;
 use skse64::log::{skse_message, skse_fatal};
+#[cfg(not(feature = "baked_config"))] use skse64::{event::register_listener, plugin_api::Message};
 use skse64::version::{SkseVersion, PACKED_SKSE_VERSION, CURRENT_RELEASE_RUNTIME};
 use skse64::plugin_api::{SksePluginVersionData, SkseInterface};
 use skyrim_patcher::flatten_patch_groups;
+use uncapper_core::{extension, settings};
+#[cfg(feature = "trace_capture")] use uncapper_core::trace;
 
-use skyrim::{GAME_SIGNATURES, NUM_GAME_SIGNATURES};
-use hooks::{HOOK_SIGNATURES, NUM_HOOK_SIGNATURES};
+use uncapper_core::skyrim::{GAME_SIGNATURES, NUM_GAME_SIGNATURES};
+use uncapper_core::hooks::{HOOK_SIGNATURES, NUM_HOOK_SIGNATURES};
 
 const NUM_PATCHES: usize = NUM_GAME_SIGNATURES + NUM_HOOK_SIGNATURES;
 
+/// The INI file which holds the settings of the plugin.
+const INI_PATH: &str = "Data\\SKSE\\Plugins\\SkyrimUncapper.ini";
+
+/// Counts the heap usage of each subsystem, when built with allocation tracking.
+#[cfg(feature = "alloc_tracking")]
+#[global_allocator]
+static ALLOCATOR: alloc_track::TrackingAllocator = alloc_track::TrackingAllocator;
+
 skse64::plugin_version_data! {
     version: SkseVersion::new(
         unsigned_from_str(env!("CARGO_PKG_VERSION_MAJOR")),
@@ -60,7 +67,7 @@ pub fn skse_plugin_rust_entry(
          Base addr: {:#x}",
         unsafe { CStr::from_ptr(SKSEPlugin_Version.name.as_ptr()).to_str().unwrap() },
         SKSEPlugin_Version.plugin_version,
-        env!("UNCAPPER_GIT_VERSION"),
+        uncapper_core::GIT_VERSION,
         PACKED_SKSE_VERSION,
         CURRENT_RELEASE_RUNTIME,
         (*skse).skse_version.unwrap(),
@@ -68,10 +75,20 @@ pub fn skse_plugin_rust_entry(
         skse64::reloc::RelocAddr::base()
     );
 
-    settings::init(Path::new("Data\\SKSE\\Plugins\\SkyrimUncapper.ini"));
+    settings::init(Path::new(INI_PATH));
+    if settings::is_version_db_shared() {
+        skyrim_patcher::share_version_db();
+    }
 
     let patches = flatten_patch_groups::<NUM_PATCHES>(&[&GAME_SIGNATURES, &HOOK_SIGNATURES]);
-    if let Err(_) = skyrim_patcher::apply(patches) {
+    let patch_scope = alloc_track::scope(Tag::Patcher);
+    let res = skyrim_patcher::apply(patches);
+    drop(patch_scope);
+
+    #[cfg(feature = "alloc_tracking")]
+    log_heap_usage();
+
+    if let Err(_) = res {
         skse_fatal!(
             "Failed to install the requested set of game patches. See log for details.\n\
              It is safe to continue playing; none of this mods changes have been applied."
@@ -79,10 +96,65 @@ pub fn skse_plugin_rust_entry(
         return Err(());
     }
 
+    // Edits to the INI take effect the next time a save is loaded.
+    #[cfg(not(feature = "baked_config"))]
+    register_listener(Message::SKSE_PRE_LOAD_GAME, |_| settings::reload(Path::new(INI_PATH)));
+
+    // Other plugins can only register hook callbacks once our hooks are in. Otherwise, their
+    // requests go unanswered, and they are left to patch the game themselves.
+    extension::init();
+
+    #[cfg(feature = "trace_capture")]
+    start_trace();
+
     skse_message!("Initialization complete!");
     Ok(())
 }
 
+/// Begins capturing each hook call, once the game objects the trace header holds are found.
+#[cfg(feature = "trace_capture")]
+fn start_trace() {
+    use skse64::{event, plugin_api::Message};
+    use uncapper_core::skyrim::*;
+
+    let path = Path::new("Data\\SKSE\\Plugins\\SkyrimUncapper.trace");
+    trace::open(path, &trace::TraceHeader {
+        runtime: skse64::version::current_runtime(),
+        settings: [
+            *ENCHANTING_SKILL_COST_BASE.get(),
+            *ENCHANTING_SKILL_COST_SCALE.get(),
+            *ENCHANTING_SKILL_COST_MULT.get(),
+            *ENCHANTING_COST_EXPONENT.get(),
+            *XP_PER_SKILL_RANK.get(),
+            *LEGENDARY_SKILL_RESET_VALUE.get()
+        ]
+    });
+
+    // SKSE doesn't tell plugins when the game exits, so the buffered records are written out
+    // whenever the game saves or loads. Only the calls made since then can be lost.
+    for msg in [Message::SKSE_SAVE_GAME, Message::SKSE_PRE_LOAD_GAME, Message::SKSE_NEW_GAME] {
+        event::register_listener(msg, |_| trace::flush());
+    }
+
+    skse_message!("Capturing hook calls to SkyrimUncapper.trace");
+}
+
+/// Logs the heap usage of each subsystem during initialization.
+#[cfg(feature = "alloc_tracking")]
+fn log_heap_usage() {
+    for tag in Tag::ALL {
+        let stats = alloc_track::stats(tag);
+        skse_message!(
+            "[HEAP] {}: {} allocations, {} bytes total, {} bytes peak, {} bytes live",
+            tag.name(),
+            stats.allocs,
+            stats.total_bytes,
+            stats.peak_bytes,
+            stats.live_bytes
+        );
+    }
+}
+
 // Converts strings to ints in const context, for version numbers.
 const fn unsigned_from_str(
     s: &str
@@ -0,0 +1,254 @@
+//!
+//! @file lib.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief A global allocator which counts the allocations made by each subsystem.
+//! @bug No known bugs.
+//!
+//! Allocations are charged to the tag of the innermost scope active on the allocating thread,
+//! and each block remembers its tag so that it is credited back to the same subsystem when it
+//! is freed, no matter which scope frees it.
+//!
+//! Scopes can always be entered, but nothing is counted unless the tracking allocator has been
+//! installed as the global allocator. This lets libraries tag their work unconditionally, and
+//! leaves the choice of tracking to the final binary.
+//!
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// The subsystems which allocations can be charged to.
+#[repr(u8)]
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub enum Tag {
+    Untagged = 0,
+    Ini,
+    Settings,
+    VersionDb,
+    Patcher
+}
+
+/// Counts the heap usage of every tag.
+pub struct TrackingAllocator;
+
+/// Restores the previous tag of the thread when dropped.
+pub struct TagScope {
+    prev: u8
+}
+
+/// A snapshot of the heap usage of a tag.
+#[derive(Copy, Clone, Default, Debug)]
+pub struct TagStats {
+    pub allocs: usize,
+    pub total_bytes: usize,
+    pub live_bytes: usize,
+    pub peak_bytes: usize
+}
+
+/// The counters for a single tag.
+struct Counters {
+    allocs: AtomicUsize,
+    total_bytes: AtomicUsize,
+    live_bytes: AtomicUsize,
+    peak_bytes: AtomicUsize
+}
+
+/// The counters of each tag, indexed by the tag.
+static COUNTERS: [Counters; Tag::COUNT] = [const { Counters::new() }; Tag::COUNT];
+
+thread_local! {
+    /// The tag allocations on this thread are charged to.
+    static CURRENT_TAG: Cell<u8> = const { Cell::new(Tag::Untagged as u8) };
+
+    /// The number of allocations made on this thread.
+    static THREAD_ALLOCS: Cell<usize> = const { Cell::new(0) };
+}
+
+impl Tag {
+    /// The number of tags.
+    pub const COUNT: usize = Self::Patcher as usize + 1;
+
+    /// Every tag, in order.
+    pub const ALL: [Self; Self::COUNT] = [
+        Self::Untagged, Self::Ini, Self::Settings, Self::VersionDb, Self::Patcher
+    ];
+
+    /// Gets the name of the tag, as it should be shown in a report.
+    pub fn name(
+        self
+    ) -> &'static str {
+        match self {
+            Self::Untagged => "Untagged",
+            Self::Ini => "Ini",
+            Self::Settings => "Settings",
+            Self::VersionDb => "VersionDb",
+            Self::Patcher => "Patcher"
+        }
+    }
+}
+
+impl Counters {
+    /// Creates a new set of zeroed counters.
+    const fn new() -> Self {
+        Self {
+            allocs: AtomicUsize::new(0),
+            total_bytes: AtomicUsize::new(0),
+            live_bytes: AtomicUsize::new(0),
+            peak_bytes: AtomicUsize::new(0)
+        }
+    }
+
+    /// Records an allocation of the given size.
+    fn grow(
+        &self,
+        size: usize
+    ) {
+        self.allocs.fetch_add(1, Ordering::Relaxed);
+        self.total_bytes.fetch_add(size, Ordering::Relaxed);
+        let live = self.live_bytes.fetch_add(size, Ordering::Relaxed) + size;
+        self.peak_bytes.fetch_max(live, Ordering::Relaxed);
+    }
+
+    /// Records that a block of the given size was freed.
+    fn shrink(
+        &self,
+        size: usize
+    ) {
+        self.live_bytes.fetch_sub(size, Ordering::Relaxed);
+    }
+}
+
+impl TrackingAllocator {
+    /// The size of the header holding the tag of each block.
+    const HEADER: usize = 16;
+
+    /// Gets the size of the header for a block with the given layout.
+    fn header(
+        layout: &Layout
+    ) -> usize {
+        layout.align().max(Self::HEADER)
+    }
+
+    /// Gets the layout of the block, including its header, which is requested from the system.
+    unsafe fn outer(
+        layout: &Layout
+    ) -> Layout {
+        // SAFETY: The header is a multiple of the alignment, so the layout remains valid unless
+        //         the size overflows, which the caller has already ruled out.
+        Layout::from_size_align_unchecked(layout.size() + Self::header(layout), layout.align())
+    }
+}
+
+unsafe impl GlobalAlloc for TrackingAllocator {
+    unsafe fn alloc(
+        &self,
+        layout: Layout
+    ) -> *mut u8 {
+        if layout.size() > isize::MAX as usize - Self::header(&layout) {
+            return std::ptr::null_mut();
+        }
+
+        let base = System.alloc(Self::outer(&layout));
+        if base.is_null() {
+            return base;
+        }
+
+        let tag = current_tag();
+        *base = tag;
+        COUNTERS[tag as usize].grow(layout.size());
+        count_thread_alloc();
+        base.add(Self::header(&layout))
+    }
+
+    unsafe fn dealloc(
+        &self,
+        ptr: *mut u8,
+        layout: Layout
+    ) {
+        let base = ptr.sub(Self::header(&layout));
+        COUNTERS[*base as usize].shrink(layout.size());
+        System.dealloc(base, Self::outer(&layout));
+    }
+
+    unsafe fn realloc(
+        &self,
+        ptr: *mut u8,
+        layout: Layout,
+        new_size: usize
+    ) -> *mut u8 {
+        let header = Self::header(&layout);
+        if new_size > isize::MAX as usize - header {
+            return std::ptr::null_mut();
+        }
+
+        let base = System.realloc(ptr.sub(header), Self::outer(&layout), new_size + header);
+        if base.is_null() {
+            return base;
+        }
+
+        // The block stays with the subsystem which first allocated it.
+        let counters = &COUNTERS[*base as usize];
+        counters.shrink(layout.size());
+        counters.grow(new_size);
+        count_thread_alloc();
+        base.add(header)
+    }
+}
+
+impl Drop for TagScope {
+    fn drop(
+        &mut self
+    ) {
+        let _ = CURRENT_TAG.try_with(|t| t.set(self.prev));
+    }
+}
+
+/// Gets the tag of the calling thread.
+fn current_tag() -> u8 {
+    CURRENT_TAG.try_with(|t| t.get()).unwrap_or(Tag::Untagged as u8)
+}
+
+/// Counts an allocation against the calling thread.
+fn count_thread_alloc() {
+    let _ = THREAD_ALLOCS.try_with(|c| c.set(c.get() + 1));
+}
+
+///
+/// Charges allocations on the calling thread to the given tag, until the returned scope is
+/// dropped.
+///
+pub fn scope(
+    tag: Tag
+) -> TagScope {
+    let prev = current_tag();
+    let _ = CURRENT_TAG.try_with(|t| t.set(tag as u8));
+    TagScope { prev }
+}
+
+/// Gets the current heap usage of the given tag.
+pub fn stats(
+    tag: Tag
+) -> TagStats {
+    let c = &COUNTERS[tag as usize];
+    TagStats {
+        allocs: c.allocs.load(Ordering::Relaxed),
+        total_bytes: c.total_bytes.load(Ordering::Relaxed),
+        live_bytes: c.live_bytes.load(Ordering::Relaxed),
+        peak_bytes: c.peak_bytes.load(Ordering::Relaxed)
+    }
+}
+
+///
+/// Calls the given function, returning its result and the number of allocations it made.
+///
+/// Only allocations made on the calling thread are counted. Reallocations count as
+/// allocations, as they may move the block.
+///
+pub fn count_allocs<R>(
+    func: impl FnOnce() -> R
+) -> (R, usize) {
+    let before = THREAD_ALLOCS.with(|c| c.get());
+    let ret = func();
+    let after = THREAD_ALLOCS.with(|c| c.get());
+    (ret, after - before)
+}
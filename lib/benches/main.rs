@@ -0,0 +1,623 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Benchmarks the hot paths of the workspace crates on the host.
+//! @bug No known bugs.
+//!
+//! Each benchmark is run in batches long enough to be timed accurately, and the median time
+//! per iteration across all batches is reported. Results can be saved as a baseline, and later
+//! runs compared against it to catch regressions.
+//!
+//! Building with the baked_config feature compiles the INI given in UNCAPPER_BAKED_INI into the
+//! plugin. Comparing such a build against a baseline saved by the default build shows the cost
+//! of reading the settings at runtime.
+//!
+
+use std::arch::asm;
+use std::collections::HashMap;
+use std::ffi::{c_int, OsString};
+use std::fmt::Write;
+use std::hint::black_box;
+use std::ptr::addr_of;
+use std::str::FromStr;
+use std::time::{Duration, Instant};
+
+use plugin_ini::{Ini, LayeredIni};
+use skse64::log::skse_message;
+use skse64_common::version::CURRENT_RELEASE_RUNTIME;
+use skyrim_patcher::{assemble_table_load, signature, GameMemory, Register};
+use versionlib::{synth, writer, DbLayout, VersionDb};
+use uncapper_core::{hooks, settings};
+use uncapper_core::settings::{cache, SettingsSnapshot};
+use uncapper_core::skyrim::{self, ActorAttribute};
+use uncapper_core::skyrim::standin::{self, GameSettings, Natives};
+use uncapper_core::skyrim::SkillIterator;
+
+/// The INI file shipped with the uncapper.
+const SHIPPED_INI: &str = include_str!("../../SkyrimUncapper/SkyrimUncapper.ini");
+
+/// The time each batch of iterations should take.
+const BATCH_TIME: Duration = Duration::from_millis(10);
+
+/// The number of batches each benchmark is timed over.
+const BATCHES: usize = 21;
+
+/// The number of breakpoints each skill has in the large configuration used by the reload
+/// benchmarks.
+const RELOAD_BREAKPOINTS: u32 = 300;
+
+/// The layer counts the layered INI benchmarks are run with.
+const LAYER_COUNTS: [usize; 3] = [1, 5, 20];
+
+/// The number of fields each override layer in the layered INI benchmarks sets.
+const LAYER_FIELDS: usize = 4;
+
+/// The default regression threshold, in percent.
+const DEFAULT_THRESHOLD: f64 = 10.0;
+
+/// The options given on the command line.
+struct Options {
+    filter: Option<String>,
+    save: Option<OsString>,
+    baseline: Option<OsString>,
+    threshold: f64
+}
+
+/// Runs each benchmark, and collects the results.
+struct Runner {
+    filter: Option<String>,
+    results: Vec<(String, f64)>
+}
+
+/// A copy of game code, which signatures can be checked against.
+struct CodeMemory(Vec<u8>);
+
+//
+// The two ways the skill cap patch can get a cap, each taking the skill in ESI and giving the
+// cap in XMM10, as the game expects.
+//
+// bench_skill_cap_call saves the registers and calls the hook, as the wrapper the patch used
+// to call did. The skill is given in the first argument register of both calling conventions,
+// so that it can be run on any host. bench_skill_cap_load is the bounds checked table load
+// the patcher writes to the stub of the patch, which is checked before it is timed. Its
+// fallback clears the cap, where the stub would run the game's original load.
+//
+// Neither includes the game call which the patch moves, as both paths keep it.
+//
+core::arch::global_asm! {
+    ".global bench_skill_cap_call",
+    ".global bench_skill_cap_load",
+    "bench_skill_cap_call:",
+    "    push %rax",
+    "    push %rcx",
+    "    push %rdx",
+    "    push %r8",
+    "    push %r9",
+    "    push %r10",
+    "    push %r11",
+    "    sub $0x80, %rsp",
+    "    movdqu %xmm0, 0x20(%rsp)",
+    "    movdqu %xmm1, 0x30(%rsp)",
+    "    movdqu %xmm2, 0x40(%rsp)",
+    "    movdqu %xmm3, 0x50(%rsp)",
+    "    movdqu %xmm4, 0x60(%rsp)",
+    "    movdqu %xmm5, 0x70(%rsp)",
+    "    mov %esi, %ecx",
+    "    mov %esi, %edi",
+    "    call {hook}",
+    "    movss %xmm0, %xmm10",
+    "    movdqu 0x30(%rsp), %xmm1",
+    "    movdqu 0x40(%rsp), %xmm2",
+    "    movdqu 0x50(%rsp), %xmm3",
+    "    movdqu 0x60(%rsp), %xmm4",
+    "    movdqu 0x70(%rsp), %xmm5",
+    "    add $0x80, %rsp",
+    "    pop %r11",
+    "    pop %r10",
+    "    pop %r9",
+    "    pop %r8",
+    "    pop %rdx",
+    "    pop %rcx",
+    "    pop %rax",
+    "    ret",
+    "bench_skill_cap_load:",
+    "    lea -{first}(%rsi), %eax",
+    "    cmp ${len}, %eax",
+    "    jae 1f",
+    "    lea skill_cap_table-{first}*4(%rip), %rax",
+    "    movss (%rax,%rsi,4), %xmm10",
+    "    jmp 2f",
+    "1:",
+    "    xorps %xmm10, %xmm10",
+    "2:",
+    "    ret",
+    hook = sym hooks::get_skill_cap_hook,
+    first = const settings::SKILL_CAP_TABLE_FIRST,
+    len = const settings::SKILL_CAP_TABLE_LEN,
+    options(att_syntax)
+}
+
+/// The fallback of bench_skill_cap_load, which is xorps %xmm10, %xmm10.
+const BENCH_SKILL_CAP_FALLBACK: [u8; 4] = [0x45, 0x0f, 0x57, 0xd2];
+
+extern "C" {
+    fn bench_skill_cap_call();
+    fn bench_skill_cap_load();
+}
+
+///
+/// Runs the benchmarks.
+///
+/// Usage: benches [options]
+///
+/// Options:
+/// - --filter=S: Only runs the benchmarks whose name contains S.
+/// - --save=FILE: Saves the results as a baseline.
+/// - --baseline=FILE: Compares the results against a saved baseline, failing if any benchmark
+///   regressed by more than the threshold.
+/// - --threshold=P: The regression threshold, in percent. Defaults to 10.
+///
+fn main() {
+    let opts = parse_args();
+    let mut runner = Runner {
+        filter: opts.filter.clone(),
+        results: Vec::new()
+    };
+
+    bench_lz77(&mut runner);
+    bench_ini(&mut runner);
+    bench_layered_ini(&mut runner);
+    bench_version_db(&mut runner);
+    bench_signature(&mut runner);
+    bench_settings(&mut runner);
+    bench_hooks(&mut runner);
+    bench_log(&mut runner);
+
+    if let Some(save) = opts.save.as_ref() {
+        let mut out = String::new();
+        for (name, ns) in runner.results.iter() {
+            out += &format!("{} {:.1}\n", name, ns);
+        }
+        std::fs::write(save, out).unwrap();
+    }
+
+    if let Some(baseline) = opts.baseline.as_ref() {
+        if !compare(&runner.results, &read_baseline(baseline), opts.threshold) {
+            std::process::exit(1);
+        }
+    }
+}
+
+/// Parses the command line, panicking on any malformed option.
+fn parse_args() -> Options {
+    let mut opts = Options {
+        filter: None,
+        save: None,
+        baseline: None,
+        threshold: DEFAULT_THRESHOLD
+    };
+
+    for arg in std::env::args().skip(1) {
+        let (key, value) = arg.split_once('=').expect("Options must be given as --key=value");
+        match key {
+            "--filter" => opts.filter = Some(value.to_string()),
+            "--save" => opts.save = Some(value.into()),
+            "--baseline" => opts.baseline = Some(value.into()),
+            "--threshold" => opts.threshold = f64::from_str(value).unwrap(),
+            _ => panic!("Unknown option: {}", key)
+        }
+    }
+
+    opts
+}
+
+/// Reads a baseline written by --save.
+fn read_baseline(
+    path: &OsString
+) -> HashMap<String, f64> {
+    let text = std::fs::read_to_string(path).unwrap();
+    text.lines().filter(|l| !l.trim().is_empty()).map(|line| {
+        let (name, ns) = line.rsplit_once(' ').unwrap();
+        (name.to_string(), f64::from_str(ns).unwrap())
+    }).collect()
+}
+
+///
+/// Compares the results against the baseline, printing the change of each benchmark.
+///
+/// Returns false if any benchmark regressed by more than the threshold.
+///
+fn compare(
+    results: &[(String, f64)],
+    baseline: &HashMap<String, f64>,
+    threshold: f64
+) -> bool {
+    let mut ok = true;
+    println!();
+    for (name, ns) in results.iter() {
+        let Some(base) = baseline.get(name) else {
+            println!("{:<40} {:>12} (not in baseline)", name, "");
+            continue;
+        };
+
+        let change = (ns - base) / base * 100.0;
+        let regressed = change > threshold;
+        ok &= !regressed;
+        println!(
+            "{:<40} {:>+11.1}%{}",
+            name,
+            change,
+            if regressed { " REGRESSION" } else { "" }
+        );
+    }
+
+    if !ok {
+        println!("\nRegressions above {}% were found.", threshold);
+    }
+
+    ok
+}
+
+impl Runner {
+    /// Checks if the benchmark with the given name is filtered out.
+    fn is_filtered(
+        &self,
+        name: &str
+    ) -> bool {
+        self.filter.as_ref().map(|f| !name.contains(f.as_str())).unwrap_or(false)
+    }
+
+    /// Times the given function, unless it is filtered out.
+    fn bench<R>(
+        &mut self,
+        name: &str,
+        mut func: impl FnMut() -> R
+    ) {
+        if self.is_filtered(name) {
+            return;
+        }
+
+        let mut batch = |iters: usize| {
+            let start = Instant::now();
+            for _ in 0..iters {
+                black_box(func());
+            }
+            start.elapsed()
+        };
+
+        // Find a batch size which takes long enough to time, warming up along the way.
+        let mut iters = 1;
+        while batch(iters) < BATCH_TIME {
+            iters *= 2;
+        }
+
+        let mut times = (0..BATCHES).map(|_| {
+            batch(iters).as_nanos() as f64 / iters as f64
+        }).collect::<Vec<_>>();
+        times.sort_by(|a, b| a.partial_cmp(b).unwrap());
+        let median = times[BATCHES / 2];
+
+        println!("{:<40} {:>12.1} ns/iter", name, median);
+        self.results.push((name.to_string(), median));
+    }
+
+    ///
+    /// Prints a measurement which isn't a time, unless it is filtered out.
+    ///
+    /// Such measurements are exact, so they are not saved in or compared against a baseline.
+    ///
+    fn report(
+        &self,
+        name: &str,
+        value: usize,
+        unit: &str
+    ) {
+        if !self.is_filtered(name) {
+            println!("{:<40} {:>12} {}", name, value, unit);
+        }
+    }
+}
+
+impl GameMemory for CodeMemory {
+    fn base(
+        &self
+    ) -> usize {
+        0
+    }
+
+    fn read(
+        &self,
+        offset: usize,
+        len: usize
+    ) -> Result<Vec<u8>, ()> {
+        let end = offset.checked_add(len).ok_or(())?;
+        self.0.get(offset..end).map(|b| b.to_vec()).ok_or(())
+    }
+
+    fn write(
+        &mut self,
+        offset: usize,
+        bytes: &[u8]
+    ) -> Result<(), ()> {
+        let end = offset.checked_add(bytes.len()).ok_or(())?;
+        self.0.get_mut(offset..end).ok_or(())?.copy_from_slice(bytes);
+        Ok(())
+    }
+}
+
+/// Benchmarks compressing and decompressing the shipped INI.
+fn bench_lz77(
+    runner: &mut Runner
+) {
+    let compressed = lz77::compress(SHIPPED_INI.as_bytes());
+    runner.bench("lz77/compress_ini", || lz77::compress(black_box(SHIPPED_INI.as_bytes())));
+    runner.bench("lz77/decompress_ini", || lz77::decompress(black_box(&compressed)));
+}
+
+///
+/// Benchmarks parsing and reading INI files.
+///
+/// The update benchmark parses a user INI which is missing the back half of its sections,
+/// then fills them in from the shipped INI, as happens when a new version adds settings.
+/// The read benchmarks compare looking a field up by name against reading it by handle.
+///
+fn bench_ini(
+    runner: &mut Runner
+) {
+    let default = Ini::from_str(SHIPPED_INI).unwrap();
+    let half = SHIPPED_INI.len() / 2;
+    let user = &SHIPPED_INI[..half + SHIPPED_INI[half..].find("\n[").unwrap()];
+
+    runner.bench("plugin_ini/from_str", || Ini::from_str(black_box(SHIPPED_INI)).unwrap());
+    runner.bench("plugin_ini/from_str_update", || {
+        let mut ini = Ini::from_str(black_box(user)).unwrap();
+        ini.update(&default);
+        ini
+    });
+
+    let handle = default.resolve("SkillExpGainMults", "fSmithing").unwrap();
+    runner.bench("plugin_ini/get", || {
+        default.get::<f32>(black_box("SkillExpGainMults"), black_box("fSmithing"))
+    });
+    runner.bench("plugin_ini/get_by_handle", || default.get_by_handle::<f32>(black_box(handle)));
+}
+
+///
+/// Benchmarks reading a stack of INI layers in place against merging it into one INI first.
+///
+/// The bottom layer is the shipped INI, and each layer above it overrides a few fields of one
+/// section, as a mod adjusting the uncapper would. The field read is only in the bottom layer,
+/// so a layered read has to search every layer. Iteration walks every field of every section.
+///
+fn bench_layered_ini(
+    runner: &mut Runner
+) {
+    for count in LAYER_COUNTS {
+        let mut stack = LayeredIni::new();
+        stack.push(Ini::from_str(SHIPPED_INI).unwrap());
+        let sections = stack.sections().map(|s| {
+            (s.name().to_string(), s.fields().map(|f| f.name().to_string()).collect::<Vec<_>>())
+        }).filter(|(_, f)| f.len() >= LAYER_FIELDS).collect::<Vec<_>>();
+
+        for layer in 1..count {
+            let (section, fields) = &sections[(layer * 7) % sections.len()];
+            let mut ini = format!("; Override layer {}\n[{}]\n", layer, section);
+            for field in fields[..LAYER_FIELDS].iter() {
+                writeln!(ini, "{} = {}", field, layer).unwrap();
+            }
+            stack.push(Ini::from_str(&ini).unwrap());
+        }
+
+        let merged = stack.flatten();
+        runner.bench(&format!("plugin_ini/flatten_{}", count), || black_box(&stack).flatten());
+        runner.bench(&format!("plugin_ini/layered_get_{}", count), || {
+            stack.get::<f32>(black_box("SkillExpGainMults"), black_box("fSmithing"))
+        });
+        runner.bench(&format!("plugin_ini/merged_get_{}", count), || {
+            merged.get::<f32>(black_box("SkillExpGainMults"), black_box("fSmithing"))
+        });
+        runner.bench(&format!("plugin_ini/layered_iter_{}", count), || {
+            black_box(&stack).sections().flat_map(|s| s.fields()).map(|f| {
+                f.name().len() + f.raw_value().map(|v| v.len()).unwrap_or(0)
+            }).sum::<usize>()
+        });
+        runner.bench(&format!("plugin_ini/merged_iter_{}", count), || {
+            black_box(&merged).sections().flat_map(|s| s.fields()).map(|f| {
+                f.name().len() + f.raw_value().map(|v| v.len()).unwrap_or(0)
+            }).sum::<usize>()
+        });
+    }
+}
+
+///
+/// Benchmarks loading synthetic databases, shaped like an AE address library, in each layout,
+/// and looking ids up in them. The heap size of each layout is reported alongside.
+///
+fn bench_version_db(
+    runner: &mut Runner
+) {
+    const LOOKUPS: usize = 4096;
+
+    let pairs = synth::generate(&synth::SynthConfig::default());
+    let data = writer::encode_db(&pairs, CURRENT_RELEASE_RUNTIME, 2, writer::DEFAULT_PTR_SIZE);
+
+    // Lookups are spread over the whole database, so that they aren't all served from cache.
+    let step = pairs.len() / LOOKUPS;
+    let ids = (0..LOOKUPS).map(|i| pairs[(i * step * 7919) % pairs.len()].0).collect::<Vec<_>>();
+
+    for (name, layout) in [
+        ("hashed", DbLayout::Hashed),
+        ("sorted", DbLayout::Sorted),
+        ("compact", DbLayout::Compact)
+    ] {
+        runner.bench(&format!("versionlib/load_{}", name), || {
+            VersionDb::new_from_bytes(black_box(&data), CURRENT_RELEASE_RUNTIME, 2, layout)
+        });
+
+        let db = VersionDb::new_from_bytes(&data, CURRENT_RELEASE_RUNTIME, 2, layout);
+        runner.report(&format!("versionlib/heap_{}", name), db.heap_size(), "bytes");
+
+        let mut next = 0;
+        runner.bench(&format!("versionlib/find_addr_{}", name), || {
+            next = (next + 1) % LOOKUPS;
+            db.find_addr_by_id(black_box(ids[next]))
+        });
+    }
+}
+
+/// Benchmarks checking a signature against code which does and doesn't match it.
+fn bench_signature(
+    runner: &mut Runner
+) {
+    const OFFSET: usize = 0x800;
+    let sig = signature![
+        0x48, 0x89, 0x5c, 0x24, ?, 0x57, 0x48, 0x83, 0xec, 0x20, 0x8b, 0xda, 0x48, 0x8b, ?, ?; 16
+    ];
+    let code = [
+        0x48, 0x89, 0x5c, 0x24, 0x08, 0x57, 0x48, 0x83, 0xec, 0x20, 0x8b, 0xda, 0x48, 0x8b, 0xf9, 0xe8
+    ];
+
+    let mut mem = CodeMemory(vec![0xcc; 0x1000]);
+    mem.write(OFFSET, &code).unwrap();
+    assert!(sig.matches(&mem, OFFSET));
+
+    runner.bench("skyrim_patcher/sig_check_match", || sig.matches(&mem, black_box(OFFSET)));
+    runner.bench("skyrim_patcher/sig_check_mismatch", || sig.matches(&mem, black_box(0)));
+}
+
+///
+/// Benchmarks the leveled settings lookups made by the hooks, rebuilding the settings after a
+/// change to the INI, and loading them from the settings cache.
+///
+/// The settings are loaded from a copy of the shipped INI, as they would be in game. The
+/// rebuild benchmarks compare reading a large configuration from scratch against rebuilding
+/// only what depends on the one section that changed. The load benchmarks compare parsing and
+/// reading the shipped INI against loading the same settings from a cache.
+///
+fn bench_settings(
+    runner: &mut Runner
+) {
+    let path = std::env::temp_dir().join(format!("benches-{}.ini", std::process::id()));
+    std::fs::write(&path, SHIPPED_INI).unwrap();
+    settings::init_uncached(&path);
+    std::fs::remove_file(&path).unwrap();
+
+    runner.bench("settings/get_nearest", || {
+        settings::get_skill_exp_mult(ActorAttribute::Smithing, black_box(57), black_box(33))
+    });
+    runner.bench("settings/get_cumulative_delta", || {
+        settings::get_perk_delta(black_box(81))
+    });
+    runner.bench("settings/get_attribute_level_up", || {
+        settings::get_attribute_level_up(black_box(42), ActorAttribute::Health)
+    });
+
+    // Give every skill a long list of leveled skill exp mults, then change one of them.
+    let large_ini = |smithing_mult: f32| {
+        let mut s = SHIPPED_INI.to_string();
+        for skill in SkillIterator::new() {
+            writeln!(s, "[SkillExpGainMults\\BaseSkillLevel\\{}]", skill.name()).unwrap();
+            for level in 1..=RELOAD_BREAKPOINTS {
+                let is_changed = (skill == ActorAttribute::Smithing) && (level == 50);
+                let mult = if is_changed { smithing_mult } else { 1.0 + level as f32 / 100.0 };
+                writeln!(s, "{} = {}", level, mult).unwrap();
+            }
+        }
+        Ini::from_str(&s).unwrap()
+    };
+
+    let (before, after) = (large_ini(1.0), large_ini(2.0));
+    let snapshot = SettingsSnapshot::new(&before);
+    assert!(snapshot.rebuild(&after).1 == 1);
+    runner.bench("settings/rebuild_all", || SettingsSnapshot::new(black_box(&after)));
+    runner.bench("settings/rebuild_changed", || snapshot.rebuild(black_box(&after)));
+
+    // Compare a launch which reads the INI against one which finds it in the cache.
+    let key = cache::key(SHIPPED_INI.as_bytes());
+    let blob = SettingsSnapshot::new(&Ini::from_str(SHIPPED_INI).unwrap()).to_cache(key);
+    runner.bench("settings/load_ini", || {
+        SettingsSnapshot::new(&Ini::from_str(black_box(SHIPPED_INI)).unwrap())
+    });
+    runner.bench("settings/load_cached", || {
+        let key = cache::key(black_box(SHIPPED_INI.as_bytes()));
+        SettingsSnapshot::from_cache(black_box(&blob), key).unwrap()
+    });
+}
+
+///
+/// Benchmarks the hooks which run the most often in game.
+///
+/// The hooks are pointed at the stand-in player, whose natives only read and write its values,
+/// so only the work done by the plugin is timed. The settings must already have been loaded.
+///
+fn bench_hooks(
+    runner: &mut Runner
+) {
+    standin::install(CURRENT_RELEASE_RUNTIME, GameSettings::VANILLA, Natives::STAND_IN);
+    standin::set_level(33);
+    standin::set_all_base(57.0);
+
+    let smithing = ActorAttribute::Smithing as c_int;
+    runner.bench("hooks/improve_player_skill_points", || {
+        hooks::improve_player_skill_points_hook(black_box(smithing), black_box(10.0), 5.0)
+    });
+    runner.bench("hooks/improve_level_exp_by_skill_level", || {
+        hooks::improve_level_exp_by_skill_level_hook(black_box(3.0), black_box(smithing))
+    });
+    runner.bench("hooks/player_avo_get_current", || {
+        hooks::player_avo_get_current_hook(skyrim::get_player_avo(), black_box(smithing))
+    });
+    runner.bench("hooks/improve_attribute_when_level_up", || {
+        hooks::improve_attribute_when_level_up_hook(black_box(ActorAttribute::Health as c_int))
+    });
+
+    // Compare calling the skill cap hook against the table load which replaces it.
+    let table = addr_of!(settings::skill_cap_table).cast::<f32>();
+    let load_addr = bench_skill_cap_load as usize;
+    let load = assemble_table_load(
+        load_addr, table, settings::SKILL_CAP_TABLE_FIRST, settings::SKILL_CAP_TABLE_LEN,
+        Register::Rsi, 10, Register::Rax, &BENCH_SKILL_CAP_FALLBACK
+    ).unwrap();
+    assert!(unsafe { std::slice::from_raw_parts(load_addr as *const u8, load.len()) } == load);
+
+    let skill_cap = |func: unsafe extern "C" fn(), skill: c_int| -> f32 {
+        let cap: f32;
+        unsafe {
+            // SAFETY: Both functions only read the skill, and only write the registers which
+            //         the calling convention allows.
+            asm!(
+                "call {func}",
+                func = in(reg) func,
+                in("rsi") skill as u64,
+                out("xmm10") cap,
+                clobber_abi("sysv64")
+            );
+        }
+        cap
+    };
+    for skill in SkillIterator::new() {
+        assert!(skill_cap(bench_skill_cap_call, skill as c_int)
+            == skill_cap(bench_skill_cap_load, skill as c_int));
+    }
+    let end = settings::SKILL_CAP_TABLE_FIRST + settings::SKILL_CAP_TABLE_LEN;
+    for attr in (0..settings::SKILL_CAP_TABLE_FIRST).chain([end]) {
+        assert!(skill_cap(bench_skill_cap_load, attr as c_int) == 0.0);
+    }
+    assert!(skill_cap(bench_skill_cap_load, -1) == 0.0);
+
+    runner.bench("hooks/get_skill_cap_call", || {
+        skill_cap(bench_skill_cap_call, black_box(smithing))
+    });
+    runner.bench("hooks/get_skill_cap_table_load", || {
+        skill_cap(bench_skill_cap_load, black_box(smithing))
+    });
+}
+
+/// Benchmarks dropping a message from a call site which has reached its limit.
+fn bench_log(
+    runner: &mut Runner
+) {
+    runner.bench("skse64/log_suppressed", || {
+        skse_message!("[WARNING] Benchmark message {}", black_box(1) => limit 0);
+    });
+}
@@ -0,0 +1,304 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Stands in for a plugin which extends the hooks of the uncapper.
+//! @bug No known bugs.
+//!
+//! The stand-in registers a pre and post callback for every event through a LocalBroker, just
+//! as a plugin in the game would through SKSE, and the callbacks are then frozen as they are
+//! once every plugin has loaded. Each hook is then called with the callbacks switched off and
+//! on, and the results are compared against what the callbacks should have changed. The hooks
+//! are driven against a stand-in game, in the same way as the simulator.
+//!
+//! Any difference is reported, and makes the process exit with an error.
+//!
+
+use std::ffi::c_int;
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::Mutex;
+
+use racy_cell::RacyCell;
+use skse64::version::CURRENT_RELEASE_RUNTIME;
+use uncapper_core::extension;
+use uncapper_core::hooks;
+use uncapper_core::settings;
+use uncapper_core::skyrim::{self, ActorAttribute};
+use uncapper_core::skyrim::standin::{self, GameSettings, Natives, VALUE_COUNT};
+use uncapper_ext::*;
+
+/// The level of the stand-in player.
+const PLAYER_LEVEL: u32 = 30;
+
+/// The level of every skill of the stand-in player.
+const SKILL_LEVEL: f32 = 50.0;
+
+/// Switches the callbacks of the stand-in plugin on, as they can't be removed once frozen.
+static ACTIVE: AtomicBool = AtomicBool::new(false);
+
+/// The callbacks which ran while active, in the order they ran.
+static CALLS: Mutex<Vec<&'static str>> = Mutex::new(Vec::new());
+
+/// Counts the checks which failed.
+static FAILURES: RacyCell<usize> = RacyCell::new(0);
+
+///
+/// Registers the callbacks of the stand-in plugin, then checks the changes they make to each
+/// hook.
+///
+/// Usage: ext-standin <ini>
+///
+/// Hooks which are disabled by the INI are skipped.
+///
+fn main() {
+    let path = std::env::args_os().nth(1).expect("Usage: ext-standin <ini>");
+    install();
+    settings::init_uncached(Path::new(&path));
+
+    // A plugin which loads without the uncapper gets no answer.
+    let broker = LocalBroker::<ExtensionRequest>::new();
+    let mut request = ExtensionRequest::new(callbacks());
+    broker.send(&mut request);
+    check("unanswered without the uncapper", request.status == ExtensionRequest::UNANSWERED);
+
+    // Then the uncapper loads, and the stand-in plugin registers during SKSE_POST_LOAD.
+    broker.listen(extension::register);
+    let mut request = ExtensionRequest::new(callbacks());
+    request.abi = EXTENSION_ABI + 1;
+    broker.send(&mut request);
+    check("unanswered with another ABI", request.status == ExtensionRequest::UNANSWERED);
+
+    let mut request = ExtensionRequest::new(callbacks());
+    broker.send(&mut request);
+    check("registered while loading", request.is_registered());
+
+    // Once every plugin has loaded, the callbacks are frozen.
+    extension::freeze();
+    let mut request = ExtensionRequest::new(callbacks());
+    broker.send(&mut request);
+    check("refused once frozen", request.status == ExtensionRequest::TOO_LATE);
+
+    check_skill_exp();
+    check_level_exp();
+    check_perk_delta();
+    check_attribute_gain();
+
+    let failures = unsafe { *FAILURES.get() };
+    if failures > 0 {
+        eprintln!("{} check(s) failed", failures);
+        std::process::exit(1);
+    }
+    eprintln!("All checks passed");
+}
+
+/// Gets the callbacks of the stand-in plugin.
+fn callbacks() -> ExtensionCallbacks {
+    ExtensionCallbacks {
+        skill_exp: EventCallbacks { pre: Some(skill_exp_pre), post: Some(skill_exp_post) },
+        level_exp: EventCallbacks { pre: Some(level_exp_pre), post: Some(level_exp_post) },
+        perk_delta: EventCallbacks { pre: Some(perk_delta_pre), post: Some(perk_delta_post) },
+        attribute_gain: EventCallbacks {
+            pre: Some(attribute_gain_pre),
+            post: Some(attribute_gain_post)
+        }
+    }
+}
+
+/// Doubles the base experience the game gives for a skill use.
+unsafe extern "C" fn skill_exp_pre(
+    event: *mut SkillExpEvent
+) {
+    if called("skill_exp/pre") {
+        (*event).base *= 2.0;
+    }
+}
+
+/// Adds a flat bonus to the experience of a skill use.
+unsafe extern "C" fn skill_exp_post(
+    event: *mut SkillExpEvent
+) {
+    if called("skill_exp/post") {
+        (*event).exp += 1.0;
+    }
+}
+
+/// Gives level experience as if every skill was smithing.
+unsafe extern "C" fn level_exp_pre(
+    event: *mut LevelExpEvent
+) {
+    if called("level_exp/pre") {
+        (*event).skill = ActorAttribute::Smithing as c_int;
+    }
+}
+
+/// Halves the level experience of a skill level up.
+unsafe extern "C" fn level_exp_post(
+    event: *mut LevelExpEvent
+) {
+    if called("level_exp/post") {
+        (*event).exp *= 0.5;
+    }
+}
+
+/// Leaves the perk pool request alone, only recording the call.
+unsafe extern "C" fn perk_delta_pre(
+    _event: *mut PerkDeltaEvent
+) {
+    called("perk_delta/pre");
+}
+
+/// Gives an extra perk at each level up.
+unsafe extern "C" fn perk_delta_post(
+    event: *mut PerkDeltaEvent
+) {
+    if called("perk_delta/post") && ((*event).count > 0) {
+        (*event).delta += 1;
+    }
+}
+
+/// Makes every level up choose health.
+unsafe extern "C" fn attribute_gain_pre(
+    event: *mut AttributeGainEvent
+) {
+    if called("attribute_gain/pre") {
+        (*event).choice = ActorAttribute::Health as c_int;
+    }
+}
+
+/// Adds some carry weight to each level up.
+unsafe extern "C" fn attribute_gain_post(
+    event: *mut AttributeGainEvent
+) {
+    if called("attribute_gain/post") {
+        (*event).carry_weight += 5.0;
+    }
+}
+
+/// Records a call to a callback, returning true if the callbacks are active.
+fn called(
+    name: &'static str
+) -> bool {
+    let active = ACTIVE.load(Ordering::Relaxed);
+    if active {
+        CALLS.lock().unwrap().push(name);
+    }
+    active
+}
+
+/// Runs the given hook call with the callbacks switched on or off.
+fn with_callbacks<T>(
+    active: bool,
+    call: impl FnOnce() -> T
+) -> T {
+    CALLS.lock().unwrap().clear();
+    ACTIVE.store(active, Ordering::Relaxed);
+    let res = call();
+    ACTIVE.store(false, Ordering::Relaxed);
+    res
+}
+
+/// Checks the given event ran its pre callback, then its post callback.
+fn check_calls(
+    event: &str
+) {
+    let calls = CALLS.lock().unwrap().clone();
+    let expected = [format!("{}/pre", event), format!("{}/post", event)];
+    check(&format!("{} callbacks ran in order", event), calls == expected);
+}
+
+/// Checks the callbacks of the skill experience hook.
+fn check_skill_exp() {
+    if !settings::is_skill_exp_enabled() {
+        eprintln!("[SKIPPED] skill_exp, as its hook is disabled");
+        return;
+    }
+
+    let skill = ActorAttribute::Alchemy as c_int;
+    let plain = hooks::improve_player_skill_points_hook(skill, 20.0, 3.0) + 1.0;
+    let extended = with_callbacks(true, || {
+        hooks::improve_player_skill_points_hook(skill, 10.0, 3.0)
+    });
+    check_calls("skill_exp");
+    check("skill_exp doubled the base and added the bonus", plain == extended);
+}
+
+/// Checks the callbacks of the level experience hook.
+fn check_level_exp() {
+    if !settings::is_level_exp_enabled() {
+        eprintln!("[SKIPPED] level_exp, as its hook is disabled");
+        return;
+    }
+
+    let plain = hooks::improve_level_exp_by_skill_level_hook(
+        8.0,
+        ActorAttribute::Smithing as c_int
+    ) * 0.5;
+    let extended = with_callbacks(true, || {
+        hooks::improve_level_exp_by_skill_level_hook(8.0, ActorAttribute::Destruction as c_int)
+    });
+    check_calls("level_exp");
+    check("level_exp used smithing and halved the result", plain == extended);
+}
+
+/// Checks the callbacks of the perk pool hook.
+fn check_perk_delta() {
+    if !settings::is_perk_points_enabled() {
+        eprintln!("[SKIPPED] perk_delta, as its hook is disabled");
+        return;
+    }
+
+    let pool = skyrim::get_player_perk_pool();
+    pool.set(0);
+    hooks::modify_perk_pool_hook(1);
+    let plain = pool.get();
+
+    pool.set(0);
+    with_callbacks(true, || hooks::modify_perk_pool_hook(1));
+    check_calls("perk_delta");
+    check("perk_delta gave an extra perk", pool.get() == plain.saturating_add(1));
+
+    pool.set(3);
+    with_callbacks(true, || hooks::modify_perk_pool_hook(-1));
+    check("perk_delta left spent perks alone", pool.get() == 2);
+}
+
+/// Checks the callbacks of the attribute level up hook.
+fn check_attribute_gain() {
+    if !settings::is_attr_points_enabled() {
+        eprintln!("[SKIPPED] attribute_gain, as its hook is disabled");
+        return;
+    }
+
+    let gain = |active: bool, choice: ActorAttribute| -> [f32; VALUE_COUNT] {
+        let before = standin::values();
+        with_callbacks(active, || hooks::improve_attribute_when_level_up_hook(choice as c_int));
+        let after = standin::values();
+        std::array::from_fn(|i| after[i] - before[i])
+    };
+
+    let mut plain = gain(false, ActorAttribute::Health);
+    plain[ActorAttribute::CarryWeight as usize] += 5.0;
+    let extended = gain(true, ActorAttribute::Magicka);
+    check_calls("attribute_gain");
+    check("attribute_gain chose health and added carry weight", plain == extended);
+}
+
+/// Reports the result of a check.
+fn check(
+    name: &str,
+    passed: bool
+) {
+    if passed {
+        eprintln!("[PASSED] {}", name);
+    } else {
+        eprintln!("[FAILED] {}", name);
+        unsafe { *FAILURES.get() += 1; }
+    }
+}
+
+/// Points the plugin at the stand-in game, emulating the current release runtime.
+fn install() {
+    standin::install(CURRENT_RELEASE_RUNTIME, GameSettings::VANILLA, Natives::STAND_IN);
+    standin::set_level(PLAYER_LEVEL);
+    standin::set_all_base(SKILL_LEVEL);
+}
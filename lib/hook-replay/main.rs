@@ -0,0 +1,440 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Replays a captured trace of hook calls through the hooks of this build.
+//! @bug No known bugs.
+//!
+//! Each record in the trace is fed back through the matching hook, with the natives it calls
+//! stubbed to return the values they returned when the trace was captured. The result and
+//! changes of each call are then compared against the ones in the trace, so that any change
+//! to the hooks or settings which alters their behavior is reported.
+//!
+//! The replay is also timed, both per call and as a whole, to give the throughput and latency
+//! of each hook on a realistic workload.
+//!
+
+use std::ffi::{c_int, OsString};
+use std::path::Path;
+use std::str::FromStr;
+use std::time::{Duration, Instant};
+
+use racy_cell::RacyCell;
+use uncapper_core::hooks;
+use uncapper_core::settings;
+use uncapper_core::skyrim::{self, ActorAttribute, ActorValueOwner, PlayerCharacter};
+use uncapper_core::skyrim::standin::{self, GameSettings, Natives};
+use uncapper_core::trace::{self, TraceEffect, TraceHeader, TraceHook, TraceRecord, TraceValue};
+
+/// The options given on the command line.
+struct Options {
+    ini: OsString,
+    trace: OsString,
+    iterations: usize,
+    diffs: usize,
+    save: Option<OsString>
+}
+
+/// The natives and changes of the record being replayed.
+struct ReplayState {
+    natives: Vec<u32>,
+    next_native: usize,
+    effects: Vec<(u32, u32)>
+}
+
+/// The replay statistics of a single hook.
+#[derive(Default)]
+struct HookStats {
+    calls: usize,
+    skipped: usize,
+    mismatches: usize,
+    latencies: Vec<u32>
+}
+
+/// The state the stubbed natives are answered from.
+static STATE: RacyCell<ReplayState> = RacyCell::new(ReplayState {
+    natives: Vec::new(),
+    next_native: 0,
+    effects: Vec::new()
+});
+
+///
+/// Replays a trace through the hooks, reporting any differences and the time each hook took.
+///
+/// Usage: hook-replay [options] <ini> <trace>
+///
+/// The INI should match the one the trace was captured with, or any change it makes will be
+/// reported as a difference. Calls to hooks which are disabled by the INI are skipped.
+///
+/// Options:
+/// - --iterations=N: The number of timed passes over the trace. Defaults to 5.
+/// - --diffs=N: The number of differences to print. Defaults to 10.
+/// - --save=PATH: Writes a copy of the trace with the results of this build, so that a later
+///   build can be compared against this one.
+///
+fn main() {
+    let opts = parse_args();
+
+    let bytes = std::fs::read(Path::new(&opts.trace)).expect("Could not read trace file");
+    let (header, records) = trace::parse(&bytes).expect("Not a trace file");
+    install(&header);
+    settings::init_uncached(Path::new(&opts.ini));
+
+    // The first pass checks the results of this build against the trace.
+    let mut stats = (0..TraceHook::COUNT).map(|_| HookStats::default()).collect::<Vec<_>>();
+    let mut enabled = Vec::with_capacity(records.len());
+    let mut replayed = Vec::with_capacity(records.len());
+    let mut diffs = 0;
+    for (i, record) in records.iter().enumerate() {
+        let stat = &mut stats[record.hook as usize];
+        if !is_enabled(record.hook) {
+            stat.skipped += 1;
+            continue;
+        }
+
+        let out = replay(record);
+        stat.calls += 1;
+        if out != *record {
+            stat.mismatches += 1;
+            if diffs < opts.diffs {
+                print_diff(i, record, &out);
+                diffs += 1;
+            }
+        }
+        enabled.push(record);
+        replayed.push(out);
+    }
+
+    // Then each call is timed on its own, for the latency and throughput of each hook.
+    let overhead = timer_overhead();
+    for _ in 0..opts.iterations {
+        begin_pass();
+        for record in enabled.iter() {
+            let start = Instant::now();
+            std::hint::black_box(call(std::hint::black_box(record)));
+            let elapsed = start.elapsed().saturating_sub(overhead);
+            stats[record.hook as usize].latencies.push(elapsed.as_nanos() as u32);
+        }
+    }
+
+    // And the whole trace is timed without the clock in the way, for the total throughput.
+    let start = Instant::now();
+    for _ in 0..opts.iterations {
+        begin_pass();
+        for record in enabled.iter() {
+            std::hint::black_box(call(std::hint::black_box(record)));
+        }
+    }
+    let whole = start.elapsed();
+
+    print_report(&mut stats);
+    eprintln!(
+        "Replayed {} of {} calls x{} in {:.3}s ({:.2}M calls/s)",
+        replayed.len(),
+        records.len(),
+        opts.iterations,
+        whole.as_secs_f64(),
+        (replayed.len() * opts.iterations) as f64 / whole.as_secs_f64().max(1e-9) / 1e6
+    );
+
+    if let Some(ref path) = opts.save {
+        let mut buf = Vec::new();
+        header.encode(&mut buf);
+        for record in replayed.iter() {
+            record.encode(&mut buf);
+        }
+        std::fs::write(Path::new(path), buf).expect("Could not write trace file");
+    }
+
+    let mismatches = stats.iter().map(|s| s.mismatches).sum::<usize>();
+    if mismatches > 0 {
+        eprintln!("{} calls did not match the trace", mismatches);
+        std::process::exit(1);
+    }
+}
+
+/// Parses the command line, panicking on any malformed option.
+fn parse_args() -> Options {
+    let mut opts = Options {
+        ini: OsString::new(),
+        trace: OsString::new(),
+        iterations: 5,
+        diffs: 10,
+        save: None
+    };
+
+    let mut positional = Vec::new();
+    for arg in std::env::args_os().skip(1) {
+        let Some((key, value)) = arg.to_str().and_then(|s| s.split_once('=')) else {
+            positional.push(arg);
+            continue;
+        };
+
+        match key {
+            "--iterations" => opts.iterations = usize::from_str(value).unwrap().max(1),
+            "--diffs" => opts.diffs = usize::from_str(value).unwrap(),
+            "--save" => opts.save = Some(OsString::from(value)),
+            _ => panic!("Unknown option: {}", key)
+        }
+    }
+
+    assert!(positional.len() == 2, "Usage: hook-replay [options] <ini> <trace>");
+    opts.trace = positional.pop().unwrap();
+    opts.ini = positional.pop().unwrap();
+    opts
+}
+
+/// Points the plugin at the stubbed natives, and the game settings held by the trace.
+fn install(
+    header: &TraceHeader
+) {
+    standin::install(header.runtime, GameSettings::from_array(header.settings), Natives {
+        get_level,
+        avo_get_base,
+        avo_get_current,
+        avo_mod_base,
+        avo_mod_current
+    });
+}
+
+///
+/// Resets the state the hooks keep between calls, before another pass over the trace.
+///
+/// A trace may end between the calls which begin and end a weapon charge calculation, which
+/// would otherwise leave the charge cap in use at the start of the next pass.
+///
+fn begin_pass() {
+    settings::use_enchant_magnitude_cap();
+}
+
+/// Checks if the patches which call the given hook are enabled.
+fn is_enabled(
+    hook: TraceHook
+) -> bool {
+    match hook {
+        TraceHook::GetSkillCap => settings::is_skill_cap_enabled(),
+        TraceHook::MaxChargeBegin
+            | TraceHook::MaxChargeEnd
+            | TraceHook::CalculateChargePointsPerUse => settings::is_enchant_patch_enabled(),
+        TraceHook::PlayerAvoGetCurrent => settings::is_skill_formula_cap_enabled(),
+        TraceHook::ImprovePlayerSkillPoints => settings::is_skill_exp_enabled(),
+        TraceHook::ModifyPerkPool => settings::is_perk_points_enabled(),
+        TraceHook::ImproveLevelExpBySkillLevel => settings::is_level_exp_enabled(),
+        TraceHook::ImproveAttributeWhenLevelUp => settings::is_attr_points_enabled(),
+        TraceHook::LegendaryResetSkillLevel
+            | TraceHook::CheckConditionForLegendarySkill
+            | TraceHook::HideLegendaryButton
+            | TraceHook::ClearLegendaryButton => settings::is_legendary_enabled()
+    }
+}
+
+///
+/// Replays the given record, returning a record of what this build did.
+///
+/// The returned record holds the natives this build consumed, and the changes and result it
+/// produced.
+///
+fn replay(
+    record: &TraceRecord
+) -> TraceRecord {
+    let result = call(record);
+    let state = unsafe {
+        // SAFETY: The replay is single threaded.
+        &*STATE.get()
+    };
+
+    TraceRecord {
+        hook: record.hook,
+        args: record.args.clone(),
+        natives: state.natives[..state.next_native.min(state.natives.len())].to_vec(),
+        effects: state.effects.clone(),
+        result
+    }
+}
+
+/// Calls the hook of the given record with its arguments and natives, returning its result.
+fn call(
+    record: &TraceRecord
+) -> u32 {
+    let state = unsafe {
+        // SAFETY: The replay is single threaded, and the natives only run during the hook.
+        &mut *STATE.get()
+    };
+    state.natives.clear();
+    state.natives.extend_from_slice(&record.natives);
+    state.next_native = 0;
+    state.effects.clear();
+
+    let arg = |i: usize| record.args[i];
+    let float = |i: usize| f32::from_bits(record.args[i]);
+    match record.hook {
+        TraceHook::GetSkillCap => hooks::get_skill_cap_hook(arg(0) as c_int).to_word(),
+        TraceHook::MaxChargeBegin => hooks::max_charge_begin_hook(arg(0)).to_word(),
+        TraceHook::MaxChargeEnd => hooks::max_charge_end_hook().to_word(),
+        TraceHook::CalculateChargePointsPerUse => {
+            hooks::calculate_charge_points_per_use_hook(float(0), float(1)).to_word()
+        },
+        TraceHook::PlayerAvoGetCurrent => {
+            hooks::player_avo_get_current_hook(skyrim::get_player_avo(), arg(0) as c_int)
+                .to_word()
+        },
+        TraceHook::ImprovePlayerSkillPoints => {
+            hooks::improve_player_skill_points_hook(arg(0) as c_int, float(1), float(2))
+                .to_word()
+        },
+        TraceHook::ModifyPerkPool => {
+            let pool = skyrim::get_player_perk_pool();
+            pool.set(arg(1) as u8);
+            hooks::modify_perk_pool_hook(arg(0) as i8);
+            let kind = (TraceEffect::PerkPool as u32) << 16;
+            state.effects.push((kind, pool.get().to_word()));
+            0
+        },
+        TraceHook::ImproveLevelExpBySkillLevel => {
+            hooks::improve_level_exp_by_skill_level_hook(float(0), arg(1) as c_int).to_word()
+        },
+        TraceHook::ImproveAttributeWhenLevelUp => {
+            hooks::improve_attribute_when_level_up_hook(arg(0) as c_int).to_word()
+        },
+        TraceHook::LegendaryResetSkillLevel => {
+            hooks::legendary_reset_skill_level_hook(float(0)).to_word()
+        },
+        TraceHook::CheckConditionForLegendarySkill => {
+            hooks::check_condition_for_legendary_skill_hook(arg(0) as c_int).to_word()
+        },
+        TraceHook::HideLegendaryButton => {
+            hooks::hide_legendary_button_hook(arg(0) as c_int).to_word()
+        },
+        TraceHook::ClearLegendaryButton => {
+            hooks::clear_legendary_button_hook(arg(0) as c_int).to_word()
+        }
+    }
+}
+
+/// Gets the next recorded native value, or 0 if this build called more natives than the trace.
+fn next_native() -> u32 {
+    unsafe {
+        // SAFETY: See replay().
+        let state = &mut *STATE.get();
+        let val = state.natives.get(state.next_native).copied().unwrap_or(0);
+        state.next_native += 1;
+        val
+    }
+}
+
+/// Records a change made to the player by the running hook.
+fn push_effect(
+    kind: TraceEffect,
+    attr: ActorAttribute,
+    val: f32
+) {
+    unsafe {
+        // SAFETY: See replay().
+        let kind = ((kind as u32) << 16) | (attr as u32 & 0xFFFF);
+        (*STATE.get()).effects.push((kind, val.to_word()));
+    }
+}
+
+/// Gets the level of the player.
+fn get_level(
+    _player: *mut PlayerCharacter
+) -> u16 {
+    next_native() as u16
+}
+
+/// Gets the base value of a player attribute.
+unsafe extern "system" fn avo_get_base(
+    _av: *mut ActorValueOwner,
+    _attr: ActorAttribute
+) -> f32 {
+    f32::from_bits(next_native())
+}
+
+/// Gets the current value of a player attribute.
+unsafe extern "system" fn avo_get_current(
+    _av: *mut ActorValueOwner,
+    _attr: c_int
+) -> f32 {
+    f32::from_bits(next_native())
+}
+
+/// Modifies the base value of a player attribute.
+unsafe extern "system" fn avo_mod_base(
+    _av: *mut ActorValueOwner,
+    attr: ActorAttribute,
+    delta: f32
+) {
+    push_effect(TraceEffect::ModBase, attr, delta);
+}
+
+/// Modifies the current value of a player attribute.
+unsafe extern "system" fn avo_mod_current(
+    _av: *mut ActorValueOwner,
+    _unk1: u32,
+    attr: ActorAttribute,
+    delta: f32
+) {
+    push_effect(TraceEffect::ModCurrent, attr, delta);
+}
+
+/// Measures the time taken to read the clock, so it can be removed from each latency.
+fn timer_overhead() -> Duration {
+    let mut samples = (0..1001).map(|_| {
+        let start = Instant::now();
+        start.elapsed()
+    }).collect::<Vec<_>>();
+    samples.sort();
+    samples[samples.len() / 2]
+}
+
+/// Prints a record which did not match the trace.
+fn print_diff(
+    index: usize,
+    expected: &TraceRecord,
+    actual: &TraceRecord
+) {
+    println!("Record {} ({}): args {:08x?}", index, expected.hook.name(), expected.args);
+    println!("  trace:  natives {:08x?} effects {:08x?} result {:08x} ({})",
+             expected.natives, expected.effects, expected.result,
+             f32::from_bits(expected.result));
+    println!("  replay: natives {:08x?} effects {:08x?} result {:08x} ({})",
+             actual.natives, actual.effects, actual.result, f32::from_bits(actual.result));
+}
+
+/// Prints the call counts, differences, throughput and latencies of each hook.
+fn print_report(
+    stats: &mut [HookStats]
+) {
+    println!(
+        "{:<32} {:>9} {:>8} {:>8} {:>9} {:>8} {:>8} {:>8}",
+        "Hook", "Calls", "Skipped", "Diffs", "Mcalls/s", "p50 ns", "p99 ns", "max ns"
+    );
+
+    for (hook, stat) in TraceHook::ALL.iter().zip(stats.iter_mut()) {
+        if (stat.calls == 0) && (stat.skipped == 0) {
+            continue;
+        }
+
+        stat.latencies.sort_unstable();
+        let percentile = |p: usize| -> u32 {
+            if stat.latencies.is_empty() {
+                0
+            } else {
+                stat.latencies[(stat.latencies.len() - 1) * p / 100]
+            }
+        };
+        let total = stat.latencies.iter().map(|l| *l as f64).sum::<f64>();
+        let throughput = stat.latencies.len() as f64 / total.max(1.0) * 1e3;
+
+        println!(
+            "{:<32} {:>9} {:>8} {:>8} {:>9.2} {:>8} {:>8} {:>8}",
+            hook.name(),
+            stat.calls,
+            stat.skipped,
+            stat.mismatches,
+            throughput,
+            percentile(50),
+            percentile(99),
+            percentile(100)
+        );
+    }
+}
@@ -0,0 +1,38 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Main file for the ring log recovery tool.
+//! @bug No known bugs.
+//!
+//! Plugins built with the mmap_log feature write their log to a ring buffer file, which keeps
+//! the last messages written before the game exited or crashed. This tool reads such a file
+//! back as text.
+//!
+
+use std::io::Write;
+
+use skse64::log_ring;
+
+///
+/// Writes the messages in a ring log file to stdout, oldest first.
+///
+/// Usage: log-recover <file>
+///
+/// Messages are written by the plugin in UTF-16, and are converted to UTF-8.
+///
+fn main() {
+    let args = std::env::args_os().skip(1).collect::<Vec<_>>();
+    assert!(args.len() == 1, "Usage: log-recover <file>");
+
+    let file = std::fs::read(&args[0]).expect("Could not read the ring log file");
+    let msgs = log_ring::recover(&file).expect("The file is not a valid ring log");
+
+    let mut out = std::io::stdout().lock();
+    for msg in msgs.iter() {
+        let wide = msg.chunks_exact(2).map(|c| u16::from_le_bytes([c[0], c[1]]));
+        let text = char::decode_utf16(wide).map(|c| c.unwrap_or(char::REPLACEMENT_CHARACTER));
+        out.write_all(text.collect::<String>().as_bytes()).unwrap();
+    }
+
+    eprintln!("Recovered {} messages.", msgs.len());
+}
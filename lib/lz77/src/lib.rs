@@ -223,21 +223,17 @@ impl MatchGroup {
         data: &[u8]
     ) -> Result<(), (usize, usize)> {
         assert!(self.matches.len() > 0);
-        let mut matches = Vec::new();
 
-        for i in self.matches.iter() {
-            if b == data[i + self.len] {
-                matches.push(*i);
-            }
+        // Check for a survivor first, so the group can be filtered in place without losing
+        // the match we return on failure.
+        let len = self.len;
+        if !self.matches.iter().any(|i| b == data[i + len]) {
+            return Err((self.matches[0], self.len));
         }
 
-        if matches.len() > 0 {
-            self.matches = matches;
-            self.len += 1;
-            Ok(())
-        } else {
-            Err((self.matches[0], self.len))
-        }
+        self.matches.retain(|i| b == data[i + len]);
+        self.len += 1;
+        Ok(())
     }
 }
 
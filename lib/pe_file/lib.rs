@@ -0,0 +1,190 @@
+//!
+//! @file lib.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Minimal reader for the sections of a PE image on disk.
+//! @bug No known bugs.
+//!
+//! This allows tools to inspect the code of a game executable without loading it, so they
+//! can run on any host. Only the section table and the image base are parsed; relocations,
+//! imports and the rest of the optional header are ignored.
+//!
+
+use std::path::Path;
+
+/// The offset of the e_lfanew field in the DOS header.
+const DOS_LFANEW_OFFSET: usize = 0x3c;
+
+/// The signature at the start of the NT headers.
+const PE_SIGNATURE: u32 = u32::from_le_bytes(*b"PE\0\0");
+
+/// The size of the COFF file header.
+const COFF_HEADER_SIZE: usize = 20;
+
+/// The size of each entry in the section table.
+const SECTION_HEADER_SIZE: usize = 40;
+
+/// The magic number of a PE32+ (64-bit) optional header.
+const PE32_PLUS_MAGIC: u16 = 0x20b;
+
+/// A section of a PE image.
+pub struct Section {
+    pub name: String,
+    pub rva: usize,
+    pub virtual_size: usize,
+    raw: std::ops::Range<usize>
+}
+
+/// A PE image which has been read in from disk.
+pub struct PeFile {
+    data: Vec<u8>,
+    image_base: usize,
+    sections: Vec<Section>
+}
+
+/// Reads a little endian u16 from the data.
+fn read_u16(
+    data: &[u8],
+    pos: usize
+) -> Result<u16, ()> {
+    data.get(pos..pos + 2).map(|b| u16::from_le_bytes([b[0], b[1]])).ok_or(())
+}
+
+/// Reads a little endian u32 from the data.
+fn read_u32(
+    data: &[u8],
+    pos: usize
+) -> Result<u32, ()> {
+    data.get(pos..pos + 4).map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]])).ok_or(())
+}
+
+/// Reads a little endian u64 from the data.
+fn read_u64(
+    data: &[u8],
+    pos: usize
+) -> Result<u64, ()> {
+    Ok((read_u32(data, pos)? as u64) | ((read_u32(data, pos + 4)? as u64) << 32))
+}
+
+impl PeFile {
+    /// Reads in the PE image at the given path.
+    pub fn open(
+        path: &Path
+    ) -> Result<Self, ()> {
+        Self::from_bytes(std::fs::read(path).map_err(|_| ())?)
+    }
+
+    /// Parses a PE image from its contents.
+    pub fn from_bytes(
+        data: Vec<u8>
+    ) -> Result<Self, ()> {
+        if data.get(0..2) != Some(b"MZ") {
+            return Err(());
+        }
+
+        let nt = read_u32(&data, DOS_LFANEW_OFFSET)? as usize;
+        if read_u32(&data, nt)? != PE_SIGNATURE {
+            return Err(());
+        }
+
+        let coff = nt + 4;
+        let num_sections = read_u16(&data, coff + 2)? as usize;
+        let opt_size = read_u16(&data, coff + 16)? as usize;
+        let opt = coff + COFF_HEADER_SIZE;
+        let table = opt + opt_size;
+
+        // The image base is the only field which moves between PE32 and PE32+.
+        let image_base = if read_u16(&data, opt)? == PE32_PLUS_MAGIC {
+            read_u64(&data, opt + 24)? as usize
+        } else {
+            read_u32(&data, opt + 28)? as usize
+        };
+
+        let mut sections = Vec::with_capacity(num_sections);
+        for i in 0..num_sections {
+            let hdr = table + i * SECTION_HEADER_SIZE;
+            let name = data.get(hdr..hdr + 8).ok_or(())?;
+            let name = String::from_utf8_lossy(name).trim_end_matches('\0').to_string();
+            let virtual_size = read_u32(&data, hdr + 8)? as usize;
+            let rva = read_u32(&data, hdr + 12)? as usize;
+            let raw_size = read_u32(&data, hdr + 16)? as usize;
+            let raw_start = read_u32(&data, hdr + 20)? as usize;
+
+            // Sections are padded on disk, but only their virtual size is meaningful.
+            let raw_len = if virtual_size == 0 { raw_size } else { raw_size.min(virtual_size) };
+            if raw_start + raw_len > data.len() {
+                return Err(());
+            }
+
+            sections.push(Section {
+                name,
+                rva,
+                virtual_size,
+                raw: raw_start..raw_start + raw_len
+            });
+        }
+
+        Ok(Self { data, image_base, sections })
+    }
+
+    /// Gets the address the image prefers to be loaded at.
+    pub fn image_base(
+        &self
+    ) -> usize {
+        self.image_base
+    }
+
+    /// Gets the sections of the image.
+    pub fn sections(
+        &self
+    ) -> &[Section] {
+        &self.sections
+    }
+
+    /// Finds the section with the given name.
+    pub fn section(
+        &self,
+        name: &str
+    ) -> Option<&Section> {
+        self.sections.iter().find(|s| s.name == name)
+    }
+
+    /// Gets the contents of a section which are stored on disk.
+    pub fn section_data(
+        &self,
+        section: &Section
+    ) -> &[u8] {
+        &self.data[section.raw.clone()]
+    }
+
+    ///
+    /// Reads len bytes at the given RVA.
+    ///
+    /// Fails if the range isn't entirely within the on-disk contents of a single section.
+    ///
+    pub fn read(
+        &self,
+        rva: usize,
+        len: usize
+    ) -> Option<&[u8]> {
+        let s = self.sections.iter().find(|s| (s.rva <= rva) && (rva < s.rva + s.virtual_size))?;
+        let start = rva - s.rva;
+        self.section_data(s).get(start..start.checked_add(len)?)
+    }
+
+    ///
+    /// Lays out the sections of the image as the loader would, with each section at its RVA.
+    ///
+    /// The headers and any gaps between sections are left zeroed, as is the tail of any section
+    /// whose virtual size is larger than its contents on disk.
+    ///
+    pub fn map(
+        &self
+    ) -> Vec<u8> {
+        let size = self.sections.iter().map(|s| s.rva + s.virtual_size.max(s.raw.len())).max();
+        let mut image = vec![0; size.unwrap_or(0)];
+        for s in self.sections.iter() {
+            image[s.rva..s.rva + s.raw.len()].copy_from_slice(self.section_data(s));
+        }
+        image
+    }
+}
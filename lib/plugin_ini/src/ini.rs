@@ -5,10 +5,12 @@
 //! @bug No known bugs.
 //!
 
+use std::any::Any;
 use std::path::Path;
 use std::fs::File;
 use std::io::{Read, Write};
 use std::str::FromStr;
+use std::sync::OnceLock;
 
 use crate::map::*;
 
@@ -16,17 +18,30 @@ use crate::map::*;
 const COMMENT_CHARS: &[char] = &['#', ';'];
 
 /// The metadata associated with each field in the INI file.
-#[derive(Clone)]
-struct FieldMeta {
+pub(crate) struct FieldMeta {
     prefix: Option<String>,
     inline_comment: Option<String>,
-    val: Option<String>
+    val: Option<String>,
+    /// The result of the first typed read through a handle, as an Option of that type.
+    parsed: OnceLock<Box<dyn Any + Send + Sync>>
+}
+
+///
+/// Refers to a field within an INI, allowing it to be read without searching for it again.
+///
+/// Fields are never removed from an INI, so a handle remains valid for the lifetime of the
+/// INI which resolved it. Handles must not be used with any other INI.
+///
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub struct FieldHandle {
+    section: usize,
+    field: usize
 }
 
 /// A field in the INI file.
 pub struct Field<'a> {
-    field: &'a str,
-    meta: &'a FieldMeta
+    pub(crate) field: &'a str,
+    pub(crate) meta: &'a FieldMeta
 }
 
 ///
@@ -38,10 +53,10 @@ pub struct FieldIter<'a>(IniMapIter<'a, FieldMeta>);
 
 /// The metadata associated with each section in the INI file.
 #[derive(Clone)]
-struct SectionMeta {
+pub(crate) struct SectionMeta {
     prefix: Option<String>,
     inline_comment: Option<String>,
-    fields: IniMap<FieldMeta>
+    pub(crate) fields: IniMap<FieldMeta>
 }
 
 /// A section in the INI file.
@@ -60,8 +75,22 @@ pub struct SectionIter<'a>(IniMapIter<'a, SectionMeta>);
 
 /// Manages an INI file, allowing it to be updated, read, and written to a file.
 pub struct Ini {
-    sections: IniMap<SectionMeta>,
-    suffix: Option<String>
+    pub(crate) sections: IniMap<SectionMeta>,
+    pub(crate) suffix: Option<String>
+}
+
+/// Copies the field, without the cached value of any typed read.
+impl Clone for FieldMeta {
+    fn clone(
+        &self
+    ) -> Self {
+        Self {
+            prefix: self.prefix.clone(),
+            inline_comment: self.inline_comment.clone(),
+            val: self.val.clone(),
+            parsed: OnceLock::new()
+        }
+    }
 }
 
 impl<'a> Field<'a> {
@@ -72,6 +101,13 @@ impl<'a> Field<'a> {
         self.field
     }
 
+    /// Gets the text of the value for the given field, if it has one.
+    pub fn raw_value(
+        &self
+    ) -> Option<&'a str> {
+        self.meta.val.as_deref()
+    }
+
     /// Attempts to read the value for the given field.
     pub fn value<T: FromStr>(
         &self
@@ -167,6 +203,38 @@ impl Ini {
         self.section(section).ok()?.field(field).ok()?.value()
     }
 
+    /// Resolves the given section/field pair to a handle, which can be read from repeatedly.
+    pub fn resolve(
+        &self,
+        section: &str,
+        field: &str
+    ) -> Result<FieldHandle, ()> {
+        let section_index = self.sections.position(section).ok_or(())?;
+        let section = self.sections.get_at(section_index).unwrap();
+        let field_index = section.fields.position(field).ok_or(())?;
+        Ok(FieldHandle { section: section_index, field: field_index })
+    }
+
+    ///
+    /// Gets the value of the field the given handle refers to.
+    ///
+    /// The value is parsed the first time it is read, and that result is returned by every
+    /// later read of the same type. A field which is read as several types is only cached
+    /// as the first one. The cache is boxed, so fields which are read once should use get().
+    ///
+    pub fn get_by_handle<T: FromStr + Clone + Send + Sync + 'static>(
+        &self,
+        handle: FieldHandle
+    ) -> Option<T> {
+        let meta = self.sections.get_at(handle.section)?.fields.get_at(handle.field)?;
+        let parse = || meta.val.as_ref().and_then(|s| T::from_str(s).ok());
+        let parsed = meta.parsed.get_or_init(|| Box::new(parse()));
+        match parsed.downcast_ref::<Option<T>>() {
+            Some(val) => val.clone(),
+            None => parse()
+        }
+    }
+
     /// Updates the sections/fields in the given map with values found only in the second map.
     pub fn update(
         &mut self,
@@ -229,7 +297,7 @@ impl Ini {
     }
 
     /// Creates a new, empty, INI object.
-    fn new() -> Self {
+    pub(crate) fn new() -> Self {
         Self {
             sections: IniMap::new(),
             suffix: None
@@ -337,7 +405,8 @@ impl Ini {
             section.fields.insert(key, FieldMeta {
                 prefix,
                 inline_comment: comment.map(|s| String::from_str(s).unwrap()),
-                val: val.map(|s| String::from_str(s).unwrap())
+                val: val.map(|s| String::from_str(s).unwrap()),
+                parsed: OnceLock::new()
             });
 
             Ok(())
@@ -358,3 +427,103 @@ impl Ini {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::cell::Cell;
+
+    const BASE: &str = "[General]\niA = 1\n[Caps]\niOne = 100\n";
+    const DELTA: &str = "[General]\niA = 5\niB = 2\n[Extra]\niC = 3\n";
+
+    thread_local! {
+        /// The number of times a Counted value was parsed on this thread.
+        static PARSES: Cell<usize> = Cell::new(0);
+    }
+
+    /// A value which counts how many times it is parsed.
+    #[derive(Copy, Clone, PartialEq, Debug)]
+    struct Counted(u32);
+
+    impl FromStr for Counted {
+        type Err = ();
+        fn from_str(
+            s: &str
+        ) -> Result<Self, ()> {
+            PARSES.with(|p| p.set(p.get() + 1));
+            u32::from_str(s).map(Counted).map_err(|_| ())
+        }
+    }
+
+    /// Gets the number of times a Counted value was parsed on this thread.
+    fn parses() -> usize {
+        PARSES.with(|p| p.get())
+    }
+
+    #[test]
+    fn handle_reads_parse_once() {
+        let ini = Ini::from_str(BASE).unwrap();
+        let handle = ini.resolve("caps", "ione").unwrap();
+        assert!(ini.resolve("Caps", "iTwo").is_err() && ini.resolve("Other", "iOne").is_err());
+
+        let start = parses();
+        assert_eq!(ini.get_by_handle(handle), Some(Counted(100)));
+        assert_eq!(ini.get_by_handle(handle), Some(Counted(100)));
+        assert_eq!(parses(), start + 1);
+
+        // A plain read still parses the text.
+        assert_eq!(ini.get("Caps", "iOne"), Some(Counted(100)));
+        assert_eq!(parses(), start + 2);
+    }
+
+    #[test]
+    fn reads_as_another_type_skip_the_cache() {
+        let ini = Ini::from_str(BASE).unwrap();
+        let handle = ini.resolve("Caps", "iOne").unwrap();
+
+        // The field is cached as a u32, so every read as a Counted must parse again.
+        let start = parses();
+        assert_eq!(ini.get_by_handle::<u32>(handle), Some(100));
+        assert_eq!(ini.get_by_handle(handle), Some(Counted(100)));
+        assert_eq!(ini.get_by_handle(handle), Some(Counted(100)));
+        assert_eq!(parses(), start + 2);
+        assert_eq!(ini.get_by_handle::<u32>(handle), Some(100));
+        assert_eq!(ini.get_by_handle::<bool>(handle), None);
+    }
+
+    #[test]
+    fn handles_stay_valid_across_updates() {
+        let mut ini = Ini::from_str(BASE).unwrap();
+        let handle = ini.resolve("Caps", "iOne").unwrap();
+        let general = ini.resolve("General", "iA").unwrap();
+        assert_eq!(ini.get_by_handle::<u32>(handle), Some(100));
+
+        // Existing fields keep their values, and new ones are added after them.
+        assert!(ini.update(&Ini::from_str(DELTA).unwrap()).is_some());
+        assert_eq!(ini.resolve("Caps", "iOne"), Ok(handle));
+        assert_eq!(ini.resolve("General", "iA"), Ok(general));
+        assert_eq!(ini.get_by_handle::<u32>(handle), Some(100));
+        assert_eq!(ini.get_by_handle::<u32>(general), Some(1));
+        assert_eq!(ini.get("Extra", "iC"), Some(3));
+    }
+
+    #[test]
+    fn cloned_fields_start_uncached() {
+        let delta = Ini::from_str(DELTA).unwrap();
+        let handle = delta.resolve("Extra", "iC").unwrap();
+        assert_eq!(delta.get_by_handle(handle), Some(Counted(3)));
+
+        // The update copies the field from the delta, which must parse it again.
+        let mut ini = Ini::from_str(BASE).unwrap();
+        ini.update(&delta);
+        let copied = ini.resolve("Extra", "iC").unwrap();
+        let start = parses();
+        assert_eq!(ini.get_by_handle(copied), Some(Counted(3)));
+        assert_eq!(parses(), start + 1);
+
+        // The field it was copied from keeps its own cache.
+        assert_eq!(delta.get_by_handle(handle), Some(Counted(3)));
+        assert_eq!(parses(), start + 1);
+    }
+}
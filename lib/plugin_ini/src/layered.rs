@@ -0,0 +1,415 @@
+//!
+//! @file layered.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Stacks INI files on top of each other behind a single read-only view.
+//! @bug No known bugs.
+//!
+//! Each layer overrides the values of the layers below it, so a base INI can be adjusted by any
+//! number of small override files. Nothing is merged when a layer is added. Instead, lookups
+//! search the layers from the top down and return the first match, and iteration checks the
+//! layers below each entry to skip the ones it has already given.
+//!
+//! Iteration gives each section and field once, in the order it first appears when reading the
+//! layers from the bottom up, with the value of the highest layer which has it.
+//!
+
+use std::str::FromStr;
+
+use crate::ini::*;
+use crate::map::*;
+
+/// The number of layers whose sections are tracked by the layer mask of a section.
+const MASK_LAYERS: usize = u64::BITS as usize;
+
+/// A stack of INI files, where each layer overrides the layers below it.
+pub struct LayeredIni {
+    layers: Vec<Ini>
+}
+
+///
+/// A section in a layered INI, which may be defined by several of its layers.
+///
+/// The section holds the lowest layer which defines it, and a mask of the layers which do, so
+/// that reading its fields only searches those layers. Layers past the end of the mask are
+/// always searched.
+///
+#[derive(Copy, Clone)]
+pub struct LayeredSection<'a> {
+    section: &'a str,
+    layers: &'a [Ini],
+    first: usize,
+    meta: &'a SectionMeta,
+    mask: u64
+}
+
+/// An iterator over the sections in a layered INI (in order).
+pub struct LayeredSectionIter<'a> {
+    layers: &'a [Ini],
+    layer: usize,
+    iter: Option<IniMapIter<'a, SectionMeta>>
+}
+
+/// An iterator over the effective fields within a section of a layered INI (in order).
+pub struct LayeredFieldIter<'a> {
+    section: LayeredSection<'a>,
+    layer: usize,
+    iter: IniMapIter<'a, FieldMeta>
+}
+
+impl LayeredIni {
+    /// Creates a new stack, with no layers.
+    pub fn new() -> Self {
+        Self { layers: Vec::new() }
+    }
+
+    /// Adds a layer to the top of the stack, overriding every layer already in it.
+    pub fn push(
+        &mut self,
+        ini: Ini
+    ) {
+        self.layers.push(ini);
+    }
+
+    /// Gets the layers in the stack, from the bottom up.
+    pub fn layers(
+        &self
+    ) -> &[Ini] {
+        &self.layers
+    }
+
+    /// Gets a single section within the stack.
+    pub fn section<'a>(
+        &'a self,
+        section: &str
+    ) -> Result<LayeredSection<'a>, ()> {
+        // Names are taken from the lowest layer, so they match the iteration order.
+        let (first, (section, meta)) = self.layers.iter().enumerate().find_map(|(i, l)| {
+            l.sections.get_key_value(section).map(|s| (i, s))
+        }).ok_or(())?;
+        Ok(LayeredSection::new(&self.layers, first, section.as_key_str().get(), meta))
+    }
+
+    /// Gets an iterator over all sections in the stack.
+    pub fn sections<'a>(
+        &'a self
+    ) -> LayeredSectionIter<'a> {
+        LayeredSectionIter {
+            layers: &self.layers,
+            layer: 0,
+            iter: self.layers.first().map(|l| l.sections.iter())
+        }
+    }
+
+    /// Gets the effective value from the given section/field pair.
+    pub fn get<T: FromStr>(
+        &self,
+        section: &str,
+        field: &str
+    ) -> Option<T> {
+        self.layers.iter().rev().find_map(|l| field_meta(l, section, field))?.value()
+    }
+
+    ///
+    /// Merges the layers into a single INI.
+    ///
+    /// Each field keeps the comments of the layer its value was taken from. Sections, and any
+    /// text after the last section, keep those of the lowest layer which has them.
+    ///
+    pub fn flatten(
+        &self
+    ) -> Ini {
+        let mut ini = Ini::new();
+        for layer in self.layers.iter() {
+            for (name, meta) in layer.sections.iter() {
+                let Some(section) = ini.sections.get_mut(name.get()) else {
+                    ini.sections.insert(String::from_str(name.get()).unwrap(), meta.clone());
+                    continue;
+                };
+
+                for (field, field_meta) in meta.fields.iter() {
+                    section.fields.insert(String::from_str(field.get()).unwrap(),
+                                          field_meta.clone());
+                }
+            }
+
+            if ini.suffix.is_none() {
+                ini.suffix = layer.suffix.clone();
+            }
+        }
+
+        ini
+    }
+}
+
+impl<'a> LayeredSection<'a> {
+    /// Creates a section, which is first defined by the given layer.
+    fn new(
+        layers: &'a [Ini],
+        first: usize,
+        section: &'a str,
+        meta: &'a SectionMeta
+    ) -> Self {
+        let mut mask = 0;
+        for (i, layer) in layers.iter().enumerate().take(MASK_LAYERS).skip(first) {
+            if (i == first) || layer.sections.get(section).is_some() {
+                mask |= 1 << i;
+            }
+        }
+
+        Self { section, layers, first, meta, mask }
+    }
+
+    /// Gets the name of the given section.
+    pub fn name(
+        &self
+    ) -> &str {
+        self.section
+    }
+
+    /// Gets the effective field with the given name in the section.
+    pub fn field(
+        &self,
+        name: &str
+    ) -> Result<Field<'a>, ()> {
+        let upper = (self.first + 1..self.layers.len()).rev().find_map(|i| {
+            self.layer(i)?.fields.get_key_value(name)
+        });
+        let (field, meta) = upper.or_else(|| self.meta.fields.get_key_value(name)).ok_or(())?;
+        Ok(Field { field: field.as_key_str().get(), meta })
+    }
+
+    /// Gets an iterator over the effective fields in the section.
+    pub fn fields(
+        &self
+    ) -> LayeredFieldIter<'a> {
+        LayeredFieldIter {
+            section: *self,
+            layer: self.first,
+            iter: self.meta.fields.iter()
+        }
+    }
+
+    /// Gets the section in the given layer, if that layer defines it.
+    fn layer(
+        &self,
+        layer: usize
+    ) -> Option<&'a SectionMeta> {
+        if (layer < MASK_LAYERS) && (self.mask & (1 << layer) == 0) {
+            return None;
+        }
+
+        self.layers[layer].sections.get(self.section)
+    }
+
+    /// Gets the given field from the given layer, if that layer defines it.
+    fn field_meta(
+        &self,
+        layer: usize,
+        field: &str
+    ) -> Option<&'a FieldMeta> {
+        self.layer(layer)?.fields.get(field)
+    }
+}
+
+impl<'a> Iterator for LayeredSectionIter<'a> {
+    type Item = LayeredSection<'a>;
+    fn next(
+        &mut self
+    ) -> Option<Self::Item> {
+        loop {
+            if let Some((name, meta)) = self.iter.as_mut()?.next() {
+                // Skip sections which a lower layer already gave.
+                let lower = &self.layers[..self.layer];
+                if lower.iter().all(|l| l.sections.get(name.get()).is_none()) {
+                    return Some(LayeredSection::new(self.layers, self.layer, name.get(), meta));
+                }
+            } else {
+                self.layer += 1;
+                self.iter = self.layers.get(self.layer).map(|l| l.sections.iter());
+            }
+        }
+    }
+}
+
+impl<'a> Iterator for LayeredFieldIter<'a> {
+    type Item = Field<'a>;
+    fn next(
+        &mut self
+    ) -> Option<Self::Item> {
+        let sec = self.section;
+        loop {
+            let Some((name, meta)) = self.iter.next() else {
+                // Move on to the next layer which defines this section.
+                let (layer, meta) = (self.layer + 1..sec.layers.len())
+                    .find_map(|i| sec.layer(i).map(|s| (i, s)))?;
+                self.layer = layer;
+                self.iter = meta.fields.iter();
+                continue;
+            };
+
+            // Skip fields which a lower layer already gave, and take the value of the highest
+            // layer which has the field.
+            let name = name.get();
+            if (sec.first..self.layer).all(|i| sec.field_meta(i, name).is_none()) {
+                let meta = (self.layer + 1..sec.layers.len()).rev()
+                    .find_map(|i| sec.field_meta(i, name)).unwrap_or(meta);
+                return Some(Field { field: name, meta });
+            }
+        }
+    }
+}
+
+/// Gets the given field from a single layer.
+fn field_meta<'a>(
+    layer: &'a Ini,
+    section: &str,
+    field: &str
+) -> Option<Field<'a>> {
+    let (field, meta) = layer.sections.get(section)?.fields.get_key_value(field)?;
+    Some(Field { field: field.as_key_str().get(), meta })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// The sections of an INI, each with its fields and their values, in iteration order.
+    type Entries = Vec<(String, Vec<(String, String)>)>;
+
+    // The layers of the test stack, from the bottom up.
+    const BASE: &str = "[General]\nbA = true\niB = 2\n[Caps]\nfOne = 1.0\n";
+    const MID: &str = "[caps]\nfTwo = 2.0\n[Extra]\nsName = mid\n[General]\niB = 20\n";
+    const TOP: &str = "[Extra]\nsName = top\n[General]\nbA = false\niC = 3\n";
+
+    /// Builds a stack from the given INI files, from the bottom up.
+    fn stack(
+        files: &[&str]
+    ) -> LayeredIni {
+        let mut layered = LayeredIni::new();
+        for file in files.iter() {
+            layered.push(Ini::from_str(file).unwrap());
+        }
+        layered
+    }
+
+    /// Gets the entries of a layered view.
+    fn layered_entries(
+        layered: &LayeredIni
+    ) -> Entries {
+        layered.sections().map(|s| {
+            let fields = s.fields().map(|f| {
+                (f.name().to_string(), f.raw_value().unwrap().to_string())
+            }).collect();
+            (s.name().to_string(), fields)
+        }).collect()
+    }
+
+    /// Gets the entries of a single INI.
+    fn ini_entries(
+        ini: &Ini
+    ) -> Entries {
+        ini.sections().map(|s| {
+            let fields = s.fields().map(|f| {
+                (f.name().to_string(), f.raw_value().unwrap().to_string())
+            }).collect();
+            (s.name().to_string(), fields)
+        }).collect()
+    }
+
+    /// Sorts the entries by their lowercase names, for comparisons which ignore order.
+    fn sorted(
+        mut entries: Entries
+    ) -> Entries {
+        for (name, fields) in entries.iter_mut() {
+            *name = name.to_ascii_lowercase();
+            for (field, _) in fields.iter_mut() {
+                *field = field.to_ascii_lowercase();
+            }
+            fields.sort();
+        }
+        entries.sort();
+        entries
+    }
+
+    /// Builds the owned entries of a section.
+    fn entry(
+        name: &str,
+        fields: &[(&str, &str)]
+    ) -> (String, Vec<(String, String)>) {
+        (name.to_string(), fields.iter().map(|(f, v)| (f.to_string(), v.to_string())).collect())
+    }
+
+    #[test]
+    fn empty_stack_has_nothing() {
+        let layered = LayeredIni::new();
+        assert!(layered.layers().is_empty());
+        assert!(layered.section("General").is_err());
+        assert_eq!(layered.get::<u32>("General", "iB"), None);
+        assert_eq!(layered.sections().count(), 0);
+        assert_eq!(layered_entries(&layered), ini_entries(&layered.flatten()));
+    }
+
+    #[test]
+    fn upper_layers_override_lookups() {
+        let layered = stack(&[BASE, MID, TOP]);
+        assert_eq!(layered.get::<bool>("General", "bA"), Some(false));
+        assert_eq!(layered.get::<u32>("general", "ib"), Some(20));
+        assert_eq!(layered.get::<u32>("General", "iC"), Some(3));
+        assert_eq!(layered.get::<f32>("Caps", "fOne"), Some(1.0));
+        assert_eq!(layered.get::<f32>("CAPS", "fTwo"), Some(2.0));
+        assert_eq!(layered.get::<String>("Extra", "sName"), Some("top".to_string()));
+        assert_eq!(layered.get::<u32>("General", "iMissing"), None);
+        assert_eq!(layered.get::<u32>("Missing", "iB"), None);
+
+        // Sections keep the name of the lowest layer which defines them.
+        let caps = layered.section("CAPS").unwrap();
+        assert_eq!(caps.name(), "Caps");
+        assert_eq!(caps.field("ftwo").unwrap().raw_value(), Some("2.0"));
+        assert!(caps.field("bA").is_err());
+    }
+
+    #[test]
+    fn iteration_gives_each_entry_once_in_order() {
+        let layered = stack(&[BASE, MID, TOP]);
+        assert_eq!(layered_entries(&layered), vec![
+            entry("General", &[("bA", "false"), ("iB", "20"), ("iC", "3")]),
+            entry("Caps", &[("fOne", "1.0"), ("fTwo", "2.0")]),
+            entry("Extra", &[("sName", "top")])
+        ]);
+    }
+
+    #[test]
+    fn flatten_matches_the_view_and_eager_merging() {
+        let layered = stack(&[BASE, MID, TOP]);
+        let flat = layered.flatten();
+        assert_eq!(ini_entries(&flat), layered_entries(&layered));
+
+        // Merging eagerly fills each layer in with the ones below it, so only the order of
+        // the entries differs.
+        let mut eager = Ini::from_str(TOP).unwrap();
+        eager.update(&Ini::from_str(MID).unwrap());
+        eager.update(&Ini::from_str(BASE).unwrap());
+        assert_eq!(sorted(ini_entries(&eager)), sorted(ini_entries(&flat)));
+    }
+
+    #[test]
+    fn layers_past_the_mask_are_searched() {
+        let files: Vec<String> = (0..MASK_LAYERS + 6).map(|i| {
+            if i % 2 == 0 {
+                format!("[Shared]\niTop = {}\niLayer{} = {}\n", i, i, i)
+            } else {
+                format!("[Other{}]\niLayer = {}\n", i, i)
+            }
+        }).collect();
+        let layered = stack(&files.iter().map(|f| f.as_str()).collect::<Vec<_>>());
+
+        let top = (MASK_LAYERS + 4) as u32;
+        assert_eq!(layered.get::<u32>("Shared", "iTop"), Some(top));
+        let shared = layered.section("Shared").unwrap();
+        assert_eq!(shared.field("iTop").unwrap().value::<u32>(), Some(top));
+        assert_eq!(shared.field(&format!("iLayer{}", top)).unwrap().value::<u32>(), Some(top));
+        assert_eq!(shared.fields().count(), 1 + (MASK_LAYERS + 6) / 2);
+        assert_eq!(layered.sections().count(), 1 + (MASK_LAYERS + 6) / 2);
+        assert_eq!(ini_entries(&layered.flatten()), layered_entries(&layered));
+    }
+}
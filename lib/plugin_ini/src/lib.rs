@@ -8,5 +8,7 @@
 mod key;
 mod map;
 mod ini;
+mod layered;
 
 pub use ini::*;
+pub use layered::*;
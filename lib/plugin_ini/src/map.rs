@@ -53,6 +53,26 @@ impl<V> IniMap<V> {
         self.search(key).ok().map(|i| &mut self.order[i].1)
     }
 
+    ///
+    /// Gets the position of the given key in the insertion order.
+    ///
+    /// Elements are never removed or reordered, so the position of a key never changes.
+    ///
+    pub fn position(
+        &self,
+        key: &str
+    ) -> Option<usize> {
+        self.search(key).ok()
+    }
+
+    /// Gets the element at the given position in the insertion order.
+    pub fn get_at(
+        &self,
+        index: usize
+    ) -> Option<&V> {
+        self.order.get(index).map(|e| &e.1)
+    }
+
     /// Gets the (key, value) associated with the given key.
     pub fn get_key_value(
         &self,
@@ -0,0 +1,360 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Main file for the signature auditor.
+//! @bug No known bugs.
+//!
+//! Builds a suffix array over the code of a game executable, and uses it to check how many
+//! places in the code match each signature, and to propose the shortest unique signature at
+//! any given address. RIP relative fields are always wildcarded in proposals, as they differ
+//! between game versions.
+//!
+
+use std::path::Path;
+use std::time::Instant;
+
+use pe_file::PeFile;
+use sigscan::*;
+use versionlib::*;
+
+/// The longest signature which will be proposed.
+const MAX_PROPOSAL: usize = 256;
+
+/// The result of checking a descriptor signature against the executable.
+struct Audit {
+    matches: usize,
+    /// The address the database gives the descriptor, if a database was given.
+    rva: Option<Option<usize>>,
+    /// Whether the signature matches at that address.
+    expected: Option<Option<bool>>
+}
+
+/// The options given on the command line.
+struct Options {
+    exe: String,
+    sigs_from: Option<String>,
+    db: Option<String>,
+    propose: Vec<usize>,
+    min_len: usize,
+    threads: usize
+}
+
+///
+/// Audits the signatures used by the patcher against a game executable.
+///
+/// Usage: sig-audit [options] <exe>
+///
+/// Options:
+/// - --sigs-from=FILE: Counts the matches of each descriptor signature in a rust source file,
+///   such as lib/uncapper_core/src/hooks.rs.
+/// - --db=FILE: The version database of the executable. Selects which descriptors apply, and
+///   checks that each signature matches at its expected location. If it doesn't uniquely
+///   match there, a replacement is proposed.
+/// - --propose=RVA[,RVA...]: Proposes the shortest unique signature at each hex address.
+/// - --min-len=N: The shortest signature which may be proposed.
+/// - --threads=N: The number of threads used to build the suffix array.
+///
+fn main() {
+    let opts = parse_args();
+    let pe = PeFile::open(Path::new(&opts.exe)).expect("Could not read executable");
+    let text_section = pe.section(".text").expect("Executable has no .text section");
+    let text = pe.section_data(text_section);
+
+    let start = Instant::now();
+    let sa = SuffixArray::new(text, opts.threads);
+    eprintln!(
+        "Indexed {} bytes of .text in {:.2?} with {} threads",
+        text.len(),
+        start.elapsed(),
+        opts.threads
+    );
+
+    let db = opts.db.as_ref().map(|p| {
+        let (_, format) = VersionDb::version_from_path(Path::new(p));
+        (VersionDb::new_from_path_with_layout(Path::new(p), DbLayout::Sorted), format)
+    });
+
+    if let Some(src) = opts.sigs_from.as_ref() {
+        let descriptors = read_descriptors(&std::fs::read_to_string(src).unwrap());
+        println!("| {:<32} |  LEN  | MATCHES | EXPECTED |", "NAME");
+        for d in descriptors.iter().filter(|d| !d.sig.is_empty()) {
+            let Some(audit) = audit(&sa, text_section.rva, db.as_ref(), d) else { continue };
+            println!(
+                "| {:<32} | {:5} | {:7} | {:>8} |",
+                d.name,
+                d.sig.len(),
+                audit.matches,
+                match audit.expected {
+                    Some(Some(true)) => "ok",
+                    Some(Some(false)) => "MISSING",
+                    Some(None) => "no id",
+                    None => "-"
+                }
+            );
+
+            if let Some(Some(rva)) = audit.rva {
+                if (audit.matches != 1) || (audit.expected != Some(Some(true))) {
+                    propose(&sa, text_section.rva, rva, opts.min_len.max(d.sig.len()));
+                }
+            }
+        }
+    }
+
+    for rva in opts.propose.iter() {
+        propose(&sa, text_section.rva, *rva, opts.min_len);
+    }
+}
+
+/// Parses the command line, panicking on any malformed option.
+fn parse_args() -> Options {
+    let mut opts = Options {
+        exe: String::new(),
+        sigs_from: None,
+        db: None,
+        propose: Vec::new(),
+        min_len: 1,
+        threads: std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    };
+
+    let mut positional = Vec::new();
+    for arg in std::env::args().skip(1) {
+        let Some((key, val)) = arg.strip_prefix("--").and_then(|s| s.split_once('=')) else {
+            assert!(!arg.starts_with("--"), "Unknown option {}", arg);
+            positional.push(arg);
+            continue;
+        };
+
+        match key {
+            "sigs-from" => opts.sigs_from = Some(val.to_string()),
+            "db" => opts.db = Some(val.to_string()),
+            "propose" => opts.propose.extend(val.split(',').map(|r| {
+                usize::from_str_radix(r.strip_prefix("0x").unwrap_or(r), 16).unwrap()
+            })),
+            "min-len" => opts.min_len = val.parse().unwrap(),
+            "threads" => opts.threads = val.parse().unwrap(),
+            _ => panic!("Unknown option {}", key)
+        }
+    }
+
+    assert!(positional.len() == 1, "Expected a single executable");
+    opts.exe = positional.remove(0);
+    opts
+}
+
+///
+/// Counts the matches of a descriptor signature, and checks if one of them is where the
+/// database expects it.
+///
+/// Returns nothing if the descriptor has no location in the format of the database.
+///
+fn audit(
+    sa: &SuffixArray,
+    text_rva: usize,
+    db: Option<&(VersionDb, u32)>,
+    d: &SourceDescriptor
+) -> Option<Audit> {
+    // Without a database, we can't tell which descriptors apply, so we audit all of them.
+    let rva = match db {
+        Some((db, format)) => {
+            let (id, offset) = d.loc(*format)?;
+            Some(db.find_addr_by_id(id).map(|a| a.offset() + offset).ok())
+        },
+        None => None
+    };
+
+    let matches = sa.find_pattern(&d.sig);
+    let expected = rva.map(|rva| {
+        rva.and_then(|r| r.checked_sub(text_rva)).map(|r| matches.binary_search(&r).is_ok())
+    });
+
+    Some(Audit { matches: matches.len(), rva, expected })
+}
+
+/// Prints the shortest signature at the given address which only matches once.
+fn propose(
+    sa: &SuffixArray,
+    text_rva: usize,
+    rva: usize,
+    min_len: usize
+) {
+    let Some(pos) = rva.checked_sub(text_rva).filter(|p| *p < sa.text().len()) else {
+        println!("{:08x}: not within .text", rva);
+        return;
+    };
+
+    match shortest_unique(sa, pos, min_len) {
+        Some(sig) => println!("{:08x}: {}", rva, sig),
+        None => println!(
+            "{:08x}: no unique signature within {} bytes",
+            rva,
+            MAX_PROPOSAL.min(sa.text().len() - pos)
+        )
+    }
+}
+
+///
+/// Finds the shortest signature at the given position in the text which only matches once.
+///
+/// Adding bytes to a signature can never add matches, so the length is binary searched.
+///
+fn shortest_unique(
+    sa: &SuffixArray,
+    pos: usize,
+    min_len: usize
+) -> Option<Pattern> {
+    let code = &sa.text()[pos..];
+    let max_len = MAX_PROPOSAL.min(code.len());
+    let min_len = min_len.clamp(1, max_len);
+    if sa.count_pattern(&masked_pattern(code, max_len)) != 1 {
+        return None;
+    }
+
+    let (mut lo, mut hi) = (min_len, max_len);
+    while lo < hi {
+        let mid = lo + (hi - lo) / 2;
+        if sa.count_pattern(&masked_pattern(code, mid)) == 1 {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    Some(masked_pattern(code, lo))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use skse64_common::version::SkseVersion;
+
+    /// The version the test databases are encoded with.
+    const TEST_VERSION: SkseVersion = SkseVersion::new(1, 6, 640, 0);
+
+    /// The address of the test .text sections.
+    const TEXT_RVA: usize = 0x1000;
+
+    /// lea rax, [rip+0x11111111]; call +0x22222222; mov eax, ecx; ret
+    const CODE_A: [u8; 15] = [
+        0x48, 0x8d, 0x05, 0x11, 0x11, 0x11, 0x11, 0xe8, 0x22, 0x22, 0x22, 0x22, 0x89, 0xc8, 0xc3
+    ];
+
+    /// The same code as CODE_A with other RIP relative fields, which then moves edx instead.
+    const CODE_B: [u8; 15] = [
+        0x48, 0x8d, 0x05, 0x33, 0x33, 0x33, 0x33, 0xe8, 0x44, 0x44, 0x44, 0x44, 0x89, 0xd0, 0xc3
+    ];
+
+    /// Builds a .text section holding each of the given blocks of code, padded with int3.
+    fn build_text(
+        code: &[&[u8]]
+    ) -> (Vec<u8>, Vec<usize>) {
+        let mut text = vec![0xcc; 64];
+        let mut starts = Vec::new();
+        for c in code.iter() {
+            starts.push(text.len());
+            text.extend_from_slice(c);
+            text.extend_from_slice(&[0xcc; 16]);
+        }
+        (text, starts)
+    }
+
+    /// Finds every position where the given pattern matches the text, by checking each one.
+    fn scan(
+        text: &[u8],
+        pat: &Pattern
+    ) -> Vec<usize> {
+        (0..text.len()).filter(|p| pat.matches(&text[*p..])).collect()
+    }
+
+    #[test]
+    fn pattern_counts_match_a_scan() {
+        // A small alphabet, so that short patterns repeat often.
+        let mut state = 0x5eedu64;
+        let text = (0..5000).map(|_| {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            (state % 4) as u8
+        }).collect::<Vec<_>>();
+
+        for threads in [1, 3] {
+            let sa = SuffixArray::new(&text, threads);
+            for (i, len) in (0..text.len()).step_by(97).zip((1..48).cycle()) {
+                // Wildcard every third byte of some of the patterns.
+                let code = &text[i..text.len().min(i + len)];
+                let pat = Pattern::new(code.iter().enumerate().map(|(j, b)| {
+                    if (i % 2 == 1) && (j % 3 == 1) { None } else { Some(*b) }
+                }).collect());
+
+                let expected = scan(&text, &pat);
+                assert!(expected.contains(&i));
+                assert_eq!(sa.find_pattern(&pat), expected);
+                assert_eq!(sa.count_pattern(&pat), expected.len());
+            }
+
+            let absent = Pattern::new(vec![Some(0), Some(4), None, Some(1)]);
+            assert_eq!((sa.find_pattern(&absent).len(), sa.count_pattern(&absent)), (0, 0));
+            let any = Pattern::new(vec![None; 3]);
+            assert_eq!(sa.count_pattern(&any), text.len() - 2);
+        }
+    }
+
+    #[test]
+    fn audits_check_the_location_given_by_the_database() {
+        let (text, starts) = build_text(&[&CODE_A, &CODE_B, &CODE_A[..7]]);
+        let sa = SuffixArray::new(&text, 1);
+        let pairs = [(10, TEXT_RVA + starts[0]), (11, TEXT_RVA + starts[1])];
+        let data = writer::encode_db(&pairs, TEST_VERSION, 2, writer::DEFAULT_PTR_SIZE);
+        let db = (VersionDb::new_from_bytes(&data, TEST_VERSION, 2, DbLayout::Sorted), 2);
+
+        let descriptor = |ae: Option<(usize, usize)>, sig: &str| SourceDescriptor {
+            name: String::new(),
+            se: Some((10, 0)),
+            ae,
+            sig: Pattern::parse(sig).unwrap()
+        };
+        let check = |d: &SourceDescriptor| {
+            audit(&sa, TEXT_RVA, Some(&db), d).map(|a| (a.matches, a.rva, a.expected))
+        };
+
+        // The call is found past the start of id 10, and in no other place.
+        let call = descriptor(Some((10, 7)), "e8 ?? ?? ?? ?? 89 c8");
+        let rva = TEXT_RVA + starts[0] + 7;
+        assert_eq!(check(&call), Some((1, Some(Some(rva)), Some(Some(true)))));
+
+        // The lea is in every block, but isn't where id 11 says it is.
+        let lea = descriptor(Some((11, 1)), "48 8d 05");
+        let rva = TEXT_RVA + starts[1] + 1;
+        assert_eq!(check(&lea), Some((3, Some(Some(rva)), Some(Some(false)))));
+
+        // Ids missing from the database are reported, and SE descriptors don't apply to AE.
+        assert_eq!(check(&descriptor(Some((12, 0)), "c3")), Some((2, Some(None), Some(None))));
+        assert_eq!(check(&descriptor(None, "c3")), None);
+
+        // Without a database, every descriptor is only counted.
+        let a = audit(&sa, TEXT_RVA, None, &lea).unwrap();
+        assert_eq!((a.matches, a.rva, a.expected), (3, None, None));
+    }
+
+    #[test]
+    fn proposals_are_the_shortest_unique_signature() {
+        let (text, starts) = build_text(&[&CODE_A, &CODE_B]);
+        let sa = SuffixArray::new(&text, 1);
+
+        // The RIP relative fields are wildcarded, so only the register of the mov tells the
+        // two blocks apart.
+        let sig = shortest_unique(&sa, starts[0], 1).unwrap();
+        assert_eq!(sig, masked_pattern(&CODE_A, 14));
+        assert!(sig.bytes()[3..7].iter().chain(sig.bytes()[8..12].iter()).all(|b| b.is_none()));
+        assert!(sig.bytes()[..3].iter().chain(sig.bytes()[12..].iter()).all(|b| b.is_some()));
+        assert_eq!(sa.count_pattern(&masked_pattern(&CODE_A, 13)), 2);
+
+        // Longer minimums are kept, and unique code needs no more than the minimum.
+        assert_eq!(shortest_unique(&sa, starts[0], 15).unwrap().len(), 15);
+        assert_eq!(shortest_unique(&sa, starts[0] + 12, 1).unwrap().len(), 2);
+
+        // Blocks which are the same for longer than a proposal have no unique signature.
+        let block = [&CODE_A[..], &[0xcc; MAX_PROPOSAL]].concat();
+        let (text, starts) = build_text(&[&block, &block]);
+        assert!(shortest_unique(&SuffixArray::new(&text, 1), starts[0], 1).is_none());
+    }
+}
@@ -0,0 +1,95 @@
+//!
+//! @file descriptor.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Reads the patcher descriptors out of a rust source file.
+//! @bug No known bugs.
+//!
+//! This is a simple scanner rather than a parser. It finds each GameLocation, and associates
+//! it with the closest name before it and the first signature after it, so it only handles
+//! descriptor arrays written in the style of lib/uncapper_core/src/hooks.rs.
+//!
+
+use crate::Pattern;
+
+/// The location and signature of a descriptor.
+#[derive(Clone, Debug)]
+pub struct SourceDescriptor {
+    pub name: String,
+    pub se: Option<(usize, usize)>,
+    pub ae: Option<(usize, usize)>,
+    pub sig: Pattern
+}
+
+impl SourceDescriptor {
+    /// Gets the (id, offset) location of the descriptor in the given database format.
+    pub fn loc(
+        &self,
+        format: u32
+    ) -> Option<(usize, usize)> {
+        if format == 1 { self.se } else { self.ae }
+    }
+}
+
+/// Parses an integer with an optional 0x prefix.
+fn parse_int(
+    s: &str
+) -> usize {
+    let s = s.trim();
+    match s.strip_prefix("0x") {
+        Some(hex) => usize::from_str_radix(hex, 16).unwrap(),
+        None => s.parse().unwrap()
+    }
+}
+
+/// Reads the descriptors in the given rust source.
+pub fn read_descriptors(
+    src: &str
+) -> Vec<SourceDescriptor> {
+    const LOC: &str = "GameLocation::";
+    const SIG: &str = "signature![";
+    const NAME: &str = "name: \"";
+
+    let mut res = Vec::new();
+    let mut pos = 0;
+    while let Some(found) = src[pos..].find(LOC) {
+        let start = pos + found;
+        let body_start = start + src[start..].find('{').unwrap();
+        let body_end = body_start + src[body_start..].find('}').unwrap();
+        let kind = src[start + LOC.len()..body_start].trim();
+        let field = |name: &str| -> usize {
+            src[body_start + 1..body_end].split(',').find_map(|f| {
+                let (k, v) = f.split_once(':')?;
+                if k.trim() == name { Some(parse_int(v)) } else { None }
+            }).unwrap()
+        };
+
+        let (se, ae) = match kind {
+            "Base" => (Some((field("se"), 0)), Some((field("ae"), 0))),
+            "Se" => (Some((field("id"), field("offset"))), None),
+            "Ae" => (None, Some((field("id"), field("offset")))),
+            "All" => (
+                Some((field("id_se"), field("offset_se"))),
+                Some((field("id_ae"), field("offset_ae")))
+            ),
+            _ => panic!("Unknown location kind {}", kind)
+        };
+
+        // The signature belongs to this location only if it comes before the next one.
+        let next = src[body_end..].find(LOC).map(|n| body_end + n).unwrap_or(src.len());
+        let sig = src[body_end..next].find(SIG).map(|s| {
+            let sig_start = body_end + s + SIG.len();
+            let sig_end = sig_start + src[sig_start..].find(';').unwrap();
+            Pattern::parse(&src[sig_start..sig_end]).unwrap()
+        }).unwrap_or_default();
+
+        let name = src[..start].rfind(NAME).map(|n| {
+            let n = n + NAME.len();
+            src[n..n + src[n..].find('"').unwrap()].to_string()
+        }).unwrap_or_default();
+
+        res.push(SourceDescriptor { name, se, ae, sig });
+        pos = body_end;
+    }
+
+    res
+}
@@ -0,0 +1,19 @@
+//!
+//! @file lib.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Offline tools for searching game code for signatures.
+//! @bug No known bugs.
+//!
+//! Unlike the signatures in skyrim_patcher, nothing here touches live game memory. The code
+//! being searched is always a plain byte slice, usually read from an executable on disk.
+//!
+
+mod descriptor;
+mod pattern;
+mod suffix;
+mod x86;
+
+pub use descriptor::*;
+pub use pattern::*;
+pub use suffix::*;
+pub use x86::*;
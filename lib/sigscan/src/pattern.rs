@@ -0,0 +1,103 @@
+//!
+//! @file pattern.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Masked byte patterns, matching the signatures used by the patcher.
+//! @bug No known bugs.
+//!
+
+/// A string of bytes, where any byte may be a wildcard.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct Pattern(Vec<Option<u8>>);
+
+impl Pattern {
+    /// Creates a new pattern from the given bytes, where None is a wildcard.
+    pub fn new(
+        bytes: Vec<Option<u8>>
+    ) -> Self {
+        Self(bytes)
+    }
+
+    /// Creates a pattern from hex bytes separated by whitespace or commas, where ? is a wildcard.
+    pub fn parse(
+        s: &str
+    ) -> Result<Self, ()> {
+        s.split(|c: char| c.is_whitespace() || (c == ',')).filter(|b| !b.is_empty()).map(|b| {
+            if b.starts_with('?') {
+                Ok(None)
+            } else {
+                u8::from_str_radix(b.strip_prefix("0x").unwrap_or(b), 16).map(Some).map_err(|_| ())
+            }
+        }).collect::<Result<Vec<_>, ()>>().map(Self)
+    }
+
+    /// Gets the bytes of the pattern.
+    pub fn bytes(
+        &self
+    ) -> &[Option<u8>] {
+        &self.0
+    }
+
+    /// Gets the length of the pattern.
+    pub fn len(
+        &self
+    ) -> usize {
+        self.0.len()
+    }
+
+    /// Checks if the pattern is empty.
+    pub fn is_empty(
+        &self
+    ) -> bool {
+        self.0.is_empty()
+    }
+
+    /// Checks if the pattern matches the start of the given code.
+    pub fn matches(
+        &self,
+        code: &[u8]
+    ) -> bool {
+        (code.len() >= self.0.len()) && self.0.iter().zip(code.iter()).all(|(p, b)| {
+            p.map(|p| p == *b).unwrap_or(true)
+        })
+    }
+
+    ///
+    /// Finds the longest run of bytes in the pattern without a wildcard.
+    ///
+    /// Returns the start of the run and its bytes. The run is empty if the pattern is entirely
+    /// made of wildcards.
+    ///
+    pub fn longest_fixed_run(
+        &self
+    ) -> (usize, Vec<u8>) {
+        let (mut best, mut start) = ((0, 0), 0);
+        for (i, b) in self.0.iter().enumerate() {
+            if b.is_none() {
+                start = i + 1;
+            } else if i + 1 - start > best.1 {
+                best = (start, i + 1 - start);
+            }
+        }
+
+        let run = self.0[best.0..best.0 + best.1].iter().map(|b| b.unwrap()).collect();
+        (best.0, run)
+    }
+}
+
+impl std::fmt::Display for Pattern {
+    /// Formats the pattern in the style of the signature! macro.
+    fn fmt(
+        &self,
+        f: &mut std::fmt::Formatter<'_>
+    ) -> Result<(), std::fmt::Error> {
+        write!(f, "signature![")?;
+        for (i, b) in self.0.iter().enumerate() {
+            let sep = if i == 0 { "" } else { ", " };
+            match b {
+                Some(b) => write!(f, "{}0x{:02x}", sep, b)?,
+                None => write!(f, "{}?", sep)?
+            }
+        }
+        write!(f, "; {}]", self.0.len())
+    }
+}
@@ -0,0 +1,206 @@
+//!
+//! @file suffix.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Truncated suffix array for counting pattern matches in game code.
+//! @bug No known bugs.
+//!
+//! The suffixes are only ordered by their first MAX_DEPTH bytes, which is far longer than any
+//! signature we use, and keeps construction cheap on the long runs of padding found in game
+//! executables. Construction buckets the suffixes by their first two bytes, and then sorts
+//! each bucket on its own thread.
+//!
+
+use std::sync::Mutex;
+
+use crate::Pattern;
+
+/// The number of bytes each suffix is sorted by.
+pub const MAX_DEPTH: usize = 64;
+
+/// The number of buckets suffixes are initially placed in, one for each two byte prefix.
+const NUM_BUCKETS: usize = 1 << 16;
+
+/// A suffix array over a block of code.
+pub struct SuffixArray<'a> {
+    text: &'a [u8],
+    sa: Vec<u32>
+}
+
+impl<'a> SuffixArray<'a> {
+    /// Builds a suffix array over the given code, using the given number of threads.
+    pub fn new(
+        text: &'a [u8],
+        threads: usize
+    ) -> Self {
+        assert!(text.len() < u32::MAX as usize);
+
+        let key = |i: usize| -> usize {
+            ((text[i] as usize) << 8) | (text.get(i + 1).copied().unwrap_or(0) as usize)
+        };
+
+        // Counting sort into buckets by the first two bytes.
+        let mut starts = vec![0usize; NUM_BUCKETS + 1];
+        for i in 0..text.len() {
+            starts[key(i) + 1] += 1;
+        }
+        for b in 0..NUM_BUCKETS {
+            starts[b + 1] += starts[b];
+        }
+
+        let mut sa = vec![0u32; text.len()];
+        let mut next = starts.clone();
+        for i in 0..text.len() {
+            let k = key(i);
+            sa[next[k]] = i as u32;
+            next[k] += 1;
+        }
+
+        // Hand out the buckets largest first, so one big bucket doesn't hold up the rest.
+        let mut buckets = Vec::new();
+        let mut rest = sa.as_mut_slice();
+        for b in 0..NUM_BUCKETS {
+            let (bucket, tail) = rest.split_at_mut(starts[b + 1] - starts[b]);
+            if bucket.len() > 1 {
+                buckets.push(bucket);
+            }
+            rest = tail;
+        }
+        buckets.sort_unstable_by_key(|b| std::cmp::Reverse(b.len()));
+
+        let queue = Mutex::new(buckets.into_iter());
+        std::thread::scope(|s| {
+            for _ in 0..threads.max(1) {
+                s.spawn(|| {
+                    loop {
+                        let Some(bucket) = queue.lock().unwrap().next() else { break };
+                        Self::sort_bucket(text, bucket);
+                    }
+                });
+            }
+        });
+
+        Self { text, sa }
+    }
+
+    ///
+    /// Sorts a bucket of suffixes which share their first two bytes.
+    ///
+    /// The suffixes are first sorted by the next eight bytes, which are packed into an integer
+    /// so most comparisons avoid touching the text. Only runs which tie on those bytes are then
+    /// compared in full.
+    ///
+    fn sort_bucket(
+        text: &[u8],
+        bucket: &mut [u32]
+    ) {
+        const KEY_START: usize = 2;
+        const KEY_LEN: usize = 8;
+
+        let key = |i: u32| -> u64 {
+            let mut b = [0u8; KEY_LEN];
+            let i = i as usize + KEY_START;
+            let avail = &text[text.len().min(i)..text.len().min(i + KEY_LEN)];
+            b[..avail.len()].copy_from_slice(avail);
+            u64::from_be_bytes(b)
+        };
+
+        let mut keyed: Vec<(u64, u32)> = bucket.iter().map(|i| (key(*i), *i)).collect();
+        keyed.sort_unstable();
+
+        let mut start = 0;
+        while start < keyed.len() {
+            let mut end = start + 1;
+            while (end < keyed.len()) && (keyed[end].0 == keyed[start].0) {
+                end += 1;
+            }
+
+            // Zero padding in the key can't tell a short suffix from real zeros, so full
+            // comparisons are needed for any tie.
+            if end - start > 1 {
+                keyed[start..end].sort_unstable_by(|a, b| {
+                    Self::prefix(text, a.1 as usize).cmp(Self::prefix(text, b.1 as usize))
+                });
+            }
+            start = end;
+        }
+
+        for (dst, (_, i)) in bucket.iter_mut().zip(keyed.into_iter()) {
+            *dst = i;
+        }
+    }
+
+    /// Gets the sorted prefix of a suffix.
+    fn prefix(
+        text: &[u8],
+        i: usize
+    ) -> &[u8] {
+        &text[i..text.len().min(i + MAX_DEPTH)]
+    }
+
+    /// Gets the text the array was built over.
+    pub fn text(
+        &self
+    ) -> &'a [u8] {
+        self.text
+    }
+
+    ///
+    /// Finds the positions of every occurrence of the given bytes.
+    ///
+    /// Only the first MAX_DEPTH bytes are searched for, so the caller must check any longer
+    /// pattern against the text.
+    ///
+    pub fn find(
+        &self,
+        needle: &[u8]
+    ) -> &[u32] {
+        let needle = &needle[..needle.len().min(MAX_DEPTH)];
+        let head = |i: &u32| {
+            let i = *i as usize;
+            &self.text[i..self.text.len().min(i + needle.len())]
+        };
+
+        let lo = self.sa.partition_point(|i| head(i) < needle);
+        let hi = lo + self.sa[lo..].partition_point(|i| head(i) <= needle);
+        &self.sa[lo..hi]
+    }
+
+    ///
+    /// Finds every position where the given pattern matches the text.
+    ///
+    /// The longest run of the pattern without wildcards is looked up in the array, and each
+    /// occurrence is then checked against the whole pattern.
+    ///
+    pub fn find_pattern(
+        &self,
+        pat: &Pattern
+    ) -> Vec<usize> {
+        let (run_start, run) = pat.longest_fixed_run();
+        if run.is_empty() {
+            return (0..(self.text.len() + 1).saturating_sub(pat.len())).collect();
+        }
+
+        let mut res: Vec<usize> = self.find(&run).iter().filter_map(|p| {
+            let start = (*p as usize).checked_sub(run_start)?;
+            if pat.matches(&self.text[start..]) { Some(start) } else { None }
+        }).collect();
+        res.sort_unstable();
+        res
+    }
+
+    /// Counts the positions where the given pattern matches the text.
+    pub fn count_pattern(
+        &self,
+        pat: &Pattern
+    ) -> usize {
+        let (run_start, run) = pat.longest_fixed_run();
+        if run.is_empty() {
+            return (self.text.len() + 1).saturating_sub(pat.len());
+        }
+
+        self.find(&run).iter().filter(|p| {
+            (**p as usize).checked_sub(run_start).map(|s| pat.matches(&self.text[s..]))
+                .unwrap_or(false)
+        }).count()
+    }
+}
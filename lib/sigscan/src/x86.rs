@@ -0,0 +1,433 @@
+//!
+//! @file x86.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Minimal x86-64 instruction length decoder.
+//! @bug Rare encodings (3DNow, XOP, AMX) are not decoded.
+//!
+//! The decoder finds the length of each instruction, and the location of any field which
+//! holds a RIP-relative displacement or a rel32 branch target. Those fields change whenever
+//! code or data moves between game versions, so they must be wildcarded in signatures.
+//!
+//! The opcode and operand bytes are also given, so that callers can work out which registers
+//! an instruction uses. Nothing else about the operands is decoded here.
+//!
+
+/// A decoded instruction.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub struct Insn {
+    /// The length of the instruction, in bytes.
+    pub len: usize,
+    /// The offset of a 4-byte field within the instruction which is relative to RIP.
+    pub rel32: Option<usize>,
+    /// The opcode map the opcode is in.
+    pub map: Map,
+    /// The opcode, without its map escape bytes.
+    pub op: u8,
+    /// The ModRM byte, if the instruction has one.
+    pub modrm: Option<u8>,
+    /// The SIB byte, if the instruction has one.
+    pub sib: Option<u8>,
+    /// The REX prefix, or 0 if there is none. The W, R, X, and B bits of a VEX or EVEX prefix
+    /// are given here as well.
+    pub rex: u8,
+    /// Whether the instruction had a VEX or EVEX prefix.
+    pub vex: bool,
+    /// Whether a 0x66 prefix was given, or implied by a VEX prefix.
+    pub opsize16: bool,
+    /// The last 0xf2 or 0xf3 prefix given, or implied by a VEX prefix, or 0 if there is none.
+    pub rep: u8,
+    /// The distance from the end of a relative branch to its target.
+    pub branch: Option<isize>
+}
+
+/// The opcode map an opcode was found in.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum Map {
+    Primary,
+    Map0f,
+    Map0f38,
+    Map0f3a
+}
+
+/// Checks if a byte is a legacy prefix.
+fn is_prefix(
+    b: u8
+) -> bool {
+    matches!(b, 0x26 | 0x2e | 0x36 | 0x3e | 0x64 | 0x65 | 0x66 | 0x67 | 0xf0 | 0xf2 | 0xf3)
+}
+
+///
+/// Gets whether a primary map opcode takes a ModRM byte, and the size of its immediate.
+///
+/// Returns None for opcodes which are invalid in 64-bit mode. The immediate size of 0xf6 and
+/// 0xf7 depends on the ModRM byte, and is handled by the caller.
+///
+fn primary_operands(
+    op: u8,
+    opsize16: bool,
+    rex_w: bool,
+    addr32: bool
+) -> Option<(bool, usize)> {
+    let immz = if opsize16 { 2 } else { 4 };
+    Some(match op {
+        0x00..=0x3f => match op & 0x07 {
+            0..=3 => (true, 0),
+            4 => (false, 1),
+            5 => (false, immz),
+            _ => return None
+        },
+        0x50..=0x5f => (false, 0),
+        0x63 => (true, 0),
+        0x68 => (false, immz),
+        0x69 => (true, immz),
+        0x6a => (false, 1),
+        0x6b => (true, 1),
+        0x6c..=0x6f => (false, 0),
+        0x70..=0x7f => (false, 1),
+        0x80 | 0x83 => (true, 1),
+        0x81 => (true, immz),
+        0x84..=0x8f => (true, 0),
+        0x90..=0x99 | 0x9b..=0x9f => (false, 0),
+        0xa0..=0xa3 => (false, if addr32 { 4 } else { 8 }),
+        0xa4..=0xa7 | 0xaa..=0xaf => (false, 0),
+        0xa8 => (false, 1),
+        0xa9 => (false, immz),
+        0xb0..=0xb7 => (false, 1),
+        0xb8..=0xbf => (false, if rex_w { 8 } else { immz }),
+        0xc0 | 0xc1 | 0xc6 => (true, 1),
+        0xc2 | 0xca => (false, 2),
+        0xc3 | 0xc9 | 0xcb | 0xcc | 0xcf => (false, 0),
+        0xc7 => (true, immz),
+        0xc8 => (false, 3),
+        0xcd => (false, 1),
+        0xd0..=0xd3 | 0xd8..=0xdf => (true, 0),
+        0xd7 => (false, 0),
+        0xe0..=0xe7 | 0xeb => (false, 1),
+        0xe8 | 0xe9 => (false, 4),
+        0xec..=0xef | 0xf1 | 0xf4 | 0xf5 | 0xf8..=0xfd => (false, 0),
+        0xf6 | 0xf7 | 0xfe | 0xff => (true, 0),
+        _ => return None
+    })
+}
+
+/// Gets whether a 0x0f map opcode takes a ModRM byte, and the size of its immediate.
+fn map0f_operands(
+    op: u8
+) -> Option<(bool, usize)> {
+    Some(match op {
+        0x04 | 0x0a | 0x0c | 0x24..=0x27 | 0x36 | 0x38..=0x3f | 0x7a | 0x7b => return None,
+        0x05..=0x09 | 0x0b | 0x0e | 0x30..=0x35 | 0x37 | 0x77 => (false, 0),
+        0x80..=0x8f => (false, 4),
+        0xa0..=0xa2 | 0xa8..=0xaa | 0xc8..=0xcf => (false, 0),
+        0x70..=0x73 | 0xa4 | 0xac | 0xba | 0xc2 | 0xc4..=0xc6 => (true, 1),
+        0x0f => (true, 1),
+        _ => (true, 0)
+    })
+}
+
+///
+/// Decodes the instruction at the start of the given code.
+///
+/// Returns None if the instruction is invalid, or runs past the end of the code.
+///
+pub fn decode(
+    code: &[u8]
+) -> Option<Insn> {
+    let mut i = 0;
+    let (mut opsize16, mut addr32, mut rep) = (false, false, 0);
+    while is_prefix(*code.get(i)?) {
+        opsize16 |= code[i] == 0x66;
+        addr32 |= code[i] == 0x67;
+        if matches!(code[i], 0xf2 | 0xf3) {
+            rep = code[i];
+        }
+        i += 1;
+    }
+
+    let mut rex = 0;
+    if (code[i] & 0xf0) == 0x40 {
+        rex = code[i];
+        i += 1;
+    }
+    let mut rex_w = (rex & 0x08) != 0;
+
+    // VEX and EVEX prefixes encode the opcode map, and are followed by a ModRM byte for every
+    // opcode except VZEROUPPER and VZEROALL.
+    let (map, op) = match *code.get(i)? {
+        0xc5 => (Map::Map0f, *code.get(i + 2)?),
+        0xc4 | 0x62 => {
+            let map = match code.get(i + 1)? & 0x07 {
+                1 => Map::Map0f,
+                2 => Map::Map0f38,
+                3 => Map::Map0f3a,
+                _ => return None
+            };
+            let len = if code[i] == 0xc4 { 3 } else { 4 };
+            (map, *code.get(i + len)?)
+        },
+        _ => (Map::Primary, code[i])
+    };
+
+    let is_vex = matches!(code[i], 0xc4 | 0xc5 | 0x62);
+    if is_vex {
+        // The R, X, and B bits are stored inverted, and the last byte before the opcode holds
+        // the implied prefix.
+        let (rxb, wpp) = match code[i] {
+            0xc5 => (((code[i + 1] >> 5) & 0x04) ^ 0x04, code[i + 1] & 0x03),
+            _ => (((code[i + 1] >> 5) & 0x07) ^ 0x07, code[i + 2])
+        };
+        rex_w = (code[i] != 0xc5) && ((wpp & 0x80) != 0);
+        rex = 0x40 | ((rex_w as u8) << 3) | rxb;
+        match wpp & 0x03 {
+            1 => opsize16 = true,
+            2 => rep = 0xf3,
+            3 => rep = 0xf2,
+            _ => ()
+        }
+    }
+
+    let (map, op, has_modrm, mut imm) = if is_vex {
+        i += match code[i] { 0xc5 => 3, 0xc4 => 4, _ => 5 };
+        let imm = match map {
+            Map::Map0f3a => 1,
+            Map::Map0f => map0f_operands(op)?.1,
+            _ => 0
+        };
+        (map, op, (map, op) != (Map::Map0f, 0x77), imm)
+    } else if op == 0x0f {
+        let next = *code.get(i + 1)?;
+        match next {
+            0x38 => { i += 3; (Map::Map0f38, *code.get(i - 1)?, true, 0) },
+            0x3a => { i += 3; (Map::Map0f3a, *code.get(i - 1)?, true, 1) },
+            _ => {
+                i += 2;
+                let (has_modrm, imm) = map0f_operands(next)?;
+                (Map::Map0f, next, has_modrm, imm)
+            }
+        }
+    } else {
+        i += 1;
+        let (has_modrm, imm) = primary_operands(op, opsize16, rex_w, addr32)?;
+        (map, op, has_modrm, imm)
+    };
+
+    let (mut rel32, mut modrm_byte, mut sib_byte) = (None, None, None);
+    if has_modrm {
+        let modrm = *code.get(i)?;
+        modrm_byte = Some(modrm);
+        let (md, reg, rm) = (modrm >> 6, (modrm >> 3) & 0x07, modrm & 0x07);
+        i += 1;
+
+        // The test forms of the group 3 opcodes take an immediate.
+        if (map == Map::Primary) && (reg <= 1) {
+            match op {
+                0xf6 => imm = 1,
+                0xf7 => imm = if opsize16 { 2 } else { 4 },
+                _ => ()
+            }
+        }
+
+        if md != 3 {
+            let mut disp = match md { 1 => 1, 2 => 4, _ => 0 };
+            if rm == 4 {
+                let sib = *code.get(i)?;
+                sib_byte = Some(sib);
+                i += 1;
+                if (md == 0) && ((sib & 0x07) == 5) {
+                    disp = 4;
+                }
+            } else if (md == 0) && (rm == 5) {
+                rel32 = Some(i);
+                disp = 4;
+            }
+            i += disp;
+        }
+    }
+
+    // Relative branches hold their target in the immediate.
+    let is_branch = ((map == Map::Primary) && matches!(op, 0xe8 | 0xe9))
+        || ((map == Map::Map0f) && (0x80..=0x8f).contains(&op));
+    let is_short_branch = (map == Map::Primary) && matches!(op, 0x70..=0x7f | 0xe0..=0xe3 | 0xeb);
+    if is_branch {
+        rel32 = Some(i);
+    }
+
+    let imm_pos = i;
+    i += imm;
+    if i > code.len() {
+        return None;
+    }
+
+    let branch = if is_branch {
+        Some(i32::from_le_bytes(code[imm_pos..i].try_into().unwrap()) as isize)
+    } else if is_short_branch {
+        Some(code[imm_pos] as i8 as isize)
+    } else {
+        None
+    };
+
+    Some(Insn {
+        len: i,
+        rel32,
+        map,
+        op,
+        modrm: modrm_byte,
+        sib: sib_byte,
+        rex,
+        vex: is_vex,
+        opsize16,
+        rep,
+        branch
+    })
+}
+
+///
+/// Builds a pattern from the code at the start of the given slice, wildcarding any RIP
+/// relative fields.
+///
+/// Instructions are decoded until at least len bytes are covered, and the pattern is then
+/// cut to len bytes. Decoding stops early at an invalid instruction, with the remaining bytes
+/// being left as-is.
+///
+pub fn masked_pattern(
+    code: &[u8],
+    len: usize
+) -> crate::Pattern {
+    let len = len.min(code.len());
+    let mut bytes: Vec<Option<u8>> = code[..len].iter().copied().map(Some).collect();
+    let mut pos = 0;
+    while pos < len {
+        let Some(insn) = decode(&code[pos..]) else { break };
+        if let Some(rel) = insn.rel32 {
+            for b in bytes.iter_mut().skip(pos + rel).take(4) {
+                *b = None;
+            }
+        }
+        pos += insn.len;
+    }
+
+    crate::Pattern::new(bytes)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Decodes the given code, which must be exactly one instruction.
+    fn decode_one(
+        code: &[u8]
+    ) -> Insn {
+        let insn = decode(code).unwrap();
+        assert_eq!(insn.len, code.len(), "{:02x?}", code);
+        insn
+    }
+
+    #[test]
+    fn decodes_modrm_sib_and_rex() {
+        // mov [rsp+8], rbx
+        let insn = decode_one(&[0x48, 0x89, 0x5c, 0x24, 0x08]);
+        assert_eq!((insn.map, insn.op, insn.rex), (Map::Primary, 0x89, 0x48));
+        assert_eq!((insn.modrm, insn.sib), (Some(0x5c), Some(0x24)));
+        assert_eq!((insn.rel32, insn.branch), (None, None));
+
+        // call r11
+        let insn = decode_one(&[0x41, 0xff, 0xd3]);
+        assert_eq!((insn.rex, insn.modrm, insn.sib), (0x41, Some(0xd3), None));
+
+        // nop dword [rax+rax]
+        let insn = decode_one(&[0x0f, 0x1f, 0x44, 0x00, 0x00]);
+        assert_eq!((insn.map, insn.op), (Map::Map0f, 0x1f));
+    }
+
+    #[test]
+    fn decodes_immediate_sizes() {
+        // mov rax, imm64
+        decode_one(&[0x48, 0xb8, 1, 2, 3, 4, 5, 6, 7, 8]);
+        // mov eax, imm32
+        decode_one(&[0xb8, 1, 2, 3, 4]);
+        // mov ax, imm16
+        assert!(decode_one(&[0x66, 0xb8, 1, 2]).opsize16);
+        // test ecx, imm32 and neg eax, which share an opcode.
+        decode_one(&[0xf7, 0xc1, 0xff, 0x00, 0x00, 0x00]);
+        decode_one(&[0xf7, 0xd8]);
+        // test byte [rcx], imm8
+        decode_one(&[0xf6, 0x01, 0x80]);
+        // mov eax, [moffs64] and mov eax, [moffs32]
+        decode_one(&[0xa1, 1, 2, 3, 4, 5, 6, 7, 8]);
+        decode_one(&[0x67, 0xa1, 1, 2, 3, 4]);
+        // ret imm16 and enter imm16, imm8
+        decode_one(&[0xc2, 0x08, 0x00]);
+        decode_one(&[0xc8, 0x10, 0x00, 0x00]);
+        // roundss xmm0, xmm1, imm8
+        decode_one(&[0x66, 0x0f, 0x3a, 0x0a, 0xc1, 0x04]);
+    }
+
+    #[test]
+    fn decodes_rip_relative_fields_and_branches() {
+        // movss xmm0, [rip+0x12345678]
+        let insn = decode_one(&[0xf3, 0x0f, 0x10, 0x05, 0x78, 0x56, 0x34, 0x12]);
+        assert_eq!((insn.rel32, insn.rep, insn.branch), (Some(4), 0xf3, None));
+
+        // call +0x10
+        let insn = decode_one(&[0xe8, 0x10, 0x00, 0x00, 0x00]);
+        assert_eq!((insn.rel32, insn.branch), (Some(1), Some(0x10)));
+
+        // je -0x100
+        let insn = decode_one(&[0x0f, 0x84, 0x00, 0xff, 0xff, 0xff]);
+        assert_eq!((insn.map, insn.rel32, insn.branch), (Map::Map0f, Some(2), Some(-0x100)));
+
+        // jmp short to itself, and jrcxz +5
+        assert_eq!(decode_one(&[0xeb, 0xfe]).branch, Some(-2));
+        let insn = decode_one(&[0xe3, 0x05]);
+        assert_eq!((insn.rel32, insn.branch), (None, Some(5)));
+
+        // lea rax, [rip+0]
+        assert_eq!(decode_one(&[0x48, 0x8d, 0x05, 0, 0, 0, 0]).rel32, Some(3));
+
+        // A SIB with no base is absolute, not RIP relative.
+        assert_eq!(decode_one(&[0x8b, 0x04, 0x25, 0, 0, 0, 0]).rel32, None);
+    }
+
+    #[test]
+    fn decodes_vex_and_evex() {
+        // vzeroupper has no ModRM byte.
+        let insn = decode_one(&[0xc5, 0xf8, 0x77]);
+        assert!(insn.vex && insn.modrm.is_none());
+
+        // vmovss xmm0, [rip+0]
+        let insn = decode_one(&[0xc5, 0xfa, 0x10, 0x05, 0, 0, 0, 0]);
+        assert_eq!((insn.map, insn.op, insn.rep, insn.rel32), (Map::Map0f, 0x10, 0xf3, Some(4)));
+
+        // vextractps eax, xmm0, 1
+        let insn = decode_one(&[0xc4, 0xe3, 0x79, 0x17, 0xc0, 0x01]);
+        assert_eq!((insn.map, insn.op, insn.opsize16), (Map::Map0f3a, 0x17, true));
+
+        // vbroadcastss xmm0, [rip+0]
+        let insn = decode_one(&[0xc4, 0xe2, 0x79, 0x18, 0x05, 0, 0, 0, 0]);
+        assert_eq!((insn.map, insn.rel32), (Map::Map0f38, Some(5)));
+
+        // vmovq r9, xmm0 sets W, and the inverted B bit.
+        let insn = decode_one(&[0xc4, 0xc1, 0xf9, 0x7e, 0xc1]);
+        assert_eq!(insn.rex, 0x49);
+
+        // vmovups zmm0, [rip+0]
+        let insn = decode_one(&[0x62, 0xf1, 0x7c, 0x48, 0x10, 0x05, 0, 0, 0, 0]);
+        assert_eq!((insn.map, insn.op, insn.rel32), (Map::Map0f, 0x10, Some(6)));
+    }
+
+    #[test]
+    fn rejects_invalid_and_truncated_code() {
+        // push es, which is invalid in 64-bit mode.
+        assert!(decode(&[0x06]).is_none());
+        // An undefined 0x0f opcode.
+        assert!(decode(&[0x0f, 0x04]).is_none());
+        // A call whose immediate is cut short.
+        assert!(decode(&[0xe8, 0x00, 0x00]).is_none());
+        // A ModRM which needs a missing SIB.
+        assert!(decode(&[0x8b, 0x04]).is_none());
+        // Only prefixes.
+        assert!(decode(&[0x66, 0xf3]).is_none());
+        assert!(decode(&[0x48]).is_none());
+        assert!(decode(&[]).is_none());
+    }
+}
@@ -0,0 +1,68 @@
+//!
+//! @file curves.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Vanilla skill curves, game settings, and workload parsing shared by the progression
+//!        tools.
+//! @bug No known bugs.
+//!
+
+use std::str::FromStr;
+
+use uncapper_core::skyrim::{SkillIterator, SKILL_COUNT};
+
+/// The skill use and improvement values of a skill, as set in its AVIF record.
+pub struct SkillCurve {
+    pub use_mult: f32,
+    pub use_offset: f32,
+    pub improve_mult: f32,
+    pub improve_offset: f32
+}
+
+/// The vanilla skill curves, in skill slot order.
+pub const SKILL_CURVES: [SkillCurve; SKILL_COUNT] = [
+    SkillCurve { use_mult: 6.3, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 5.95, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 9.3, use_offset: 0.0, improve_mult: 1.95, improve_offset: 0.0 },
+    SkillCurve { use_mult: 8.1, use_offset: 0.0, improve_mult: 1.95, improve_offset: 0.0 },
+    SkillCurve { use_mult: 0.25, use_offset: 300.0, improve_mult: 0.25, improve_offset: 300.0 },
+    SkillCurve { use_mult: 3.8, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 4.0, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 8.1, use_offset: 0.0, improve_mult: 0.25, improve_offset: 250.0 },
+    SkillCurve { use_mult: 45.0, use_offset: 10.0, improve_mult: 0.25, improve_offset: 300.0 },
+    SkillCurve { use_mult: 11.25, use_offset: 0.0, improve_mult: 0.5, improve_offset: 120.0 },
+    SkillCurve { use_mult: 0.75, use_offset: 0.0, improve_mult: 1.6, improve_offset: 65.0 },
+    SkillCurve { use_mult: 0.36, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 3.0, use_offset: 0.0, improve_mult: 3.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 2.1, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 1.35, use_offset: 0.0, improve_mult: 1.35, improve_offset: 0.0 },
+    SkillCurve { use_mult: 4.6, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 2.0, use_offset: 0.0, improve_mult: 2.0, improve_offset: 0.0 },
+    SkillCurve { use_mult: 900.0, use_offset: 0.0, improve_mult: 1.0, improve_offset: 170.0 }
+];
+
+// Vanilla game settings for character levels.
+pub const XP_LEVEL_UP_BASE: f32 = 75.0;
+pub const XP_LEVEL_UP_MULT: f32 = 25.0;
+
+// Vanilla game settings for skills and attributes.
+pub const SKILL_EXP_EXPONENT: f32 = 1.95;
+pub const XP_PER_SKILL_RANK: f32 = 1.0;
+pub const VANILLA_SKILL_CAP: f32 = 100.0;
+pub const VANILLA_ATTRIBUTE_GAIN: f32 = 10.0;
+pub const VANILLA_CARRY_WEIGHT_GAIN: f32 = 5.0;
+pub const LEGENDARY_THRESHOLD: f32 = 100.0;
+pub const LEGENDARY_SKILL_RESET_VALUE: f32 = 15.0;
+
+/// Parses a list of Skill:weight pairs.
+pub fn parse_weights(
+    value: &str
+) -> [u32; SKILL_COUNT] {
+    let mut weights = [0; SKILL_COUNT];
+    for pair in value.split(',') {
+        let (name, weight) = pair.split_once(':').expect("Weights must be given as Skill:W");
+        let skill = SkillIterator::new().find(|s| s.name().eq_ignore_ascii_case(name));
+        let skill = skill.unwrap_or_else(|| panic!("Unknown skill: {}", name));
+        weights[skill.skill_slot()] = u32::from_str(weight).unwrap();
+    }
+    weights
+}
@@ -0,0 +1,56 @@
+//!
+//! @file game.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Stands in for the game, so that the hooks can be driven outside of it.
+//! @bug No known bugs.
+//!
+//! The hooks are driven against the stand-in game of the uncapper, with the XP curves of the
+//! simulator.
+//!
+
+use skse64::version::CURRENT_RELEASE_RUNTIME;
+use uncapper_core::skyrim;
+use uncapper_core::skyrim::standin::{self, GameSettings, Natives};
+
+pub use standin::{base, current, level, set_base, set_level};
+
+/// The game settings the simulator runs with, which use the XP curves of the simulator.
+const SETTINGS: GameSettings = GameSettings {
+    xp_per_skill_rank: crate::curves::XP_PER_SKILL_RANK,
+    legendary_skill_reset_value: crate::curves::LEGENDARY_SKILL_RESET_VALUE,
+    ..GameSettings::VANILLA
+};
+
+///
+/// Points the plugin at the stand-in game, emulating the current release runtime.
+///
+/// Must be called once, before any hook is used. The simulator is single threaded, so the
+/// stand-in is never accessed concurrently.
+///
+pub fn install() {
+    standin::install(CURRENT_RELEASE_RUNTIME, SETTINGS, Natives::STAND_IN);
+}
+
+/// Begins capturing each hook call to a trace file, as the plugin would in game.
+#[cfg(feature = "trace_capture")]
+pub fn start_trace(
+    path: &std::path::Path
+) {
+    uncapper_core::trace::open(path, &uncapper_core::trace::TraceHeader {
+        runtime: CURRENT_RELEASE_RUNTIME,
+        settings: SETTINGS.to_array()
+    });
+}
+
+/// Fails to capture hook calls, as the capture code was not built.
+#[cfg(not(feature = "trace_capture"))]
+pub fn start_trace(
+    _path: &std::path::Path
+) {
+    panic!("Traces can only be captured when built with the trace_capture feature");
+}
+
+/// Gets the number of perk points the player has available.
+pub fn perk_pool() -> u32 {
+    skyrim::get_player_perk_pool().get() as u32
+}
@@ -0,0 +1,458 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Simulates character progression under a given uncapper configuration.
+//! @bug No known bugs.
+//!
+//! The simulator loads an INI through the settings module, then feeds a stream of skill uses
+//! through the same hook functions the game calls. Skill and character level-ups follow the
+//! vanilla formulas, so the results match what a player would see in game for the same
+//! sequence of skill uses.
+//!
+
+mod curves;
+mod game;
+
+use std::ffi::{c_int, OsString};
+use std::path::Path;
+use std::str::FromStr;
+use std::time::Instant;
+
+use curves::*;
+use uncapper_core::hooks;
+use uncapper_core::settings;
+use uncapper_core::skyrim::{ActorAttribute, SkillIterator, SKILL_COUNT};
+
+/// The formats the tables can be written in.
+#[derive(Copy, Clone, PartialEq, Eq)]
+enum Format {
+    Text,
+    Csv
+}
+
+/// The options given on the command line.
+struct Options {
+    path: OsString,
+    format: Format,
+    levels: u32,
+    max_events: u64,
+    seed: u64,
+    weights: [u32; SKILL_COUNT],
+    exp: f32,
+    events_per_hour: f64,
+    attributes: [u32; 3],
+    legendary: Option<u32>,
+    start_skill: f32,
+    trace: Option<OsString>
+}
+
+/// The state of the player at a level-up.
+struct LevelRow {
+    level: u32,
+    events: u64,
+    perks: u32,
+    health: f32,
+    magicka: f32,
+    stamina: f32,
+    carry_weight: f32,
+    skill_total: f32,
+    legendaries: u32
+}
+
+/// Progresses the stand-in player through a workload of skill uses.
+struct Simulator {
+    rng: u64,
+    skills: Vec<ActorAttribute>,
+    skill_weights: [u32; SKILL_COUNT],
+    attr_weights: [u32; 3],
+    exp: f32,
+    legendary: Option<u32>,
+    skill_exp: [f32; SKILL_COUNT],
+    level_exp: f32,
+    events: u64,
+    legendaries: u32,
+    rows: Vec<LevelRow>
+}
+
+/// The attributes which can be chosen at a level-up.
+const LEVEL_UP_CHOICES: [ActorAttribute; 3] = [
+    ActorAttribute::Health,
+    ActorAttribute::Magicka,
+    ActorAttribute::Stamina
+];
+
+///
+/// Simulates leveling a character with the given INI.
+///
+/// Usage: skill-sim [options] <ini>
+///
+/// Options:
+/// - --format=text|csv: Selects the format of the per-level table.
+/// - --levels=N: Stops once the character reaches level N. Defaults to 81.
+/// - --max-events=N: Stops after N skill uses, even if the level was not reached.
+/// - --seed=N: Seeds the choice of skills and attributes.
+/// - --weights=Skill:W,...: The relative frequency each skill is used with. Skills use the INI
+///   names, such as Marksman or SpeechCraft. Unlisted skills are never used, and every skill
+///   is used equally if this is not given.
+/// - --exp=F: The base experience of each skill use, before the skill use mult/offset.
+/// - --events-per-hour=F: The number of skill uses in an hour of play, for the hours column.
+/// - --attributes=H:M:S: The relative frequency of each level-up choice.
+/// - --legendary=N: Makes any skill legendary once it reaches level N, if the settings allow.
+/// - --start-skill=F: The level every skill starts at.
+/// - --trace=PATH: Captures each hook call to a trace file, which can be replayed with
+///   hook-replay. Requires the trace_capture feature.
+///
+fn main() {
+    let opts = parse_args();
+
+    game::install();
+    settings::init_uncached(Path::new(&opts.path));
+
+    if let Some(ref path) = opts.trace {
+        game::start_trace(Path::new(path));
+    }
+
+    let mut sim = Simulator::new(&opts);
+    let start = Instant::now();
+    sim.run(opts.levels, opts.max_events);
+    let elapsed = start.elapsed().as_secs_f64();
+
+    #[cfg(feature = "trace_capture")]
+    uncapper_core::trace::close();
+
+    print_table(&sim.rows, opts.format, opts.events_per_hour);
+    print_skills(opts.format);
+    eprintln!(
+        "Simulated {} skill uses in {:.3}s ({:.2}M uses/s)",
+        sim.events,
+        elapsed,
+        sim.events as f64 / elapsed / 1e6
+    );
+}
+
+/// Parses the command line, panicking on any malformed option.
+fn parse_args() -> Options {
+    let mut opts = Options {
+        path: OsString::new(),
+        format: Format::Text,
+        levels: 81,
+        max_events: 1_000_000_000,
+        seed: 0x5eed,
+        weights: [1; SKILL_COUNT],
+        exp: 1.0,
+        events_per_hour: 1800.0,
+        attributes: [1, 1, 1],
+        legendary: None,
+        start_skill: 15.0,
+        trace: None
+    };
+
+    let mut positional = Vec::new();
+    for arg in std::env::args_os().skip(1) {
+        let Some((key, value)) = arg.to_str().and_then(|s| s.split_once('=')) else {
+            positional.push(arg);
+            continue;
+        };
+
+        match key {
+            "--format" => opts.format = match value {
+                "text" => Format::Text,
+                "csv" => Format::Csv,
+                _ => panic!("Unknown format: {}", value)
+            },
+            "--levels" => opts.levels = u32::from_str(value).unwrap(),
+            "--max-events" => opts.max_events = u64::from_str(value).unwrap(),
+            "--seed" => opts.seed = u64::from_str(value).unwrap(),
+            "--weights" => opts.weights = parse_weights(value),
+            "--exp" => opts.exp = f32::from_str(value).unwrap(),
+            "--events-per-hour" => opts.events_per_hour = f64::from_str(value).unwrap(),
+            "--attributes" => {
+                let parts = value.split(':').map(|w| u32::from_str(w).unwrap());
+                let parts = parts.collect::<Vec<_>>();
+                opts.attributes = parts.try_into().expect("Attributes must be given as H:M:S");
+            },
+            "--legendary" => opts.legendary = Some(u32::from_str(value).unwrap()),
+            "--start-skill" => opts.start_skill = f32::from_str(value).unwrap(),
+            "--trace" => opts.trace = Some(OsString::from(value)),
+            _ => panic!("Unknown option: {}", key)
+        }
+    }
+
+    assert!(positional.len() == 1, "Usage: skill-sim [options] <ini>");
+    opts.path = positional.pop().unwrap();
+    assert!(opts.weights.iter().any(|w| *w > 0), "At least one skill must be used");
+    assert!(opts.attributes.iter().any(|w| *w > 0), "At least one attribute must be chosen");
+    opts
+}
+
+impl Simulator {
+    /// Creates a new simulator, and sets up the stand-in player for a new character.
+    fn new(
+        opts: &Options
+    ) -> Self {
+        game::set_level(1);
+        for skill in SkillIterator::new() {
+            game::set_base(skill, opts.start_skill);
+        }
+        for attr in LEVEL_UP_CHOICES.iter() {
+            game::set_base(*attr, 100.0);
+        }
+        game::set_base(ActorAttribute::CarryWeight, 300.0);
+
+        let mut sim = Self {
+            rng: if opts.seed == 0 { 0x9e3779b97f4a7c15 } else { opts.seed },
+            skills: SkillIterator::new().collect(),
+            skill_weights: [0; SKILL_COUNT],
+            attr_weights: [0; 3],
+            exp: opts.exp,
+            legendary: opts.legendary,
+            skill_exp: [0.0; SKILL_COUNT],
+            level_exp: 0.0,
+            events: 0,
+            legendaries: 0,
+            rows: Vec::new()
+        };
+
+        // Weights are stored as running totals, so a choice is a search for the first total
+        // above a random value.
+        let mut acc = 0;
+        for (total, w) in sim.skill_weights.iter_mut().zip(opts.weights.iter()) {
+            acc += *w;
+            *total = acc;
+        }
+        let mut acc = 0;
+        for (total, w) in sim.attr_weights.iter_mut().zip(opts.attributes.iter()) {
+            acc += *w;
+            *total = acc;
+        }
+
+        sim.record_level();
+        sim
+    }
+
+    /// Uses skills until the character reaches the given level, or the events run out.
+    fn run(
+        &mut self,
+        levels: u32,
+        max_events: u64
+    ) {
+        while (game::level() < levels) && (self.events < max_events) {
+            let weights = self.skill_weights;
+            let slot = self.choose(&weights);
+            self.use_skill(self.skills[slot]);
+            self.events += 1;
+        }
+    }
+
+    /// Gets the next random value, from a xorshift64* generator.
+    fn next_random(
+        &mut self
+    ) -> u64 {
+        self.rng ^= self.rng >> 12;
+        self.rng ^= self.rng << 25;
+        self.rng ^= self.rng >> 27;
+        self.rng.wrapping_mul(0x2545f4914f6cdd1d)
+    }
+
+    /// Chooses an index at random, given the running totals of the weight of each index.
+    fn choose(
+        &mut self,
+        totals: &[u32]
+    ) -> usize {
+        let pick = (self.next_random() % (*totals.last().unwrap() as u64)) as u32;
+        totals.partition_point(|t| *t <= pick)
+    }
+
+    /// Uses a skill once, applying any skill or character level-ups it causes.
+    fn use_skill(
+        &mut self,
+        skill: ActorAttribute
+    ) {
+        let slot = skill.skill_slot();
+        let curve = &SKILL_CURVES[slot];
+        let exp_base = curve.use_mult * self.exp;
+        let exp_offset = curve.use_offset;
+
+        self.skill_exp[slot] += if settings::is_skill_exp_enabled() {
+            hooks::improve_player_skill_points_hook(skill as c_int, exp_base, exp_offset)
+        } else {
+            exp_base + exp_offset
+        };
+
+        let cap = if settings::is_skill_cap_enabled() {
+            hooks::get_skill_cap_hook(skill as c_int)
+        } else {
+            VANILLA_SKILL_CAP
+        };
+
+        loop {
+            let level = game::base(skill);
+            let needed = curve.improve_mult * (level - 1.0).max(0.0).powf(SKILL_EXP_EXPONENT)
+                + curve.improve_offset;
+            if (level >= cap) || (self.skill_exp[slot] < needed) {
+                break;
+            }
+
+            self.skill_exp[slot] -= needed;
+            game::set_base(skill, level + 1.0);
+            self.skill_level_up(skill, level + 1.0);
+        }
+
+        if let Some(threshold) = self.legendary {
+            if (game::base(skill) >= threshold as f32) && self.can_legendary(skill) {
+                self.make_legendary(skill);
+            }
+        }
+    }
+
+    /// Gives the character the experience for a skill level-up.
+    fn skill_level_up(
+        &mut self,
+        skill: ActorAttribute,
+        level: f32
+    ) {
+        self.level_exp += if settings::is_level_exp_enabled() {
+            hooks::improve_level_exp_by_skill_level_hook(level, skill as c_int)
+        } else {
+            level
+        };
+
+        loop {
+            let needed = XP_LEVEL_UP_BASE + XP_LEVEL_UP_MULT * game::level() as f32;
+            if self.level_exp < needed {
+                break;
+            }
+
+            self.level_exp -= needed;
+            self.level_up();
+        }
+    }
+
+    /// Levels up the character, choosing an attribute and gaining perks.
+    fn level_up(
+        &mut self
+    ) {
+        game::set_level(game::level() + 1);
+
+        let weights = self.attr_weights;
+        let choice = LEVEL_UP_CHOICES[self.choose(&weights)];
+        if settings::is_attr_points_enabled() {
+            hooks::improve_attribute_when_level_up_hook(choice as c_int);
+        } else {
+            game::set_base(choice, game::base(choice) + VANILLA_ATTRIBUTE_GAIN);
+            if choice == ActorAttribute::Stamina {
+                let carry_weight = game::base(ActorAttribute::CarryWeight)
+                    + VANILLA_CARRY_WEIGHT_GAIN;
+                game::set_base(ActorAttribute::CarryWeight, carry_weight);
+            }
+        }
+
+        if settings::is_perk_points_enabled() {
+            hooks::modify_perk_pool_hook(1);
+        } else {
+            let pool = uncapper_core::skyrim::get_player_perk_pool();
+            pool.set(pool.get().saturating_add(1));
+        }
+
+        self.record_level();
+    }
+
+    /// Checks if the given skill can currently be made legendary.
+    fn can_legendary(
+        &self,
+        skill: ActorAttribute
+    ) -> bool {
+        if settings::is_legendary_enabled() {
+            hooks::check_condition_for_legendary_skill_hook(skill as c_int) >= LEGENDARY_THRESHOLD
+        } else {
+            game::base(skill) >= LEGENDARY_THRESHOLD
+        }
+    }
+
+    /// Makes the given skill legendary, resetting its level.
+    fn make_legendary(
+        &mut self,
+        skill: ActorAttribute
+    ) {
+        let level = game::base(skill);
+        let reset = if settings::is_legendary_enabled() {
+            hooks::legendary_reset_skill_level_hook(level)
+        } else {
+            LEGENDARY_SKILL_RESET_VALUE
+        };
+
+        game::set_base(skill, reset);
+        self.skill_exp[skill.skill_slot()] = 0.0;
+        self.legendaries += 1;
+    }
+
+    /// Records the state of the character at its current level.
+    fn record_level(
+        &mut self
+    ) {
+        self.rows.push(LevelRow {
+            level: game::level(),
+            events: self.events,
+            perks: game::perk_pool(),
+            health: game::current(ActorAttribute::Health),
+            magicka: game::current(ActorAttribute::Magicka),
+            stamina: game::current(ActorAttribute::Stamina),
+            carry_weight: game::current(ActorAttribute::CarryWeight),
+            skill_total: SkillIterator::new().map(game::base).sum(),
+            legendaries: self.legendaries
+        });
+    }
+}
+
+/// Prints the state of the character at each level.
+fn print_table(
+    rows: &[LevelRow],
+    format: Format,
+    events_per_hour: f64
+) {
+    if format == Format::Csv {
+        println!("level,events,hours,perks,health,magicka,stamina,carry_weight,skill_total,\
+                  legendaries");
+    } else {
+        println!(
+            "{:>5} {:>12} {:>9} {:>5} {:>7} {:>7} {:>7} {:>7} {:>7} {:>4}",
+            "Level", "Uses", "Hours", "Perks", "Health", "Magicka", "Stamina", "Carry", "Skills",
+            "Leg"
+        );
+    }
+
+    for row in rows.iter() {
+        let hours = row.events as f64 / events_per_hour;
+        if format == Format::Csv {
+            println!(
+                "{},{},{:.2},{},{},{},{},{},{},{}",
+                row.level, row.events, hours, row.perks, row.health, row.magicka, row.stamina,
+                row.carry_weight, row.skill_total, row.legendaries
+            );
+        } else {
+            println!(
+                "{:>5} {:>12} {:>9.2} {:>5} {:>7.0} {:>7.0} {:>7.0} {:>7.0} {:>7.0} {:>4}",
+                row.level, row.events, hours, row.perks, row.health, row.magicka, row.stamina,
+                row.carry_weight, row.skill_total, row.legendaries
+            );
+        }
+    }
+}
+
+/// Prints the final level of each skill.
+fn print_skills(
+    format: Format
+) {
+    println!();
+    if format == Format::Csv {
+        println!("skill,level");
+    }
+
+    for skill in SkillIterator::new() {
+        if format == Format::Csv {
+            println!("{},{}", skill.name(), game::base(skill));
+        } else {
+            println!("{:<12} {:>5.0}", skill.name(), game::base(skill));
+        }
+    }
+}
@@ -0,0 +1,763 @@
+//!
+//! @file sweep.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Evaluates character progression across many variants of an uncapper configuration.
+//! @bug No known bugs.
+//!
+//! Each variant is an INI file with some grid of fields overridden. The progression settings of
+//! each variant are expanded into dense tables by the settings module, and groups of LANES
+//! variants are packed together, so that each table entry holds one value per variant. Every
+//! variant in a group sees the same stream of skill uses, so the per-use math runs over whole
+//! lanes at once, and the groups themselves are spread across a pool of threads.
+//!
+//! The math follows the hooks and the skill simulator exactly; only the global settings and the
+//! stand-in player are replaced by the packed tables and per-lane state.
+//!
+
+mod curves;
+
+use std::ffi::OsString;
+use std::path::Path;
+use std::str::FromStr;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::Instant;
+
+use plugin_ini::Ini;
+use uncapper_core::settings::{self, ProgressionTable};
+use uncapper_core::skyrim::SKILL_COUNT;
+
+use curves::*;
+
+/// The number of variants which are evaluated together.
+const LANES: usize = 8;
+
+/// The number of level-up choices, and the number of values each choice changes.
+const CHOICES: usize = 3;
+const GAINS: usize = 4;
+
+/// A field which takes on each of the given values across the variants.
+struct GridAxis {
+    section: String,
+    field: String,
+    values: Vec<String>
+}
+
+/// A single configuration to be evaluated.
+struct Variant {
+    ini: usize,
+    values: Vec<usize>
+}
+
+/// The options given on the command line.
+struct Options {
+    paths: Vec<OsString>,
+    grid: Vec<GridAxis>,
+    hours: f64,
+    events_per_hour: f64,
+    perk_level: u32,
+    max_level: u32,
+    max_events: u64,
+    seed: u64,
+    weights: [u32; SKILL_COUNT],
+    exp: f32,
+    attributes: [u32; 3],
+    legendary: Option<u32>,
+    start_skill: f32,
+    threads: usize,
+    sort: Option<(usize, bool)>
+}
+
+/// The outcome of playing a single variant.
+#[derive(Copy, Clone, Default)]
+struct Outcome {
+    level: u32,
+    perks: u32,
+    legendaries: u32,
+    health: f32,
+    magicka: f32,
+    stamina: f32,
+    carry_weight: f32,
+    perk_level_events: Option<u64>,
+    perk_level_perks: u32
+}
+
+///
+/// The progression tables of a group of variants, with each entry holding one value per lane.
+///
+/// Tables by skill level hold skill_levels entries per skill slot, and tables by player level
+/// hold player_levels entries per skill slot. Enabled flags are folded in when the tables are
+/// packed, so disabled settings hold the vanilla values.
+///
+struct LaneTables {
+    skill_levels: usize,
+    player_levels: usize,
+    skill_caps: [[f32; LANES]; SKILL_COUNT],
+    skill_exp_base_by_skill: Vec<[f32; LANES]>,
+    skill_exp_offset_by_skill: Vec<[f32; LANES]>,
+    skill_exp_base_by_pc: Vec<[f32; LANES]>,
+    skill_exp_offset_by_pc: Vec<[f32; LANES]>,
+    level_exp_by_skill: Vec<[f32; LANES]>,
+    level_exp_by_pc: Vec<[f32; LANES]>,
+    perks: Vec<[u32; LANES]>,
+    attributes: Vec<[[[f32; LANES]; GAINS]; CHOICES]>,
+    legendary_level: [f32; LANES],
+    legendary_reset: [f32; LANES],
+    skill_exp_needed: Vec<f32>
+}
+
+/// The state of the players of a group of variants.
+struct Lanes<'a> {
+    opts: &'a Options,
+    tables: LaneTables,
+    rng: u64,
+    attr_rng: [u64; LANES],
+    skill_weights: [u32; SKILL_COUNT],
+    attr_weights: [u32; CHOICES],
+    skill_level: [[f32; LANES]; SKILL_COUNT],
+    skill_exp: [[f32; LANES]; SKILL_COUNT],
+    level: [u32; LANES],
+    level_exp: [f32; LANES],
+    perks: [u32; LANES],
+    legendaries: [u32; LANES],
+    attrs: [[f32; LANES]; GAINS],
+    events: u64,
+    outcomes: [Outcome; LANES]
+}
+
+/// The names of the outcome columns, in the order they are written.
+const OUTCOME_COLUMNS: [&str; 9] = [
+    "level_at_hours",
+    "perks_at_hours",
+    "legendaries_at_hours",
+    "health_at_hours",
+    "magicka_at_hours",
+    "stamina_at_hours",
+    "carry_weight_at_hours",
+    "hours_to_perk_level",
+    "perks_at_perk_level"
+];
+
+///
+/// Evaluates a grid of variants of the given INI files.
+///
+/// Usage: config-sweep [options] <ini>...
+///
+/// Every INI file is crossed with every combination of grid values, and one CSV row is written
+/// for each variant.
+///
+/// Options:
+/// - --grid=Section:Field=V1,V2,...: Adds an axis to the grid. Leveled fields use the level as
+///   the field name, such as --grid=PerksAtLevelUp:1=1,1.5,2.
+/// - --hours=F: The hours of play the at_hours columns are taken at. Defaults to 100.
+/// - --events-per-hour=F: The number of skill uses in an hour of play.
+/// - --perk-level=N: The level the perk_level columns are taken at. Defaults to 81.
+/// - --max-level=N: The highest level a character can reach. Defaults to 255.
+/// - --max-events=N: Stops after N skill uses, even if the perk level was not reached.
+///   Defaults to 20000000, as characters whose skills are capped may never reach it.
+/// - --seed=N: Seeds the choice of skills and attributes, which is shared by every variant.
+/// - --weights=Skill:W,...: The relative frequency each skill is used with.
+/// - --exp=F: The base experience of each skill use, before the skill use mult/offset.
+/// - --attributes=H:M:S: The relative frequency of each level-up choice.
+/// - --legendary=N: Makes any skill legendary once it reaches level N, if the settings allow.
+/// - --start-skill=F: The level every skill starts at.
+/// - --threads=N: The number of threads to evaluate variants on.
+/// - --sort=Column[:asc]: Sorts the rows by an outcome column, in descending order by default.
+///
+fn main() {
+    let opts = parse_args();
+
+    let inis = opts.paths.iter().map(|path| {
+        std::fs::read_to_string(Path::new(path)).unwrap_or_else(|_| {
+            panic!("Could not read INI file: {}", Path::new(path).display())
+        })
+    }).collect::<Vec<_>>();
+
+    let variants = make_variants(&opts);
+    let start = Instant::now();
+    let mut rows = run_variants(&opts, &inis, &variants);
+    let elapsed = start.elapsed().as_secs_f64();
+
+    if let Some((column, ascending)) = opts.sort {
+        rows.sort_by(|a, b| {
+            let order = outcome_value(&a.1, column).total_cmp(&outcome_value(&b.1, column));
+            if ascending { order } else { order.reverse() }
+        });
+    }
+
+    print_rows(&opts, &variants, &rows);
+
+    let batches = (variants.len() + LANES - 1) / LANES;
+    eprintln!(
+        "Evaluated {} variants in {} batches on {} threads in {:.3}s",
+        variants.len(),
+        batches,
+        opts.threads,
+        elapsed
+    );
+}
+
+/// Parses the command line, panicking on any malformed option.
+fn parse_args() -> Options {
+    let mut opts = Options {
+        paths: Vec::new(),
+        grid: Vec::new(),
+        hours: 100.0,
+        events_per_hour: 1800.0,
+        perk_level: 81,
+        max_level: 255,
+        max_events: 20_000_000,
+        seed: 0x5eed,
+        weights: [1; SKILL_COUNT],
+        exp: 1.0,
+        attributes: [1, 1, 1],
+        legendary: None,
+        start_skill: 15.0,
+        threads: std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1),
+        sort: None
+    };
+
+    for arg in std::env::args_os().skip(1) {
+        let Some((key, value)) = arg.to_str().and_then(|s| s.split_once('=')) else {
+            opts.paths.push(arg);
+            continue;
+        };
+
+        match key {
+            "--grid" => opts.grid.push(parse_axis(value)),
+            "--hours" => opts.hours = f64::from_str(value).unwrap(),
+            "--events-per-hour" => opts.events_per_hour = f64::from_str(value).unwrap(),
+            "--perk-level" => opts.perk_level = u32::from_str(value).unwrap(),
+            "--max-level" => opts.max_level = u32::from_str(value).unwrap(),
+            "--max-events" => opts.max_events = u64::from_str(value).unwrap(),
+            "--seed" => opts.seed = u64::from_str(value).unwrap(),
+            "--weights" => opts.weights = parse_weights(value),
+            "--exp" => opts.exp = f32::from_str(value).unwrap(),
+            "--attributes" => {
+                let parts = value.split(':').map(|w| u32::from_str(w).unwrap());
+                let parts = parts.collect::<Vec<_>>();
+                opts.attributes = parts.try_into().expect("Attributes must be given as H:M:S");
+            },
+            "--legendary" => opts.legendary = Some(u32::from_str(value).unwrap()),
+            "--start-skill" => opts.start_skill = f32::from_str(value).unwrap(),
+            "--threads" => opts.threads = usize::from_str(value).unwrap().max(1),
+            "--sort" => {
+                let (name, ascending) = match value.split_once(':') {
+                    Some((name, "asc")) => (name, true),
+                    Some((name, "desc")) => (name, false),
+                    Some(_) => panic!("Sort order must be asc or desc"),
+                    None => (value, false)
+                };
+                let column = OUTCOME_COLUMNS.iter().position(|c| *c == name);
+                let column = column.unwrap_or_else(|| panic!("Unknown column: {}", name));
+                opts.sort = Some((column, ascending));
+            },
+            _ => panic!("Unknown option: {}", key)
+        }
+    }
+
+    assert!(!opts.paths.is_empty(), "Usage: config-sweep [options] <ini>...");
+    assert!(opts.weights.iter().any(|w| *w > 0), "At least one skill must be used");
+    assert!(opts.attributes.iter().any(|w| *w > 0), "At least one attribute must be chosen");
+    assert!(opts.perk_level <= opts.max_level, "The perk level must be below the max level");
+    opts
+}
+
+/// Parses a Section:Field=V1,V2,... grid axis.
+fn parse_axis(
+    value: &str
+) -> GridAxis {
+    let (name, values) = value.split_once('=').expect("Grids must be given as Section:Field=...");
+    let (section, field) = name.rsplit_once(':').expect("Grids must be given as Section:Field");
+    GridAxis {
+        section: section.to_string(),
+        field: field.to_string(),
+        values: values.split(',').map(|v| v.trim().to_string()).collect()
+    }
+}
+
+/// Creates every combination of INI file and grid value.
+fn make_variants(
+    opts: &Options
+) -> Vec<Variant> {
+    let mut variants = Vec::new();
+    for ini in 0..opts.paths.len() {
+        let mut values = vec![0; opts.grid.len()];
+        'combos: loop {
+            variants.push(Variant { ini, values: values.clone() });
+
+            // Count through the combinations, with the last axis changing fastest.
+            for (axis, value) in opts.grid.iter().zip(values.iter_mut()).rev() {
+                *value += 1;
+                if *value < axis.values.len() {
+                    continue 'combos;
+                }
+                *value = 0;
+            }
+
+            break;
+        }
+    }
+    variants
+}
+
+///
+/// Evaluates every variant on a pool of threads.
+///
+/// Each thread takes the next group of LANES variants until none are left. The INI files are
+/// parsed by each thread, as they cannot be shared between threads.
+///
+fn run_variants(
+    opts: &Options,
+    inis: &[String],
+    variants: &[Variant]
+) -> Vec<(usize, Outcome)> {
+    let next = AtomicUsize::new(0);
+    let batches = (variants.len() + LANES - 1) / LANES;
+
+    let mut rows = std::thread::scope(|scope| {
+        let workers = (0..opts.threads.min(batches)).map(|_| scope.spawn(|| {
+            let defaults = settings::default_ini();
+            let mut rows = Vec::new();
+            loop {
+                let batch = next.fetch_add(1, Ordering::Relaxed);
+                if batch >= batches {
+                    break;
+                }
+
+                let start = batch * LANES;
+                let group = &variants[start..(start + LANES).min(variants.len())];
+                let tables = group.iter().map(|v| {
+                    settings::progression_table(&variant_ini(opts, inis, &defaults, v),
+                                                opts.max_level)
+                }).collect::<Vec<_>>();
+
+                let mut lanes = Lanes::new(opts, LaneTables::pack(&tables));
+                lanes.run();
+                for (i, outcome) in lanes.outcomes.iter().take(group.len()).enumerate() {
+                    rows.push((start + i, *outcome));
+                }
+            }
+            rows
+        })).collect::<Vec<_>>();
+
+        workers.into_iter().flat_map(|w| w.join().unwrap()).collect::<Vec<_>>()
+    });
+
+    rows.sort_by_key(|(i, _)| *i);
+    rows
+}
+
+///
+/// Builds the INI of the given variant.
+///
+/// The grid values are read first, so that the values in the INI file are only used for the
+/// fields they do not replace. Fields missing from both are then taken from the default INI,
+/// as they would be when the plugin loads.
+///
+fn variant_ini(
+    opts: &Options,
+    inis: &[String],
+    defaults: &Ini,
+    variant: &Variant
+) -> Ini {
+    let mut text = String::new();
+    for (axis, value) in opts.grid.iter().zip(variant.values.iter()) {
+        text += &format!("[{}]\n{} = {}\n", axis.section, axis.field, axis.values[*value]);
+    }
+
+    let mut ini = Ini::from_str(&text).expect("Grid values must form a valid INI");
+    let _ = ini.update(&Ini::from_str(&inis[variant.ini]).expect("Could not parse INI file"));
+    let _ = ini.update(defaults);
+    ini
+}
+
+impl LaneTables {
+    ///
+    /// Packs the tables of up to LANES variants together.
+    ///
+    /// Unused lanes repeat the first variant. Variants with lower skill caps than the rest of
+    /// the group have their last skill level entry repeated, which is never read as their skills
+    /// cannot pass their caps.
+    ///
+    fn pack(
+        tables: &[ProgressionTable]
+    ) -> Self {
+        assert!(!tables.is_empty() && (tables.len() <= LANES));
+        let lane = |l: usize| &tables[l.min(tables.len() - 1)];
+
+        let skill_levels = tables.iter().map(|t| t.max_skill_level).max().unwrap() as usize + 1;
+        let player_levels = tables[0].max_player_level as usize + 1;
+
+        let mut packed = Self {
+            skill_levels,
+            player_levels,
+            skill_caps: [[VANILLA_SKILL_CAP; LANES]; SKILL_COUNT],
+            skill_exp_base_by_skill: vec![[1.0; LANES]; SKILL_COUNT * skill_levels],
+            skill_exp_offset_by_skill: vec![[1.0; LANES]; SKILL_COUNT * skill_levels],
+            skill_exp_base_by_pc: vec![[1.0; LANES]; SKILL_COUNT * player_levels],
+            skill_exp_offset_by_pc: vec![[1.0; LANES]; SKILL_COUNT * player_levels],
+            level_exp_by_skill: vec![[1.0; LANES]; SKILL_COUNT * skill_levels],
+            level_exp_by_pc: vec![[1.0; LANES]; SKILL_COUNT * player_levels],
+            perks: vec![[1; LANES]; player_levels],
+            attributes: vec![[[[0.0; LANES]; GAINS]; CHOICES]; player_levels],
+            legendary_level: [LEGENDARY_THRESHOLD; LANES],
+            legendary_reset: [LEGENDARY_SKILL_RESET_VALUE; LANES],
+            skill_exp_needed: Vec::with_capacity(SKILL_COUNT * skill_levels)
+        };
+
+        for l in 0..LANES {
+            let t = lane(l);
+            assert!(t.max_player_level as usize + 1 == player_levels);
+            let t_skill_levels = t.max_skill_level as usize + 1;
+
+            for slot in 0..SKILL_COUNT {
+                if t.skill_caps_en {
+                    packed.skill_caps[slot][l] = t.skill_caps[slot];
+                }
+
+                for level in 0..skill_levels {
+                    let i = slot * skill_levels + level;
+                    let ti = slot * t_skill_levels + level.min(t_skill_levels - 1);
+                    if t.skill_exp_mults_en {
+                        packed.skill_exp_base_by_skill[i][l] = t.skill_exp_by_skill[ti].0;
+                        packed.skill_exp_offset_by_skill[i][l] = t.skill_exp_by_skill[ti].1;
+                    }
+                    if t.level_exp_mults_en {
+                        packed.level_exp_by_skill[i][l] = t.level_exp_by_skill[ti];
+                    }
+                }
+
+                for level in 0..player_levels {
+                    let i = slot * player_levels + level;
+                    if t.skill_exp_mults_en {
+                        packed.skill_exp_base_by_pc[i][l] = t.skill_exp_by_pc[i].0;
+                        packed.skill_exp_offset_by_pc[i][l] = t.skill_exp_by_pc[i].1;
+                    }
+                    if t.level_exp_mults_en {
+                        packed.level_exp_by_pc[i][l] = t.level_exp_by_pc[i];
+                    }
+                }
+            }
+
+            for level in 0..player_levels {
+                // The hook caps the perks given at a single level to the size of the pool.
+                if t.perk_points_en {
+                    packed.perks[level][l] = t.perks[level].min(0xFF);
+                }
+
+                let gains = &mut packed.attributes[level];
+                if t.attr_points_en {
+                    for (choice, (hp, mp, sp, cw)) in t.attributes[level].iter().enumerate() {
+                        gains[choice][0][l] = *hp;
+                        gains[choice][1][l] = *mp;
+                        gains[choice][2][l] = *sp;
+                        gains[choice][3][l] = *cw;
+                    }
+                } else {
+                    for choice in 0..CHOICES {
+                        gains[choice][choice][l] = VANILLA_ATTRIBUTE_GAIN;
+                    }
+                    gains[CHOICES - 1][GAINS - 1][l] = VANILLA_CARRY_WEIGHT_GAIN;
+                }
+            }
+
+            // Keeping the skill level is the same as resetting to an infinitely high level, as
+            // legendarying can never raise the level of a skill.
+            if t.legendary_en {
+                packed.legendary_level[l] = t.legendary_skill_level as f32;
+                packed.legendary_reset[l] = if t.legendary_keep_skill_level {
+                    f32::INFINITY
+                } else if t.legendary_skill_level_after == 0 {
+                    LEGENDARY_SKILL_RESET_VALUE
+                } else {
+                    t.legendary_skill_level_after as f32
+                };
+            }
+        }
+
+        for curve in SKILL_CURVES.iter() {
+            for level in 0..skill_levels {
+                let level = level as f32;
+                packed.skill_exp_needed.push(
+                    curve.improve_mult * (level - 1.0).max(0.0).powf(SKILL_EXP_EXPONENT)
+                        + curve.improve_offset
+                );
+            }
+        }
+
+        packed
+    }
+}
+
+impl<'a> Lanes<'a> {
+    /// Creates a new group of characters, one for each lane of the given tables.
+    fn new(
+        opts: &'a Options,
+        tables: LaneTables
+    ) -> Self {
+        let seed = if opts.seed == 0 { 0x9e3779b97f4a7c15 } else { opts.seed };
+        let mut lanes = Self {
+            opts,
+            tables,
+            rng: seed,
+            attr_rng: [seed ^ 0xa5a5a5a5a5a5a5a5; LANES],
+            skill_weights: [0; SKILL_COUNT],
+            attr_weights: [0; CHOICES],
+            skill_level: [[opts.start_skill; LANES]; SKILL_COUNT],
+            skill_exp: [[0.0; LANES]; SKILL_COUNT],
+            level: [1; LANES],
+            level_exp: [0.0; LANES],
+            perks: [0; LANES],
+            legendaries: [0; LANES],
+            attrs: [[100.0; LANES], [100.0; LANES], [100.0; LANES], [300.0; LANES]],
+            events: 0,
+            outcomes: [Outcome::default(); LANES]
+        };
+
+        // As in the simulator, weights are stored as running totals.
+        let mut acc = 0;
+        for (total, w) in lanes.skill_weights.iter_mut().zip(opts.weights.iter()) {
+            acc += *w;
+            *total = acc;
+        }
+        let mut acc = 0;
+        for (total, w) in lanes.attr_weights.iter_mut().zip(opts.attributes.iter()) {
+            acc += *w;
+            *total = acc;
+        }
+
+        lanes
+    }
+
+    ///
+    /// Uses skills until the hours have passed and every lane has reached the perk level, or
+    /// the events run out.
+    ///
+    fn run(
+        &mut self
+    ) {
+        let hours_events = (self.opts.hours * self.opts.events_per_hour) as u64;
+        let perk_level = self.opts.perk_level;
+
+        while self.events < self.opts.max_events {
+            if self.events == hours_events {
+                self.record_hours();
+            }
+
+            let done = self.level.iter().all(|l| (*l >= perk_level) || (*l >= self.max_level()));
+            if (self.events >= hours_events) && done {
+                break;
+            }
+
+            let pick = (next_random(&mut self.rng) % (*self.skill_weights.last().unwrap() as u64))
+                as u32;
+            self.use_skill(self.skill_weights.partition_point(|t| *t <= pick));
+            self.events += 1;
+        }
+
+        if self.events < hours_events {
+            self.record_hours();
+        }
+    }
+
+    /// Gets the highest level the characters can reach.
+    fn max_level(
+        &self
+    ) -> u32 {
+        (self.tables.player_levels - 1) as u32
+    }
+
+    /// Uses a skill once in every lane, applying any level-ups it causes.
+    fn use_skill(
+        &mut self,
+        slot: usize
+    ) {
+        let t = &self.tables;
+        let curve = &SKILL_CURVES[slot];
+        let exp_base = curve.use_mult * self.opts.exp;
+        let exp_offset = curve.use_offset;
+        let skill_row = slot * t.skill_levels;
+        let pc_row = slot * t.player_levels;
+
+        // Gain the experience in every lane, as improve_player_skill_points_hook() does.
+        let mut level_up = false;
+        for l in 0..LANES {
+            let level = (self.skill_level[slot][l] as usize).min(t.skill_levels - 1);
+            let si = skill_row + level;
+            let pi = pc_row + self.level[l] as usize;
+            let base_mult = t.skill_exp_base_by_skill[si][l] * t.skill_exp_base_by_pc[pi][l];
+            let offset_mult = t.skill_exp_offset_by_skill[si][l] * t.skill_exp_offset_by_pc[pi][l];
+            self.skill_exp[slot][l] += exp_base * base_mult + exp_offset * offset_mult;
+
+            let needed = t.skill_exp_needed[si];
+            level_up |= (self.skill_exp[slot][l] >= needed)
+                && (self.skill_level[slot][l] < t.skill_caps[slot][l]);
+        }
+
+        // Level-ups are rare, so they are handled one lane at a time.
+        if level_up {
+            for l in 0..LANES {
+                self.skill_level_ups(slot, l);
+            }
+        }
+
+        if let Some(threshold) = self.opts.legendary {
+            self.legendary(slot, threshold as f32);
+        }
+    }
+
+    /// Applies any skill level-ups the skill in the given lane has the experience for.
+    fn skill_level_ups(
+        &mut self,
+        slot: usize,
+        l: usize
+    ) {
+        loop {
+            let t = &self.tables;
+            let level = self.skill_level[slot][l];
+            let i = slot * t.skill_levels + (level as usize).min(t.skill_levels - 1);
+            let needed = t.skill_exp_needed[i];
+            if (level >= t.skill_caps[slot][l]) || (self.skill_exp[slot][l] < needed) {
+                break;
+            }
+
+            self.skill_exp[slot][l] -= needed;
+            self.skill_level[slot][l] = level + 1.0;
+
+            // The level exp mult is taken at the new skill level, as in the simulator.
+            let i = slot * t.skill_levels + ((level + 1.0) as usize).min(t.skill_levels - 1);
+            let pi = slot * t.player_levels + self.level[l] as usize;
+            let mult = t.level_exp_by_skill[i][l] * t.level_exp_by_pc[pi][l];
+            self.level_exp[l] += (level + 1.0) * mult * XP_PER_SKILL_RANK;
+            self.character_level_ups(l);
+        }
+    }
+
+    /// Applies any character level-ups the given lane has the experience for.
+    fn character_level_ups(
+        &mut self,
+        l: usize
+    ) {
+        loop {
+            let needed = XP_LEVEL_UP_BASE + XP_LEVEL_UP_MULT * self.level[l] as f32;
+            if (self.level_exp[l] < needed) || (self.level[l] >= self.max_level()) {
+                break;
+            }
+
+            self.level_exp[l] -= needed;
+            self.level[l] += 1;
+            let level = self.level[l] as usize;
+
+            // Each lane makes the same sequence of choices, so the variants can be compared.
+            let pick = next_random(&mut self.attr_rng[l])
+                % (*self.attr_weights.last().unwrap() as u64);
+            let choice = self.attr_weights.partition_point(|t| *t as u64 <= pick);
+            let gains = &self.tables.attributes[level][choice];
+            for (attr, gain) in self.attrs.iter_mut().zip(gains.iter()) {
+                attr[l] += gain[l];
+            }
+
+            self.perks[l] += self.tables.perks[level][l];
+
+            if self.level[l] == self.opts.perk_level {
+                self.outcomes[l].perk_level_events = Some(self.events);
+                self.outcomes[l].perk_level_perks = self.perks[l];
+            }
+        }
+    }
+
+    /// Makes the given skill legendary in every lane where it has reached the threshold.
+    fn legendary(
+        &mut self,
+        slot: usize,
+        threshold: f32
+    ) {
+        for l in 0..LANES {
+            let level = self.skill_level[slot][l];
+            if (level >= threshold) && (level >= self.tables.legendary_level[l]) {
+                self.skill_level[slot][l] = self.tables.legendary_reset[l].min(level);
+                self.skill_exp[slot][l] = 0.0;
+                self.legendaries[l] += 1;
+            }
+        }
+    }
+
+    /// Records the state of each lane once the requested hours have passed.
+    fn record_hours(
+        &mut self
+    ) {
+        for (l, outcome) in self.outcomes.iter_mut().enumerate() {
+            outcome.level = self.level[l];
+            outcome.perks = self.perks[l];
+            outcome.legendaries = self.legendaries[l];
+            outcome.health = self.attrs[0][l];
+            outcome.magicka = self.attrs[1][l];
+            outcome.stamina = self.attrs[2][l];
+            outcome.carry_weight = self.attrs[3][l];
+        }
+    }
+}
+
+/// Gets the next random value from a xorshift64* generator.
+fn next_random(
+    rng: &mut u64
+) -> u64 {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    rng.wrapping_mul(0x2545f4914f6cdd1d)
+}
+
+/// Gets the value of the given outcome column, for sorting.
+fn outcome_value(
+    outcome: &Outcome,
+    column: usize
+) -> f64 {
+    match column {
+        0 => outcome.level as f64,
+        1 => outcome.perks as f64,
+        2 => outcome.legendaries as f64,
+        3 => outcome.health as f64,
+        4 => outcome.magicka as f64,
+        5 => outcome.stamina as f64,
+        6 => outcome.carry_weight as f64,
+        7 => outcome.perk_level_events.map(|e| e as f64).unwrap_or(f64::INFINITY),
+        _ => outcome.perk_level_perks as f64
+    }
+}
+
+/// Writes the outcome of each variant as CSV.
+fn print_rows(
+    opts: &Options,
+    variants: &[Variant],
+    rows: &[(usize, Outcome)]
+) {
+    let mut header = String::from("variant,ini");
+    for axis in opts.grid.iter() {
+        header += &format!(",{}:{}", axis.section, axis.field);
+    }
+    for column in OUTCOME_COLUMNS.iter() {
+        header += &format!(",{}", column);
+    }
+    println!("{}", header);
+
+    for (i, outcome) in rows.iter() {
+        let variant = &variants[*i];
+        let mut row = format!("{},{}", i, Path::new(&opts.paths[variant.ini]).display());
+        for (axis, value) in opts.grid.iter().zip(variant.values.iter()) {
+            row += &format!(",{}", axis.values[*value]);
+        }
+
+        let hours = outcome.perk_level_events.map(|e| {
+            format!("{:.2}", e as f64 / opts.events_per_hour)
+        }).unwrap_or_default();
+        row += &format!(
+            ",{},{},{},{},{},{},{},{},{}",
+            outcome.level, outcome.perks, outcome.legendaries, outcome.health, outcome.magicka,
+            outcome.stamina, outcome.carry_weight, hours,
+            if outcome.perk_level_events.is_some() { outcome.perk_level_perks.to_string() }
+            else { String::new() }
+        );
+        println!("{}", row);
+    }
+}
@@ -1,12 +1,13 @@
 //!
 //! @file event.rs
 //! @author Andrew Spaulding (Kasplat)
-//! @brief Allows a plugin to register to listen to SKSE events.
+//! @brief Allows a plugin to register to listen to SKSE events, and to message other plugins.
 //! @bug No known bugs.
 //!
 
-use core::ffi::c_char;
+use core::ffi::{c_char, c_void};
 
+use later::Later;
 use racy_cell::RacyCell;
 
 use crate::plugin_api::{Message, SkseMessagingInterface, SkseInterface, InterfaceId};
@@ -16,13 +17,21 @@ const VEC_INIT: Vec<fn(&Message)> = Vec::new();
 static SKSE_HANDLERS: RacyCell<[Vec<fn(&Message)>; Message::SKSE_MAX]>
     = RacyCell::new([VEC_INIT; Message::SKSE_MAX]);
 
+/// The handlers for messages sent by other plugins, along with the message type they handle.
+static PLUGIN_HANDLERS: RacyCell<Vec<(u32, fn(&Message))>> = RacyCell::new(Vec::new());
+
+/// The messaging interface provided by SKSE.
+static MESSAGING: Later<&'static SkseMessagingInterface> = Later::new();
+
 /// Registers our listener wrapper to the SKSE message sender.
+#[cfg_attr(not(windows), allow(dead_code))]
 pub (in crate) fn init_listener(
     skse: &SkseInterface
 ) {
     unsafe {
         // SAFETY: The SkseInterface structure is provided by SKSE and is valid.
         let msg_if = (skse.query_interface)(InterfaceId::Messaging) as *mut SkseMessagingInterface;
+        MESSAGING.init(msg_if.as_ref().unwrap());
         ((*msg_if).register_listener)(
             plugin_api::handle(),
             "SKSE\0".as_bytes().as_ptr() as *const c_char,
@@ -42,7 +51,51 @@ pub fn register_listener(
     }
 }
 
+///
+/// Registers a new listener for a message of the given type, sent by any other plugin.
+///
+/// Messages sent by plugins which load after a handler is registered are only received if
+/// that plugin broadcasts them. Does nothing outside of the game.
+///
+pub fn register_plugin_listener(
+    msg_type: u32,
+    callback: fn(&Message)
+) {
+    unsafe {
+        // SAFETY: Plugin loading is single threaded.
+        let handlers = &mut *PLUGIN_HANDLERS.get();
+        if handlers.is_empty() && MESSAGING.is_init() {
+            // A null sender listens to every plugin.
+            (MESSAGING.register_listener)(plugin_api::handle(), std::ptr::null(), plugin_listener);
+        }
+        handlers.push((msg_type, callback));
+    }
+}
+
+///
+/// Sends a message to every plugin listening to this one.
+///
+/// The message is handled before this function returns, so the listeners may write their
+/// response into the data. Returns false if the message could not be sent, which is always
+/// the case outside of the game.
+///
+pub fn dispatch(
+    msg_type: u32,
+    data: *mut c_void,
+    len: u32
+) -> bool {
+    if !MESSAGING.is_init() {
+        return false;
+    }
+
+    unsafe {
+        // SAFETY: The messaging interface is provided by SKSE and is valid.
+        (MESSAGING.dispatch)(plugin_api::handle(), msg_type, data, len, std::ptr::null())
+    }
+}
+
 /// Handles a message from the skse plugin by forwarding it to the registered listener.
+#[cfg_attr(not(windows), allow(dead_code))]
 unsafe extern "system" fn skse_listener(
     msg: *mut Message
 ) {
@@ -55,3 +108,15 @@ unsafe extern "system" fn skse_listener(
         callback(msg);
     }
 }
+
+/// Handles a message from another plugin by forwarding it to the registered listeners.
+unsafe extern "system" fn plugin_listener(
+    msg: *mut Message
+) {
+    let msg = msg.as_ref().unwrap();
+    for (msg_type, callback) in (*PLUGIN_HANDLERS.get()).iter() {
+        if *msg_type == msg.msg_type {
+            callback(msg);
+        }
+    }
+}
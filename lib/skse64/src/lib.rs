@@ -9,13 +9,14 @@ pub use skse64_common::reloc;
 
 pub mod version;
 pub mod event;
-mod errors;
+#[cfg(windows)] mod errors;
 pub mod log;
+pub mod log_ring;
 pub mod util;
 pub mod plugin_api;
 #[cfg(feature = "trampoline")] pub mod trampoline;
 pub mod safe;
-pub mod loader;
+#[cfg(windows)] pub mod loader;
 
 // For macros.
 pub use core;
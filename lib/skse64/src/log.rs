@@ -5,24 +5,63 @@
 //!        name of the plugin in the version structure.
 //! @bug No known bugs.
 //!
+//! Outside of windows, such as when the patcher is run against a game image by a host tool,
+//! all messages are instead written to stderr.
+//!
+//! With the mmap_log feature, the log file is instead a ring buffer mapped into memory (see
+//! log_ring.rs), which keeps the most recent messages even if the game crashes.
+//!
+//! Messages which may repeat, such as a warning for each bad line of a config file, can be
+//! limited to a number of writes from their call site. Any further copies only increment the
+//! counter of that site, and are reported together by write_suppressed().
+//!
 
-use std::fmt;
+#[cfg(windows)] use std::fmt;
 use std::fmt::Arguments;
-use std::fs::File;
-use std::io::Write;
-use std::ffi::{CStr, OsString};
-use std::os::windows::ffi::{OsStrExt, OsStringExt};
-
-use later::Later;
-use racy_cell::RacyCell;
-use windows_sys::Win32::UI::WindowsAndMessaging::MessageBoxW;
+#[cfg(all(windows, not(feature = "mmap_log")))] use std::fs::File;
+#[cfg(all(windows, feature = "mmap_log"))] use std::fs::OpenOptions;
+#[cfg(all(windows, feature = "mmap_log"))] use std::os::windows::io::AsRawHandle;
+#[cfg(not(all(windows, feature = "mmap_log")))] use std::io::Write;
+use std::ptr::null_mut;
+use std::sync::atomic::{AtomicBool, AtomicPtr, AtomicUsize, Ordering};
+#[cfg(windows)] use std::ffi::{CStr, OsString};
+#[cfg(windows)] use std::os::windows::ffi::{OsStrExt, OsStringExt};
+
+#[cfg(windows)] use later::Later;
+#[cfg(windows)] use racy_cell::RacyCell;
+#[cfg(windows)] use windows_sys::Win32::UI::WindowsAndMessaging::MessageBoxW;
+#[cfg(windows)]
 use windows_sys::Win32::UI::Shell::{SHGetFolderPathW, CSIDL_MYDOCUMENTS, SHGFP_TYPE_CURRENT};
-use windows_sys::Win32::Foundation::MAX_PATH;
+#[cfg(windows)] use windows_sys::Win32::Foundation::MAX_PATH;
+#[cfg(all(windows, feature = "mmap_log"))]
+use windows_sys::Win32::System::Memory::{
+    CreateFileMappingW, MapViewOfFile, FILE_MAP_WRITE, PAGE_READWRITE
+};
 
 #[doc(hidden)]
+#[cfg(windows)]
 pub use windows_sys::Win32::UI::WindowsAndMessaging::{MB_ICONERROR, MB_ICONWARNING};
 
-use crate::loader::SKSEPlugin_Version;
+#[doc(hidden)]
+#[cfg(not(windows))]
+pub const MB_ICONERROR: u32 = 0x10;
+
+#[doc(hidden)]
+#[cfg(not(windows))]
+pub const MB_ICONWARNING: u32 = 0x30;
+
+#[cfg(windows)] use crate::loader::SKSEPlugin_Version;
+#[cfg(all(windows, feature = "mmap_log"))] use crate::log_ring::LogRing;
+
+/// The extension of the log file.
+#[cfg(all(windows, not(feature = "mmap_log")))]
+const LOG_EXTENSION: &str = "log";
+#[cfg(all(windows, feature = "mmap_log"))]
+const LOG_EXTENSION: &str = "log.ring";
+
+/// The number of bytes of messages the log ring holds.
+#[cfg(all(windows, feature = "mmap_log"))]
+const LOG_RING_CAPACITY: usize = 1 << 20;
 
 ///
 /// The structure used to format information before writing it to the log file.
@@ -32,6 +71,7 @@ use crate::loader::SKSEPlugin_Version;
 /// encoded in UTF-16, as this is the format that windows actually uses for its
 /// OS strings.
 ///
+#[cfg(windows)]
 struct LogBuf {
     buf: [u16; Self::BUF_SIZE],
     len: usize
@@ -45,15 +85,42 @@ pub enum LogType {
     Both(u32)
 }
 
+///
+/// A call site of a limited message, which counts how many times the message was logged.
+///
+/// Sites which have gone over their limit are added to a list, so that the copies which were
+/// dropped can be reported later.
+///
+#[doc(hidden)]
+pub struct LogSite {
+    location: &'static str,
+    template: &'static str,
+    limit: usize,
+    count: AtomicUsize,
+    listed: AtomicBool,
+    next: AtomicPtr<LogSite>
+}
+
+/// The list of call sites which have dropped messages.
+static SUPPRESSED_SITES: AtomicPtr<LogSite> = AtomicPtr::new(null_mut());
+
 /// The global file we log our output to.
+#[cfg(all(windows, not(feature = "mmap_log")))]
 static LOG_FILE: Later<RacyCell<File>> = Later::new();
 
+/// The global ring we log our output to, which is mapped to the log file.
+#[cfg(all(windows, feature = "mmap_log"))]
+static LOG_RING: Later<RacyCell<LogRing>> = Later::new();
+
 /// The global log buffer used to print our output.
+#[cfg(windows)]
 static LOG_BUFFER: RacyCell<LogBuf> = RacyCell::new(LogBuf::new());
 
 /// The OS-encoded name of our plugin.
+#[cfg(windows)]
 static OS_PLUGIN_NAME: Later<Vec<u16>> = Later::new();
 
+#[cfg(windows)]
 impl LogBuf {
     /// Large enough to contain any reasonably size line in a log file.
     const BUF_SIZE: usize = 8192;
@@ -120,6 +187,7 @@ impl LogBuf {
     }
 }
 
+#[cfg(windows)]
 impl fmt::Write for LogBuf {
     fn write_str(
         &mut self,
@@ -136,6 +204,7 @@ impl fmt::Write for LogBuf {
     }
 }
 
+#[cfg(windows)]
 impl LogType {
     //
     // Attempts to write a message to the requested log types.
@@ -173,12 +242,7 @@ impl LogType {
                     msg.as_ptr().cast(),
                     msg.len() * std::mem::size_of::<u16>()
                 );
-                if LOG_FILE.is_init() &&
-                        (*LOG_FILE.get()).write(msg).is_ok() {
-                    Ok(())
-                } else {
-                    Err(())
-                }
+                write_file(msg)
             },
             _ => Ok(())
         };
@@ -187,7 +251,122 @@ impl LogType {
     }
 }
 
+impl LogSite {
+    /// Creates a new call site, which logs its message at most limit times.
+    pub const fn new(
+        location: &'static str,
+        template: &'static str,
+        limit: usize
+    ) -> Self {
+        Self {
+            location,
+            template,
+            limit,
+            count: AtomicUsize::new(0),
+            listed: AtomicBool::new(false),
+            next: AtomicPtr::new(null_mut())
+        }
+    }
+
+    ///
+    /// Counts a message from this site, and checks if it should be written.
+    ///
+    /// Dropping a message costs only the increment of the counter.
+    ///
+    #[inline(always)]
+    pub fn enter(
+        &'static self
+    ) -> bool {
+        let count = self.count.fetch_add(1, Ordering::Relaxed);
+        if count == self.limit {
+            self.list();
+        }
+
+        count < self.limit
+    }
+
+    /// Adds this site to the list of sites which have dropped messages.
+    #[cold]
+    #[inline(never)]
+    fn list(
+        &'static self
+    ) {
+        if self.listed.swap(true, Ordering::Relaxed) {
+            return;
+        }
+
+        let mut head = SUPPRESSED_SITES.load(Ordering::Relaxed);
+        loop {
+            self.next.store(head, Ordering::Relaxed);
+            match SUPPRESSED_SITES.compare_exchange_weak(
+                head,
+                self as *const Self as *mut Self,
+                Ordering::Release,
+                Ordering::Relaxed
+            ) {
+                Ok(_) => break,
+                Err(h) => head = h
+            }
+        }
+    }
+}
+
+///
+/// Writes the number of messages each limited call site has dropped since the last call, and
+/// a summary line with the total, to the log file.
+///
+/// Nothing is written if no messages were dropped.
+///
+pub fn write_suppressed() {
+    let total = drain_suppressed(|site, dropped| {
+        write(LogType::File, format_args!(
+            "[SUPPRESSED] {} more messages from {}: \"{}\"",
+            dropped,
+            site.location,
+            site.template
+        ));
+    });
+
+    if total > 0 {
+        write(LogType::File, format_args!(
+            "[SUPPRESSED] {} repeated messages were not logged",
+            total
+        ));
+    }
+}
+
+///
+/// Gives each listed call site which has dropped messages since the last call to the report
+/// function, along with the number it dropped, then takes that number from its counter.
+///
+/// Returns the total number of dropped messages.
+///
+fn drain_suppressed(
+    mut report: impl FnMut(&'static LogSite, usize)
+) -> usize {
+    let mut total = 0;
+    let mut site = SUPPRESSED_SITES.load(Ordering::Acquire);
+    while let Some(s) = unsafe {
+        // SAFETY: Only call site statics are added to the list.
+        site.as_ref()
+    } {
+        let count = s.count.load(Ordering::Relaxed);
+        if count > s.limit {
+            // Subtract only what was reported, so messages dropped meanwhile aren't lost.
+            let dropped = count - s.limit;
+            report(s, dropped);
+            s.count.fetch_sub(dropped, Ordering::Relaxed);
+            total += dropped;
+        }
+
+        site = s.next.load(Ordering::Relaxed);
+    }
+
+    total
+}
+
 /// Opens a log file with the given name in the SKSE log directory.
+#[cfg(windows)]
 pub (in crate) fn open() {
     unsafe {
         // SAFETY: Single threaded library, protected from double init by skse.
@@ -208,24 +387,88 @@ pub (in crate) fn open() {
         OS_PLUGIN_NAME.init(OsString::from(plugin_name.to_string()).encode_wide().collect());
 
         <dyn fmt::Write>::write_fmt(&mut *LOG_BUFFER.get(), format_args!(
-            "\\My Games\\Skyrim Special Edition\\SKSE\\{}.log",
-            plugin_name
+            "\\My Games\\Skyrim Special Edition\\SKSE\\{}.{}",
+            plugin_name,
+            LOG_EXTENSION
         )).unwrap();
 
-        LOG_FILE.init(RacyCell::new(
-            File::create(&OsString::from_wide((*LOG_BUFFER.get()).as_bytes())).unwrap()
-        ));
+        open_file(&OsString::from_wide((*LOG_BUFFER.get()).as_bytes()));
 
         // Clear our file path.
         (*LOG_BUFFER.get()).clear();
+    }
+}
 
-        // Write the byte-order mark, so text editors know the file is UTF-16.
-        (*LOG_FILE.get()).write(&[0xFF, 0xFE]).unwrap();
+/// Creates the log file at the given path.
+#[cfg(all(windows, not(feature = "mmap_log")))]
+unsafe fn open_file(
+    path: &OsString
+) {
+    LOG_FILE.init(RacyCell::new(File::create(path).unwrap()));
+
+    // Write the byte-order mark, so text editors know the file is UTF-16.
+    (*LOG_FILE.get()).write(&[0xFF, 0xFE]).unwrap();
+}
+
+///
+/// Creates the log file at the given path, and maps a log ring to it.
+///
+/// The file and its mapping are never closed, so that the ring stays valid until the game
+/// exits.
+///
+#[cfg(all(windows, feature = "mmap_log"))]
+unsafe fn open_file(
+    path: &OsString
+) {
+    let file = OpenOptions::new().read(true).write(true).create(true).truncate(true).open(path);
+    let file = file.unwrap();
+    file.set_len(LogRing::file_size(LOG_RING_CAPACITY) as u64).unwrap();
+
+    let mapping = CreateFileMappingW(
+        file.as_raw_handle() as _,
+        std::ptr::null(),
+        PAGE_READWRITE,
+        0,
+        0,
+        std::ptr::null()
+    );
+    assert!(mapping != 0);
+
+    let view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    assert!(!view.is_null());
+
+    // SAFETY: The view is page aligned, and is only used by the ring.
+    LOG_RING.init(RacyCell::new(LogRing::new(view.cast(), LOG_RING_CAPACITY)));
+}
+
+/// Writes a message to the log file, if it is open.
+#[cfg(all(windows, not(feature = "mmap_log")))]
+unsafe fn write_file(
+    msg: &[u8]
+) -> Result<(), ()> {
+    if LOG_FILE.is_init() && (*LOG_FILE.get()).write(msg).is_ok() {
+        Ok(())
+    } else {
+        Err(())
+    }
+}
+
+/// Writes a message to the log ring, if it is open.
+#[cfg(all(windows, feature = "mmap_log"))]
+unsafe fn write_file(
+    msg: &[u8]
+) -> Result<(), ()> {
+    if LOG_RING.is_init() {
+        (*LOG_RING.get()).write(msg);
+        Ok(())
+    } else {
+        Err(())
     }
 }
 
 // Logs a message to the requested log types.
 #[doc(hidden)]
+#[cfg(windows)]
 pub fn write(
     log_type: LogType,
     args: Arguments<'_>
@@ -244,6 +487,7 @@ pub fn write(
 // Called from panic, so we have to be extra careful not to panic again.
 //
 #[doc(hidden)]
+#[cfg(windows)]
 pub fn fatal(
     log_type: LogType,
     args: Arguments<'_>
@@ -263,8 +507,44 @@ pub fn fatal(
     }
 }
 
+// Logs a message to stderr, as there is no log file or window outside of the game.
+#[doc(hidden)]
+#[cfg(not(windows))]
+pub fn write(
+    log_type: LogType,
+    args: Arguments<'_>
+) {
+    let _ = log_type;
+    let _ = writeln!(std::io::stderr(), "{}", args);
+}
+
+// Logs a fatal error to stderr.
+#[doc(hidden)]
+#[cfg(not(windows))]
+pub fn fatal(
+    log_type: LogType,
+    args: Arguments<'_>
+) {
+    write(log_type, args);
+}
+
 #[macro_export]
 macro_rules! skse_message {
+    ( $tmpl:literal $(, $arg:expr)* => limit $limit:expr ) => {
+        {
+            static SITE: $crate::log::LogSite = $crate::log::LogSite::new(
+                ::std::concat!(::std::file!(), ":", ::std::line!()),
+                $tmpl,
+                $limit
+            );
+            if SITE.enter() {
+                $crate::log::write(
+                    $crate::log::LogType::File,
+                    ::std::format_args!($tmpl $(, $arg)*)
+                );
+            }
+        }
+    };
     ( $($fmt:expr),* ) => {
         $crate::log::write($crate::log::LogType::File, ::std::format_args!($($fmt),*));
     };
@@ -317,3 +597,84 @@ macro_rules! skse_fatal {
 pub use skse_message;
 pub use skse_warning;
 pub use skse_fatal;
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    ///
+    /// Gets the messages each of the given sites dropped, as reported by drain_suppressed().
+    ///
+    /// Other tests may list their own sites at the same time, so only the given ones are kept.
+    ///
+    fn drain(
+        sites: &[&'static LogSite]
+    ) -> Vec<usize> {
+        let mut dropped = vec![0; sites.len()];
+        drain_suppressed(|site, count| {
+            if let Some(i) = sites.iter().position(|s| std::ptr::eq(*s, site)) {
+                dropped[i] += count;
+            }
+        });
+        dropped
+    }
+
+    /// Counts the times the given site appears in the list of suppressed sites.
+    fn times_listed(
+        site: &'static LogSite
+    ) -> usize {
+        let mut times = 0;
+        let mut next = SUPPRESSED_SITES.load(Ordering::Acquire);
+        while let Some(s) = unsafe {
+            // SAFETY: Only call site statics are added to the list.
+            next.as_ref()
+        } {
+            times += std::ptr::eq(s, site) as usize;
+            next = s.next.load(Ordering::Relaxed);
+        }
+        times
+    }
+
+    #[test]
+    fn messages_are_written_up_to_the_limit() {
+        static SITE: LogSite = LogSite::new("limit", "limit", 3);
+        assert!((0..3).all(|_| SITE.enter()));
+        assert_eq!(times_listed(&SITE), 0);
+        assert_eq!(drain(&[&SITE]), [0]);
+
+        assert!(!SITE.enter());
+        assert_eq!(times_listed(&SITE), 1);
+        assert_eq!(drain(&[&SITE]), [1]);
+    }
+
+    #[test]
+    fn sites_are_listed_once() {
+        static SITE: LogSite = LogSite::new("listed", "listed", 1);
+        assert!(SITE.enter());
+        for _ in 0..3 {
+            // Each report leaves the counter at the limit, so the site reaches it again.
+            assert!((0..4).all(|_| !SITE.enter()));
+            assert_eq!(drain(&[&SITE]), [4]);
+            assert_eq!(times_listed(&SITE), 1);
+        }
+    }
+
+    #[test]
+    fn only_reported_messages_are_taken_from_the_counter() {
+        static SITE: LogSite = LogSite::new("counter", "counter", 2);
+        (0..5).for_each(|_| { SITE.enter(); });
+
+        // Messages dropped while the site is reported must be left for the next report.
+        let mut reported = 0;
+        drain_suppressed(|site, count| {
+            if std::ptr::eq(site, &SITE) {
+                reported = count;
+                (0..2).for_each(|_| { SITE.enter(); });
+            }
+        });
+        assert_eq!(reported, 3);
+        assert_eq!(SITE.count.load(Ordering::Relaxed), 4);
+        assert_eq!(drain(&[&SITE]), [2]);
+        assert_eq!(drain(&[&SITE]), [0]);
+    }
+}
@@ -0,0 +1,333 @@
+//!
+//! @file log_ring.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Implements the ring buffer log format used by the memory mapped log backend.
+//! @bug No known bugs.
+//!
+//! The ring is stored in a file which is mapped into memory, so writing a message is only a
+//! copy into the mapping. Since the pages belong to the file, the OS keeps them even if the
+//! game crashes before they are flushed.
+//!
+//! The file starts with a header which holds the size of the ring and the range of it which
+//! contains whole messages. Each message is stored as its length, followed by its bytes, and
+//! may wrap around the end of the ring. The range is only widened once a message has been
+//! fully copied in, and is shrunk before any message is overwritten, so a reader never sees a
+//! partial message, even if the writer was stopped in the middle of one.
+//!
+//! Positions in the header count every byte ever written, and are wrapped to the ring only
+//! when accessing it.
+//!
+
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// The magic number at the start of a ring log file.
+const MAGIC: [u8; 8] = *b"SKSERING";
+
+/// The size of the header. Keeps the ring aligned, and leaves room for new fields.
+pub const HEADER_SIZE: usize = 64;
+
+// Offsets of the header fields, each of which is a little endian u64 after the magic.
+const CAPACITY_OFFSET: usize = 8;
+const START_OFFSET: usize = 16;
+const END_OFFSET: usize = 24;
+
+/// The size of the length before each message.
+const LEN_SIZE: usize = std::mem::size_of::<u32>();
+
+/// Writes messages into a ring mapped into memory.
+pub struct LogRing {
+    base: *mut u8,
+    capacity: usize,
+    start: u64,
+    end: u64
+}
+
+impl LogRing {
+    /// Gets the size of the file needed to hold a ring with the given capacity.
+    pub const fn file_size(
+        capacity: usize
+    ) -> usize {
+        HEADER_SIZE + capacity
+    }
+
+    ///
+    /// Creates a new, empty, ring in the given memory, which must be file_size(capacity)
+    /// bytes long.
+    ///
+    /// The memory must be 8 byte aligned, and must not be accessed by anything else while the
+    /// ring is in use.
+    ///
+    pub unsafe fn new(
+        base: *mut u8,
+        capacity: usize
+    ) -> Self {
+        assert!(capacity > LEN_SIZE);
+        assert!((base as usize) % std::mem::align_of::<AtomicU64>() == 0);
+
+        let ring = Self { base, capacity, start: 0, end: 0 };
+        std::ptr::write_bytes(base, 0, HEADER_SIZE);
+        std::ptr::copy_nonoverlapping(MAGIC.as_ptr(), base, MAGIC.len());
+        ring.field(CAPACITY_OFFSET).store((capacity as u64).to_le(), Ordering::Relaxed);
+        ring
+    }
+
+    ///
+    /// Writes a message to the ring, overwriting the oldest messages if there isn't room.
+    ///
+    /// Messages larger than the ring are cut short to fit.
+    ///
+    pub fn write(
+        &mut self,
+        msg: &[u8]
+    ) {
+        let msg = &msg[..std::cmp::min(msg.len(), self.capacity - LEN_SIZE)];
+        let len = (LEN_SIZE + msg.len()) as u64;
+
+        // Drop the messages which will be overwritten before touching them.
+        if self.end + len - self.start > self.capacity as u64 {
+            while self.end + len - self.start > self.capacity as u64 {
+                let mut old = [0; LEN_SIZE];
+                self.read(self.start, &mut old);
+                self.start += (LEN_SIZE + u32::from_le_bytes(old) as usize) as u64;
+            }
+            self.field(START_OFFSET).store(self.start.to_le(), Ordering::Release);
+        }
+
+        self.copy(self.end, &(msg.len() as u32).to_le_bytes());
+        self.copy(self.end + LEN_SIZE as u64, msg);
+        self.end += len;
+        self.field(END_OFFSET).store(self.end.to_le(), Ordering::Release);
+    }
+
+    /// Gets a header field of the ring.
+    fn field(
+        &self,
+        offset: usize
+    ) -> &AtomicU64 {
+        unsafe {
+            // SAFETY: The header is aligned and in bounds, and is only accessed through the ring.
+            &*self.base.add(offset).cast::<AtomicU64>()
+        }
+    }
+
+    /// Copies the given bytes into the ring at the given position, wrapping at the end.
+    fn copy(
+        &mut self,
+        pos: u64,
+        bytes: &[u8]
+    ) {
+        let off = (pos % self.capacity as u64) as usize;
+        let first = std::cmp::min(bytes.len(), self.capacity - off);
+        unsafe {
+            // SAFETY: Both copies stay within the ring, which we have exclusive access to.
+            let ring = self.base.add(HEADER_SIZE);
+            std::ptr::copy_nonoverlapping(bytes.as_ptr(), ring.add(off), first);
+            std::ptr::copy_nonoverlapping(bytes.as_ptr().add(first), ring, bytes.len() - first);
+        }
+    }
+
+    /// Reads bytes from the ring at the given position, wrapping at the end.
+    fn read(
+        &self,
+        pos: u64,
+        bytes: &mut [u8]
+    ) {
+        let off = (pos % self.capacity as u64) as usize;
+        let first = std::cmp::min(bytes.len(), self.capacity - off);
+        unsafe {
+            // SAFETY: Both copies stay within the ring, which we have exclusive access to.
+            let ring = self.base.add(HEADER_SIZE);
+            std::ptr::copy_nonoverlapping(ring.add(off), bytes.as_mut_ptr(), first);
+            std::ptr::copy_nonoverlapping(ring, bytes.as_mut_ptr().add(first), bytes.len() - first);
+        }
+    }
+}
+
+// SAFETY: The ring owns its memory, and can only be written through a mutable reference.
+unsafe impl Send for LogRing {}
+
+///
+/// Recovers the messages from the contents of a ring log file, oldest first.
+///
+/// The file may be taken from a process which stopped at any point while writing. Returns
+/// an error if the file isn't a ring, or if its header is inconsistent.
+///
+pub fn recover(
+    file: &[u8]
+) -> Result<Vec<Vec<u8>>, ()> {
+    let header = |offset: usize| u64::from_le_bytes(file[offset..offset + 8].try_into().unwrap());
+    if file.len() < HEADER_SIZE || file[..MAGIC.len()] != MAGIC {
+        return Err(());
+    }
+
+    let capacity = header(CAPACITY_OFFSET);
+    let (mut pos, end) = (header(START_OFFSET), header(END_OFFSET));
+    if capacity != (file.len() - HEADER_SIZE) as u64 || pos > end || end - pos > capacity {
+        return Err(());
+    }
+
+    let ring = &file[HEADER_SIZE..];
+    let read = |pos: u64, len: usize| {
+        (0..len as u64).map(|i| ring[((pos + i) % capacity) as usize]).collect::<Vec<_>>()
+    };
+
+    let mut msgs = Vec::new();
+    while pos < end {
+        if end - pos < LEN_SIZE as u64 {
+            return Err(());
+        }
+
+        let len = u32::from_le_bytes(read(pos, LEN_SIZE).try_into().unwrap()) as u64;
+        pos += LEN_SIZE as u64;
+        if end - pos < len {
+            return Err(());
+        }
+
+        msgs.push(read(pos, len as usize));
+        pos += len;
+    }
+
+    Ok(msgs)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// The capacity of the test rings. Small, so that a few messages wrap it.
+    const CAPACITY: usize = 64;
+
+    /// Holds the memory of a test ring, aligned as the ring requires.
+    struct RingFile {
+        words: Vec<u64>
+    }
+
+    impl RingFile {
+        /// Creates the zeroed memory of a ring with the test capacity.
+        fn new() -> Self {
+            Self { words: vec![0; LogRing::file_size(CAPACITY) / 8] }
+        }
+
+        /// Creates a new ring in the memory.
+        fn ring(
+            &mut self
+        ) -> LogRing {
+            // SAFETY: The memory is aligned, and is only used by this ring.
+            unsafe { LogRing::new(self.words.as_mut_ptr().cast(), CAPACITY) }
+        }
+
+        /// Gets the contents of the file.
+        fn bytes(
+            &mut self
+        ) -> &mut [u8] {
+            let len = self.words.len() * 8;
+            // SAFETY: The words are plain memory, which can be viewed as bytes.
+            unsafe { std::slice::from_raw_parts_mut(self.words.as_mut_ptr().cast(), len) }
+        }
+
+        /// Overwrites a header field, as a torn or corrupted write would.
+        fn set_field(
+            &mut self,
+            offset: usize,
+            val: u64
+        ) {
+            self.bytes()[offset..offset + 8].copy_from_slice(&val.to_le_bytes());
+        }
+    }
+
+    /// Gets the messages which should survive in the ring, oldest first.
+    fn newest(
+        msgs: &[Vec<u8>]
+    ) -> Vec<Vec<u8>> {
+        let mut used = 0;
+        let kept = msgs.iter().rev().take_while(|m| {
+            used += LEN_SIZE + m.len();
+            used <= CAPACITY
+        }).count();
+        msgs[msgs.len() - kept..].to_vec()
+    }
+
+    #[test]
+    fn wrapping_keeps_the_newest_messages_in_order() {
+        let mut file = RingFile::new();
+        let mut ring = file.ring();
+        let msgs: Vec<Vec<u8>> = (0..40).map(|i| format!("msg {}{}", i, "!".repeat(i % 7)))
+            .map(String::into_bytes).collect();
+
+        for (i, msg) in msgs.iter().enumerate() {
+            ring.write(msg);
+            assert_eq!(recover(file.bytes()), Ok(newest(&msgs[..=i])));
+        }
+    }
+
+    #[test]
+    fn oversized_messages_are_cut_short() {
+        let mut file = RingFile::new();
+        let mut ring = file.ring();
+        ring.write(b"first");
+        ring.write(&[b'x'; CAPACITY * 2]);
+        assert_eq!(recover(file.bytes()), Ok(vec![vec![b'x'; CAPACITY - LEN_SIZE]]));
+    }
+
+    #[test]
+    fn torn_writes_recover_whole_messages() {
+        let mut file = RingFile::new();
+        let mut ring = file.ring();
+        let msgs: Vec<Vec<u8>> = (0..6).map(|i| vec![b'a' + i; 10]).collect();
+        for msg in msgs.iter() {
+            ring.write(msg);
+        }
+
+        // The writer stopped after dropping the oldest messages and copying in a new one, but
+        // before publishing the end. The new message must not be seen.
+        let end = ring.end;
+        let torn = vec![b'z'; 20];
+        ring.write(&torn);
+        file.set_field(END_OFFSET, end);
+
+        let mut kept = newest(&[msgs.as_slice(), &[torn]].concat());
+        assert!(kept.pop().unwrap()[0] == b'z');
+        assert!(kept.len() < newest(&msgs).len());
+        assert_eq!(recover(file.bytes()), Ok(kept));
+    }
+
+    #[test]
+    fn inconsistent_headers_are_rejected() {
+        let mut file = RingFile::new();
+        let mut ring = file.ring();
+        ring.write(b"hello");
+        ring.write(b"world");
+        let (start, end) = (ring.start, ring.end);
+
+        file.set_field(START_OFFSET, end + 1);
+        assert_eq!(recover(file.bytes()), Err(()));
+
+        file.set_field(START_OFFSET, start);
+        file.set_field(END_OFFSET, start + CAPACITY as u64 + 1);
+        assert_eq!(recover(file.bytes()), Err(()));
+
+        // An end inside a message leaves it partial.
+        file.set_field(END_OFFSET, end - 1);
+        assert_eq!(recover(file.bytes()), Err(()));
+
+        file.set_field(END_OFFSET, end);
+        assert_eq!(recover(file.bytes()), Ok(vec![b"hello".to_vec(), b"world".to_vec()]));
+
+        file.bytes()[0] = b'X';
+        assert_eq!(recover(file.bytes()), Err(()));
+    }
+
+    #[test]
+    fn files_of_the_wrong_size_are_rejected() {
+        let mut file = RingFile::new();
+        let mut ring = file.ring();
+        ring.write(b"hello");
+
+        let bytes = file.bytes().to_vec();
+        assert_eq!(recover(&bytes), Ok(vec![b"hello".to_vec()]));
+        assert_eq!(recover(&bytes[..bytes.len() - 1]), Err(()));
+        assert_eq!(recover(&[bytes.as_slice(), &[0; 8]].concat()), Err(()));
+        assert_eq!(recover(&bytes[..HEADER_SIZE - 1]), Err(()));
+        assert_eq!(recover(&[]), Err(()));
+    }
+}
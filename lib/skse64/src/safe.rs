@@ -6,9 +6,11 @@
 //!
 
 use core::slice;
+#[cfg(windows)]
 use core::ffi::c_void;
 use core::mem::size_of;
 
+#[cfg(windows)]
 use windows_sys::Win32::System::Memory::{VirtualProtect, PAGE_EXECUTE_READWRITE};
 
 /// The maximum patch size. Chosen as our largest patch size is 16 (call absolute).
@@ -23,7 +25,7 @@ struct Patch {
 
 /// Encodes a x86-64 +rq register index.
 #[repr(u8)]
-#[derive(Copy, Clone)]
+#[derive(Copy, Clone, Debug)]
 pub enum Register {
     Rax = 0,
     Rcx = 1,
@@ -224,16 +226,45 @@ impl Flow {
     }
 }
 
+///
 /// Temporarily marks the given memory region for read/write, then calls the given fn.
+///
+/// Outside of windows, there is no game code to protect, so the fn is simply called.
+///
 pub unsafe fn use_region(
     addr: usize,
     size: usize,
     func: impl FnOnce()
 ) {
-    let mut old_prot: u32 = 0;
-    VirtualProtect(addr as *const c_void, size, PAGE_EXECUTE_READWRITE, &mut old_prot);
-    func();
-    VirtualProtect(addr as *const c_void, size, old_prot, &mut old_prot);
+    #[cfg(windows)] {
+        let mut old_prot: u32 = 0;
+        VirtualProtect(addr as *const c_void, size, PAGE_EXECUTE_READWRITE, &mut old_prot);
+        func();
+        VirtualProtect(addr as *const c_void, size, old_prot, &mut old_prot);
+    }
+
+    #[cfg(not(windows))] {
+        let _ = (addr, size);
+        func();
+    }
+}
+
+///
+/// Assembles the given instruction type, as it would be written to the given address.
+///
+/// Indirect flows are not supported, as assembling them requires writing to their trampoline.
+///
+pub fn assemble_flow(
+    addr: usize,
+    target: usize,
+    flow: Flow
+) -> Result<Vec<u8>, ()> {
+    if let Flow::CallIndirect(_) | Flow::JumpIndirect(_) = flow {
+        return Err(());
+    }
+
+    let patch = flow.as_patch(addr, target)?;
+    Ok(patch.buf.split_at(patch.len).0.to_vec())
 }
 
 ///
@@ -17,6 +17,23 @@ pub fn current_runtime() -> SkseVersion {
     *RUNNING_GAME_VERSION
 }
 
+///
+/// Sets the game version which a host tool stands in for.
+///
+/// Host tools are not started by the loader, which would otherwise set the running version,
+/// so they must call this before using anything which depends on it, such as the version
+/// offsets of game structures. Later calls must give the same version, and do nothing.
+///
+pub fn init_host_runtime(
+    version: SkseVersion
+) {
+    if RUNNING_GAME_VERSION.is_init() {
+        assert!(*RUNNING_GAME_VERSION == version);
+    } else {
+        RUNNING_GAME_VERSION.init(version);
+    }
+}
+
 /// Gets the currently running SKSE version.
 pub fn current_skse() -> SkseVersion {
     *RUNNING_SKSE_VERSION
@@ -7,3 +7,4 @@
 
 pub mod version;
 pub mod reloc;
+pub mod messaging;
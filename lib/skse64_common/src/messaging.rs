@@ -0,0 +1,58 @@
+//!
+//! @file messaging.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Sends requests between plugins, which are answered before the send returns.
+//! @bug No known bugs.
+//!
+//! Plugins share data by sending a request structure to any plugin which listens for it. The
+//! listeners fill in their answer before the send returns, so the requesting plugin knows
+//! right away if it must fall back to doing the work itself.
+//!
+//! The requests are sent by a Messenger, which is SKSE in the game. LocalBroker stands in for
+//! SKSE when the plugins are in the same process, such as in host tools.
+//!
+
+use std::sync::Mutex;
+
+/// Sends requests of the given type to every plugin which answers them.
+pub trait Messenger<R> {
+    /// Sends the request, returning once every listener has had the chance to answer it.
+    fn send(
+        &self,
+        request: &mut R
+    );
+}
+
+/// A listener of a LocalBroker, which may answer the requests it is given.
+type Handler<R> = Box<dyn Fn(&mut R) + Send + Sync>;
+
+/// Passes requests directly to the listeners registered in this process.
+pub struct LocalBroker<R> {
+    handlers: Mutex<Vec<Handler<R>>>
+}
+
+impl<R> LocalBroker<R> {
+    /// Creates a new broker, with no listeners.
+    pub const fn new() -> Self {
+        Self { handlers: Mutex::new(Vec::new()) }
+    }
+
+    /// Adds a listener, which is given every request sent through the broker.
+    pub fn listen(
+        &self,
+        handler: impl Fn(&mut R) + Send + Sync + 'static
+    ) {
+        self.handlers.lock().unwrap().push(Box::new(handler));
+    }
+}
+
+impl<R> Messenger<R> for LocalBroker<R> {
+    fn send(
+        &self,
+        request: &mut R
+    ) {
+        for handler in self.handlers.lock().unwrap().iter() {
+            handler(request);
+        }
+    }
+}
@@ -7,6 +7,7 @@
 
 use later::Later;
 
+#[cfg(windows)]
 use windows_sys::Win32::System::LibraryLoader::GetModuleHandleA;
 
 /// Holds a game address, which can be accessed by offset or address.
@@ -19,11 +20,17 @@ static BASE_ADDR: Later<usize> = Later::new();
 
 impl RelocAddr {
     #[doc(hidden)]
+    #[cfg(windows)]
     pub fn init_manager() {
         BASE_ADDR.init(unsafe { GetModuleHandleA(std::ptr::null_mut()) as usize });
     }
 
+    ///
     /// Gets the base address of the skyrim binary.
+    ///
+    /// Outside of the game (or before the manager is initialized) this is the preferred base
+    /// address of the binary.
+    ///
     pub fn base() -> usize {
         if BASE_ADDR.is_init() { *BASE_ADDR } else { 0x140000000 }
     }
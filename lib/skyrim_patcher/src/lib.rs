@@ -7,9 +7,17 @@
 
 mod patcher;
 mod sig;
+mod memory;
+mod shared;
+mod liveness;
+mod stub;
 
 pub use patcher::*;
 pub use sig::*;
+pub use memory::*;
+pub use shared::share_version_db;
+pub use liveness::{register_liveness, Liveness};
+pub use stub::assemble_table_load;
 
 /// Flattens multiple arrays of patches into a single array.
 pub fn flatten_patch_groups<const N: usize>(
@@ -0,0 +1,702 @@
+//!
+//! @file liveness.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Checks whether a register is read by the game code after a patch.
+//! @bug Only general purpose registers are tracked. The flags are not.
+//!
+//! Hooks which call through a register overwrite it, so the game code after the patch must
+//! not read the value it held before. This is checked by decoding forward from the end of the
+//! patch, following branches, until every path either overwrites the register or leaves the
+//! function.
+//!
+//! Calls and returns are handled with the Windows x64 calling convention: a call may read the
+//! argument registers and overwrites the volatile ones, and a return must preserve the
+//! non-volatile registers. Whether a call reads its arguments, or a return gives a value in
+//! RAX, isn't known, so those are reported as unknown rather than live.
+//!
+
+use sigscan::{decode, Insn, Map};
+
+use crate::memory::GameMemory;
+use crate::patcher::Register;
+
+/// The most instructions which are decoded when checking a register.
+const MAX_SCAN_INSNS: usize = 256;
+
+/// The longest an x86-64 instruction can be.
+const MAX_INSN_LEN: usize = 15;
+
+// Register masks, with one bit for each general purpose register.
+const RAX: u16 = 1 << 0;
+const RCX: u16 = 1 << 1;
+const RDX: u16 = 1 << 2;
+const RBP: u16 = 1 << 5;
+const RSI: u16 = 1 << 6;
+const RDI: u16 = 1 << 7;
+const ARGS: u16 = RCX | RDX | (1 << 8) | (1 << 9);
+const VOLATILE: u16 = RAX | RCX | RDX | (1 << 8) | (1 << 9) | (1 << 10) | (1 << 11);
+const NON_VOLATILE: u16 = !VOLATILE;
+
+/// Whether a register may be read before it is next written.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum Liveness {
+    /// Every path overwrites the register before reading it.
+    Dead,
+    /// The register is read at the given offset before it is overwritten.
+    Live(usize),
+    /// The scan couldn't follow the code at the given offset.
+    Unknown(usize)
+}
+
+/// Where execution goes after an instruction.
+#[derive(Copy, Clone, PartialEq, Eq)]
+enum Control {
+    Next,
+    Jump(usize),
+    Branch(usize),
+    Return,
+    Stop
+}
+
+/// The registers used by an instruction.
+struct Effects {
+    /// Registers which are read.
+    reads: u16,
+    /// Registers which may be read, depending on code we can't see.
+    maybe: u16,
+    /// Registers which are entirely overwritten.
+    writes: u16,
+    control: Control
+}
+
+/// The operands of an instruction, as registers.
+struct Operands {
+    /// The register in the reg field of the ModRM byte.
+    reg: u8,
+    /// The register in the rm field of the ModRM byte, if it isn't a memory operand.
+    rm: Option<u8>,
+    /// The registers used to address the memory operand, if there is one.
+    addr: u16,
+    /// The size of a general purpose operand, in bytes, if it isn't a byte operand.
+    size: u8,
+    /// Whether there is a REX prefix, which changes which registers byte operands refer to.
+    rex: bool
+}
+
+///
+/// Checks if the given register may be read by the code at the given offset before it is
+/// overwritten.
+///
+pub fn register_liveness(
+    mem: &dyn GameMemory,
+    offset: usize,
+    reg: Register
+) -> Liveness {
+    let bit = 1 << (reg as u8);
+    let mut paths = vec![offset];
+    let mut seen = vec![offset];
+    let mut budget = MAX_SCAN_INSNS;
+    let mut res = Liveness::Dead;
+
+    'paths: while let Some(mut pc) = paths.pop() {
+        loop {
+            if budget == 0 {
+                return Liveness::Unknown(pc);
+            }
+            budget -= 1;
+
+            let Some(insn) = read_insn(mem, pc) else {
+                res = Liveness::Unknown(pc);
+                continue 'paths;
+            };
+            let Some(fx) = effects(&insn, pc) else {
+                res = Liveness::Unknown(pc);
+                continue 'paths;
+            };
+
+            if (fx.reads & bit) != 0 {
+                return Liveness::Live(pc);
+            } else if (fx.maybe & bit) != 0 {
+                res = Liveness::Unknown(pc);
+                continue 'paths;
+            } else if (fx.writes & bit) != 0 {
+                continue 'paths;
+            }
+
+            match fx.control {
+                Control::Next => pc += insn.len,
+                Control::Jump(target) => {
+                    if seen.contains(&target) { continue 'paths; }
+                    seen.push(target);
+                    pc = target;
+                },
+                Control::Branch(target) => {
+                    if !seen.contains(&target) {
+                        seen.push(target);
+                        paths.push(target);
+                    }
+                    pc += insn.len;
+                },
+                Control::Return => continue 'paths,
+                Control::Stop => {
+                    res = Liveness::Unknown(pc);
+                    continue 'paths;
+                }
+            }
+        }
+    }
+
+    res
+}
+
+/// Decodes the instruction at the given offset.
+fn read_insn(
+    mem: &dyn GameMemory,
+    offset: usize
+) -> Option<Insn> {
+    // The last instruction in the image may be shorter than the longest instruction.
+    let code = (1..=MAX_INSN_LEN).rev().find_map(|len| mem.read(offset, len).ok())?;
+    decode(&code)
+}
+
+///
+/// Gets the registers used by the given instruction, at the given offset.
+///
+/// Returns None for any instruction whose register use isn't known.
+///
+fn effects(
+    insn: &Insn,
+    offset: usize
+) -> Option<Effects> {
+    let mut fx = Effects { reads: 0, maybe: 0, writes: 0, control: Control::Next };
+    let ops = Operands::new(insn);
+    let target = insn.branch.map(|b| (offset + insn.len).wrapping_add_signed(b));
+    let reg = insn.op & 0x07 | ((insn.rex & 0x01) << 3);
+    let ext = insn.modrm.map(|m| (m >> 3) & 0x07).unwrap_or(0);
+
+    if insn.vex {
+        return vex_effects(insn, &ops, fx);
+    }
+
+    match (insn.map, insn.op) {
+        (Map::Primary, 0x00..=0x3f) => {
+            let byte = (insn.op & 0x01) == 0;
+            let cmp = (insn.op >> 3) == 7;
+            match insn.op & 0x07 {
+                0 | 1 => {
+                    // XOR and SUB of a register with itself only writes it.
+                    let zero = matches!(insn.op >> 3, 5 | 6) && (ops.rm == Some(ops.reg));
+                    if !zero { fx.reads |= ops.rm_read(byte) | ops.reg_read(byte); }
+                    if !cmp { ops.rm_write(&mut fx, byte); }
+                },
+                2 | 3 => {
+                    let zero = matches!(insn.op >> 3, 5 | 6) && (ops.rm == Some(ops.reg));
+                    if !zero { fx.reads |= ops.rm_read(byte) | ops.reg_read(byte); }
+                    if !cmp { ops.reg_write(&mut fx, byte); }
+                },
+                _ => {
+                    fx.reads |= RAX;
+                    if !cmp { fx.write(0, if (insn.op & 0x01) == 0 { 1 } else { ops.size }); }
+                }
+            }
+        },
+        (Map::Primary, 0x50..=0x57) => fx.reads |= 1 << reg,
+        (Map::Primary, 0x58..=0x5f) => fx.writes |= 1 << reg,
+        (Map::Primary, 0x63) | (Map::Primary, 0x69) | (Map::Primary, 0x6b) => {
+            fx.reads |= ops.rm_read(false);
+            ops.reg_write(&mut fx, false);
+        },
+        (Map::Primary, 0x68) | (Map::Primary, 0x6a) => (),
+        (Map::Primary, 0x70..=0x7f) => fx.control = Control::Branch(target?),
+        (Map::Primary, 0x80..=0x83) => {
+            let byte = insn.op != 0x81 && insn.op != 0x83;
+            fx.reads |= ops.rm_read(byte);
+            if ext != 7 { ops.rm_write(&mut fx, byte); }
+        },
+        (Map::Primary, 0x84..=0x87) => {
+            let byte = (insn.op & 0x01) == 0;
+            fx.reads |= ops.rm_read(byte) | ops.reg_read(byte);
+        },
+        (Map::Primary, 0x88..=0x8b) => {
+            let byte = (insn.op & 0x01) == 0;
+            if insn.op <= 0x89 {
+                fx.reads |= ops.reg_read(byte) | ops.addr;
+                ops.rm_write(&mut fx, byte);
+            } else {
+                fx.reads |= ops.rm_read(byte);
+                ops.reg_write(&mut fx, byte);
+            }
+        },
+        (Map::Primary, 0x8d) => {
+            fx.reads |= ops.addr;
+            ops.reg_write(&mut fx, false);
+        },
+        (Map::Primary, 0x8f) if ext == 0 => ops.rm_write(&mut fx, false),
+        (Map::Primary, 0x90) if (insn.rex & 0x01) == 0 => (),
+        (Map::Primary, 0x90..=0x97) => fx.reads |= RAX | (1 << reg),
+        (Map::Primary, 0x98) => fx.reads |= RAX,
+        (Map::Primary, 0x99) => {
+            fx.reads |= RAX;
+            fx.write(2, ops.size);
+        },
+        (Map::Primary, 0x9b..=0x9d) => (),
+        (Map::Primary, 0x9e) | (Map::Primary, 0x9f) | (Map::Primary, 0xa8)
+            | (Map::Primary, 0xa9) => fx.reads |= RAX,
+        (Map::Primary, 0xa4..=0xa7) | (Map::Primary, 0xaa..=0xaf) => {
+            fx.reads |= RAX | RCX | RSI | RDI;
+        },
+        (Map::Primary, 0xb0..=0xb7) => fx.write(byte_reg(reg, insn.rex != 0), 1),
+        (Map::Primary, 0xb8..=0xbf) => fx.write(reg, ops.size),
+        (Map::Primary, 0xc0) | (Map::Primary, 0xc1) | (Map::Primary, 0xd0..=0xd3) => {
+            let byte = (insn.op & 0x01) == 0;
+            fx.reads |= ops.rm_read(byte) | if insn.op >= 0xd2 { RCX } else { 0 };
+            ops.rm_write(&mut fx, byte);
+        },
+        (Map::Primary, 0xc2) | (Map::Primary, 0xc3) => {
+            fx.reads |= NON_VOLATILE;
+            fx.maybe |= RAX;
+            fx.control = Control::Return;
+        },
+        (Map::Primary, 0xc6) | (Map::Primary, 0xc7) if ext == 0 => {
+            ops.rm_write(&mut fx, insn.op == 0xc6);
+        },
+        (Map::Primary, 0xc9) => fx.reads |= RBP,
+        (Map::Primary, 0xd8..=0xdf) => {
+            // Only FNSTSW AX writes a general purpose register.
+            if insn.modrm == Some(0xe0) && insn.op == 0xdf { fx.reads |= RAX; }
+            fx.reads |= ops.addr;
+        },
+        (Map::Primary, 0xe0..=0xe3) => {
+            fx.reads |= RCX;
+            fx.control = Control::Branch(target?);
+        },
+        (Map::Primary, 0xe8) => fx.call(),
+        (Map::Primary, 0xe9) | (Map::Primary, 0xeb) => fx.control = Control::Jump(target?),
+        (Map::Primary, 0xf5) | (Map::Primary, 0xf8..=0xfd) => (),
+        (Map::Primary, 0xf6) | (Map::Primary, 0xf7) => {
+            let byte = insn.op == 0xf6;
+            fx.reads |= ops.rm_read(byte);
+            match ext {
+                0 | 1 => (),
+                2 | 3 => ops.rm_write(&mut fx, byte),
+                4 | 5 => {
+                    fx.reads |= RAX;
+                    fx.write(0, if byte { 2 } else { ops.size });
+                    if !byte { fx.write(2, ops.size); }
+                },
+                _ => {
+                    fx.reads |= RAX | if byte { 0 } else { RDX };
+                    fx.write(0, if byte { 2 } else { ops.size });
+                    if !byte { fx.write(2, ops.size); }
+                }
+            }
+        },
+        (Map::Primary, 0xfe) if ext <= 1 => {
+            fx.reads |= ops.rm_read(true);
+            ops.rm_write(&mut fx, true);
+        },
+        (Map::Primary, 0xff) => {
+            fx.reads |= ops.rm_read(false);
+            match ext {
+                0 | 1 => ops.rm_write(&mut fx, false),
+                2 => fx.call(),
+                4 => fx.control = Control::Stop,
+                6 => (),
+                _ => return None
+            }
+        },
+
+        (Map::Map0f, 0x0b) => fx.control = Control::Stop,
+        (Map::Map0f, 0x0d) | (Map::Map0f, 0x18..=0x1f) => {
+            // Prefetches and multi-byte NOPs never use the value of their address.
+        },
+        (Map::Map0f, 0x2a) | (Map::Map0f, 0x6e) | (Map::Map0f, 0xc4) => {
+            fx.reads |= ops.rm_read(false);
+        },
+        (Map::Map0f, 0x2c) | (Map::Map0f, 0x2d) | (Map::Map0f, 0x50) | (Map::Map0f, 0xc5)
+            | (Map::Map0f, 0xd7) => {
+            fx.reads |= ops.addr;
+            fx.write(ops.reg, 4);
+        },
+        (Map::Map0f, 0x7e) if insn.rep != 0xf3 => {
+            fx.reads |= ops.addr;
+            if let Some(rm) = ops.rm { fx.write(rm, 4); }
+        },
+        (Map::Map0f, 0x10..=0x17) | (Map::Map0f, 0x28..=0x2f) | (Map::Map0f, 0x51..=0x7f)
+            | (Map::Map0f, 0xc2) | (Map::Map0f, 0xc3) | (Map::Map0f, 0xc6)
+            | (Map::Map0f, 0xd0..=0xff) => {
+            // SSE instructions, whose register operands are vector registers.
+            fx.reads |= ops.addr;
+            if insn.op == 0xc3 { ops.rm_write(&mut fx, false); fx.reads |= ops.reg_read(false); }
+        },
+        (Map::Map0f, 0x40..=0x4f) => {
+            fx.reads |= ops.rm_read(false) | ops.reg_read(false);
+            ops.reg_write(&mut fx, false);
+        },
+        (Map::Map0f, 0x80..=0x8f) => fx.control = Control::Branch(target?),
+        (Map::Map0f, 0x90..=0x9f) => ops.rm_write(&mut fx, true),
+        (Map::Map0f, 0xa3) | (Map::Map0f, 0xa4) | (Map::Map0f, 0xa5) | (Map::Map0f, 0xab)
+            | (Map::Map0f, 0xac) | (Map::Map0f, 0xad) | (Map::Map0f, 0xb3) | (Map::Map0f, 0xbb)
+            | (Map::Map0f, 0xc0) | (Map::Map0f, 0xc1) => {
+            fx.reads |= ops.rm_read(false) | ops.reg_read(false);
+            if matches!(insn.op, 0xa5 | 0xad) { fx.reads |= RCX; }
+            if insn.op != 0xa3 { ops.rm_write(&mut fx, false); }
+            if matches!(insn.op, 0xc0 | 0xc1) { fx.reads |= ops.reg_read(false); }
+        },
+        (Map::Map0f, 0xae) => fx.reads |= ops.addr,
+        (Map::Map0f, 0xaf) => {
+            fx.reads |= ops.rm_read(false) | ops.reg_read(false);
+            ops.reg_write(&mut fx, false);
+        },
+        (Map::Map0f, 0xb0) | (Map::Map0f, 0xb1) => {
+            fx.reads |= RAX | ops.rm_read(false) | ops.reg_read(false);
+        },
+        (Map::Map0f, 0xb6) | (Map::Map0f, 0xb7) | (Map::Map0f, 0xbe) | (Map::Map0f, 0xbf) => {
+            fx.reads |= ops.rm_read(matches!(insn.op, 0xb6 | 0xbe));
+            ops.reg_write(&mut fx, false);
+        },
+        (Map::Map0f, 0xb8) | (Map::Map0f, 0xbc) | (Map::Map0f, 0xbd) => {
+            // BSF and BSR leave the destination unchanged when the source is zero.
+            fx.reads |= ops.rm_read(false);
+            if insn.rep != 0xf3 { fx.reads |= ops.reg_read(false); }
+            ops.reg_write(&mut fx, false);
+        },
+        (Map::Map0f, 0xba) if ext >= 4 => {
+            fx.reads |= ops.rm_read(false);
+            if ext != 4 { ops.rm_write(&mut fx, false); }
+        },
+        (Map::Map0f, 0xc8..=0xcf) => fx.reads |= 1 << reg,
+
+        (Map::Map0f38, 0x00..=0x41) => fx.reads |= ops.addr,
+        (Map::Map0f38, 0xf0) | (Map::Map0f38, 0xf1) => {
+            fx.reads |= ops.rm_read(false);
+            if insn.rep == 0xf2 {
+                fx.reads |= ops.reg_read(false);
+                ops.reg_write(&mut fx, false);
+            } else if ops.rm.is_some() {
+                return None;
+            } else if insn.op == 0xf0 {
+                ops.reg_write(&mut fx, false);
+            } else {
+                fx.reads |= ops.reg_read(false);
+            }
+        },
+
+        (Map::Map0f3a, 0x14..=0x17) => {
+            fx.reads |= ops.addr;
+            if let Some(rm) = ops.rm { fx.write(rm, 4); }
+        },
+        (Map::Map0f3a, 0x20) | (Map::Map0f3a, 0x22) => fx.reads |= ops.rm_read(false),
+        (Map::Map0f3a, 0x08..=0x0f) | (Map::Map0f3a, 0x21) | (Map::Map0f3a, 0x40..=0x44)
+            | (Map::Map0f3a, 0x60..=0x63) => fx.reads |= ops.addr,
+
+        _ => return None
+    }
+
+    Some(fx)
+}
+
+///
+/// Gets the registers used by a VEX or EVEX encoded instruction.
+///
+/// These are almost all vector instructions, so only the few which move values to or from
+/// general purpose registers are decoded.
+///
+fn vex_effects(
+    insn: &Insn,
+    ops: &Operands,
+    mut fx: Effects
+) -> Option<Effects> {
+    match (insn.map, insn.op) {
+        (Map::Map0f, 0x2a) | (Map::Map0f, 0x6e) | (Map::Map0f, 0xc4)
+            | (Map::Map0f3a, 0x20) | (Map::Map0f3a, 0x22) => fx.reads |= ops.rm_read(false),
+        (Map::Map0f, 0x2c) | (Map::Map0f, 0x2d) | (Map::Map0f, 0x50) | (Map::Map0f, 0xc5)
+            | (Map::Map0f, 0xd7) => {
+            fx.reads |= ops.addr;
+            fx.write(ops.reg, 4);
+        },
+        (Map::Map0f, 0x7e) if insn.rep != 0xf3 => {
+            fx.reads |= ops.addr;
+            if let Some(rm) = ops.rm { fx.write(rm, 4); }
+        },
+        (Map::Map0f3a, 0x14..=0x17) => {
+            fx.reads |= ops.addr;
+            if let Some(rm) = ops.rm { fx.write(rm, 4); }
+        },
+        (Map::Map0f38, 0xf0..=0xff) | (Map::Map0f3a, 0xf0..=0xff) => return None,
+        _ => fx.reads |= ops.addr
+    }
+
+    Some(fx)
+}
+
+impl Effects {
+    /// Records a write of the given size to the given register.
+    fn write(
+        &mut self,
+        reg: u8,
+        size: u8
+    ) {
+        // Writes smaller than 32 bits keep the rest of the register.
+        if size >= 4 {
+            self.writes |= 1 << reg;
+        } else {
+            self.reads |= 1 << reg;
+        }
+    }
+
+    /// Records a call to another function.
+    fn call(
+        &mut self
+    ) {
+        self.maybe |= ARGS;
+        self.writes |= VOLATILE;
+    }
+}
+
+impl Operands {
+    /// Gets the operands of the given instruction.
+    fn new(
+        insn: &Insn
+    ) -> Self {
+        let size = if (insn.rex & 0x08) != 0 { 8 } else if insn.opsize16 { 2 } else { 4 };
+        let modrm = insn.modrm.unwrap_or(0);
+        let (md, rm) = (modrm >> 6, modrm & 0x07);
+        let reg = ((modrm >> 3) & 0x07) | ((insn.rex & 0x04) << 1);
+        let (x, b) = ((insn.rex & 0x02) << 2, (insn.rex & 0x01) << 3);
+
+        let mut addr = 0;
+        if insn.modrm.is_some() && (md != 3) {
+            if let Some(sib) = insn.sib {
+                let (index, base) = (((sib >> 3) & 0x07) | x, (sib & 0x07) | b);
+                if index != 4 { addr |= 1 << index; }
+                if (md != 0) || ((sib & 0x07) != 5) { addr |= 1 << base; }
+            } else if (md != 0) || (rm != 5) {
+                addr |= 1 << (rm | b);
+            }
+        }
+
+        Self {
+            reg,
+            rm: if insn.modrm.is_some() && (md == 3) { Some(rm | b) } else { None },
+            addr,
+            size,
+            rex: insn.rex != 0
+        }
+    }
+
+    /// Gets the registers read by the rm operand.
+    fn rm_read(
+        &self,
+        byte: bool
+    ) -> u16 {
+        match self.rm {
+            Some(rm) => 1 << if byte { byte_reg(rm, self.rex) } else { rm },
+            None => self.addr
+        }
+    }
+
+    /// Gets the registers read by the reg operand.
+    fn reg_read(
+        &self,
+        byte: bool
+    ) -> u16 {
+        1 << if byte { byte_reg(self.reg, self.rex) } else { self.reg }
+    }
+
+    /// Records a write to the rm operand.
+    fn rm_write(
+        &self,
+        fx: &mut Effects,
+        byte: bool
+    ) {
+        match self.rm {
+            Some(rm) if byte => fx.write(byte_reg(rm, self.rex), 1),
+            Some(rm) => fx.write(rm, self.size),
+            None => fx.reads |= self.addr
+        }
+    }
+
+    /// Records a write to the reg operand.
+    fn reg_write(
+        &self,
+        fx: &mut Effects,
+        byte: bool
+    ) {
+        if byte {
+            fx.write(byte_reg(self.reg, self.rex), 1);
+        } else {
+            fx.write(self.reg, self.size);
+        }
+    }
+}
+
+///
+/// Gets the register a byte operand refers to.
+///
+/// Without a REX prefix, byte registers 4 to 7 are AH, CH, DH, and BH.
+///
+fn byte_reg(
+    reg: u8,
+    rex: bool
+) -> u8 {
+    if !rex && (4..8).contains(&reg) { reg - 4 } else { reg }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Game memory holding only the given code, at offset 0.
+    struct CodeMemory(Vec<u8>);
+
+    impl GameMemory for CodeMemory {
+        fn base(
+            &self
+        ) -> usize {
+            0x1_4000_0000
+        }
+
+        fn read(
+            &self,
+            offset: usize,
+            len: usize
+        ) -> Result<Vec<u8>, ()> {
+            self.0.get(offset..offset.checked_add(len).ok_or(())?).map(|b| b.to_vec()).ok_or(())
+        }
+
+        fn write(
+            &mut self,
+            _offset: usize,
+            _bytes: &[u8]
+        ) -> Result<(), ()> {
+            Err(())
+        }
+    }
+
+    /// Checks the liveness of the given register at the start of the given code.
+    fn liveness(
+        code: &[&[u8]],
+        reg: Register
+    ) -> Liveness {
+        register_liveness(&CodeMemory(code.concat()), 0, reg)
+    }
+
+    // Instructions used by the tests.
+    const MOV_EAX_1: &[u8] = &[0xb8, 0x01, 0x00, 0x00, 0x00];
+    const MOV_AL_1: &[u8] = &[0xb0, 0x01];
+    const MOV_RCX_RAX: &[u8] = &[0x48, 0x89, 0xc1];
+    const XOR_EAX_EAX: &[u8] = &[0x31, 0xc0];
+    const CALL: &[u8] = &[0xe8, 0x00, 0x10, 0x00, 0x00];
+    const NOP: &[u8] = &[0x90];
+    const NOP5: &[u8] = &[0x0f, 0x1f, 0x44, 0x00, 0x00];
+    const RET: &[u8] = &[0xc3];
+
+    #[test]
+    fn clobbered_before_read_is_dead() {
+        assert_eq!(liveness(&[MOV_EAX_1, MOV_RCX_RAX, RET], Register::Rax), Liveness::Dead);
+        assert_eq!(liveness(&[XOR_EAX_EAX, MOV_RCX_RAX, RET], Register::Rax), Liveness::Dead);
+
+        // pop rsi
+        assert_eq!(liveness(&[&[0x5e], RET], Register::Rsi), Liveness::Dead);
+    }
+
+    #[test]
+    fn read_before_write_is_live() {
+        assert_eq!(liveness(&[MOV_RCX_RAX, MOV_EAX_1], Register::Rax), Liveness::Live(0));
+        assert_eq!(liveness(&[NOP5, MOV_RCX_RAX], Register::Rax), Liveness::Live(5));
+
+        // Writing part of the register keeps the rest of its value.
+        assert_eq!(liveness(&[MOV_AL_1, RET], Register::Rax), Liveness::Live(0));
+
+        // Registers used to address memory are read, as are the sources of string operations.
+        assert_eq!(liveness(&[&[0x8b, 0x07]], Register::Rdi), Liveness::Live(0));
+        assert_eq!(liveness(&[&[0xf3, 0xa4]], Register::Rsi), Liveness::Live(0));
+
+        // An indirect jump through the register reads it.
+        assert_eq!(liveness(&[&[0xff, 0xe0]], Register::Rax), Liveness::Live(0));
+    }
+
+    #[test]
+    fn calls_and_returns_follow_the_calling_convention() {
+        // A call overwrites the volatile registers.
+        assert_eq!(liveness(&[CALL, MOV_RCX_RAX], Register::Rax), Liveness::Dead);
+
+        // It may read its arguments, which can't be known.
+        assert_eq!(liveness(&[CALL, RET], Register::Rcx), Liveness::Unknown(0));
+
+        // And must preserve the non-volatile registers, which the return then reads.
+        assert_eq!(liveness(&[CALL, RET], Register::Rbx), Liveness::Live(5));
+        assert_eq!(liveness(&[CALL, RET], Register::Rsi), Liveness::Live(5));
+
+        // Whether a return gives a value isn't known either.
+        assert_eq!(liveness(&[NOP, RET], Register::Rax), Liveness::Unknown(1));
+    }
+
+    #[test]
+    fn branches_are_followed_to_where_they_merge() {
+        // Both sides of the branch write RAX before the merge reads it.
+        let both = [
+            &[0x85, 0xc9][..], // 0x00: test ecx, ecx
+            &[0x74, 0x07],     // 0x02: je 0x0b
+            MOV_EAX_1,         // 0x04
+            &[0xeb, 0x05],     // 0x09: jmp 0x10
+            MOV_EAX_1,         // 0x0b
+            MOV_RCX_RAX,       // 0x10
+            RET
+        ];
+        assert_eq!(liveness(&both, Register::Rax), Liveness::Dead);
+
+        // Either side alone leaving RAX alone makes the read at the merge live.
+        let mut taken = both;
+        taken[4] = NOP5;
+        assert_eq!(liveness(&taken, Register::Rax), Liveness::Live(0x10));
+        let mut fallthrough = both;
+        fallthrough[2] = NOP5;
+        assert_eq!(liveness(&fallthrough, Register::Rax), Liveness::Live(0x10));
+
+        // The test reads RCX before either side does anything.
+        assert_eq!(liveness(&both, Register::Rcx), Liveness::Live(0));
+
+        // A loop back to code already scanned ends the path.
+        assert_eq!(liveness(&[NOP, &[0xeb, 0xfd]], Register::Rax), Liveness::Dead);
+    }
+
+    #[test]
+    fn code_which_cannot_be_followed_is_unknown() {
+        // ud2
+        assert_eq!(liveness(&[NOP, &[0x0f, 0x0b]], Register::Rax), Liveness::Unknown(1));
+        // jmp rcx
+        assert_eq!(liveness(&[&[0xff, 0xe1]], Register::Rax), Liveness::Unknown(0));
+        // Code running off the end of the memory.
+        assert_eq!(liveness(&[NOP, NOP], Register::Rax), Liveness::Unknown(2));
+    }
+
+    #[test]
+    fn scans_stop_after_max_scan_insns() {
+        let nops = vec![0x90; MAX_SCAN_INSNS];
+        let last = &nops[..MAX_SCAN_INSNS - 1];
+        assert_eq!(
+            liveness(&[last, MOV_RCX_RAX], Register::Rax),
+            Liveness::Live(MAX_SCAN_INSNS - 1)
+        );
+        assert_eq!(
+            liveness(&[&nops, MOV_RCX_RAX], Register::Rax),
+            Liveness::Unknown(MAX_SCAN_INSNS)
+        );
+
+        // The budget is shared between every path. The first path takes 202 instructions to
+        // return, which leaves the branch 54 instructions to reach a read 200 in.
+        let side = &nops[..200];
+        let je = [0x0f, 0x84, 201, 0, 0, 0];
+        let mov_rcx_rdx = &[0x48, 0x89, 0xd1];
+        assert_eq!(
+            liveness(&[&je, side, RET, side, mov_rcx_rdx], Register::Rdx),
+            Liveness::Unknown(je.len() + side.len() + RET.len() + MAX_SCAN_INSNS - 202)
+        );
+        assert_eq!(
+            liveness(&[&je, RET, side, mov_rcx_rdx], Register::Rdx),
+            Liveness::Live(je.len() + RET.len() + side.len())
+        );
+    }
+}
@@ -0,0 +1,163 @@
+//!
+//! @file memory.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Abstracts the game memory which patches are located in and installed to.
+//! @bug No known bugs.
+//!
+//! In the game, patches are checked against and written to the running binary. Host tools can
+//! instead map a game executable from disk, and run the same locate/install/verify logic
+//! against the mapped copy without ever starting the game.
+//!
+
+use pe_file::PeFile;
+use skse64::reloc::RelocAddr;
+
+/// The offset of the e_lfanew field in the DOS header.
+const DOS_LFANEW_OFFSET: usize = 0x3c;
+
+/// The offset of the SizeOfImage field from the start of the NT headers.
+const SIZE_OF_IMAGE_OFFSET: usize = 0x50;
+
+/// Memory holding a copy of the game binary, which the patcher can read from and write to.
+pub trait GameMemory {
+    /// Gets the address the binary is loaded at. Offsets are relative to this address.
+    fn base(
+        &self
+    ) -> usize;
+
+    /// Reads len bytes at the given offset from the base of the binary.
+    fn read(
+        &self,
+        offset: usize,
+        len: usize
+    ) -> Result<Vec<u8>, ()>;
+
+    /// Writes the given bytes at the given offset from the base of the binary.
+    fn write(
+        &mut self,
+        offset: usize,
+        bytes: &[u8]
+    ) -> Result<(), ()>;
+}
+
+/// The memory of the running game, which holds the size of the game binary.
+pub struct LiveMemory(usize);
+
+/// A game executable which has been mapped from disk.
+pub struct ImageMemory {
+    base: usize,
+    image: Vec<u8>
+}
+
+impl LiveMemory {
+    ///
+    /// Gets access to the memory of the running game.
+    ///
+    /// In order to use this function safely, the plugin must be loaded into the game. Accesses
+    /// outside of the game binary, as given by the size in its headers, are refused.
+    ///
+    pub unsafe fn new() -> Self {
+        // The headers of a loaded module stay mapped, and are always readable.
+        let base = RelocAddr::base();
+        let nt = ((base + DOS_LFANEW_OFFSET) as *const u32).read_unaligned() as usize;
+        Self(((base + nt + SIZE_OF_IMAGE_OFFSET) as *const u32).read_unaligned() as usize)
+    }
+
+    /// Checks that the given range is within the game binary.
+    fn check(
+        &self,
+        offset: usize,
+        len: usize
+    ) -> Result<(), ()> {
+        match offset.checked_add(len) {
+            Some(end) if end <= self.0 => Ok(()),
+            _ => Err(())
+        }
+    }
+}
+
+impl GameMemory for LiveMemory {
+    fn base(
+        &self
+    ) -> usize {
+        RelocAddr::base()
+    }
+
+    fn read(
+        &self,
+        offset: usize,
+        len: usize
+    ) -> Result<Vec<u8>, ()> {
+        self.check(offset, len)?;
+        let addr = self.base() + offset;
+        let mut buf = vec![0; len];
+        unsafe {
+            // SAFETY: The range is in the binary, every section of which is readable, so the
+            //         protection of the game code is left alone.
+            std::ptr::copy_nonoverlapping(addr as *const u8, buf.as_mut_ptr(), len);
+        }
+        Ok(buf)
+    }
+
+    fn write(
+        &mut self,
+        offset: usize,
+        bytes: &[u8]
+    ) -> Result<(), ()> {
+        self.check(offset, bytes.len())?;
+        let addr = self.base() + offset;
+        unsafe {
+            // SAFETY: The range is in the binary, and is made writable while it is written.
+            skse64::safe::use_region(addr, bytes.len(), || {
+                std::ptr::copy_nonoverlapping(bytes.as_ptr(), addr as *mut u8, bytes.len());
+            });
+        }
+        Ok(())
+    }
+}
+
+impl ImageMemory {
+    /// Maps the sections of the given executable at its preferred base address.
+    pub fn new(
+        pe: &PeFile
+    ) -> Self {
+        Self {
+            base: pe.image_base(),
+            image: pe.map()
+        }
+    }
+
+    /// Gets the mapped image, including any patches which have been written to it.
+    pub fn image(
+        &self
+    ) -> &[u8] {
+        &self.image
+    }
+}
+
+impl GameMemory for ImageMemory {
+    fn base(
+        &self
+    ) -> usize {
+        self.base
+    }
+
+    fn read(
+        &self,
+        offset: usize,
+        len: usize
+    ) -> Result<Vec<u8>, ()> {
+        let end = offset.checked_add(len).ok_or(())?;
+        self.image.get(offset..end).map(|b| b.to_vec()).ok_or(())
+    }
+
+    fn write(
+        &mut self,
+        offset: usize,
+        bytes: &[u8]
+    ) -> Result<(), ()> {
+        let end = offset.checked_add(bytes.len()).ok_or(())?;
+        self.image.get_mut(offset..end).ok_or(())?.copy_from_slice(bytes);
+        Ok(())
+    }
+}
@@ -12,6 +12,16 @@
 //! they expect to be at the modification site for the length of the patch, to ensure the
 //! mod is doing the intended modification on every version.
 //!
+//! All reads and writes to the game code go through a GameMemory, so the same logic can check
+//! a set of patches against a game executable on disk with check_image().
+//!
+//! Call and Jump hooks have their encoding selected once the patch has been located, using
+//! the smallest branch which can reach the hook from the patch site. Any hook which overwrites
+//! a register has the game code after the patch checked, to ensure that register isn't read.
+//!
+//! TableLoad hooks don't call into the plugin at all. Their patch is moved into a stub, with
+//! one load replaced by a load from a table in the plugin, and the patch jumps to the stub.
+//!
 
 use std::cell::UnsafeCell;
 use std::ptr::NonNull;
@@ -22,12 +32,16 @@ use skse64::trampoline::Trampoline;
 
 use skse64::log::{skse_message, skse_fatal};
 use skse64::reloc::RelocAddr;
-use skse64::safe::{verify_flow, write_flow, Flow};
+use skse64::safe::{assemble_flow, Flow};
 use skse64::plugin_api::Message;
+use skse64::version::RUNTIME_VERSION_1_5_97;
 use versionlib::VersionDb;
 use racy_cell::RacyCell;
 
+use crate::liveness::{register_liveness, Liveness};
+use crate::memory::{GameMemory, LiveMemory};
 use crate::sig::{Signature, BinarySig};
+use crate::stub::{assemble_table_stub, insn_end, StubArea, STUB_AREA_SIZE};
 
 pub use skse64::safe::Register;
 
@@ -85,7 +99,53 @@ pub enum Hook {
         trampoline: NonNull<UnsafeCell<usize>>
     },
 
-    Call16(*const u8)
+    Call16(*const u8),
+
+    ///
+    /// Calls the entry point with a rel32 call if it is in range of the patch. Otherwise,
+    /// behaves as Call12.
+    ///
+    Call {
+        entry: *const u8,
+        clobber: Register
+    },
+
+    ///
+    /// Jumps to the entry point with a rel32 jump if it is in range of the patch. Otherwise,
+    /// behaves as Jump12.
+    ///
+    Jump {
+        entry: *const u8,
+        clobber: Register,
+        trampoline: NonNull<UnsafeCell<usize>>
+    },
+
+    ///
+    /// Replaces the load at the given offset in the patch with a load of a float from the
+    /// table, indexed by a register, into the given XMM register. The rest of the patch is
+    /// kept, and must not depend on where it is.
+    ///
+    /// The table holds the entries from the first index on. The index is checked against the
+    /// entries of the table, and the original load is run when it is out of bounds. The
+    /// clobber register holds the address of the table, and the index register must hold a
+    /// zero extended 32-bit value. The flags are overwritten by the check, so the load must be
+    /// somewhere they aren't live. The patcher can't check this, so the descriptor must.
+    ///
+    TableLoad {
+        load: usize,
+        table: *const f32,
+        first: usize,
+        len: usize,
+        index: Register,
+        dest: u8,
+        clobber: Register
+    },
+
+    /// Jumps to a stub written by the patcher, which returns to the end of the patch itself.
+    Stub {
+        entry: *const u8,
+        near: bool
+    }
 }
 
 /// Describes a location in code to be parsed and acted on by the patcher.
@@ -121,6 +181,17 @@ enum DescriptorError {
     Mismatch(Signature, BinarySig)
 }
 
+/// Describes error reasons for why the encoding of a hook could not be selected.
+#[derive(Debug)]
+enum SelectError {
+    /// The patch could not be read from the game.
+    Unreadable,
+    /// The patch has code which can't be moved into a stub.
+    Unmovable,
+    /// The stub area has no room left for the stub.
+    StubAreaFull
+}
+
 /// The result of an attempt to locate a descriptor.
 type FindResult = Result<RelocAddr, DescriptorError>;
 
@@ -143,13 +214,26 @@ struct PatchResult {
 /// Contains the set of patches installed by a call to apply().
 struct PatchSet(Vec<PatchResult>);
 
+/// Displays a descriptor, along with its location in the game version being patched.
+struct DescriptorName<'a> {
+    desc: &'a Descriptor,
+    is_se: bool
+}
+
+/// Checks if the given database is for an SE runtime, which selects the ids of each location.
+fn is_se(
+    db: &VersionDb
+) -> bool {
+    db.loaded_version() <= RUNTIME_VERSION_1_5_97
+}
+
 impl GameLocation {
     /// Finds the game address specified by this location.
     fn find(
         &self,
         db: &VersionDb
     ) -> FindResult {
-        let (id, offset) = self.get()?;
+        let (id, offset) = self.get(is_se(db))?;
         if let Ok(ra) = db.find_addr_by_id(id) {
             Ok(ra + offset)
         } else {
@@ -157,18 +241,19 @@ impl GameLocation {
         }
     }
 
-    /// Checks if the game location is compatible with the running version.
+    /// Checks if the game location is compatible with the patched version.
     fn compatible(
-        &self
+        &self,
+        is_se: bool
     ) -> bool {
-        self.get().is_ok()
+        self.get(is_se).is_ok()
     }
 
-    /// Gets the address independent location, if it is compatible with the running game version.
+    /// Gets the address independent location, if it is compatible with the patched game version.
     fn get(
-        &self
+        &self,
+        is_se: bool
     ) -> Result<(usize, usize), DescriptorError> {
-        let is_se = skse64::version::current_runtime() <= skse64::version::RUNTIME_VERSION_1_5_97;
         let id = match self {
             Self::Base { se, ae } => if is_se { Some((*se, 0)) } else { Some((*ae, 0)) },
             Self::Se { id, offset } => if is_se { Some((*id, *offset)) } else { None },
@@ -181,14 +266,14 @@ impl GameLocation {
         };
         id.ok_or(DescriptorError::IncompatibleGameVersion)
     }
-}
 
-impl std::fmt::Display for GameLocation {
+    /// Writes out the location for the given game version.
     fn fmt(
         &self,
-        f: &mut std::fmt::Formatter<'_>
+        f: &mut std::fmt::Formatter<'_>,
+        is_se: bool
     ) -> Result<(), std::fmt::Error> {
-        let (id, offset) = self.get().unwrap();
+        let (id, offset) = self.get(is_se).unwrap();
         if offset == 0 {
             write!(f, "[ID: {}]", id)
         } else {
@@ -226,6 +311,10 @@ impl Hook {
             Hook::Jump12 { .. } | Hook::Call12 { .. } => 12,
             Hook::Jump14 { .. } => 14,
             Hook::Call16(_) => 16,
+            Hook::Stub { near, .. } => if *near { 5 } else { 14 },
+            Hook::Call { .. } | Hook::Jump { .. } | Hook::TableLoad { .. } => {
+                panic!("Hook encoding was not selected!")
+            }
         }
     }
 
@@ -240,104 +329,170 @@ impl Hook {
             },
             Hook::Jump12 { trampoline, .. } |
             Hook::Jump14 { trampoline, .. } |
-            Hook::DirectJump { trampoline, .. } => {
+            Hook::DirectJump { trampoline, .. } |
+            Hook::Jump { trampoline, .. } => {
                 Some(*trampoline)
             },
             _ => None
         }
     }
 
+    /// Gets the entry point and flow of the hook, if it is written without a trampoline.
+    fn flow(
+        &self
+    ) -> Option<(usize, Flow)> {
+        match self {
+            Self::Jump12 { entry, clobber, .. } => {
+                Some((*entry as usize, Flow::JumpRegAbsolute(*clobber)))
+            },
+            Self::Call12 { entry, clobber, .. } => {
+                Some((*entry as usize, Flow::CallRegAbsolute(*clobber)))
+            },
+            Self::Jump14 { entry, .. } => Some((*entry as usize, Flow::JumpAbsolute)),
+            Self::Call16(entry) => Some((*entry as usize, Flow::CallAbsolute)),
+            Self::DirectJump { entry, .. } => Some((*entry as usize, Flow::JumpRelative)),
+            Self::DirectCall(entry) => Some((*entry as usize, Flow::CallRelative)),
+            Self::Stub { entry, near: true } => Some((*entry as usize, Flow::JumpRelative)),
+            Self::Stub { entry, near: false } => Some((*entry as usize, Flow::JumpAbsolute)),
+            _ => None
+        }
+    }
+
+    /// Gets the register the hook overwrites, if any.
+    fn clobber(
+        &self
+    ) -> Option<Register> {
+        match self {
+            Self::Jump12 { clobber, .. } |
+            Self::Call12 { clobber, .. } |
+            Self::TableLoad { clobber, .. } => Some(*clobber),
+            _ => None
+        }
+    }
+
     ///
-    /// Installs the given patch.
+    /// Selects the encoding of the hook, for a patch of the given size at the given offset in
+    /// the game memory.
     ///
-    /// In order to use this function safely, the given address must be the correct
-    /// location for this patch to be installed to.
+    /// Any stub the hook needs is written to the given stub area. Hooks which can't reach their
+    /// entry point fall back to the 12 byte register form, never to a branch trampoline.
     ///
-    unsafe fn install(
+    fn select(
         &self,
-        addr: usize
-    ) {
+        mem: &dyn GameMemory,
+        offset: usize,
+        size: usize,
+        stubs: &mut StubArea
+    ) -> Result<Self, SelectError> {
+        let reaches = |entry: *const u8| {
+            assemble_flow(mem.base() + offset, entry as usize, Flow::CallRelative).is_ok()
+        };
+
+        match *self {
+            Self::Call { entry, clobber } => {
+                if reaches(entry) {
+                    return Ok(Self::DirectCall(entry));
+                }
+
+                Ok(Self::Call12 { entry, clobber })
+            },
+            Self::Jump { entry, clobber, trampoline } => {
+                if reaches(entry) {
+                    return Ok(Self::DirectJump { entry, trampoline });
+                }
+
+                Ok(Self::Jump12 { entry, clobber, trampoline })
+            },
+            Self::TableLoad { load, table, first, len, index, dest, clobber } => {
+                let entry = stubs.next() as *const u8;
+                let hook = Self::Stub { entry, near: reaches(entry) };
+                let origin = mem.base() + offset;
+                let ret = origin + hook.patch_size();
+                let patch = mem.read(offset, size).map_err(|_| SelectError::Unreadable)?;
+                let stub = assemble_table_stub(
+                    entry as usize, origin, &patch, load, table, first, len, index, dest, clobber,
+                    ret
+                ).map_err(|_| SelectError::Unmovable)?;
+                stubs.write(&stub).map_err(|_| SelectError::StubAreaFull)?;
+                Ok(hook)
+            },
+            _ => Ok(self.clone())
+        }
+    }
+
+    ///
+    /// Installs the given patch to the given offset in the game memory.
+    ///
+    /// The offset must be the correct location for this patch to be installed to.
+    ///
+    fn install(
+        &self,
+        mem: &mut dyn GameMemory,
+        offset: usize
+    ) -> Result<(), ()> {
+        let addr = mem.base() + offset;
         match self {
             #[cfg(feature = "alloc_trampoline")]
-            Self::Jump5 { entry, .. } => {
+            Self::Jump5 { entry, .. } => unsafe {
                 skse64::trampoline::write_jump5(Trampoline::Global, addr, *entry as usize);
+                Ok(())
             },
             #[cfg(feature = "alloc_trampoline")]
-            Self::Call5(entry) => {
+            Self::Call5(entry) => unsafe {
                 skse64::trampoline::write_call5(Trampoline::Global, addr, *entry as usize);
+                Ok(())
             },
             #[cfg(feature = "alloc_trampoline")]
-            Self::Jump6 { entry, .. } => {
+            Self::Jump6 { entry, .. } => unsafe {
                 skse64::trampoline::write_jump6(Trampoline::Global, addr, *entry as usize);
+                Ok(())
             },
             #[cfg(feature = "alloc_trampoline")]
-            Self::Call6(entry) => {
+            Self::Call6(entry) => unsafe {
                 skse64::trampoline::write_call6(Trampoline::Global, addr, *entry as usize);
-            },
-            Self::Jump12 { entry, clobber, .. } => {
-                write_flow(addr, *entry as usize, Flow::JumpRegAbsolute(*clobber)).unwrap();
-            },
-            Self::Call12 { entry, clobber, .. } => {
-                write_flow(addr, *entry as usize, Flow::CallRegAbsolute(*clobber)).unwrap();
-            },
-            Self::Jump14 { entry, .. } => {
-                write_flow(addr, *entry as usize, Flow::JumpAbsolute).unwrap();
-            },
-            Self::Call16(entry) => {
-                write_flow(addr, *entry as usize, Flow::CallAbsolute).unwrap();
-            },
-            Self::DirectJump { entry, .. } => {
-                write_flow(addr, *entry as usize, Flow::JumpRelative).unwrap();
-            },
-            Self::DirectCall(entry) => {
-                write_flow(addr, *entry as usize, Flow::CallRelative).unwrap();
+                Ok(())
             },
             Self::None => panic!("Cannot install to a None hook!"),
+            Self::Call { .. } | Self::Jump { .. } | Self::TableLoad { .. } => {
+                panic!("Hook encoding was not selected!")
+            },
+            _ => {
+                let (entry, flow) = self.flow().unwrap();
+                mem.write(offset, &assemble_flow(addr, entry, flow)?)
+            }
         }
     }
 
-    ///
-    /// Verifies that the given patch was installed correctly.
-    ///
-    /// In order to use this function safely, the given address must be a part of the games code.
-    ///
-    unsafe fn verify(
+    /// Verifies that the given patch was installed correctly to the given offset.
+    fn verify(
         &self,
-        addr: usize
+        mem: &dyn GameMemory,
+        offset: usize
     ) -> Result<(), ()> {
         match self {
             #[cfg(feature = "alloc_trampoline")]
-            Self::Jump5 { .. } | Self::Call5(_) | Self::Jump6 { .. } | Self::Call5(_) => {
+            Self::Jump5 { .. } | Self::Call5(_) | Self::Jump6 { .. } | Self::Call6(_) => {
                 todo!();
             },
-            Self::Jump12 { entry, clobber, .. } => {
-                verify_flow(addr, *entry as usize, Flow::JumpRegAbsolute(*clobber))
-            },
-            Self::Call12 { entry, clobber, .. } => {
-                verify_flow(addr, *entry as usize, Flow::CallRegAbsolute(*clobber))
-            },
-            Self::Jump14 { entry, .. } => {
-                verify_flow(addr, *entry as usize, Flow::JumpAbsolute)
-            },
-            Self::Call16(entry) => {
-                verify_flow(addr, *entry as usize, Flow::CallAbsolute)
-            },
-            Self::DirectJump { entry, .. } => {
-                verify_flow(addr, *entry as usize, Flow::JumpRelative)
-            },
-            Self::DirectCall(entry) => {
-                verify_flow(addr, *entry as usize, Flow::CallRelative)
-            },
             Self::None => Ok(()),
+            Self::Call { .. } | Self::Jump { .. } | Self::TableLoad { .. } => {
+                panic!("Hook encoding was not selected!")
+            },
+            _ => {
+                let (entry, flow) = self.flow().unwrap();
+                let code = assemble_flow(mem.base() + offset, entry, flow)?;
+                if mem.read(offset, code.len())? == code { Ok(()) } else { Err(()) }
+            }
         }
     }
 }
 
 impl Descriptor {
-    /// Finds the address and verifies its signature, if applicable.
+    /// Finds the address and verifies its signature against the game memory, if applicable.
     fn find(
         &self,
-        db: &VersionDb
+        db: &VersionDb,
+        mem: &dyn GameMemory
     ) -> FindResult {
         match self {
             Self::Object { loc, .. } => loc.find(db),
@@ -345,7 +500,7 @@ impl Descriptor {
             Self::Patch { enabled, loc, sig, .. } => {
                 // Incompatible game version needs to take priority, or we'll try to report on
                 // a patch that should be invisible.
-                if !loc.compatible() {
+                if !loc.compatible(is_se(db)) {
                     return Err(DescriptorError::IncompatibleGameVersion);
                 }
 
@@ -354,10 +509,7 @@ impl Descriptor {
                 }
 
                 let addr = loc.find(db)?;
-                unsafe {
-                    // SAFETY: We know addr is in the skyrim binary, since it came from the db.
-                    sig.check(addr.addr()).map_err(|e| DescriptorError::Mismatch(*sig, e))?;
-                }
+                sig.check(mem, addr.offset()).map_err(|e| DescriptorError::Mismatch(*sig, e))?;
                 Ok(addr)
             }
         }
@@ -366,26 +518,28 @@ impl Descriptor {
     /// Reports the results of an attempt to find a descriptor.
     fn report(
         &self,
-        res: &FindResult
+        res: &FindResult,
+        is_se: bool
     ) {
+        let name = DescriptorName { desc: self, is_se };
         match res {
             Ok(addr) => {
                 skse_message!(
                     "[SUCCESS] {} is at offset {:#x}",
-                    self,
+                    name,
                     addr.offset()
                 );
             },
             Err(DescriptorError::Disabled) => {
-                skse_message!("[SKIPPED] {} is disabled", self);
+                skse_message!("[SKIPPED] {} is disabled", name);
             },
             Err(DescriptorError::Missing) => {
-                skse_message!("[FAILURE] {} was not in the version database!", self);
+                skse_message!("[FAILURE] {} was not in the version database!", name);
             },
             Err(DescriptorError::Mismatch(sig, bsig)) => {
                 skse_message!(
                     "[FAILURE] {} at offset {:#x} did not match the expected code signature!",
-                    self,
+                    name,
                     bsig.reloc().offset()
                 );
                 skse_message!("\\------> [EXPECTED] {}", sig);
@@ -395,13 +549,87 @@ impl Descriptor {
         }
     }
 
-    /// Creates a patch result for the descriptor, if the descriptor is a patch.
+    ///
+    /// Selects the hook encoding for the patch at the given address, and checks that the
+    /// register it overwrites, if any, isn't read by the game code after the patch.
+    ///
+    /// Gives a None hook for anything which isn't a patch.
+    ///
+    fn select_hook(
+        &self,
+        addr: RelocAddr,
+        mem: &dyn GameMemory,
+        is_se: bool,
+        stubs: &mut StubArea
+    ) -> Result<Hook, ()> {
+        let Self::Patch { hook: request, sig, .. } = self else {
+            return Ok(Hook::None);
+        };
+
+        let name = DescriptorName { desc: self, is_se };
+        let hook = request.select(mem, addr.offset(), sig.len(), stubs).map_err(|e| match e {
+            SelectError::Unreadable => {
+                skse_message!("[FAILURE] {} could not be read from the game!", name);
+            },
+            SelectError::Unmovable => {
+                skse_message!("[FAILURE] {} could not be moved to a stub!", name);
+            },
+            SelectError::StubAreaFull => {
+                skse_message!("[FAILURE] {} did not fit in the stub area!", name);
+            }
+        })?;
+        let Some(clobber) = hook.clobber().or(request.clobber()) else {
+            return Ok(hook);
+        };
+
+        // A stub overwrites the register in the middle of the patch, so the rest of the patch
+        // must be checked as well. The scan doesn't track the flags, which a table load also
+        // overwrites, so those are left to the descriptor.
+        let start = match request {
+            Hook::TableLoad { load, .. } => {
+                let patch = mem.read(addr.offset(), sig.len());
+                patch.and_then(|patch| insn_end(&patch, *load)).map_err(|_| {
+                    skse_message!(
+                        "[FAILURE] {} could not decode the load at offset {:#x}!",
+                        name,
+                        addr.offset() + load
+                    );
+                })?
+            },
+            _ => sig.len()
+        };
+
+        match register_liveness(mem, addr.offset() + start, clobber) {
+            Liveness::Dead => Ok(hook),
+            Liveness::Live(at) => {
+                skse_message!(
+                    "[FAILURE] {} overwrites {:?}, which is read at offset {:#x}!",
+                    name,
+                    clobber,
+                    at
+                );
+                Err(())
+            },
+            Liveness::Unknown(at) => {
+                skse_message!(
+                    "[WARNING] {} overwrites {:?}, which could not be followed past offset {:#x}",
+                    name,
+                    clobber,
+                    at
+                );
+                Ok(hook)
+            }
+        }
+    }
+
+    /// Creates a patch result for the descriptor, using the given hook, if it is a patch.
     fn patch_result(
         &self,
-        addr: RelocAddr
+        addr: RelocAddr,
+        hook: &Hook
     ) -> Option<PatchResult> {
         match self {
-            Self::Patch { name, hook, conflicts, .. } => {
+            Self::Patch { name, conflicts, .. } => {
                 Some(PatchResult {
                     name: *name,
                     hook: hook.clone(),
@@ -423,43 +651,29 @@ impl Descriptor {
         }
     }
 
-    /// Gets the hook for this patch.
-    fn hook<'a>(
-        &'a self
-    ) -> Option<&'a Hook> {
-        match self {
-            Self::Patch { hook, .. } => Some(hook),
-            _ => None
-        }
-    }
-
     /// Checks if the given patch is disabled.
     fn disabled(
-        &self
+        &self,
+        is_se: bool
     ) -> bool {
         match self {
-            Self::Patch { enabled, loc, .. } => !enabled() || !loc.compatible(),
-            Self::Function { loc, .. } | Self::Object { loc, .. } => !loc.compatible()
+            Self::Patch { enabled, loc, .. } => !enabled() || !loc.compatible(is_se),
+            Self::Function { loc, .. } | Self::Object { loc, .. } => !loc.compatible(is_se)
         }
     }
 }
 
-impl std::fmt::Display for Descriptor {
+impl std::fmt::Display for DescriptorName<'_> {
     fn fmt(
         &self,
         f: &mut std::fmt::Formatter<'_>
     ) -> Result<(), std::fmt::Error> {
-        match self {
-            Self::Object { name, loc, .. } => {
-                write!(f, "Object {} {}", name, loc)
-            },
-            Self::Function { name, loc, .. } => {
-                write!(f, "Function {} {}", name, loc)
-            },
-            Self::Patch { name, loc, .. } => {
-                write!(f, "Patch {} {}", name, loc)
-            }
-        }
+        let loc = match self.desc {
+            Descriptor::Object { name, loc, .. } => { write!(f, "Object {} ", name)?; loc },
+            Descriptor::Function { name, loc, .. } => { write!(f, "Function {} ", name)?; loc },
+            Descriptor::Patch { name, loc, .. } => { write!(f, "Patch {} ", name)?; loc }
+        };
+        loc.fmt(f, self.is_se)
     }
 }
 
@@ -500,23 +714,22 @@ impl<T> GameRef<T> {
 impl PatchResult {
     /// Verifies that the given patch is installed to the game code.
     fn verify(
-        &self
+        &self,
+        mem: &dyn GameMemory
     ) -> Result<(), ()> {
-        unsafe {
-            // SAFETY: We give this hook the address it was installed to.
-            self.hook.verify(self.loc.addr())
-        }
+        self.hook.verify(mem, self.loc.offset())
     }
 }
 
 impl PatchSet {
     /// Verifies that the given patch set has correctly been installed.
     pub fn verify(
-        &self
+        &self,
+        mem: &dyn GameMemory
     ) {
         let mut fails = 0;
         for patch in self.0.iter() {
-            if let Err(_) = patch.verify() {
+            if let Err(_) = patch.verify(mem) {
                 skse_message!("[ERROR] Patch {} has been clobbered!", patch.name);
                 skse_fatal!(
                     "The integrity checker has determined that the patch {} was \
@@ -542,12 +755,20 @@ unsafe impl Sync for Hook {}
 unsafe impl Sync for Descriptor {}
 unsafe impl<T> Sync for GameRef<T> {}
 
-/// Uses the version database to locate the patches that the user requested be installed.
+///
+/// Uses the version database to locate the patches that the user requested be installed, and
+/// selects the hook each of them will be installed with.
+///
+/// Any stubs the hooks need are written to the given stub area.
+///
 fn locate_patches<const NUM_PATCHES: usize>(
-    patches: &[&Descriptor]
-) -> Result<([usize; NUM_PATCHES], Vec<PatchResult>, usize), ()> {
-    let db = VersionDb::new(skse64::version::current_runtime());
+    patches: &[&Descriptor],
+    db: &VersionDb,
+    mem: &dyn GameMemory,
+    stubs: &mut StubArea
+) -> Result<([usize; NUM_PATCHES], Vec<Hook>, Vec<PatchResult>, usize), ()> {
     let mut res_addrs: [usize; NUM_PATCHES] = [0; NUM_PATCHES];
+    let mut hooks: Vec<Hook> = vec![Hook::None; NUM_PATCHES];
     let mut installed_patches: Vec<PatchResult> = Vec::new();
 
     let mut _alloc_size: usize = 0;
@@ -555,22 +776,28 @@ fn locate_patches<const NUM_PATCHES: usize>(
     // Attempt to locate all of the patch signatures.
     let mut fails = 0;
     for (i, sig) in patches.iter().enumerate() {
-        let res = sig.find(&db);
-        sig.report(&res);
+        let res = sig.find(db, mem);
+        sig.report(&res, is_se(db));
 
         match res {
             Ok(addr) => {
-                assert!(sig.hook().map(|h| h.patch_size() <= sig.size()).unwrap_or(true));
-                res_addrs[i] = addr.addr();
+                let Ok(hook) = sig.select_hook(addr, mem, is_se(db), stubs) else {
+                    fails += 1;
+                    continue;
+                };
+
+                assert!(hook.patch_size() <= sig.size());
+                res_addrs[i] = mem.base() + addr.offset();
 
                 #[cfg(feature = "alloc_trampoline")]
-                if let Some(h) = sig.hook() {
-                    _alloc_size += h.alloc_size();
+                {
+                    _alloc_size += hook.alloc_size();
                 }
 
-                if let Some(patch_result) = sig.patch_result(addr) {
+                if let Some(patch_result) = sig.patch_result(addr, &hook) {
                     installed_patches.push(patch_result);
                 }
+                hooks[i] = hook;
             },
             Err(DescriptorError::Disabled) | Err(DescriptorError::IncompatibleGameVersion) => (),
             _ => {
@@ -580,34 +807,37 @@ fn locate_patches<const NUM_PATCHES: usize>(
     }
 
     if fails == 0 {
-        Ok((res_addrs, installed_patches, _alloc_size))
+        Ok((res_addrs, hooks, installed_patches, _alloc_size))
     } else {
         Err(())
     }
 }
 
-/// Installs the set of previously located patches.
+/// Installs the set of previously located patches to the game memory, using the given hooks.
 fn install_patches(
     patches: &[&Descriptor],
     res_addrs: &[usize],
-    set: PatchSet
-) {
-    // Install our patches.
+    hooks: &[Hook],
+    db: &VersionDb,
+    mem: &mut dyn GameMemory
+) -> Result<(), ()> {
     for (i, sig) in patches.iter().enumerate() {
-        if sig.disabled() { continue; }
+        if sig.disabled(is_se(db)) { continue; }
 
-        let hook_size = sig.hook().map(|h| h.patch_size()).unwrap_or(0);
+        let hook = &hooks[i];
+        let hook_size = hook.patch_size();
         let ret_addr = res_addrs[i] + hook_size;
+        let offset = res_addrs[i] - mem.base();
         match sig {
-            Descriptor::Patch { hook, .. } => {
+            Descriptor::Patch { .. } => {
                 unsafe {
                     // SAFETY: We will ensure our return address is valid by writing NOPS to any
                     //         bytes that are part of the patch and after the return address.
                     if let Some(t) = hook.trampoline() {
                         *(t.as_ref().get()) = ret_addr;
                     }
-                    hook.install(res_addrs[i]);
                 }
+                hook.install(mem, offset)?;
             },
             Descriptor::Function { result, .. } | Descriptor::Object { result, .. } => {
                 unsafe {
@@ -618,18 +848,20 @@ fn install_patches(
             }
         }
 
-        unsafe {
-            // SAFETY: We have matched signatures to ensure our patch is valid.
-            let remain = sig.size() - hook_size;
-            if remain > 0 {
-                skse64::safe::use_region(ret_addr, remain, || {
-                    ::std::ptr::write_bytes::<u8>(ret_addr as *mut u8, 0x90, remain);
-                });
-            }
+        // We have matched signatures to ensure our patch is valid.
+        let remain = sig.size() - hook_size;
+        if remain > 0 {
+            mem.write(offset + hook_size, &vec![0x90; remain])?;
         }
     }
 
-    // Register the patches to be verified later.
+    Ok(())
+}
+
+/// Registers the given patches to be verified once every plugin has been loaded.
+fn register_verification(
+    set: PatchSet
+) {
     static INSTALLED_PATCHES: RacyCell<Vec<PatchSet>> = RacyCell::new(Vec::new());
     static DO_ONCE: RacyCell<bool> = RacyCell::new(true);
     unsafe {
@@ -645,8 +877,10 @@ fn install_patches(
             // phase, so we can't actually panic there.
             //
             skse64::event::register_listener(Message::SKSE_POST_POST_LOAD, |_| {
+                // SAFETY: The listener is only called by skse, within the game.
+                let mem = LiveMemory::new();
                 for set in (*INSTALLED_PATCHES.get()).drain(0..) {
-                    set.verify();
+                    set.verify(&mem);
                 }
             });
         }
@@ -662,7 +896,16 @@ pub fn apply<const NUM_PATCHES: usize>(
         env!("CARGO_PKG_VERSION")
     );
 
-    let (res_addrs, to_install, _alloc_size) = locate_patches::<NUM_PATCHES>(&patches).map_err(|_| {
+    // SAFETY: Offsets only come from the version database of the running game.
+    let mut mem = unsafe { LiveMemory::new() };
+    let db = crate::shared::open_version_db();
+    let (res_addrs, hooks, to_install, _alloc_size) = locate_patches::<NUM_PATCHES>(
+        &patches,
+        &db,
+        &mem,
+        // SAFETY: Plugins are loaded one at a time, so nothing else can be writing stubs.
+        &mut unsafe { StubArea::live() }
+    ).map_err(|_| {
         skse_message!("[FAILURE] Could not locate every game signature!");
         skse_message!("----------------------------------------------------------------");
     })?;
@@ -680,9 +923,53 @@ pub fn apply<const NUM_PATCHES: usize>(
         skse_message!("[SKIPPED] No patches require a branch trampoline allocation");
     }
 
-    install_patches(&patches, &res_addrs, PatchSet(to_install));
+    install_patches(&patches, &res_addrs, &hooks, &db, &mut mem).unwrap();
+    register_verification(PatchSet(to_install));
 
     skse_message!("[SUCCESS] Applied game patches.");
     skse_message!("----------------------------------------------------------------");
     Ok(())
 }
+
+///
+/// Locates, installs, and verifies a set of patches against a copy of the game binary, such as
+/// an executable mapped from disk, without running the game.
+///
+/// The results of each descriptor are logged just as they are by apply(). Patches whose hooks
+/// require a trampoline can't be installed to a copy of the binary, and are reported as
+/// failures. Stubs are written to a scratch buffer, as they are never run.
+///
+pub fn check_image<const NUM_PATCHES: usize>(
+    patches: [&Descriptor; NUM_PATCHES],
+    db: &VersionDb,
+    mem: &mut dyn GameMemory
+) -> Result<(), ()> {
+    skse_message!(
+        "--------------------- Skyrim Patcher {} ---------------------",
+        env!("CARGO_PKG_VERSION")
+    );
+
+    let (mut scratch, mut used) = (vec![0xcc; STUB_AREA_SIZE], 0);
+    let mut stubs = StubArea::new(&mut scratch, &mut used);
+    let res = locate_patches::<NUM_PATCHES>(&patches, db, mem, &mut stubs).map_err(|_| {
+        skse_message!("[FAILURE] Could not locate every game signature!");
+    }).and_then(|(res_addrs, hooks, to_install, _)| {
+        install_patches(&patches, &res_addrs, &hooks, db, mem).map_err(|_| {
+            skse_message!("[FAILURE] Could not install every patch to the image!");
+        })?;
+
+        let fails = to_install.iter().filter(|p| p.verify(mem).is_err()).map(|p| {
+            skse_message!("[FAILURE] Patch {} did not verify after installation!", p.name);
+        }).count();
+
+        if fails == 0 {
+            skse_message!("[SUCCESS] Installed and verified {} patches.", to_install.len());
+            Ok(())
+        } else {
+            Err(())
+        }
+    });
+
+    skse_message!("----------------------------------------------------------------");
+    res
+}
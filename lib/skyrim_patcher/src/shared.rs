@@ -0,0 +1,85 @@
+//!
+//! @file shared.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Shares the version database with other plugins over SKSE messaging.
+//! @bug No known bugs.
+//!
+//! A plugin which shares its database keeps it loaded in the compact layout for the rest of
+//! the game, and answers any request for it. Plugins which request a database fall back to
+//! loading it themselves when no plugin answers.
+//!
+
+use std::ffi::c_void;
+use std::mem::size_of;
+
+use alloc_track::Tag;
+use later::Later;
+use skse64::event::{dispatch, register_plugin_listener};
+use skse64::log::skse_message;
+use skse64::plugin_api::Message;
+use skse64::version::current_runtime;
+use versionlib::{DbLayout, VersionDb};
+use versionlib::shared::{Messenger, SharedDbRequest, SharedDbTable, SHARED_DB_MESSAGE};
+
+/// Sends database requests to other plugins through SKSE.
+struct SkseMessenger;
+
+/// The database this plugin shares, if it shares one.
+static SHARED_DB: Later<&'static SharedDbTable> = Later::new();
+
+impl Messenger<SharedDbRequest> for SkseMessenger {
+    fn send(
+        &self,
+        request: &mut SharedDbRequest
+    ) {
+        dispatch(
+            SHARED_DB_MESSAGE,
+            request as *mut SharedDbRequest as *mut c_void,
+            size_of::<SharedDbRequest>() as u32
+        );
+    }
+}
+
+///
+/// Loads the database of the running game, and shares it with any plugin which requests it.
+///
+/// If another plugin already shares the same database, nothing is loaded.
+///
+pub fn share_version_db() {
+    let mut request = SharedDbRequest::new(current_runtime());
+    SkseMessenger.send(&mut request);
+    if request.answer().is_some() {
+        skse_message!("[SKIPPED] The version database is already shared by another plugin");
+        return;
+    }
+
+    let db = {
+        let _scope = alloc_track::scope(Tag::VersionDb);
+        VersionDb::new_with_layout(current_runtime(), DbLayout::Compact)
+    };
+    skse_message!("[SUCCESS] Sharing the version database ({} ids)", db.len());
+    SHARED_DB.init(SharedDbTable::publish(db));
+    register_plugin_listener(SHARED_DB_MESSAGE, answer_request);
+}
+
+/// Opens the database of the running game, preferring one shared by any plugin.
+pub (in crate) fn open_version_db() -> VersionDb {
+    let _scope = alloc_track::scope(Tag::VersionDb);
+    if SHARED_DB.is_init() {
+        VersionDb::from_shared(*SHARED_DB)
+    } else {
+        VersionDb::new_shared(current_runtime(), DbLayout::Hashed, &SkseMessenger)
+    }
+}
+
+/// Answers a database request from another plugin.
+fn answer_request(
+    msg: &Message
+) {
+    if (msg.data_len as usize == size_of::<SharedDbRequest>()) && !msg.data.is_null() {
+        unsafe {
+            // SAFETY: The sender gave us a request of the correct size.
+            SHARED_DB.answer(&mut *(msg.data as *mut SharedDbRequest));
+        }
+    }
+}
@@ -7,6 +7,8 @@
 
 use skse64::reloc::RelocAddr;
 
+use crate::memory::GameMemory;
+
 ///
 /// @brief Used to match code to pre-defined signatures.
 ///
@@ -24,9 +26,9 @@ pub enum Opcode {
 #[derive(Copy, Clone, Debug)]
 pub struct Signature(&'static [Opcode]);
 
-/// Helper to print a signature in the games code.
+/// Helper to print a signature in the games code, holding the bytes which were found there.
 #[derive(Debug)]
-pub (in crate) struct BinarySig(RelocAddr, usize);
+pub (in crate) struct BinarySig(RelocAddr, Vec<u8>);
 
 /// @brief Generates a new signature out of hex digits and question marks.
 #[macro_export]
@@ -57,32 +59,33 @@ impl Signature {
     }
 
     ///
-    /// Checks the given signature against the given memory location.
+    /// Checks the given signature against the given offset in the game memory.
     ///
-    /// In order to use this function safely, the address range specified must be
-    /// a valid part of the Skyrim binary.
+    /// An offset outside of the memory is treated as a mismatch, with no bytes found.
     ///
-    pub (in crate) unsafe fn check(
+    pub (in crate) fn check(
         &self,
-        a: usize
+        mem: &dyn GameMemory,
+        offset: usize
     ) -> Result<(), BinarySig> {
-        assert!(a != 0);
         if self.0.len() == 0 { return Ok(()); }
 
-        let mut diff = 0;
-        skse64::safe::use_region(a, self.0.len(), || {
-            for (i, op) in self.0.iter().enumerate() {
-                if let Opcode::Code(b) = *op {
-                    diff += if b == *(a as *mut u8).add(i) { 0 } else { 1 };
-                }
-            }
+        let found = |code| BinarySig(RelocAddr::from_offset(offset), code);
+        let code = mem.read(offset, self.len()).map_err(|_| found(Vec::new()))?;
+        let diff = self.0.iter().zip(code.iter()).any(|(op, c)| {
+            if let Opcode::Code(b) = *op { b != *c } else { false }
         });
 
-        if diff > 0 {
-            Err(BinarySig(RelocAddr::from_addr(a), self.len()))
-        } else {
-            Ok(())
-        }
+        if diff { Err(found(code)) } else { Ok(()) }
+    }
+
+    /// Checks if the given offset in the game memory matches the signature.
+    pub fn matches(
+        &self,
+        mem: &dyn GameMemory,
+        offset: usize
+    ) -> bool {
+        self.check(mem, offset).is_ok()
     }
 
     /// Checks how long the signature is.
@@ -123,29 +126,10 @@ impl std::fmt::Display for BinarySig {
         &self,
         f: &mut std::fmt::Formatter<'_>
     ) -> Result<(), std::fmt::Error> {
-        let mut res = Ok(());
-
-        unsafe {
-            // SAFETY: The caller of the diff function ensures this is a valid sig.
-            skse64::safe::use_region(self.0.addr(), self.1, || {
-                let sig = std::slice::from_raw_parts(self.0.addr() as *const u8, self.1);
-
-                if let Err(e) = write!(f, "{{ ") {
-                    res = Err(e);
-                    return;
-                }
-
-                for b in sig.iter() {
-                    if let Err(e) = write!(f, "{:02x} ", b) {
-                        res = Err(e);
-                        return;
-                    }
-                }
-
-                res = write!(f, "}}");
-            });
+        write!(f, "{{ ")?;
+        for b in self.1.iter() {
+            write!(f, "{:02x} ", b)?;
         }
-
-        return res;
+        write!(f, "}}")
     }
 }
@@ -0,0 +1,484 @@
+//!
+//! @file stub.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Writes the short code stubs which some hooks run in place of calling the plugin.
+//! @bug No known bugs.
+//!
+//! A stub holds the code of a patch, moved out of the game, with one of its instructions
+//! replaced. The patch then jumps to the stub, and the stub jumps back to the end of the patch
+//! once it is done. Since the stub is written by the patcher, it can do simple work, such as
+//! loading a value from a table, without saving any registers or calling into the plugin.
+//!
+//! The stubs of the running game are placed in an area reserved in the code of the plugin.
+//!
+
+use std::ptr::addr_of;
+
+use sigscan::decode;
+use skse64::safe::{assemble_flow, use_region, Flow};
+use racy_cell::RacyCell;
+
+use crate::patcher::Register;
+
+/// The size of the area reserved for stubs in the plugin.
+pub(crate) const STUB_AREA_SIZE: usize = 256;
+
+/// The alignment of each stub within the area.
+const STUB_ALIGN: usize = 16;
+
+/// The number of XMM registers a stub can load into.
+const XMM_COUNT: u8 = 16;
+
+/// Memory which stubs are written to.
+pub(crate) struct StubArea<'a> {
+    base: usize,
+    len: usize,
+    used: &'a mut usize
+}
+
+// The stub area must be executable in the game. The patcher never runs stubs outside of
+// windows, so host builds keep it with the rest of the plugin data, where it can be written.
+#[cfg(windows)]
+core::arch::global_asm! {
+    ".section .text$skyrim_patcher_stubs,\"xr\"",
+    ".balign {align}",
+    ".global skyrim_patcher_stub_area",
+    "skyrim_patcher_stub_area:",
+    ".fill {size}, 1, 0xcc",
+    ".text",
+    align = const STUB_ALIGN,
+    size = const STUB_AREA_SIZE
+}
+
+#[cfg(not(windows))]
+core::arch::global_asm! {
+    ".section .data.skyrim_patcher_stubs,\"aw\",@progbits",
+    ".balign {align}",
+    ".global skyrim_patcher_stub_area",
+    ".hidden skyrim_patcher_stub_area",
+    "skyrim_patcher_stub_area:",
+    ".fill {size}, 1, 0xcc",
+    ".text",
+    align = const STUB_ALIGN,
+    size = const STUB_AREA_SIZE
+}
+
+extern "C" {
+    static skyrim_patcher_stub_area: u8;
+}
+
+impl<'a> StubArea<'a> {
+    /// Creates a stub area in the given buffer, of which the given number of bytes are used.
+    pub fn new(
+        buf: &'a mut [u8],
+        used: &'a mut usize
+    ) -> Self {
+        Self { base: buf.as_mut_ptr() as usize, len: buf.len(), used }
+    }
+
+    ///
+    /// Gets the stub area reserved in the plugin, which is shared by every call to apply().
+    ///
+    /// In order to use this function safely, the caller must have exclusive access to the
+    /// area, as it does during plugin loading.
+    ///
+    pub unsafe fn live() -> StubArea<'static> {
+        static USED: RacyCell<usize> = RacyCell::new(0);
+        StubArea {
+            base: addr_of!(skyrim_patcher_stub_area) as usize,
+            len: STUB_AREA_SIZE,
+            used: &mut *USED.get()
+        }
+    }
+
+    /// Gets the address the next stub will be written to.
+    pub fn next(
+        &self
+    ) -> usize {
+        (self.base + *self.used).next_multiple_of(STUB_ALIGN)
+    }
+
+    /// Writes the given stub to the address given by next().
+    pub fn write(
+        &mut self,
+        code: &[u8]
+    ) -> Result<(), ()> {
+        let addr = self.next();
+        if addr + code.len() > self.base + self.len {
+            return Err(());
+        }
+
+        unsafe {
+            // SAFETY: The stub is within the area, which we have exclusive access to.
+            use_region(addr, code.len(), || {
+                std::ptr::copy_nonoverlapping(code.as_ptr(), addr as *mut u8, code.len());
+            });
+        }
+        *self.used = addr + code.len() - self.base;
+        Ok(())
+    }
+}
+
+///
+/// Assembles a load of the float at the given index of a table into an XMM register, as it
+/// would be written to the given address.
+///
+/// The table holds the entries from the given first index on. The index is checked against
+/// the entries of the table first, and the fallback code is run in place of the load if it is
+/// out of bounds. The fallback must not depend on where it is. The clobber register, which
+/// can't be the index, is overwritten with the address of the table, and the flags are
+/// overwritten by the check. The index register must hold a zero extended 32-bit value, as it
+/// does after any 32-bit write.
+///
+pub fn assemble_table_load(
+    addr: usize,
+    table: *const f32,
+    first: usize,
+    len: usize,
+    index: Register,
+    dest: u8,
+    clobber: Register,
+    fallback: &[u8]
+) -> Result<Vec<u8>, ()> {
+    if (dest >= XMM_COUNT) || matches!(index, Register::Rsp)
+            || ((index as u8) == (clobber as u8)) {
+        return Err(());
+    }
+
+    // lea clobber32, [index - first], so that indices below the first wrap past the length.
+    let mut code = Vec::new();
+    let mut check = index as u8;
+    if first != 0 {
+        let disp = i32::try_from(first).map_err(|_| ())?.wrapping_neg();
+        let modrm = ((clobber as u8) << 3) | index as u8;
+        match i8::try_from(disp) {
+            Ok(disp) => code.extend_from_slice(&[0x8d, 0x40 | modrm, disp as u8]),
+            Err(_) => {
+                code.extend_from_slice(&[0x8d, 0x80 | modrm]);
+                code.extend_from_slice(&disp.to_le_bytes());
+            }
+        }
+        check = clobber as u8;
+    }
+
+    // cmp check32, len
+    match i8::try_from(len) {
+        Ok(len) => code.extend_from_slice(&[0x83, 0xf8 | check, len as u8]),
+        Err(_) => {
+            code.extend_from_slice(&[0x81, 0xf8 | check]);
+            code.extend_from_slice(&u32::try_from(len).map_err(|_| ())?.to_le_bytes());
+        }
+    }
+
+    // The table is addressed as if it started at index zero.
+    let table = (table as usize).wrapping_sub(first * std::mem::size_of::<f32>());
+
+    // lea clobber, [rip + table], or mov clobber, table if the table is out of range.
+    let start = addr + code.len() + 2;
+    let mut load = vec![0x48, 0x8d, 0x05 | ((clobber as u8) << 3)];
+    match i32::try_from(table.wrapping_sub(start + 7) as isize) {
+        Ok(rel) => load.extend_from_slice(&rel.to_le_bytes()),
+        Err(_) => {
+            load = vec![0x48, 0xb8 + clobber as u8];
+            load.extend_from_slice(&(table as u64).to_le_bytes());
+        }
+    }
+
+    // movss dest, [clobber + index * 4]. RBP can only be a base with a displacement.
+    load.push(0xf3);
+    if dest >= 8 {
+        load.push(0x44);
+    }
+    let (md, disp) = if matches!(clobber, Register::Rbp) { (0x40, Some(0)) } else { (0, None) };
+    load.extend_from_slice(&[0x0f, 0x10, md | ((dest & 7) << 3) | 0x04]);
+    load.push(0x80 | ((index as u8) << 3) | clobber as u8);
+    load.extend(disp);
+
+    // jae fallback, then jmp over the fallback once the load is done.
+    let over = i8::try_from(fallback.len()).map_err(|_| ())?;
+    let skip = i8::try_from(load.len() + 2).map_err(|_| ())?;
+    code.extend_from_slice(&[0x73, skip as u8]);
+    code.extend(load);
+    code.extend_from_slice(&[0xeb, over as u8]);
+    code.extend_from_slice(fallback);
+    Ok(code)
+}
+
+///
+/// Moves the given instruction of the game, which was at the given address, so that it can be
+/// run from anywhere.
+///
+/// A RIP relative memory operand is replaced by the address it refers to, which is first
+/// loaded into the clobber register. Branches can't be moved.
+///
+fn relocate_insn(
+    code: &[u8],
+    origin: usize,
+    clobber: Register
+) -> Result<Vec<u8>, ()> {
+    let insn = decode(code).ok_or(())?;
+    let code = &code[..insn.len];
+    if insn.branch.is_some() {
+        return Err(());
+    }
+
+    let Some(rel32) = insn.rel32 else {
+        return Ok(code.to_vec());
+    };
+
+    // The ModRM byte comes right before the displacement, as RIP relative operands have no
+    // SIB byte. The base of the new operand is given by ModRM alone, so REX.B must be clear.
+    let modrm = insn.modrm.ok_or(())?;
+    if insn.vex || (insn.rex & 1 != 0) || matches!(clobber, Register::Rsp)
+            || (modrm & 0xc7 != 0x05) || (rel32 == 0) || (code[rel32 - 1] != modrm) {
+        return Err(());
+    }
+
+    let rel = i32::from_le_bytes(code[rel32..rel32 + 4].try_into().unwrap());
+    let target = (origin + insn.len).wrapping_add_signed(rel as isize);
+
+    // mov clobber, target, then the instruction with its operand changed to [clobber].
+    let mut out = vec![0x48, 0xb8 + clobber as u8];
+    out.extend_from_slice(&(target as u64).to_le_bytes());
+    out.extend_from_slice(&code[..rel32 - 1]);
+    if matches!(clobber, Register::Rbp) {
+        out.extend_from_slice(&[0x40 | (modrm & 0x38) | clobber as u8, 0]);
+    } else {
+        out.push((modrm & 0x38) | clobber as u8);
+    }
+    out.extend_from_slice(&code[rel32 + 4..]);
+    Ok(out)
+}
+
+///
+/// Assembles a stub at the given address, which runs the given patch code with the
+/// instruction at the given offset replaced by a table load, then jumps to the return address.
+///
+/// The patch code was read from the given address in the game. If the index is out of the
+/// bounds of the table, the replaced instruction is run instead of the table load.
+///
+/// Fails if any other instruction in the patch depends on where it is, as it can't be moved.
+///
+pub(crate) fn assemble_table_stub(
+    addr: usize,
+    origin: usize,
+    patch: &[u8],
+    load: usize,
+    table: *const f32,
+    first: usize,
+    len: usize,
+    index: Register,
+    dest: u8,
+    clobber: Register,
+    ret: usize
+) -> Result<Vec<u8>, ()> {
+    let mut code = Vec::new();
+    let (mut i, mut replaced) = (0, false);
+    while i < patch.len() {
+        let insn = decode(&patch[i..]).ok_or(())?;
+        if i == load {
+            let fallback = relocate_insn(&patch[i..], origin + i, clobber)?;
+            code.extend(assemble_table_load(
+                addr + code.len(), table, first, len, index, dest, clobber, &fallback
+            )?);
+            replaced = true;
+        } else if insn.rel32.is_none() && insn.branch.is_none() {
+            code.extend_from_slice(&patch[i..i + insn.len]);
+        } else {
+            return Err(());
+        }
+        i += insn.len;
+    }
+
+    // The load must have been the start of an instruction.
+    if !replaced {
+        return Err(());
+    }
+
+    let flow = match assemble_flow(addr + code.len(), ret, Flow::JumpRelative) {
+        Ok(jump) => jump,
+        Err(_) => assemble_flow(addr + code.len(), ret, Flow::JumpAbsolute)?
+    };
+    code.extend(flow);
+    Ok(code)
+}
+
+///
+/// Gets the offset of the end of the instruction at the given offset in the patch code.
+///
+/// Returns an error if the code can't be decoded.
+///
+pub(crate) fn insn_end(
+    patch: &[u8],
+    offset: usize
+) -> Result<usize, ()> {
+    Ok(offset + decode(patch.get(offset..).ok_or(())?).ok_or(())?.len)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// The address stubs are assembled to by the tests.
+    const STUB: usize = 0x1_8000_0000;
+
+    /// The address of the table used by the tests, which is within reach of the stubs.
+    const TABLE: usize = 0x1_8000_1000;
+
+    /// The address the patch was read from in the game, which is out of reach of the stubs.
+    const ORIGIN: usize = 0x7ff6_0000_1000;
+
+    // Instructions used by the tests.
+    const CALL_RAX_18: &[u8] = &[0xff, 0x50, 0x18];
+    const MOVSS_XMM8_RIP: &[u8] = &[0xf3, 0x44, 0x0f, 0x10, 0x05, 0x00, 0x01, 0x00, 0x00];
+    const MOVAPS_XMM6_XMM0: &[u8] = &[0x0f, 0x28, 0xf0];
+    const CALL_REL: &[u8] = &[0xe8, 0x00, 0x10, 0x00, 0x00];
+    const NOP: &[u8] = &[0x90];
+
+    /// Encodes the given address as a little endian rel32 from the given end of instruction.
+    fn rel32(
+        end: usize,
+        target: usize
+    ) -> [u8; 4] {
+        i32::try_from(target.wrapping_sub(end) as isize).unwrap().to_le_bytes()
+    }
+
+    #[test]
+    fn table_load_checks_the_index() {
+        let load = assemble_table_load(
+            STUB, TABLE as *const f32, 0, 18, Register::Rsi, 10, Register::Rax, NOP
+        ).unwrap();
+        assert_eq!(load, [
+            &[0x83, 0xfe, 18][..],
+            &[0x73, 15],
+            &[0x48, 0x8d, 0x05], &rel32(STUB + 12, TABLE),
+            &[0xf3, 0x44, 0x0f, 0x10, 0x14, 0xb0],
+            &[0xeb, 1],
+            NOP
+        ].concat());
+
+        // Long tables need a 32-bit length.
+        let load = assemble_table_load(
+            STUB, TABLE as *const f32, 0, 200, Register::Rcx, 1, Register::Rbp, NOP
+        ).unwrap();
+        assert_eq!(load, [
+            &[0x81, 0xf9, 200, 0, 0, 0][..],
+            &[0x73, 15],
+            &[0x48, 0x8d, 0x2d], &rel32(STUB + 15, TABLE),
+            &[0xf3, 0x0f, 0x10, 0x4c, 0x8d, 0x00],
+            &[0xeb, 1],
+            NOP
+        ].concat());
+    }
+
+    #[test]
+    fn far_tables_are_loaded_by_address() {
+        let load = assemble_table_load(
+            ORIGIN, TABLE as *const f32, 0, 18, Register::Rsi, 8, Register::Rax, NOP
+        ).unwrap();
+        assert_eq!(load, [
+            &[0x83, 0xfe, 18][..],
+            &[0x73, 18],
+            &[0x48, 0xb8], &(TABLE as u64).to_le_bytes(),
+            &[0xf3, 0x44, 0x0f, 0x10, 0x04, 0xb0],
+            &[0xeb, 1],
+            NOP
+        ].concat());
+    }
+
+    #[test]
+    fn table_load_skips_entries_before_the_first() {
+        // Indices below the first wrap around, and so fail the same check as those past the end.
+        let load = assemble_table_load(
+            STUB, TABLE as *const f32, 6, 18, Register::Rsi, 10, Register::Rax, NOP
+        ).unwrap();
+        assert_eq!(load, [
+            &[0x8d, 0x46, (-6i8) as u8][..],
+            &[0x83, 0xf8, 18],
+            &[0x73, 15],
+            &[0x48, 0x8d, 0x05], &rel32(STUB + 15, TABLE - 6 * 4),
+            &[0xf3, 0x44, 0x0f, 0x10, 0x14, 0xb0],
+            &[0xeb, 1],
+            NOP
+        ].concat());
+
+        // A large first index needs a 32-bit displacement.
+        let load = assemble_table_load(
+            STUB, TABLE as *const f32, 200, 18, Register::Rcx, 1, Register::Rdx, NOP
+        ).unwrap();
+        assert_eq!(load[..9], [
+            &[0x8d, 0x91][..], &(-200i32).to_le_bytes(),
+            &[0x83, 0xfa, 18]
+        ].concat());
+    }
+
+    #[test]
+    fn bad_table_loads_are_refused() {
+        let load = |first, len, index, dest, fallback: &[u8]| {
+            assemble_table_load(
+                STUB, TABLE as *const f32, first, len, index, dest, Register::Rax, fallback
+            )
+        };
+        assert!(load(0, 18, Register::Rsp, 0, NOP).is_err());
+        assert!(load(0, 18, Register::Rax, 0, NOP).is_err());
+        assert!(load(0, 18, Register::Rsi, 16, NOP).is_err());
+        assert!(load(0, 1 << 32, Register::Rsi, 0, NOP).is_err());
+        assert!(load(1 << 31, 18, Register::Rsi, 0, NOP).is_err());
+        assert!(load(0, 18, Register::Rsi, 0, &[0; 128]).is_err());
+    }
+
+    #[test]
+    fn relocated_loads_use_the_clobber_register() {
+        let target = (ORIGIN + MOVSS_XMM8_RIP.len() + 0x100) as u64;
+        assert_eq!(relocate_insn(MOVSS_XMM8_RIP, ORIGIN, Register::Rax).unwrap(), [
+            &[0x48, 0xb8][..], &target.to_le_bytes(),
+            &[0xf3, 0x44, 0x0f, 0x10, 0x00]
+        ].concat());
+
+        // RBP can only be a base with a displacement.
+        assert_eq!(relocate_insn(MOVSS_XMM8_RIP, ORIGIN, Register::Rbp).unwrap(), [
+            &[0x48, 0xbd][..], &target.to_le_bytes(),
+            &[0xf3, 0x44, 0x0f, 0x10, 0x45, 0x00]
+        ].concat());
+
+        // Code which doesn't depend on where it is stays the same.
+        assert_eq!(relocate_insn(MOVAPS_XMM6_XMM0, ORIGIN, Register::Rax).unwrap(),
+            MOVAPS_XMM6_XMM0);
+        assert!(relocate_insn(CALL_REL, ORIGIN, Register::Rax).is_err());
+        assert!(relocate_insn(MOVSS_XMM8_RIP, ORIGIN, Register::Rsp).is_err());
+    }
+
+    #[test]
+    fn table_stub_falls_back_to_the_original_load() {
+        let patch = [CALL_RAX_18, MOVSS_XMM8_RIP, MOVAPS_XMM6_XMM0].concat();
+        let ret = ORIGIN + patch.len();
+        let stub = assemble_table_stub(
+            STUB, ORIGIN, &patch, 3, TABLE as *const f32, 6, 18, Register::Rsi, 8, Register::Rax,
+            ret
+        ).unwrap();
+
+        let fallback = relocate_insn(MOVSS_XMM8_RIP, ORIGIN + 3, Register::Rax).unwrap();
+        let load = assemble_table_load(
+            STUB + 3, TABLE as *const f32, 6, 18, Register::Rsi, 8, Register::Rax, &fallback
+        ).unwrap();
+        let body = [CALL_RAX_18, &load, MOVAPS_XMM6_XMM0].concat();
+        let jump = assemble_flow(STUB + body.len(), ret, Flow::JumpAbsolute).unwrap();
+        assert_eq!(stub, [body, jump].concat());
+    }
+
+    #[test]
+    fn bad_table_stubs_are_refused() {
+        let table = TABLE as *const f32;
+        let stub = |patch: &[u8], load| {
+            assemble_table_stub(
+                STUB, ORIGIN, patch, load, table, 6, 18, Register::Rsi, 8, Register::Rax, ORIGIN
+            )
+        };
+
+        // The load must start an instruction, and the rest must be able to move.
+        assert!(stub(&[CALL_RAX_18, MOVSS_XMM8_RIP].concat(), 4).is_err());
+        assert!(stub(&[CALL_RAX_18, MOVSS_XMM8_RIP].concat(), 12).is_err());
+        assert!(stub(&[CALL_REL, MOVSS_XMM8_RIP].concat(), 5).is_err());
+        assert!(stub(&[MOVSS_XMM8_RIP, MOVSS_XMM8_RIP].concat(), 0).is_err());
+    }
+}
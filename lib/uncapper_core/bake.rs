@@ -0,0 +1,287 @@
+//!
+//! @file bake.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Compiles an INI file into the constant settings tables of a baked configuration.
+//! @bug No known bugs.
+//!
+//! The INI is read the same way the plugin reads it at runtime: missing fields are filled in
+//! from the shipped INI, and leveled sections give the value of the nearest level at or below
+//! the one requested. Leveled sections are expanded into dense tables which end at their last
+//! configured level, so the plugin can index them directly and clamp anything past the end.
+//!
+//! A baked configuration can't be fixed by editing the INI in game, so any value which fails
+//! to parse stops the build instead of being skipped with a warning.
+//!
+
+use std::fmt::Write;
+use std::path::Path;
+use std::str::FromStr;
+
+use plugin_ini::Ini;
+
+/// The skill names used by the INI, in skill slot order.
+const SKILL_NAMES: [&str; 18] = [
+    "OneHanded",
+    "TwoHanded",
+    "Marksman",
+    "Block",
+    "Smithing",
+    "HeavyArmor",
+    "LightArmor",
+    "Pickpocket",
+    "LockPicking",
+    "Sneak",
+    "Alchemy",
+    "SpeechCraft",
+    "Alteration",
+    "Conjuration",
+    "Destruction",
+    "Illusion",
+    "Restoration",
+    "Enchanting"
+];
+
+/// The highest level a leveled section may configure, which bounds the size of the tables.
+const MAX_TABLE_LEVEL: u32 = 0xffff;
+
+/// A skill exp multiplier, holding both the base and offset multiplier.
+#[derive(Copy, Clone)]
+struct Mult(f32, f32);
+
+/// Parses skill multipliers the same way the plugin does, with an optional offset multiplier.
+impl FromStr for Mult {
+    type Err = <f32 as FromStr>::Err;
+
+    fn from_str(
+        s: &str
+    ) -> Result<Self, Self::Err> {
+        if let Some((base, offset)) = s.split_once('/') {
+            if offset.trim().is_empty() {
+                Ok(Self(f32::from_str(base)?, f32::from_str(base)?))
+            } else {
+                Ok(Self(f32::from_str(base)?, f32::from_str(offset)?))
+            }
+        } else {
+            Ok(Self(f32::from_str(s)?, 1.0))
+        }
+    }
+}
+
+///
+/// Reads the INI file at the given path and writes the baked settings module to the given
+/// output file.
+///
+pub fn bake(
+    path: &Path,
+    shipped_ini: &str,
+    out: &Path
+) {
+    let mut ini = Ini::from_path(path).unwrap_or_else(|_| {
+        panic!("Could not load the INI file to bake: {}", path.display())
+    });
+    ini.update(&Ini::from_str(shipped_ini).unwrap());
+
+    let mut s = String::new();
+    writeln!(s, "// Generated by build.rs from {}. Do not edit.", path.display()).unwrap();
+
+    const GEN_SEC: &str = "General";
+    const EN_SEC: &str = "Enchanting";
+    const LEG_SEC: &str = "LegendarySkill";
+    for (name, section, key, default) in [
+        ("SKILL_CAPS_EN", GEN_SEC, "bUseSkillCaps", true),
+        ("SKILL_FORMULA_CAPS_EN", GEN_SEC, "bUseSkillFormulaCaps", true),
+        ("SKILL_FORMULA_UI_FIX_EN", GEN_SEC, "bUseSkillFormulaCapsUIFix", true),
+        ("ENCHANTING_PATCH_EN", GEN_SEC, "bUseEnchanterCaps", true),
+        ("SKILL_EXP_MULTS_EN", GEN_SEC, "bUseSkillExpGainMults", true),
+        ("LEVEL_EXP_MULTS_EN", GEN_SEC, "bUsePCLevelSkillExpMults", true),
+        ("PERK_POINTS_EN", GEN_SEC, "bUsePerksAtLevelUp", true),
+        ("ATTR_POINTS_EN", GEN_SEC, "bUseAttributesAtLevelUp", true),
+        ("LEGENDARY_EN", GEN_SEC, "bUseLegendarySettings", true),
+        ("SHARE_VERSION_DB", GEN_SEC, "bShareVersionDb", false),
+        ("ENCHANT_USE_LINEAR_CHARGE", EN_SEC, "bUseLinearChargeFormula", false),
+        ("LEGENDARY_KEEP_SKILL_LEVEL", LEG_SEC, "bLegendaryKeepSkillLevel", false),
+        ("LEGENDARY_HIDE_BUTTON", LEG_SEC, "bHideLegendaryButton", false)
+    ] {
+        let val = field(&ini, section, key, default);
+        writeln!(s, "pub const {}: bool = {};", name, val).unwrap();
+    }
+
+    for (name, section, key, default) in [
+        ("ENCHANT_MAGNITUDE_CAP", EN_SEC, "iMagnitudeLevelCap", 100),
+        ("ENCHANT_CHARGE_CAP", EN_SEC, "iChargeLevelCap", 199),
+        ("LEGENDARY_SKILL_LEVEL_EN", LEG_SEC, "iSkillLevelEnableLegendary", 100),
+        ("LEGENDARY_SKILL_LEVEL_AFTER", LEG_SEC, "iSkillLevelAfterLegendary", 0)
+    ] {
+        let val: u32 = field(&ini, section, key, default);
+        writeln!(s, "pub const {}: u32 = {};", name, val).unwrap();
+    }
+
+    for (name, section) in [
+        ("SKILL_CAPS", "SkillCaps"),
+        ("SKILL_FORMULA_CAPS", "SkillFormulaCaps")
+    ] {
+        let caps = SKILL_NAMES.map(|skill| field(&ini, section, &format!("i{}", skill), 100u32));
+        writeln!(s, "pub static {}: [u32; SKILL_COUNT] = {:?};", name, caps).unwrap();
+    }
+
+    // The flat multipliers are folded into the skill level tables, in the same order the
+    // plugin multiplies them at runtime.
+    let lit_mult = |m: Mult| format!("SkillMult {{ base: {}, offset: {} }}", lit(m.0), lit(m.1));
+    let skill_mults = SKILL_NAMES.map(|skill| {
+        field(&ini, "SkillExpGainMults", &format!("f{}", skill), Mult(1.0, 1.0))
+    });
+    write_skill_tables(&mut s, &ini, "SKILL_EXP_BY_SKILL", "SkillMult",
+                       "SkillExpGainMults\\BaseSkillLevel", Mult(1.0, 1.0),
+                       |slot, m| lit_mult(Mult(skill_mults[slot].0 * m.0,
+                                               skill_mults[slot].1 * m.1)));
+    write_skill_tables(&mut s, &ini, "SKILL_EXP_BY_PC", "SkillMult",
+                       "SkillExpGainMults\\CharacterLevel", Mult(1.0, 1.0),
+                       |_, m| lit_mult(m));
+
+    let level_mults = SKILL_NAMES.map(|skill| {
+        field(&ini, "LevelSkillExpMults", &format!("f{}", skill), 1.0f32)
+    });
+    write_skill_tables(&mut s, &ini, "LEVEL_EXP_BY_SKILL", "f32",
+                       "LevelSkillExpMults\\BaseSkillLevel", 1.0f32,
+                       |slot, m| lit(level_mults[slot] * m));
+    write_skill_tables(&mut s, &ini, "LEVEL_EXP_BY_PC", "f32",
+                       "LevelSkillExpMults\\CharacterLevel", 1.0f32,
+                       |_, m| lit(m));
+
+    // Partial perk awards depend on every level before the requested one, so the perk list
+    // is kept as-is and accumulated by the plugin.
+    let perks = leveled(&ini, "PerksAtLevelUp", 1.0f32);
+    writeln!(s, "pub static PERKS_AT_LEVEL_UP: &[LevelItem<f32>] = &[").unwrap();
+    for (level, item) in perks.iter() {
+        writeln!(s, "    LevelItem {{ level: {}, item: {} }},", level, lit(*item)).unwrap();
+    }
+    writeln!(s, "];").unwrap();
+
+    // The (hp, mp, sp, cw) gains for the health, magicka, and stamina choices at each level.
+    let attributes = [
+        ["HealthAtLevelUp", "MagickaAtHealthLevelUp", "StaminaAtHealthLevelUp",
+         "CarryWeightAtHealthLevelUp"],
+        ["HealthAtMagickaLevelUp", "MagickaAtLevelUp", "StaminaAtMagickaLevelUp",
+         "CarryWeightAtMagickaLevelUp"],
+        ["HealthAtStaminaLevelUp", "MagickaAtStaminaLevelUp", "StaminaAtLevelUp",
+         "CarryWeightAtStaminaLevelUp"]
+    ].map(|choice| choice.map(|section| {
+        let default = match section {
+            "HealthAtLevelUp" | "MagickaAtLevelUp" | "StaminaAtLevelUp" => 10,
+            "CarryWeightAtStaminaLevelUp" => 5,
+            _ => 0
+        };
+        leveled(&ini, section, default as u32)
+    }));
+    let last = attributes.iter().flatten().map(|l| l.last().unwrap().0).max().unwrap();
+    writeln!(s, "pub static ATTRIBUTES: &[[(f32, f32, f32, f32); 3]] = &[").unwrap();
+    for level in 0..=last {
+        let gains = attributes.each_ref().map(|choice| {
+            let [hp, mp, sp, cw] = choice.each_ref().map(|l| lit(nearest(l, level) as f32));
+            format!("({}, {}, {}, {})", hp, mp, sp, cw)
+        });
+        writeln!(s, "    [{}, {}, {}],", gains[0], gains[1], gains[2]).unwrap();
+    }
+    writeln!(s, "];").unwrap();
+
+    std::fs::write(out, s).unwrap();
+}
+
+///
+/// Writes a table holding the dense leveled table of each skill, as read from the skill
+/// subsections of the given section.
+///
+fn write_skill_tables<T: Copy + FromStr>(
+    s: &mut String,
+    ini: &Ini,
+    name: &str,
+    ty: &str,
+    section: &str,
+    default: T,
+    mut lit_item: impl FnMut(usize, T) -> String
+) {
+    writeln!(s, "pub static {}: [&[{}]; SKILL_COUNT] = [", name, ty).unwrap();
+    for (slot, skill) in SKILL_NAMES.iter().enumerate() {
+        let items = leveled(ini, &format!("{}\\{}", section, skill), default);
+        let table = (0..=items.last().unwrap().0).map(|level| {
+            lit_item(slot, nearest(&items, level))
+        }).collect::<Vec<_>>();
+        writeln!(s, "    &[{}],", table.join(", ")).unwrap();
+    }
+    writeln!(s, "];").unwrap();
+}
+
+/// Reads a single field from the INI, using the default if it is missing.
+fn field<T: FromStr>(
+    ini: &Ini,
+    section: &str,
+    name: &str,
+    default: T
+) -> T {
+    let Some(field) = ini.section(section).and_then(|s| s.field(name)).ok() else {
+        return default;
+    };
+
+    field.value().unwrap_or_else(|| panic!("Invalid value for {}: {}", section, name))
+}
+
+///
+/// Reads a leveled section from the INI, sorted by level.
+///
+/// As in the plugin, the first value given for a level is used, and an empty or missing
+/// section holds only the default value at level 0.
+///
+fn leveled<T: Copy + FromStr>(
+    ini: &Ini,
+    section: &str,
+    default: T
+) -> Vec<(u32, T)> {
+    let mut items: Vec<(u32, T)> = Vec::new();
+    if let Ok(sec) = ini.section(section) {
+        for field in sec.fields() {
+            let level = u32::from_str(field.name()).unwrap_or_else(|_| {
+                panic!("Invalid level in [{}]: {}", section, field.name())
+            });
+            assert!(level <= MAX_TABLE_LEVEL, "Level {} in [{}] is too high", level, section);
+
+            let item = field.value().unwrap_or_else(|| {
+                panic!("Invalid value in [{}] for level {}", section, level)
+            });
+            if let Err(i) = items.binary_search_by_key(&level, |(l, _)| *l) {
+                items.insert(i, (level, item));
+            }
+        }
+    }
+
+    if items.is_empty() {
+        items.push((0, default));
+    }
+
+    items
+}
+
+///
+/// Finds the value of the nearest level at or below the given one, or the first value if
+/// there is none.
+///
+fn nearest<T: Copy>(
+    items: &[(u32, T)],
+    level: u32
+) -> T {
+    match items.binary_search_by_key(&level, |(l, _)| *l) {
+        Ok(i) => items[i].1,
+        Err(0) => items[0].1,
+        Err(i) => items[i - 1].1
+    }
+}
+
+/// Formats a float as a Rust expression which evaluates to exactly the same value.
+fn lit(
+    val: f32
+) -> String {
+    if val.is_finite() {
+        format!("{:?}", val)
+    } else {
+        format!("f32::from_bits({:#x})", val.to_bits())
+    }
+}
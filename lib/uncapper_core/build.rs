@@ -0,0 +1,65 @@
+//!
+//! @file build.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Builds the native wrappers and the default settings of the uncapper.
+//! @bug No known bugs.
+//!
+
+mod bake;
+
+use std::path::{Path, PathBuf};
+use std::fs::File;
+use std::io::Write;
+
+const NATIVE_WRAPPERS: &str = "src/skyrim/native_wrappers.cpp";
+
+/// The directory of the plugin, which holds the shipped INI file.
+const PLUGIN_DIR: &str = "../../SkyrimUncapper";
+
+/// The environment variable which gives the INI file to bake into the plugin.
+const BAKED_INI_VAR: &str = "UNCAPPER_BAKED_INI";
+
+fn main() {
+    // Always rerun this build script.
+    println!("cargo:rerun-if-changed=../../");
+
+    // Host builds, such as those used by the benchmarks, have no game to call into.
+    let is_windows = std::env::var_os("CARGO_CFG_WINDOWS").is_some();
+
+    // Build C++ exception nets.
+    println!("cargo:rerun-if-changed={}", NATIVE_WRAPPERS);
+    if is_windows {
+        cc::Build::new().cpp(true).file(NATIVE_WRAPPERS).compile("nets");
+    }
+
+    // Generate git version information.
+    let std::process::Output { stdout, .. } = std::process::Command::new("git").args(&[
+        "describe",
+        "--always",
+        "--dirty",
+        "--tags"
+    ]).output().unwrap();
+    let version = String::from_utf8(stdout).unwrap();
+    println!("cargo:rustc-env=UNCAPPER_GIT_VERSION={}", version.trim());
+
+    // Create a compressed default INI file.
+    let comp_ini = PathBuf::from(std::env::var("OUT_DIR").unwrap()).join("SkyrimUncapper.ini.lz");
+    let mut f = File::create(&comp_ini).unwrap();
+    let base_file = include_str!("../../SkyrimUncapper/SkyrimUncapper.ini").as_bytes();
+    let compressed_file = lz77::compress(base_file);
+    f.write(compressed_file.as_slice()).unwrap();
+
+    // Compile the settings into the plugin, if requested. Relative paths are taken from the
+    // plugin directory, and the shipped INI is used if no file was given.
+    if std::env::var_os("CARGO_FEATURE_BAKED_CONFIG").is_some() {
+        println!("cargo:rerun-if-env-changed={}", BAKED_INI_VAR);
+        let ini = std::env::var_os(BAKED_INI_VAR).map(PathBuf::from).unwrap_or_else(|| {
+            PathBuf::from("SkyrimUncapper.ini")
+        });
+        let ini = Path::new(PLUGIN_DIR).join(ini);
+        println!("cargo:rerun-if-changed={}", ini.display());
+
+        let out = PathBuf::from(std::env::var("OUT_DIR").unwrap()).join("baked_config.rs");
+        bake::bake(&ini, std::str::from_utf8(base_file).unwrap(), &out);
+    }
+}
@@ -0,0 +1,313 @@
+//!
+//! @file extension.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Runs the callbacks other plugins register to extend our hooks.
+//! @bug No known bugs.
+//!
+//! Callbacks are collected as requests come in while the game loads. Once every plugin has
+//! loaded, they are frozen into a fixed array for each event and phase, which the hooks run
+//! without taking any lock. An event with no callbacks has an empty array, so it costs a hook
+//! only a length check.
+//!
+//! See the uncapper_ext crate for the interface other plugins use.
+//!
+
+use std::ffi::CStr;
+use std::mem::size_of;
+use std::sync::Mutex;
+
+use racy_cell::RacyCell;
+use skse64::event::{register_listener, register_plugin_listener};
+use skse64::log::skse_message;
+use skse64::plugin_api::Message;
+use uncapper_ext::*;
+
+/// The frozen callbacks of a single event, in the order they were registered.
+pub struct EventDispatch<E: 'static> {
+    pre: &'static [Callback<E>],
+    post: &'static [Callback<E>]
+}
+
+/// The frozen callbacks of every event.
+pub struct ExtensionDispatch {
+    pub skill_exp: EventDispatch<SkillExpEvent>,
+    pub level_exp: EventDispatch<LevelExpEvent>,
+    pub perk_delta: EventDispatch<PerkDeltaEvent>,
+    pub attribute_gain: EventDispatch<AttributeGainEvent>
+}
+
+/// The callbacks registered by other plugins, until they are frozen.
+struct Registry {
+    pending: Vec<ExtensionCallbacks>,
+    /// Set once the callbacks are frozen, after which no more may be registered.
+    frozen: bool
+}
+
+/// The callbacks registered with the hooks of this plugin.
+static REGISTRY: Mutex<Registry> = Mutex::new(Registry::new());
+
+/// The callbacks run by the hooks. Only written by freeze(), before the game runs any hook.
+static DISPATCH: RacyCell<ExtensionDispatch> = RacyCell::new(ExtensionDispatch {
+    skill_exp: EventDispatch::EMPTY,
+    level_exp: EventDispatch::EMPTY,
+    perk_delta: EventDispatch::EMPTY,
+    attribute_gain: EventDispatch::EMPTY
+});
+
+impl<E: 'static> EventDispatch<E> {
+    const EMPTY: Self = Self { pre: &[], post: &[] };
+
+    /// Creates the dispatch arrays of an event from the given registered callbacks.
+    fn freeze(
+        callbacks: impl Iterator<Item = EventCallbacks<E>> + Clone
+    ) -> Self {
+        let leak = |v: Vec<Callback<E>>| -> &'static [Callback<E>] {
+            if v.is_empty() { &[] } else { Box::leak(v.into_boxed_slice()) }
+        };
+
+        Self {
+            pre: leak(callbacks.clone().filter_map(|c| c.pre).collect()),
+            post: leak(callbacks.filter_map(|c| c.post).collect())
+        }
+    }
+
+    ///
+    /// Runs the pre callbacks of the event, then computes the result of the hook, then runs
+    /// the post callbacks.
+    ///
+    #[inline(always)]
+    pub fn run(
+        &self,
+        event: &mut E,
+        compute: impl FnOnce(&mut E)
+    ) {
+        for callback in self.pre.iter() {
+            // SAFETY: The plugin which registered the callback promised it takes this event.
+            unsafe { callback(event) };
+        }
+
+        compute(event);
+
+        for callback in self.post.iter() {
+            // SAFETY: As above.
+            unsafe { callback(event) };
+        }
+    }
+}
+
+impl Registry {
+    /// Creates a registry with no callbacks.
+    const fn new() -> Self {
+        Self { pending: Vec::new(), frozen: false }
+    }
+
+    /// Registers the callbacks in the given request, if it has our ABI version.
+    fn register(
+        &mut self,
+        request: &mut ExtensionRequest
+    ) {
+        if request.abi != EXTENSION_ABI {
+            return;
+        }
+
+        if self.frozen {
+            request.status = ExtensionRequest::TOO_LATE;
+        } else {
+            self.pending.push(request.callbacks);
+            request.status = ExtensionRequest::REGISTERED;
+        }
+    }
+
+    /// Freezes the registered callbacks into dispatch arrays, unless they already were.
+    fn freeze(
+        &mut self
+    ) -> Option<ExtensionDispatch> {
+        if std::mem::replace(&mut self.frozen, true) {
+            return None;
+        }
+
+        if !self.pending.is_empty() {
+            skse_message!(
+                "[SUCCESS] Running the hook callbacks of {} plugin(s)",
+                self.pending.len()
+            );
+        }
+
+        let pending = &self.pending;
+        Some(ExtensionDispatch {
+            skill_exp: EventDispatch::freeze(pending.iter().map(|c| c.skill_exp)),
+            level_exp: EventDispatch::freeze(pending.iter().map(|c| c.level_exp)),
+            perk_delta: EventDispatch::freeze(pending.iter().map(|c| c.perk_delta)),
+            attribute_gain: EventDispatch::freeze(pending.iter().map(|c| c.attribute_gain))
+        })
+    }
+}
+
+/// Listens for extension requests, and freezes the callbacks once every plugin has loaded.
+pub fn init() {
+    register_plugin_listener(EXTENSION_MESSAGE, answer_request);
+    register_listener(Message::SKSE_POST_POST_LOAD, |_| freeze());
+}
+
+///
+/// Registers the callbacks in the given request, if it has our ABI version.
+///
+/// Requests which arrive after the callbacks are frozen are refused.
+///
+pub fn register(
+    request: &mut ExtensionRequest
+) {
+    REGISTRY.lock().unwrap().register(request);
+}
+
+///
+/// Freezes the registered callbacks into the arrays run by the hooks.
+///
+/// Must be called before any hook runs. The game runs none of them until after every plugin
+/// has loaded. Later calls do nothing.
+///
+pub fn freeze() {
+    let Some(dispatch) = REGISTRY.lock().unwrap().freeze() else {
+        return;
+    };
+
+    unsafe {
+        // SAFETY: No hook is running yet, so nothing can be reading the arrays.
+        *DISPATCH.get() = dispatch;
+    }
+}
+
+/// Gets the callbacks run by the hooks.
+#[inline(always)]
+pub fn dispatch() -> &'static ExtensionDispatch {
+    // SAFETY: The arrays are only written before any hook runs.
+    unsafe { &*DISPATCH.get() }
+}
+
+/// Answers an extension request from another plugin.
+fn answer_request(
+    msg: &Message
+) {
+    if (msg.data_len as usize != size_of::<ExtensionRequest>()) || msg.data.is_null() {
+        return;
+    }
+
+    // SAFETY: The sender gave us a request of the correct size.
+    let request = unsafe { &mut *(msg.data as *mut ExtensionRequest) };
+    register(request);
+
+    if !msg.sender.is_null() {
+        // SAFETY: SKSE gives the name of the sending plugin as a C string.
+        let sender = unsafe { CStr::from_ptr(msg.sender) }.to_string_lossy();
+        match request.status {
+            ExtensionRequest::REGISTERED => {
+                skse_message!("[SUCCESS] {} registered hook callbacks", sender);
+            },
+            ExtensionRequest::TOO_LATE => {
+                skse_message!("[FAILURE] {} registered hook callbacks after loading", sender);
+            },
+            _ => skse_message!("[FAILURE] {} uses another hook callback ABI", sender)
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Appends a digit to the given field of an event, so that it records which callbacks
+    /// changed it, and in what order.
+    fn append(
+        field: &mut f32,
+        digit: f32
+    ) {
+        *field = *field * 10.0 + digit;
+    }
+
+    unsafe extern "C" fn pre_1(
+        event: *mut SkillExpEvent
+    ) {
+        append(&mut (*event).base, 1.0);
+    }
+
+    unsafe extern "C" fn pre_2(
+        event: *mut SkillExpEvent
+    ) {
+        append(&mut (*event).base, 2.0);
+    }
+
+    unsafe extern "C" fn post_1(
+        event: *mut SkillExpEvent
+    ) {
+        append(&mut (*event).exp, 1.0);
+    }
+
+    unsafe extern "C" fn post_2(
+        event: *mut SkillExpEvent
+    ) {
+        append(&mut (*event).exp, 2.0);
+    }
+
+    /// Creates a request to register the given skill experience callbacks.
+    fn skill_exp_request(
+        pre: Option<Callback<SkillExpEvent>>,
+        post: Option<Callback<SkillExpEvent>>
+    ) -> ExtensionRequest {
+        ExtensionRequest::new(ExtensionCallbacks {
+            skill_exp: EventCallbacks { pre, post },
+            ..ExtensionCallbacks::default()
+        })
+    }
+
+    #[test]
+    fn callbacks_run_in_registration_order() {
+        let mut registry = Registry::new();
+        let first = &mut skill_exp_request(Some(pre_1), None);
+        let second = &mut skill_exp_request(Some(pre_2), Some(post_1));
+        for request in [first, second] {
+            registry.register(request);
+            assert!(request.is_registered());
+        }
+        registry.register(&mut skill_exp_request(None, Some(post_2)));
+
+        let dispatch = registry.freeze().unwrap();
+        assert_eq!((dispatch.skill_exp.pre.len(), dispatch.skill_exp.post.len()), (2, 2));
+        assert!(dispatch.level_exp.pre.is_empty() && dispatch.level_exp.post.is_empty());
+        assert!(dispatch.perk_delta.pre.is_empty() && dispatch.attribute_gain.post.is_empty());
+
+        // Pre callbacks change what the hook computes from, and post callbacks its result.
+        let mut event = SkillExpEvent { skill: 0, base: 0.0, offset: 0.0, exp: 0.0 };
+        dispatch.skill_exp.run(&mut event, |event| {
+            assert_eq!(event.base, 12.0);
+            event.exp = event.base * 100.0;
+        });
+        assert_eq!(event.exp, 120012.0);
+    }
+
+    #[test]
+    fn requests_with_another_abi_are_unanswered() {
+        let mut registry = Registry::new();
+        let mut bad = skill_exp_request(Some(pre_1), Some(post_1));
+        bad.abi = EXTENSION_ABI + 1;
+        registry.register(&mut bad);
+        assert_eq!(bad.status, ExtensionRequest::UNANSWERED);
+
+        let dispatch = registry.freeze().unwrap();
+        assert!(dispatch.skill_exp.pre.is_empty() && dispatch.skill_exp.post.is_empty());
+    }
+
+    #[test]
+    fn requests_after_freezing_are_too_late() {
+        let mut registry = Registry::new();
+        registry.register(&mut skill_exp_request(Some(pre_1), None));
+        assert!(registry.freeze().is_some());
+
+        let mut late = skill_exp_request(Some(pre_2), None);
+        registry.register(&mut late);
+        assert_eq!(late.status, ExtensionRequest::TOO_LATE);
+
+        // Later freezes change nothing, so the late callbacks never run.
+        assert!(registry.freeze().is_none());
+        assert_eq!(registry.pending.len(), 1);
+    }
+}
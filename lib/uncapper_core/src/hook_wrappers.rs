@@ -6,8 +6,6 @@
 //!
 
 extern "system" {
-    pub fn skill_cap_patch_wrapper_ae();
-    pub fn skill_cap_patch_wrapper_se();
     pub fn max_charge_begin_wrapper_ae();
     pub fn max_charge_begin_wrapper_se();
     pub fn max_charge_end_wrapper_ae();
@@ -33,7 +31,39 @@ extern "system" {
     pub fn clear_legendary_button_wrapper_se();
 }
 
+// The hooks and their wrappers are kept together in their own section, away from the cold
+// code of the plugin, so that the code run on each hook call shares as few cache lines as
+// possible. The section is merged into the main text section when the plugin is linked.
+#[cfg(windows)]
+macro_rules! hot_text {
+    () => { ".text$uncapper_hot" }
+}
+#[cfg(not(windows))]
+macro_rules! hot_text {
+    () => { ".text.hot.uncapper" }
+}
+pub(crate) use hot_text;
+
+#[cfg(windows)]
+core::arch::global_asm! {
+    concat!(".section ", hot_text!(), ",\"xr\""),
+    include_str!("hook_wrappers.S"),
+    ".text",
+    options(att_syntax)
+}
+
+#[cfg(not(windows))]
 core::arch::global_asm! {
+    concat!(".section ", hot_text!(), ",\"ax\",@progbits"),
     include_str!("hook_wrappers.S"),
+    ".text",
+    options(att_syntax)
+}
+
+// ELF shared objects can't reference their exported data directly, so host builds keep the
+// trampoline the wrappers jump through local to the library.
+#[cfg(not(windows))]
+core::arch::global_asm! {
+    ".hidden player_avo_get_current_return_trampoline",
     options(att_syntax)
 }
@@ -9,12 +9,18 @@
 //! Note that each function in this file is either called by the game or by
 //! an assembly wrapper, so they must be declared extern system.
 //!
+//! The experience and level-up hooks also run the callbacks other plugins have registered
+//! with the extension module, around the changes they make themselves.
+//!
 
 use std::ffi::c_int;
 
 use skyrim_patcher::{Descriptor, Hook, Register, GameLocation, GameRef, signature};
+use uncapper_ext::{AttributeGainEvent, LevelExpEvent, PerkDeltaEvent, SkillExpEvent};
 
+use crate::extension;
 use crate::settings;
+use crate::trace::{self, TraceEffect, TraceHook, TraceValue};
 use crate::hook_wrappers::*;
 use crate::skyrim::*;
 
@@ -49,12 +55,22 @@ disarray::disarray! {
         // and returned to, at the request of the author of the eXPerience mod (17751).
         // This is handled by the patcher, we need only make our signature long enough.
         //
+        // The cap is a pure lookup, so the patcher loads it from the skill cap table in place
+        // of the game's constant, rather than calling get_skill_cap_hook(). Traced builds use
+        // the same load, so lookups aren't captured. Anything which isn't a skill gets the
+        // game's constant. The check overwrites the flags, which are dead after the call.
+        //
         Descriptor::Patch {
             name: "GetSkillCap",
             enabled: settings::is_skill_cap_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
-                entry: skill_cap_patch_wrapper_ae as *const u8,
+            hook: Hook::TableLoad {
+                load: 7,
+                table: std::ptr::addr_of!(settings::skill_cap_table).cast(),
+                first: settings::SKILL_CAP_TABLE_FIRST,
+                len: settings::SKILL_CAP_TABLE_LEN,
+                index: Register::Rsi,
+                dest: 10,
                 clobber: Register::Rax
             },
             loc: GameLocation::Ae { id: 41561, offset: 0x6f },
@@ -68,8 +84,13 @@ disarray::disarray! {
             name: "GetSkillCap",
             enabled: settings::is_skill_cap_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
-                entry: skill_cap_patch_wrapper_se as *const u8,
+            hook: Hook::TableLoad {
+                load: 3,
+                table: std::ptr::addr_of!(settings::skill_cap_table).cast(),
+                first: settings::SKILL_CAP_TABLE_FIRST,
+                len: settings::SKILL_CAP_TABLE_LEN,
+                index: Register::Rsi,
+                dest: 8,
                 clobber: Register::Rax
             },
             loc: GameLocation::Se { id: 40554, offset: 0x45 },
@@ -90,7 +111,7 @@ disarray::disarray! {
             name: "BeginMaxChargeCalculation",
             enabled: settings::is_enchant_patch_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: max_charge_begin_wrapper_ae as *const u8,
                 clobber: Register::Rax // Tmp from earlier cmove. Not used again.
             },
@@ -104,7 +125,7 @@ disarray::disarray! {
             name: "BeginMaxChargeCalculation",
             enabled: settings::is_enchant_patch_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: max_charge_begin_wrapper_se as *const u8,
                 clobber: Register::Rax // Tmp from earlier cmove. Not used again.
             },
@@ -118,7 +139,7 @@ disarray::disarray! {
             name: "EndMaxChargeCalculation",
             enabled: settings::is_enchant_patch_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: max_charge_end_wrapper_ae as *const u8,
                 clobber: Register::Rcx // Patch follows a function call.
             },
@@ -132,7 +153,7 @@ disarray::disarray! {
             name: "EndMaxChargeCalculation",
             enabled: settings::is_enchant_patch_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: max_charge_end_wrapper_se as *const u8,
                 clobber: Register::Rcx // Patch follows a function call.
             },
@@ -158,7 +179,7 @@ disarray::disarray! {
             name: "CalculateChargePointsPerUse",
             enabled: settings::is_enchant_patch_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: calculate_charge_points_per_use_wrapper_ae as *const u8,
                 clobber: Register::Rax
             },
@@ -178,7 +199,7 @@ disarray::disarray! {
             name: "CalculateChargePointsPerUse",
             enabled: settings::is_enchant_patch_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: calculate_charge_points_per_use_wrapper_se as *const u8,
                 clobber: Register::Rax
             },
@@ -202,7 +223,7 @@ disarray::disarray! {
             name: "PlayerAVOGetCurrent",
             enabled: settings::is_skill_formula_cap_enabled,
             conflicts: None,
-            hook: Hook::Jump12 {
+            hook: Hook::Jump {
                 entry: player_avo_get_current_wrapper as *const u8,
                 clobber: Register::Rax,
                 trampoline: player_avo_get_current_return_trampoline.inner()
@@ -217,7 +238,7 @@ disarray::disarray! {
             name: "PlayerAVOGetCurrent",
             enabled: settings::is_skill_formula_cap_enabled,
             conflicts: None,
-            hook: Hook::Jump12 {
+            hook: Hook::Jump {
                 entry: player_avo_get_current_wrapper as *const u8,
                 clobber: Register::Rax,
                 trampoline: player_avo_get_current_return_trampoline.inner()
@@ -239,7 +260,7 @@ disarray::disarray! {
             name: "DisplayTrueSkillLevel",
             enabled: settings::is_skill_formula_cap_ui_fix_enabled,
             conflicts: Some(FORMULA_UI_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: display_true_skill_level_hook_ae as *const u8,
                 clobber: Register::Rax
             },
@@ -256,7 +277,7 @@ disarray::disarray! {
             name: "DisplayTrueSkillLevel",
             enabled: settings::is_skill_formula_cap_ui_fix_enabled,
             conflicts: Some(FORMULA_UI_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: display_true_skill_level_hook_se as *const u8,
                 clobber: Register::Rax
             },
@@ -280,7 +301,7 @@ disarray::disarray! {
             name: "DisplayTrueSkillColor",
             enabled: settings::is_skill_formula_cap_ui_fix_enabled,
             conflicts: Some(FORMULA_UI_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: display_true_skill_color_hook as *const u8,
                 clobber: Register::Rax
             },
@@ -302,7 +323,7 @@ disarray::disarray! {
             name: "ImprovePlayerSkillPoints",
             enabled: settings::is_skill_exp_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: improve_player_skill_points_wrapper_ae as *const u8,
                 clobber: Register::Rcx // Written to after this patch.
             },
@@ -317,7 +338,7 @@ disarray::disarray! {
             name: "ImprovePlayerSkillPoints",
             enabled: settings::is_skill_exp_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: improve_player_skill_points_wrapper_se as *const u8,
                 clobber: Register::Rcx // Written to after this patch, garbage before patch.
             },
@@ -337,7 +358,7 @@ disarray::disarray! {
             name: "ModifyPerkPool",
             enabled: settings::is_perk_points_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: modify_perk_pool_wrapper_ae as *const u8,
                 clobber: Register::Rax
             },
@@ -356,7 +377,7 @@ disarray::disarray! {
             name: "ModifyPerkPool",
             enabled: settings::is_perk_points_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: modify_perk_pool_wrapper_se as *const u8,
                 clobber: Register::Rax
             },
@@ -380,7 +401,7 @@ disarray::disarray! {
             name: "ImproveLevelExpBySkillLevel",
             enabled: settings::is_level_exp_enabled,
             conflicts: Some(LEVEL_MULT_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: improve_level_exp_by_skill_level_wrapper_ae as *const u8,
                 clobber: Register::Rdx // Will be smashed after this hook anyway.
             },
@@ -394,7 +415,7 @@ disarray::disarray! {
             name: "ImproveLevelExpBySkillLevel",
             enabled: settings::is_level_exp_enabled,
             conflicts: Some(LEVEL_MULT_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: improve_level_exp_by_skill_level_wrapper_se as *const u8,
                 clobber: Register::Rax // Smashed earlier in the function.
             },
@@ -422,7 +443,7 @@ disarray::disarray! {
             name: "ImproveAttributeWhenLevelUp",
             enabled: settings::is_attr_points_enabled,
             conflicts: None,
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: improve_attribute_when_level_up_wrapper as *const u8,
                 clobber: Register::Rax
             },
@@ -454,7 +475,7 @@ disarray::disarray! {
             name: "LegendaryResetSkillLevel",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: legendary_reset_skill_level_wrapper as *const u8,
                 clobber: Register::Rax
             },
@@ -479,7 +500,7 @@ disarray::disarray! {
             name: "CheckConditionForLegendarySkill",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: check_condition_for_legendary_skill_wrapper as *const u8,
                 clobber: Register::Rdx
             },
@@ -501,7 +522,7 @@ disarray::disarray! {
             name: "CheckConditionForLegendarySkillAlt",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: check_condition_for_legendary_skill_wrapper as *const u8,
                 clobber: Register::Rdx
             },
@@ -523,7 +544,7 @@ disarray::disarray! {
             name: "HideLegendaryButton",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: hide_legendary_button_wrapper_ae as *const u8,
                 clobber: Register::Rax
             },
@@ -540,7 +561,7 @@ disarray::disarray! {
             name: "HideLegendaryButton",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: hide_legendary_button_wrapper_se as *const u8,
                 clobber: Register::Rax
             },
@@ -575,7 +596,7 @@ disarray::disarray! {
             name: "ClearLegendaryButton",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: clear_legendary_button_wrapper_ae as *const u8,
                 clobber: Register::Rax
             },
@@ -592,7 +613,7 @@ disarray::disarray! {
             name: "ClearLegendaryButton",
             enabled: settings::is_legendary_enabled,
             conflicts: Some(LEGENDARY_CONFLICTS),
-            hook: Hook::Call12 {
+            hook: Hook::Call {
                 entry: clear_legendary_button_wrapper_se as *const u8,
                 clobber: Register::Rax
             },
@@ -608,30 +629,44 @@ disarray::disarray! {
     ];
 }
 
+///
 /// Determines the real skill cap of the given skill.
-#[no_mangle]
-extern "system" fn get_skill_cap_hook(
+///
+/// No patch calls this, as the skill cap patch loads from the skill cap table instead. It is
+/// kept for the host tools, which drive the hooks directly, and is left out of the plugin when
+/// it is linked.
+///
+pub extern "system" fn get_skill_cap_hook(
     skill: c_int
 ) -> f32 {
-    assert!(settings::is_skill_cap_enabled());
-    settings::get_skill_cap(ActorAttribute::from_raw_skill(skill).unwrap())
+    trace::hook(TraceHook::GetSkillCap, &[skill.to_word()], || {
+        check_enabled(settings::is_skill_cap_enabled(), TraceHook::GetSkillCap);
+        let skill = ActorAttribute::from_raw_skill(skill).unwrap_or_else(|_| bad_attribute(skill));
+        settings::get_skill_cap(skill)
+    })
 }
 
 /// Begins a calculation for weapon charge by setting the enchant cap to use the charge value.
 #[no_mangle]
-extern "system" fn max_charge_begin_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn max_charge_begin_hook(
     enchant_type: u32
 ) {
-    const WEAPON_ENCHANT_TYPE: u32 = 0x29; // Defined by the game.
-    if enchant_type == WEAPON_ENCHANT_TYPE {
-        settings::use_enchant_charge_cap();
-    }
+    trace::hook(TraceHook::MaxChargeBegin, &[enchant_type.to_word()], || {
+        const WEAPON_ENCHANT_TYPE: u32 = 0x29; // Defined by the game.
+        if enchant_type == WEAPON_ENCHANT_TYPE {
+            settings::use_enchant_charge_cap();
+        }
+    })
 }
 
 /// Ends a calculation for weapon charge by returning the cap mode to magnitude, if necessary.
 #[no_mangle]
-extern "system" fn max_charge_end_hook() {
-    settings::use_enchant_magnitude_cap();
+#[link_section = hot_text!()]
+pub extern "system" fn max_charge_end_hook() {
+    trace::hook(TraceHook::MaxChargeEnd, &[], || {
+        settings::use_enchant_magnitude_cap();
+    })
 }
 
 ///
@@ -641,134 +676,184 @@ extern "system" fn max_charge_end_hook() {
 /// implementation caps the level in the calculation to 199.
 ///
 #[no_mangle]
-extern "system" fn calculate_charge_points_per_use_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn calculate_charge_points_per_use_hook(
     base_points: f32,
     max_charge: f32
 ) -> f32 {
-    assert!(settings::is_enchant_patch_enabled());
-
-    let cost_exponent = *ENCHANTING_COST_EXPONENT.get();
-    let cost_base = *ENCHANTING_SKILL_COST_BASE.get();
-    let cost_scale = *ENCHANTING_SKILL_COST_SCALE.get();
-    let cost_mult = *ENCHANTING_SKILL_COST_MULT.get();
-    let cap = settings::get_enchant_charge_cap();
-    let enchanting_level = cap.min(player_avo_get_current(ActorAttribute::Enchanting));
-
-    let base = cost_mult * base_points.powf(cost_exponent);
-    if settings::is_enchant_charge_linear() {
-        // Linearly scale between current min/max of charge points. Max scales with skills/perks,
-        // so this isn't perfectly linear. It still smooths the EQ a lot, though.
-        let max_level_scale = (cap * cost_base).powf(cost_scale);
-        let slope = (max_charge * max_level_scale) / (base * (1.0 - max_level_scale) * cap);
-        let intercept = max_charge / base;
-        let linear_charge = slope * enchanting_level + intercept;
-        max_charge / linear_charge
-    } else {
-        // Original game equation.
-        base * (1.0 - (enchanting_level * cost_base).powf(cost_scale))
-    }
+    let args = [base_points.to_word(), max_charge.to_word()];
+    trace::hook(TraceHook::CalculateChargePointsPerUse, &args, || {
+        check_enabled(
+            settings::is_enchant_patch_enabled(),
+            TraceHook::CalculateChargePointsPerUse
+        );
+
+        let cost_exponent = *ENCHANTING_COST_EXPONENT.get();
+        let cost_base = *ENCHANTING_SKILL_COST_BASE.get();
+        let cost_scale = *ENCHANTING_SKILL_COST_SCALE.get();
+        let cost_mult = *ENCHANTING_SKILL_COST_MULT.get();
+        let cap = settings::get_enchant_charge_cap();
+        let enchanting_level = cap.min(player_avo_get_current(ActorAttribute::Enchanting));
+
+        let base = cost_mult * base_points.powf(cost_exponent);
+        if settings::is_enchant_charge_linear() {
+            // Linearly scale between current min/max of charge points. Max scales with
+            // skills/perks, so this isn't perfectly linear. It still smooths the EQ a lot, though.
+            let max_level_scale = (cap * cost_base).powf(cost_scale);
+            let slope = (max_charge * max_level_scale) / (base * (1.0 - max_level_scale) * cap);
+            let intercept = max_charge / base;
+            let linear_charge = slope * enchanting_level + intercept;
+            max_charge / linear_charge
+        } else {
+            // Original game equation.
+            base * (1.0 - (enchanting_level * cost_base).powf(cost_scale))
+        }
+    })
 }
 
 /// Caps the formula results for each skill.
 #[no_mangle]
-extern "system" fn player_avo_get_current_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn player_avo_get_current_hook(
     av: *mut ActorValueOwner,
     attr: c_int
 ) -> f32 {
-    assert!(settings::is_skill_formula_cap_enabled());
+    trace::hook(TraceHook::PlayerAvoGetCurrent, &[attr.to_word()], || {
+        check_enabled(settings::is_skill_formula_cap_enabled(), TraceHook::PlayerAvoGetCurrent);
 
-    let mut val = unsafe {
-        // SAFETY: We are passing through the original arguments.
-        player_avo_get_current_unchecked(av, attr)
-    };
+        let mut val = unsafe {
+            // SAFETY: We are passing through the original arguments.
+            player_avo_get_current_unchecked(av, attr)
+        };
 
-    if let Ok(skill) = ActorAttribute::from_raw_skill(attr) {
-        val = val.min(settings::get_skill_formula_cap(skill)).max(0.0);
-    }
+        if let Ok(skill) = ActorAttribute::from_raw_skill(attr) {
+            val = val.min(settings::get_skill_formula_cap(skill)).max(0.0);
+        }
 
-    return val;
+        return val;
+    })
 }
 
 /// Applies a multiplier to the exp gain for the given skill.
 #[no_mangle]
-extern "system" fn improve_player_skill_points_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn improve_player_skill_points_hook(
     attr: c_int,
-    mut exp_base: f32,
-    mut exp_offset: f32
+    exp_base: f32,
+    exp_offset: f32
 ) -> f32 {
-    assert!(settings::is_skill_exp_enabled());
+    let args = [attr.to_word(), exp_base.to_word(), exp_offset.to_word()];
+    trace::hook(TraceHook::ImprovePlayerSkillPoints, &args, || {
+        check_enabled(settings::is_skill_exp_enabled(), TraceHook::ImprovePlayerSkillPoints);
 
-    if let Ok(skill) = ActorAttribute::from_raw_skill(attr) {
-        let (base_mult, offset_mult) = settings::get_skill_exp_mult(
-            skill,
-            player_avo_get_base(skill) as u32,
-            get_player_level()
-        );
-        exp_base *= base_mult;
-        exp_offset *= offset_mult;
-    }
+        let mut event = SkillExpEvent { skill: attr, base: exp_base, offset: exp_offset, exp: 0.0 };
+        extension::dispatch().skill_exp.run(&mut event, |event| {
+            if let Ok(skill) = ActorAttribute::from_raw_skill(event.skill) {
+                let (base_mult, offset_mult) = settings::get_skill_exp_mult(
+                    skill,
+                    player_avo_get_base(skill) as u32,
+                    get_player_level()
+                );
+                event.base *= base_mult;
+                event.offset *= offset_mult;
+            }
 
-    exp_base + exp_offset
+            event.exp = event.base + event.offset;
+        });
+        event.exp
+    })
 }
 
 /// Adjusts the number of perks the player recieves at level-up.
 #[no_mangle]
-extern "system" fn modify_perk_pool_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn modify_perk_pool_hook(
     count: i8
 ) {
-    assert!(settings::is_perk_points_enabled());
-
+    // The perk pool is read directly from the player, so it is captured as an argument.
     let pool = get_player_perk_pool();
-    let delta = std::cmp::min(0xFF, settings::get_perk_delta(get_player_level()));
-    let res = (pool.get() as i16) + (if count > 0 { delta as i16 } else { count as i16 });
-    pool.set(std::cmp::max(0, std::cmp::min(0xff, res)) as u8);
+    trace::hook(TraceHook::ModifyPerkPool, &[count.to_word(), pool.get().to_word()], || {
+        check_enabled(settings::is_perk_points_enabled(), TraceHook::ModifyPerkPool);
+
+        let mut event = PerkDeltaEvent { count: count as c_int, delta: 0 };
+        extension::dispatch().perk_delta.run(&mut event, |event| {
+            let delta = std::cmp::min(0xFF, settings::get_perk_delta(get_player_level()));
+            event.delta = if event.count > 0 { delta as c_int } else { event.count };
+        });
+
+        let res = (pool.get() as c_int).saturating_add(event.delta);
+        pool.set(std::cmp::max(0, std::cmp::min(0xff, res)) as u8);
+        trace::effect(TraceEffect::PerkPool, 0, pool.get().to_word());
+    })
 }
 
 /// Multiplies the exp gain of a level-up by the configured multiplier.
 #[no_mangle]
-extern "system" fn improve_level_exp_by_skill_level_hook(
-    mut exp: f32,
+#[link_section = hot_text!()]
+pub extern "system" fn improve_level_exp_by_skill_level_hook(
+    exp: f32,
     attr: c_int
 ) -> f32 {
-    assert!(settings::is_level_exp_enabled());
+    trace::hook(TraceHook::ImproveLevelExpBySkillLevel, &[exp.to_word(), attr.to_word()], || {
+        check_enabled(settings::is_level_exp_enabled(), TraceHook::ImproveLevelExpBySkillLevel);
 
-    if let Ok(skill) = ActorAttribute::from_raw_skill(attr) {
-        exp *= settings::get_level_exp_mult(
-            skill,
-            player_avo_get_base(skill) as u32,
-            get_player_level()
-        );
-    }
+        let mut event = LevelExpEvent { skill: attr, skill_exp: exp, exp: 0.0 };
+        extension::dispatch().level_exp.run(&mut event, |event| {
+            let mut exp = event.skill_exp;
+            if let Ok(skill) = ActorAttribute::from_raw_skill(event.skill) {
+                exp *= settings::get_level_exp_mult(
+                    skill,
+                    player_avo_get_base(skill) as u32,
+                    get_player_level()
+                );
+            }
 
-    exp * *XP_PER_SKILL_RANK.get()
+            event.exp = exp * *XP_PER_SKILL_RANK.get();
+        });
+        event.exp
+    })
 }
 
 ///
 /// Adjusts the attribute gain at each level-up based on the configured settings.
 ///
 #[no_mangle]
-extern "system" fn improve_attribute_when_level_up_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn improve_attribute_when_level_up_hook(
     choice: c_int
 ) {
-    assert!(settings::is_attr_points_enabled());
-    let choice = ActorAttribute::from_raw(choice).unwrap();
-
-    let (hp, mp, sp, cw) = settings::get_attribute_level_up(get_player_level(), choice);
-    player_avo_mod_base(ActorAttribute::Health, hp);
-    player_avo_mod_base(ActorAttribute::Magicka, mp);
-    player_avo_mod_base(ActorAttribute::Stamina, sp);
-    player_avo_mod_current(ActorAttribute::CarryWeight, cw);
+    trace::hook(TraceHook::ImproveAttributeWhenLevelUp, &[choice.to_word()], || {
+        check_enabled(settings::is_attr_points_enabled(), TraceHook::ImproveAttributeWhenLevelUp);
+
+        let mut event = AttributeGainEvent { choice, ..Default::default() };
+        extension::dispatch().attribute_gain.run(&mut event, |event| {
+            let choice = ActorAttribute::from_raw(event.choice)
+                .unwrap_or_else(|_| bad_attribute(event.choice));
+            (event.health, event.magicka, event.stamina, event.carry_weight)
+                = settings::get_attribute_level_up(get_player_level(), choice);
+        });
+
+        player_avo_mod_base(ActorAttribute::Health, event.health);
+        player_avo_mod_base(ActorAttribute::Magicka, event.magicka);
+        player_avo_mod_base(ActorAttribute::Stamina, event.stamina);
+        player_avo_mod_current(ActorAttribute::CarryWeight, event.carry_weight);
+    })
 }
 
 /// Determines what level a skill should take on after being legendary'd.
 #[no_mangle]
-extern "system" fn legendary_reset_skill_level_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn legendary_reset_skill_level_hook(
     base_level: f32
 ) -> f32 {
-    assert!(settings::is_legendary_enabled());
-    assert!(base_level >= 0.0);
-    let base_val = *LEGENDARY_SKILL_RESET_VALUE.get();
-    settings::get_post_legendary_skill_level(base_val, base_level)
+    trace::hook(TraceHook::LegendaryResetSkillLevel, &[base_level.to_word()], || {
+        check_enabled(settings::is_legendary_enabled(), TraceHook::LegendaryResetSkillLevel);
+        if !(base_level >= 0.0) {
+            bad_skill_level(base_level);
+        }
+        let base_val = *LEGENDARY_SKILL_RESET_VALUE.get();
+        settings::get_post_legendary_skill_level(base_val, base_level)
+    })
 }
 
 ///
@@ -779,17 +864,23 @@ extern "system" fn legendary_reset_skill_level_hook(
 /// return threshold - 1.
 ///
 #[no_mangle]
-extern "system" fn check_condition_for_legendary_skill_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn check_condition_for_legendary_skill_hook(
     skill: c_int
 ) -> f32 {
-    assert!(settings::is_legendary_enabled());
-    let skill = ActorAttribute::from_raw_skill(skill).unwrap();
+    trace::hook(TraceHook::CheckConditionForLegendarySkill, &[skill.to_word()], || {
+        check_enabled(
+            settings::is_legendary_enabled(),
+            TraceHook::CheckConditionForLegendarySkill
+        );
+        let skill = ActorAttribute::from_raw_skill(skill).unwrap_or_else(|_| bad_attribute(skill));
 
-    if settings::is_legendary_available(player_avo_get_base(skill) as u32) {
-        BASE_LEGENDARY_THRESHOLD
-    } else {
-        BASE_LEGENDARY_THRESHOLD - 1.0
-    }
+        if settings::is_legendary_available(player_avo_get_base(skill) as u32) {
+            BASE_LEGENDARY_THRESHOLD
+        } else {
+            BASE_LEGENDARY_THRESHOLD - 1.0
+        }
+    })
 }
 
 ///
@@ -800,17 +891,20 @@ extern "system" fn check_condition_for_legendary_skill_hook(
 /// return threshold - 1.
 ///
 #[no_mangle]
-extern "system" fn hide_legendary_button_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn hide_legendary_button_hook(
     skill: c_int
 ) -> f32 {
-    assert!(settings::is_legendary_enabled());
-    let skill = ActorAttribute::from_raw_skill(skill).unwrap();
+    trace::hook(TraceHook::HideLegendaryButton, &[skill.to_word()], || {
+        check_enabled(settings::is_legendary_enabled(), TraceHook::HideLegendaryButton);
+        let skill = ActorAttribute::from_raw_skill(skill).unwrap_or_else(|_| bad_attribute(skill));
 
-    if settings::is_legendary_button_visible(player_avo_get_base(skill) as u32) {
-        BASE_LEGENDARY_THRESHOLD
-    } else {
-        BASE_LEGENDARY_THRESHOLD - 1.0
-    }
+        if settings::is_legendary_button_visible(player_avo_get_base(skill) as u32) {
+            BASE_LEGENDARY_THRESHOLD
+        } else {
+            BASE_LEGENDARY_THRESHOLD - 1.0
+        }
+    })
 }
 
 ///
@@ -822,25 +916,143 @@ extern "system" fn hide_legendary_button_hook(
 /// visible, respectively.
 ///
 #[no_mangle]
-extern "system" fn clear_legendary_button_hook(
+#[link_section = hot_text!()]
+pub extern "system" fn clear_legendary_button_hook(
     skill: c_int
 ) -> f32 {
-    assert!(settings::is_legendary_enabled());
+    trace::hook(TraceHook::ClearLegendaryButton, &[skill.to_word()], || {
+        check_enabled(settings::is_legendary_enabled(), TraceHook::ClearLegendaryButton);
 
-    if let Ok(skill) = ActorAttribute::from_raw_skill(skill) {
-        let level = player_avo_get_base(skill);
-        let game_vis = level >= BASE_LEGENDARY_THRESHOLD;
-        let mod_vis = settings::is_legendary_button_visible(level as u32);
+        if let Ok(skill) = ActorAttribute::from_raw_skill(skill) {
+            let level = player_avo_get_base(skill);
+            let game_vis = level >= BASE_LEGENDARY_THRESHOLD;
+            let mod_vis = settings::is_legendary_button_visible(level as u32);
 
-        if game_vis == mod_vis {
-            level
-        } else if game_vis { // visible, but shouldn't be.
-            BASE_LEGENDARY_THRESHOLD - 1.0
-        } else { // invisible, but shouldn't be.
-            BASE_LEGENDARY_THRESHOLD
+            if game_vis == mod_vis {
+                level
+            } else if game_vis { // visible, but shouldn't be.
+                BASE_LEGENDARY_THRESHOLD - 1.0
+            } else { // invisible, but shouldn't be.
+                BASE_LEGENDARY_THRESHOLD
+            }
+        } else {
+            // Some other perk menu. E.g. vampire or werewolf
+            unsafe { player_avo_get_base_unchecked(get_player_avo(), skill) }
+        }
+    })
+}
+
+///
+/// Checks that the patch which installed a hook is enabled.
+///
+/// The failure is kept out of line, so that the check costs the hook nothing more than a
+/// branch.
+///
+#[inline(always)]
+fn check_enabled(
+    enabled: bool,
+    hook: TraceHook
+) {
+    if !enabled {
+        hook_disabled(hook);
+    }
+}
+
+/// Stops the plugin after a hook was called while its patch was disabled.
+#[cold]
+#[inline(never)]
+fn hook_disabled(
+    hook: TraceHook
+) -> ! {
+    panic!("The {:?} hook was called while its patch was disabled", hook);
+}
+
+/// Stops the plugin after the game gave a hook an actor attribute it can't handle.
+#[cold]
+#[inline(never)]
+fn bad_attribute(
+    attr: c_int
+) -> ! {
+    panic!("A hook was given an invalid actor attribute: {}", attr);
+}
+
+/// Stops the plugin after the game gave a hook a negative skill level.
+#[cold]
+#[inline(never)]
+fn bad_skill_level(
+    level: f32
+) -> ! {
+    panic!("A hook was given an invalid skill level: {}", level);
+}
+
+#[cfg(all(test, not(feature = "trace_capture")))]
+mod tests {
+    use super::*;
+
+    use std::path::Path;
+
+    use skse64::version::CURRENT_RELEASE_RUNTIME;
+
+    use crate::skyrim::standin::{self, GameSettings, Natives};
+
+    /// Points the plugin at the stand-in game, and loads the shipped INI.
+    fn install() {
+        standin::install(CURRENT_RELEASE_RUNTIME, GameSettings::VANILLA, Natives::STAND_IN);
+        standin::set_level(30);
+        standin::set_all_base(50.0);
+
+        // Missing fields are written back to the INI, so it is loaded from a copy.
+        let dir = std::env::temp_dir().join(format!("uncapper-hooks-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let ini = dir.join("SkyrimUncapper.ini");
+        let shipped = Path::new(env!("CARGO_MANIFEST_DIR")).join("../../SkyrimUncapper");
+        std::fs::copy(shipped.join("SkyrimUncapper.ini"), &ini).unwrap();
+        settings::init_uncached(&ini);
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn hooks_do_not_allocate() {
+        install();
+
+        let smithing = ActorAttribute::Smithing as c_int;
+        let hooks: [(&str, &dyn Fn()); 14] = [
+            ("get_skill_cap", &|| { get_skill_cap_hook(smithing); }),
+            ("max_charge_begin", &|| max_charge_begin_hook(0x29)),
+            ("max_charge_end", &|| max_charge_end_hook()),
+            ("calculate_charge_points_per_use", &|| {
+                calculate_charge_points_per_use_hook(20.0, 3000.0);
+            }),
+            ("player_avo_get_current", &|| {
+                player_avo_get_current_hook(get_player_avo(), smithing);
+            }),
+            ("improve_player_skill_points", &|| {
+                improve_player_skill_points_hook(smithing, 10.0, 5.0);
+            }),
+            ("modify_perk_pool/gain", &|| modify_perk_pool_hook(1)),
+            ("modify_perk_pool/spend", &|| modify_perk_pool_hook(-1)),
+            ("improve_level_exp_by_skill_level", &|| {
+                improve_level_exp_by_skill_level_hook(3.0, smithing);
+            }),
+            ("improve_attribute_when_level_up", &|| {
+                improve_attribute_when_level_up_hook(ActorAttribute::Health as c_int);
+            }),
+            ("legendary_reset_skill_level", &|| { legendary_reset_skill_level_hook(100.0); }),
+            ("check_condition_for_legendary_skill", &|| {
+                check_condition_for_legendary_skill_hook(smithing);
+            }),
+            ("hide_legendary_button", &|| { hide_legendary_button_hook(smithing); }),
+            ("clear_legendary_button", &|| { clear_legendary_button_hook(smithing); })
+        ];
+
+        // Any lazy setup is allowed to allocate on the first call.
+        for (_, hook) in hooks.iter() {
+            hook();
+        }
+
+        for (name, hook) in hooks.iter() {
+            let (_, allocs) = alloc_track::count_allocs(|| hook());
+            assert!(allocs == 0, "The {} hook made {} allocation(s)", name, allocs);
         }
-    } else {
-        // Some other perk menu. E.g. vampire or werewolf
-        unsafe { player_avo_get_base_unchecked(get_player_avo(), skill) }
     }
 }
@@ -0,0 +1,24 @@
+//!
+//! @file lib.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief The settings, hooks, and game types of the uncapper.
+//! @bug No known bugs.
+//!
+//! The plugin itself only installs these into the game. They live in their own library so
+//! that host tools, such as the benchmarks and the simulator, can drive them outside of it.
+//!
+
+pub mod skyrim;
+pub mod extension;
+mod hook_wrappers;
+pub mod hooks;
+pub mod settings;
+pub mod trace;
+
+/// The git version the uncapper was built from.
+pub const GIT_VERSION: &str = env!("UNCAPPER_GIT_VERSION");
+
+/// Counts heap usage in tests, so that they can check the hooks never allocate.
+#[cfg(test)]
+#[global_allocator]
+static ALLOCATOR: alloc_track::TrackingAllocator = alloc_track::TrackingAllocator;
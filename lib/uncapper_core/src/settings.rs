@@ -0,0 +1,1052 @@
+//!
+//! @file settings.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @author Kassent
+//! @brief Loads and operates on the settings specified in the INI file.
+//! @bug No known bugs.
+//!
+
+mod config;
+mod skills;
+mod field;
+mod leveled;
+pub mod cache;
+#[cfg(feature = "baked_config")]
+mod baked;
+
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, AtomicU32, Ordering};
+use std::str::FromStr;
+
+use plugin_ini::Ini;
+use skse64::log::skse_message;
+#[cfg(not(feature = "baked_config"))]
+use {
+    std::ops::Deref,
+    std::sync::Mutex,
+    std::sync::atomic::AtomicPtr,
+    alloc_track::Tag,
+    skse64::log::{skse_warning, write_suppressed}
+};
+
+use field::IniField;
+use skills::IniSkillManager;
+use leveled::LeveledIniSection;
+use config::{DefaultIniSection, DefaultIniField, IniDefaultReadable};
+use crate::skyrim::{ActorAttribute, SkillIterator, SKILL_COUNT};
+
+const DEFAULT_INI_LZ: &[u8] = include_bytes!(concat!(env!("OUT_DIR"), "/SkyrimUncapper.ini.lz"));
+
+///
+/// Reads a setting from the tables baked into the plugin, if the baked_config feature is
+/// enabled, and from the settings loaded from the INI file otherwise.
+///
+/// Only the selected expression is compiled, so the baked expression may refer to tables
+/// which don't exist in runtime builds.
+///
+#[cfg(feature = "baked_config")]
+macro_rules! setting {
+    ( $baked:expr, $loaded:expr ) => { $baked };
+}
+
+#[cfg(not(feature = "baked_config"))]
+macro_rules! setting {
+    ( $baked:expr, $loaded:expr ) => { $loaded };
+}
+
+/// Manages the loading of a skill multiplier, which contains both a base and offset multiplier.
+#[derive(Default, Copy, Clone)]
+pub (in crate) struct SkillMult {
+    base: f32,
+    offset: f32
+}
+
+#[derive(Clone)]
+struct GeneralSettings {
+    skill_caps_en: DefaultIniField<IniField<bool>>,
+    skill_formula_caps_en: DefaultIniField<IniField<bool>>,
+    skill_formula_ui_fix_en: DefaultIniField<IniField<bool>>,
+    enchanting_patch_en: DefaultIniField<IniField<bool>>,
+    skill_exp_mults_en: DefaultIniField<IniField<bool>>,
+    level_exp_mults_en: DefaultIniField<IniField<bool>>,
+    perk_points_en: DefaultIniField<IniField<bool>>,
+    attr_points_en: DefaultIniField<IniField<bool>>,
+    legendary_en: DefaultIniField<IniField<bool>>,
+    share_version_db: DefaultIniField<IniField<bool>>
+}
+
+#[derive(Clone)]
+struct EnchantSettings {
+    magnitude_cap: DefaultIniField<IniField<u32>>,
+    charge_cap: DefaultIniField<IniField<u32>>,
+    use_linear_charge: DefaultIniField<IniField<bool>>
+}
+
+#[derive(Clone)]
+struct LegendarySettings {
+    keep_skill_level: DefaultIniField<IniField<bool>>,
+    hide_button: DefaultIniField<IniField<bool>>,
+    skill_level_en: DefaultIniField<IniField<u32>>,
+    skill_level_after: DefaultIniField<IniField<u32>>
+}
+
+/// Contains all the configuration settings loaded in from the INI file.
+#[derive(Clone)]
+struct Settings {
+    general: GeneralSettings,
+    enchant: EnchantSettings,
+    legendary: LegendarySettings,
+    skill_caps: DefaultIniSection<IniSkillManager<IniField<u32>>>,
+    skill_formula_caps: DefaultIniSection<IniSkillManager<IniField<u32>>>,
+    skill_exp_mults: DefaultIniSection<IniSkillManager<IniField<SkillMult>>>,
+    skill_exp_mults_with_skills: DefaultIniSection<IniSkillManager<LeveledIniSection<SkillMult>>>,
+    skill_exp_mults_with_pc_lvl: DefaultIniSection<IniSkillManager<LeveledIniSection<SkillMult>>>,
+    level_exp_mults: DefaultIniSection<IniSkillManager<IniField<f32>>>,
+    level_exp_mults_with_skills: DefaultIniSection<IniSkillManager<LeveledIniSection<f32>>>,
+    level_exp_mults_with_pc_lvl: DefaultIniSection<IniSkillManager<LeveledIniSection<f32>>>,
+    perks_at_lvl_up: DefaultIniSection<LeveledIniSection<f32>>,
+    hp_at_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    hp_at_mp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    hp_at_sp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    mp_at_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    mp_at_hp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    mp_at_sp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    sp_at_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    sp_at_hp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    sp_at_mp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    cw_at_hp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    cw_at_mp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>,
+    cw_at_sp_lvl_up: DefaultIniSection<LeveledIniSection<u32>>
+}
+
+///
+/// The progression settings of a single configuration, expanded into dense tables.
+///
+/// Host tools use these tables to evaluate many configurations without going through the
+/// global settings. Tables indexed by skill level hold max_skill_level + 1 entries for each
+/// skill slot, and tables indexed by player level hold max_player_level + 1 entries.
+///
+pub struct ProgressionTable {
+    pub max_skill_level: u32,
+    pub max_player_level: u32,
+    pub skill_caps_en: bool,
+    pub skill_exp_mults_en: bool,
+    pub level_exp_mults_en: bool,
+    pub perk_points_en: bool,
+    pub attr_points_en: bool,
+    pub legendary_en: bool,
+    pub skill_caps: [f32; SKILL_COUNT],
+    /// The (base, offset) skill exp mults by skill level, including the flat skill mults.
+    pub skill_exp_by_skill: Vec<(f32, f32)>,
+    /// The (base, offset) skill exp mults by player level.
+    pub skill_exp_by_pc: Vec<(f32, f32)>,
+    /// The level exp mults by skill level, including the flat skill mults.
+    pub level_exp_by_skill: Vec<f32>,
+    /// The level exp mults by player level.
+    pub level_exp_by_pc: Vec<f32>,
+    /// The perk points given for reaching each player level.
+    pub perks: Vec<u32>,
+    /// The (hp, mp, sp, cw) gain of each level-up choice at each player level.
+    pub attributes: Vec<[(f32, f32, f32, f32); 3]>,
+    pub legendary_skill_level: u32,
+    pub legendary_keep_skill_level: bool,
+    /// The level skills are reset to after being legendaried, or 0 for the game default.
+    pub legendary_skill_level_after: u32
+}
+
+///
+/// A configuration read from an INI file, which can be rebuilt from an edited copy of that file
+/// without reading every setting again.
+///
+/// Each setting knows which sections of the INI it was read from. A hash of every section is
+/// kept, so that a rebuild only re-reads the settings which depend on a section that changed.
+///
+pub struct SettingsSnapshot {
+    settings: Settings,
+    /// The hash of each section, sorted by the lowercase section name.
+    sections: Vec<(String, u64)>
+}
+
+///
+/// Holds the settings currently used by the hooks, which may be replaced by a reload.
+///
+/// Replaced snapshots are never freed, as a hook on another thread may still be reading one
+/// and nothing tracks when it stops. To bound the memory lost this way, a reload which changes
+/// nothing keeps the current snapshot, and at most MAX_RETIRED_SNAPSHOTS are ever replaced.
+///
+#[cfg(not(feature = "baked_config"))]
+struct SettingsCell(AtomicPtr<SettingsSnapshot>);
+
+/// The initial value of a 64-bit FNV-1a hash.
+const FNV_OFFSET: u64 = 0xcbf29ce484222325;
+
+/// By default, skill exp multiplication is disabled.
+const DEFAULT_SKILL_EXP_MULT: SkillMult = SkillMult { base: 1.0, offset: 1.0 };
+
+/// Holds the global settings configuration, which is created when init() is called.
+#[cfg(not(feature = "baked_config"))]
+static SETTINGS: SettingsCell = SettingsCell(AtomicPtr::new(std::ptr::null_mut()));
+
+/// Counts the snapshots replaced by reloads, and ensures only one reload runs at a time.
+#[cfg(not(feature = "baked_config"))]
+static RELOAD_LOCK: Mutex<usize> = Mutex::new(0);
+
+/// The number of snapshots reloads may replace before they are refused.
+#[cfg(not(feature = "baked_config"))]
+const MAX_RETIRED_SNAPSHOTS: usize = 32;
+
+/// Used to ensure that the max_charge critical section is not entered twice.
+static IS_USING_CHARGE_CAP: AtomicBool = AtomicBool::new(false);
+
+/// The raw actor attribute ID of the first skill, which is the first entry in the cap table.
+pub const SKILL_CAP_TABLE_FIRST: usize = ActorAttribute::OneHanded as usize;
+
+/// The number of entries in the skill cap table, one for each skill.
+pub const SKILL_CAP_TABLE_LEN: usize = SKILL_COUNT;
+
+///
+/// Holds the bits of the cap of each skill, indexed by its skill slot, so that the skill cap
+/// patch can load it without calling into the plugin. The patch subtracts the first skill ID
+/// from the raw ID it is given, so anything which isn't a skill is out of bounds.
+///
+/// The table is rewritten whenever new settings are used. A patch which runs during a reload
+/// may see the old cap of one skill and the new cap of another, which is harmless.
+///
+#[no_mangle]
+pub static skill_cap_table: [AtomicU32; SKILL_CAP_TABLE_LEN] =
+    [const { AtomicU32::new(0) }; SKILL_CAP_TABLE_LEN];
+
+/// Allows for the optional loading of an offset multiplier.
+impl FromStr for SkillMult {
+    type Err = <f32 as FromStr>::Err;
+
+    fn from_str(
+        s: &str
+    ) -> Result<Self, Self::Err> {
+        if let Some(s) = s.split_once('/') {
+            // Since there is a mode symbol, the offset has been specified in some way.
+            if s.1.trim().is_empty() {
+                // We have been asked to duplicate the first number for both.
+                Ok(Self { base: f32::from_str(s.0)?, offset: f32::from_str(s.0)? })
+            } else {
+                // Both values were given.
+                Ok(Self { base: f32::from_str(s.0)?, offset: f32::from_str(s.1)? })
+            }
+        } else {
+            // Compat mode: Assume offset mult is 1.0 and parse as single float.
+            Ok(Self { base: f32::from_str(s)?, offset: 1.0 })
+        }
+    }
+}
+
+impl Settings {
+    /// Creates a new settings structure, with default values for missing fields.
+    fn new() -> Self {
+        const GEN_SEC: &'static str = "General";
+        const EN_SEC: &'static str = "Enchanting";
+        const LEG_SEC: &'static str = "LegendarySkill";
+
+        Self {
+            general: GeneralSettings {
+                skill_caps_en: DefaultIniField::new(GEN_SEC, "bUseSkillCaps", true),
+                skill_formula_caps_en: DefaultIniField::new(GEN_SEC, "bUseSkillFormulaCaps", true),
+                skill_formula_ui_fix_en: DefaultIniField::new(
+                    GEN_SEC,
+                    "bUseSkillFormulaCapsUIFix",
+                    true
+                ),
+                enchanting_patch_en: DefaultIniField::new(GEN_SEC, "bUseEnchanterCaps", true),
+                skill_exp_mults_en: DefaultIniField::new(GEN_SEC, "bUseSkillExpGainMults", true),
+                level_exp_mults_en: DefaultIniField::new(GEN_SEC, "bUsePCLevelSkillExpMults", true),
+                perk_points_en: DefaultIniField::new(GEN_SEC, "bUsePerksAtLevelUp", true),
+                attr_points_en: DefaultIniField::new(GEN_SEC, "bUseAttributesAtLevelUp", true),
+                legendary_en: DefaultIniField::new(GEN_SEC, "bUseLegendarySettings", true),
+                share_version_db: DefaultIniField::new(GEN_SEC, "bShareVersionDb", false)
+            },
+            enchant: EnchantSettings {
+                magnitude_cap: DefaultIniField::new(EN_SEC, "iMagnitudeLevelCap", 100),
+                charge_cap: DefaultIniField::new(EN_SEC, "iChargeLevelCap", 199),
+                use_linear_charge: DefaultIniField::new(EN_SEC, "bUseLinearChargeFormula", false),
+            },
+            legendary: LegendarySettings {
+                keep_skill_level: DefaultIniField::new(LEG_SEC, "bLegendaryKeepSkillLevel", false),
+                hide_button: DefaultIniField::new(LEG_SEC, "bHideLegendaryButton", false),
+                skill_level_en: DefaultIniField::new(LEG_SEC, "iSkillLevelEnableLegendary", 100),
+                skill_level_after: DefaultIniField::new(LEG_SEC, "iSkillLevelAfterLegendary", 0),
+            },
+            skill_caps: DefaultIniSection::new("SkillCaps", 100),
+            skill_formula_caps: DefaultIniSection::new("SkillFormulaCaps", 100),
+            skill_exp_mults: DefaultIniSection::new("SkillExpGainMults", DEFAULT_SKILL_EXP_MULT),
+            skill_exp_mults_with_skills: DefaultIniSection::new(
+                "SkillExpGainMults\\BaseSkillLevel",
+                DEFAULT_SKILL_EXP_MULT
+            ),
+            skill_exp_mults_with_pc_lvl: DefaultIniSection::new(
+                "SkillExpGainMults\\CharacterLevel",
+                DEFAULT_SKILL_EXP_MULT
+            ),
+            level_exp_mults: DefaultIniSection::new("LevelSkillExpMults", 1.00),
+            level_exp_mults_with_skills: DefaultIniSection::new(
+                "LevelSkillExpMults\\BaseSkillLevel",
+                1.00
+            ),
+            level_exp_mults_with_pc_lvl: DefaultIniSection::new(
+                "LevelSkillExpMults\\CharacterLevel",
+                1.00
+            ),
+            perks_at_lvl_up: DefaultIniSection::new("PerksAtLevelUp", 1.00),
+            hp_at_lvl_up: DefaultIniSection::new("HealthAtLevelUp", 10),
+            hp_at_mp_lvl_up: DefaultIniSection::new("HealthAtMagickaLevelUp", 0),
+            hp_at_sp_lvl_up: DefaultIniSection::new("HealthAtStaminaLevelUp", 0),
+            mp_at_lvl_up: DefaultIniSection::new("MagickaAtLevelUp", 10),
+            mp_at_hp_lvl_up: DefaultIniSection::new("MagickaAtHealthLevelUp", 0),
+            mp_at_sp_lvl_up: DefaultIniSection::new("MagickaAtStaminaLevelUp", 0),
+            sp_at_lvl_up: DefaultIniSection::new("StaminaAtLevelUp", 10),
+            sp_at_hp_lvl_up: DefaultIniSection::new("StaminaAtHealthLevelUp", 0),
+            sp_at_mp_lvl_up: DefaultIniSection::new("StaminaAtMagickaLevelUp", 0),
+            cw_at_hp_lvl_up: DefaultIniSection::new("CarryWeightAtHealthLevelUp", 0),
+            cw_at_mp_lvl_up: DefaultIniSection::new("CarryWeightAtMagickaLevelUp", 0),
+            cw_at_sp_lvl_up: DefaultIniSection::new("CarryWeightAtStaminaLevelUp", 5)
+        }
+    }
+
+    /// Reads in the settings from the given INI file.
+    fn read_ini(
+        &mut self,
+        ini: &Ini
+    ) {
+        for item in self.items_mut() {
+            item.read_ini_default(ini);
+        }
+    }
+
+    /// Gets every setting, so that they can be read together.
+    fn items_mut(
+        &mut self
+    ) -> [&mut dyn IniDefaultReadable; 38] {
+        [
+            &mut self.general.skill_caps_en,
+            &mut self.general.skill_formula_caps_en,
+            &mut self.general.skill_formula_ui_fix_en,
+            &mut self.general.enchanting_patch_en,
+            &mut self.general.skill_exp_mults_en,
+            &mut self.general.level_exp_mults_en,
+            &mut self.general.perk_points_en,
+            &mut self.general.attr_points_en,
+            &mut self.general.legendary_en,
+            &mut self.general.share_version_db,
+            &mut self.enchant.magnitude_cap,
+            &mut self.enchant.charge_cap,
+            &mut self.enchant.use_linear_charge,
+            &mut self.legendary.keep_skill_level,
+            &mut self.legendary.hide_button,
+            &mut self.legendary.skill_level_en,
+            &mut self.legendary.skill_level_after,
+            &mut self.skill_caps,
+            &mut self.skill_formula_caps,
+            &mut self.skill_exp_mults,
+            &mut self.skill_exp_mults_with_skills,
+            &mut self.skill_exp_mults_with_pc_lvl,
+            &mut self.level_exp_mults,
+            &mut self.level_exp_mults_with_skills,
+            &mut self.level_exp_mults_with_pc_lvl,
+            &mut self.perks_at_lvl_up,
+            &mut self.hp_at_lvl_up,
+            &mut self.hp_at_mp_lvl_up,
+            &mut self.hp_at_sp_lvl_up,
+            &mut self.mp_at_lvl_up,
+            &mut self.mp_at_hp_lvl_up,
+            &mut self.mp_at_sp_lvl_up,
+            &mut self.sp_at_lvl_up,
+            &mut self.sp_at_hp_lvl_up,
+            &mut self.sp_at_mp_lvl_up,
+            &mut self.cw_at_hp_lvl_up,
+            &mut self.cw_at_mp_lvl_up,
+            &mut self.cw_at_sp_lvl_up
+        ]
+    }
+}
+
+impl SettingsSnapshot {
+    /// Reads every setting from the given INI file.
+    pub fn new(
+        ini: &Ini
+    ) -> Self {
+        let mut settings = Settings::new();
+        settings.read_ini(ini);
+        Self { settings, sections: section_hashes(ini) }
+    }
+
+    ///
+    /// Creates the snapshot of the given INI file, which is expected to be an edited copy of
+    /// the one this snapshot was read from.
+    ///
+    /// Only the settings which depend on a section that was added, removed, or changed are
+    /// read again, with per-skill settings read again only for the skills which changed.
+    /// Returns the new snapshot and the number of values which were read.
+    ///
+    pub fn rebuild(
+        &self,
+        ini: &Ini
+    ) -> (Self, usize) {
+        let sections = section_hashes(ini);
+        let changed = changed_sections(&self.sections, &sections);
+
+        let mut settings = self.settings.clone();
+        let mut rebuilt = 0;
+        if !changed.is_empty() {
+            for item in settings.items_mut() {
+                rebuilt += item.read_ini_changed(ini, &changed);
+            }
+        }
+
+        (Self { settings, sections }, rebuilt)
+    }
+}
+
+#[cfg(not(feature = "baked_config"))]
+impl SettingsCell {
+    /// Makes the given snapshot the one used by every later read of the settings.
+    fn publish(
+        &self,
+        snapshot: SettingsSnapshot
+    ) {
+        self.0.store(Box::into_raw(Box::new(snapshot)), Ordering::Release);
+        write_skill_cap_table();
+    }
+
+    /// Gets the snapshot in use. Settings must have been loaded.
+    fn snapshot(
+        &self
+    ) -> &'static SettingsSnapshot {
+        let snapshot = self.0.load(Ordering::Acquire);
+        assert!(!snapshot.is_null());
+        unsafe {
+            // SAFETY: Published snapshots are never freed or modified.
+            &*snapshot
+        }
+    }
+}
+
+#[cfg(not(feature = "baked_config"))]
+impl Deref for SettingsCell {
+    type Target = Settings;
+    fn deref(
+        &self
+    ) -> &Self::Target {
+        &self.snapshot().settings
+    }
+}
+
+///
+/// Attempts to load the settings structure from the given INI file.
+///
+/// If the file is unchanged since the settings were last cached, the cached settings are used
+/// instead. Otherwise, the cache is replaced once the file has been read.
+///
+#[cfg(not(feature = "baked_config"))]
+pub fn init(
+    path: &Path
+) {
+    skse_message!("Loading config file: {}", path.display());
+
+    let ini_scope = alloc_track::scope(Tag::Ini);
+    let text = std::fs::read_to_string(path).ok();
+    drop(ini_scope);
+
+    let key = text.as_ref().map(|text| cache::key(text.as_bytes()));
+    let settings_scope = alloc_track::scope(Tag::Settings);
+    if let Some(snapshot) = key.and_then(|key| cache::load(path, key)) {
+        SETTINGS.publish(snapshot);
+        skse_message!("Done initializing settings! The INI file was unchanged, so the cached \
+                       settings were used.");
+        return;
+    }
+    drop(settings_scope);
+
+    let ini_scope = alloc_track::scope(Tag::Ini);
+    let (ini, key) = load_ini(path, text);
+    drop(ini_scope);
+
+    let _scope = alloc_track::scope(Tag::Settings);
+    let mut snapshot = SettingsSnapshot::new(&ini);
+    if let Some(key) = key {
+        cache::store(path, key, &mut snapshot);
+    }
+    SETTINGS.publish(snapshot);
+    write_suppressed();
+
+    skse_message!("Done initializing settings!");
+}
+
+///
+/// Loads the settings structure from the given INI file, without reading or replacing its
+/// cache.
+///
+/// Host tools use this, as they are often given INI files the plugin will never load.
+///
+#[cfg(not(feature = "baked_config"))]
+pub fn init_uncached(
+    path: &Path
+) {
+    skse_message!("Loading config file: {}", path.display());
+
+    let (ini, _) = load_ini(path, std::fs::read_to_string(path).ok());
+    SETTINGS.publish(SettingsSnapshot::new(&ini));
+    write_suppressed();
+
+    skse_message!("Done initializing settings!");
+}
+
+///
+/// Reloads the settings from the given INI file, which should be the one given to init().
+///
+/// Only the settings which depend on a section of the file that changed since it was last
+/// read are read again. The new settings are then used by every hook at once. If nothing
+/// changed, or too many reloads have already replaced the settings, the current settings are
+/// kept.
+///
+#[cfg(not(feature = "baked_config"))]
+pub fn reload(
+    path: &Path
+) {
+    let mut retired = RELOAD_LOCK.lock().unwrap();
+    if *retired >= MAX_RETIRED_SNAPSHOTS {
+        skse_warning!(
+            "The settings have been reloaded {} times. Restart the game to apply further changes.",
+            *retired
+        );
+        return;
+    }
+
+    let _scope = alloc_track::scope(Tag::Settings);
+    let (ini, key) = load_ini(path, std::fs::read_to_string(path).ok());
+    let old = SETTINGS.snapshot();
+    let (mut snapshot, rebuilt) = old.rebuild(&ini);
+    if snapshot.sections == old.sections {
+        return;
+    }
+
+    skse_message!("Reloading config file: {}", path.display());
+    if let Some(key) = key {
+        cache::store(path, key, &mut snapshot);
+    }
+    SETTINGS.publish(snapshot);
+    *retired += 1;
+    write_suppressed();
+
+    skse_message!("Done reloading settings! {} settings were read again.", rebuilt);
+}
+
+///
+/// Parses the given contents of the INI file at the given path, adding any missing fields to
+/// the file.
+///
+/// Also returns the cache key of the file, as it was left on disk.
+///
+#[cfg(not(feature = "baked_config"))]
+fn load_ini(
+    path: &Path,
+    text: Option<String>
+) -> (Ini, Option<u64>) {
+    let ini = text.as_deref().ok_or(()).and_then(Ini::from_str);
+    if ini.is_err() {
+        skse_warning!("Could not load INI file. Defaults will be used.");
+    }
+
+    // Update the file with missing fields, if necessary.
+    let mut ini = ini.unwrap();
+    if let Some(_) = ini.update(&default_ini()) {
+        // If missing fields were added, update the INI file.
+        assert!(
+            ini.write_file(path).is_ok(),
+            "[ERROR] Failed to write to INI file. Please ensure Skyrim has permission to use the \
+             plugin directory."
+        );
+
+        skse_warning!("The INI file has been updated.");
+        return (ini, std::fs::read(path).ok().map(|text| cache::key(&text)));
+    }
+
+    (ini, text.map(|text| cache::key(text.as_bytes())))
+}
+
+/// Uses the settings baked into the plugin, leaving the INI file untouched.
+#[cfg(feature = "baked_config")]
+pub fn init(
+    path: &Path
+) {
+    skse_message!("Using the settings built into the plugin. {} will not be read.", path.display());
+    write_skill_cap_table();
+}
+
+/// Uses the settings baked into the plugin, leaving the INI file untouched.
+#[cfg(feature = "baked_config")]
+pub fn init_uncached(
+    path: &Path
+) {
+    init(path);
+}
+
+/// Gets the INI file shipped with the plugin, which holds the default value of every field.
+pub fn default_ini() -> Ini {
+    Ini::from_str(unsafe {
+        // SAFETY: We know this file was given as UTF8 text when it was compressed.
+        &String::from_utf8_unchecked(lz77::decompress(DEFAULT_INI_LZ))
+    }).unwrap()
+}
+
+///
+/// Hashes the fields of each section in the given INI with 64-bit FNV-1a, sorted by the
+/// lowercase section name.
+///
+fn section_hashes(
+    ini: &Ini
+) -> Vec<(String, u64)> {
+    let mut hashes = ini.sections().map(|section| {
+        // Renaming a field to a different case is treated as a change, which is harmless. The
+        // separators keep the boundaries between names and values from moving unnoticed.
+        let hash = section.fields().fold(FNV_OFFSET, |h, field| {
+            let h = fnv1a(fnv1a(h, field.name().as_bytes()), b"=");
+            fnv1a(fnv1a(h, field.raw_value().unwrap_or("").as_bytes()), b"\n")
+        });
+
+        (section.name().to_ascii_lowercase(), hash)
+    }).collect::<Vec<_>>();
+
+    hashes.sort_unstable();
+    hashes
+}
+
+/// Continues a 64-bit FNV-1a hash over the given bytes.
+fn fnv1a(
+    hash: u64,
+    data: &[u8]
+) -> u64 {
+    const FNV_PRIME: u64 = 0x100000001b3;
+    data.iter().fold(hash, |h, b| (h ^ (*b as u64)).wrapping_mul(FNV_PRIME))
+}
+
+/// Finds the sections which were added, removed, or changed between two sets of section hashes.
+fn changed_sections<'a>(
+    old: &'a [(String, u64)],
+    new: &'a [(String, u64)]
+) -> Vec<&'a str> {
+    let (mut i, mut j) = (0, 0);
+    let mut changed = Vec::new();
+    while (i < old.len()) || (j < new.len()) {
+        if (j == new.len()) || ((i < old.len()) && (old[i].0 < new[j].0)) {
+            changed.push(old[i].0.as_str());
+            i += 1;
+        } else if (i == old.len()) || (new[j].0 < old[i].0) {
+            changed.push(new[j].0.as_str());
+            j += 1;
+        } else {
+            if old[i].1 != new[j].1 {
+                changed.push(new[j].0.as_str());
+            }
+
+            i += 1;
+            j += 1;
+        }
+    }
+
+    changed
+}
+
+///
+/// Reads the progression settings of the given INI into dense tables, without changing the
+/// global settings.
+///
+/// The skill level tables cover every level up to the highest skill cap, and the player level
+/// tables cover every level up to the given maximum.
+///
+pub fn progression_table(
+    ini: &Ini,
+    max_player_level: u32
+) -> ProgressionTable {
+    let mut settings = Settings::new();
+    settings.read_ini(ini);
+
+    let mut skill_caps = [0.0; SKILL_COUNT];
+    for skill in SkillIterator::new() {
+        skill_caps[skill.skill_slot()] = settings.skill_caps.get(skill).get() as f32;
+    }
+    let max_skill_level = skill_caps.iter().fold(100.0f32, |acc, cap| acc.max(*cap)) as u32;
+
+    let mut table = ProgressionTable {
+        max_skill_level,
+        max_player_level,
+        skill_caps_en: settings.general.skill_caps_en.get(),
+        skill_exp_mults_en: settings.general.skill_exp_mults_en.get(),
+        level_exp_mults_en: settings.general.level_exp_mults_en.get(),
+        perk_points_en: settings.general.perk_points_en.get(),
+        attr_points_en: settings.general.attr_points_en.get(),
+        legendary_en: settings.general.legendary_en.get(),
+        skill_caps,
+        skill_exp_by_skill: Vec::with_capacity(SKILL_COUNT * (max_skill_level as usize + 1)),
+        skill_exp_by_pc: Vec::with_capacity(SKILL_COUNT * (max_player_level as usize + 1)),
+        level_exp_by_skill: Vec::with_capacity(SKILL_COUNT * (max_skill_level as usize + 1)),
+        level_exp_by_pc: Vec::with_capacity(SKILL_COUNT * (max_player_level as usize + 1)),
+        perks: Vec::with_capacity(max_player_level as usize + 1),
+        attributes: Vec::with_capacity(max_player_level as usize + 1),
+        legendary_skill_level: settings.legendary.skill_level_en.get(),
+        legendary_keep_skill_level: settings.legendary.keep_skill_level.get(),
+        legendary_skill_level_after: settings.legendary.skill_level_after.get()
+    };
+
+    // The products are grouped as in get_skill_exp_mult(), so the results match exactly.
+    for skill in SkillIterator::new() {
+        let base_mult = settings.skill_exp_mults.get(skill).get();
+        let level_mult = settings.level_exp_mults.get(skill).get();
+        for level in 0..=max_skill_level {
+            let mult = settings.skill_exp_mults_with_skills.get(skill).get_nearest(level);
+            table.skill_exp_by_skill.push((base_mult.base * mult.base,
+                                           base_mult.offset * mult.offset));
+            let mult = settings.level_exp_mults_with_skills.get(skill).get_nearest(level);
+            table.level_exp_by_skill.push(level_mult * mult);
+        }
+        for level in 0..=max_player_level {
+            let mult = settings.skill_exp_mults_with_pc_lvl.get(skill).get_nearest(level);
+            table.skill_exp_by_pc.push((mult.base, mult.offset));
+            let mult = settings.level_exp_mults_with_pc_lvl.get(skill).get_nearest(level);
+            table.level_exp_by_pc.push(mult);
+        }
+    }
+
+    for level in 0..=max_player_level {
+        table.perks.push(settings.perks_at_lvl_up.get_cumulative_delta(level));
+        table.attributes.push([
+            (settings.hp_at_lvl_up.get_nearest(level) as f32,
+             settings.mp_at_hp_lvl_up.get_nearest(level) as f32,
+             settings.sp_at_hp_lvl_up.get_nearest(level) as f32,
+             settings.cw_at_hp_lvl_up.get_nearest(level) as f32),
+            (settings.hp_at_mp_lvl_up.get_nearest(level) as f32,
+             settings.mp_at_lvl_up.get_nearest(level) as f32,
+             settings.sp_at_mp_lvl_up.get_nearest(level) as f32,
+             settings.cw_at_mp_lvl_up.get_nearest(level) as f32),
+            (settings.hp_at_sp_lvl_up.get_nearest(level) as f32,
+             settings.mp_at_sp_lvl_up.get_nearest(level) as f32,
+             settings.sp_at_lvl_up.get_nearest(level) as f32,
+             settings.cw_at_sp_lvl_up.get_nearest(level) as f32)
+        ]);
+    }
+
+    table
+}
+
+/// Checks if the skill cap patches are enabled.
+pub fn is_skill_cap_enabled() -> bool {
+    setting!(baked::SKILL_CAPS_EN, SETTINGS.general.skill_caps_en.get())
+}
+
+/// Checks if the skill formula cap patches are enabled.
+pub fn is_skill_formula_cap_enabled() -> bool {
+    setting!(baked::SKILL_FORMULA_CAPS_EN, SETTINGS.general.skill_formula_caps_en.get())
+}
+
+/// Checks if the skill formula cap UI fixes are enabled.
+pub fn is_skill_formula_cap_ui_fix_enabled() -> bool {
+    setting!(
+        baked::SKILL_FORMULA_CAPS_EN && baked::SKILL_FORMULA_UI_FIX_EN,
+        SETTINGS.general.skill_formula_caps_en.get()
+            && SETTINGS.general.skill_formula_ui_fix_en.get()
+    )
+}
+
+/// Checks if the enchanting patches are enabled.
+pub fn is_enchant_patch_enabled() -> bool {
+    setting!(baked::ENCHANTING_PATCH_EN, SETTINGS.general.enchanting_patch_en.get())
+}
+
+/// Checks if the skill exp patches are enabled.
+pub fn is_skill_exp_enabled() -> bool {
+    setting!(baked::SKILL_EXP_MULTS_EN, SETTINGS.general.skill_exp_mults_en.get())
+}
+
+/// Checks if the level exp patches are enabled.
+pub fn is_level_exp_enabled() -> bool {
+    setting!(baked::LEVEL_EXP_MULTS_EN, SETTINGS.general.level_exp_mults_en.get())
+}
+
+/// Checks if the perk point patches are enabled.
+pub fn is_perk_points_enabled() -> bool {
+    setting!(baked::PERK_POINTS_EN, SETTINGS.general.perk_points_en.get())
+}
+
+/// Checks if the attribute point patches are enabled.
+pub fn is_attr_points_enabled() -> bool {
+    setting!(baked::ATTR_POINTS_EN, SETTINGS.general.attr_points_en.get())
+}
+
+/// Checks if the legendary skill patches are enabled.
+pub fn is_legendary_enabled() -> bool {
+    setting!(baked::LEGENDARY_EN, SETTINGS.general.legendary_en.get())
+}
+
+/// Checks if the version database should be shared with other plugins.
+pub fn is_version_db_shared() -> bool {
+    setting!(baked::SHARE_VERSION_DB, SETTINGS.general.share_version_db.get())
+}
+
+/// Gets the level cap for the given skill.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_skill_cap(
+    skill: ActorAttribute
+) -> f32 {
+    setting!(baked::SKILL_CAPS[skill.skill_slot()], SETTINGS.skill_caps.get(skill).get()) as f32
+}
+
+/// Writes the cap of each skill to the skill cap table.
+fn write_skill_cap_table() {
+    for skill in SkillIterator::new() {
+        let cap = get_skill_cap(skill).to_bits();
+        skill_cap_table[skill.skill_slot()].store(cap, Ordering::Relaxed);
+    }
+}
+
+/// Gets the formula cap for the given skill.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_skill_formula_cap(
+    skill: ActorAttribute
+) -> f32 {
+    let mut cap = setting!(
+        baked::SKILL_FORMULA_CAPS[skill.skill_slot()],
+        SETTINGS.skill_formula_caps.get(skill).get()
+    ) as f32;
+
+    // Enforce the additional enchanting caps.
+    if skill == ActorAttribute::Enchanting {
+        let specific_cap = if IS_USING_CHARGE_CAP.load(Ordering::Relaxed) {
+            setting!(baked::ENCHANT_CHARGE_CAP, SETTINGS.enchant.charge_cap.get()) as f32
+        } else {
+            setting!(baked::ENCHANT_MAGNITUDE_CAP, SETTINGS.enchant.magnitude_cap.get()) as f32
+        };
+
+        cap = cap.min(specific_cap);
+    }
+
+    return cap;
+}
+
+/// Enables the use of the charge cap for the skill formula cap. It must be disabled when invoked.
+pub fn use_enchant_charge_cap() {
+    assert!(!IS_USING_CHARGE_CAP.swap(true, Ordering::Relaxed));
+}
+
+/// Disables the use of the charge cap for the skill formula cap, if it was enabled.
+pub fn use_enchant_magnitude_cap() {
+    let _ = IS_USING_CHARGE_CAP.compare_exchange(true, false, Ordering::Relaxed, Ordering::Relaxed);
+}
+
+/// Gets the formula cap for weapon-charge enchantments.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_enchant_charge_cap() -> f32 {
+    let charge_cap = setting!(baked::ENCHANT_CHARGE_CAP, SETTINGS.enchant.charge_cap.get());
+    let skill_cap = setting!(
+        baked::SKILL_FORMULA_CAPS[ActorAttribute::Enchanting.skill_slot()],
+        SETTINGS.skill_formula_caps.get(ActorAttribute::Enchanting).get()
+    );
+    (charge_cap as f32).min(199.0).min(skill_cap as f32)
+}
+
+/// Checks if the weapon charge equation should use a linear charge amount increase per level.
+pub fn is_enchant_charge_linear() -> bool {
+    setting!(baked::ENCHANT_USE_LINEAR_CHARGE, SETTINGS.enchant.use_linear_charge.get())
+}
+
+/// Calculates the skill exp gain multiplier for the given skill, skill level, and player level.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_skill_exp_mult(
+    skill: ActorAttribute,
+    skill_level: u32,
+    player_level: u32
+) -> (f32, f32) {
+    // The baked skill level table already includes the base multiplier.
+    let (skill_mult, pc_mult) = setting!(
+        (baked::nearest(baked::SKILL_EXP_BY_SKILL[skill.skill_slot()], skill_level),
+         baked::nearest(baked::SKILL_EXP_BY_PC[skill.skill_slot()], player_level)),
+        {
+            // Read every table from one snapshot, in case the settings are being reloaded.
+            let settings = &*SETTINGS;
+            let base_mult = settings.skill_exp_mults.get(skill).get();
+            let skill_mult = settings.skill_exp_mults_with_skills.get(skill)
+                .get_nearest(skill_level);
+            (SkillMult { base: base_mult.base * skill_mult.base,
+                         offset: base_mult.offset * skill_mult.offset },
+             settings.skill_exp_mults_with_pc_lvl.get(skill).get_nearest(player_level))
+        }
+    );
+
+    (skill_mult.base * pc_mult.base, skill_mult.offset * pc_mult.offset)
+}
+
+/// Calculates the level exp gain multiplier for the given skill, skill level, and player level.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_level_exp_mult(
+    skill: ActorAttribute,
+    skill_level: u32,
+    player_level: u32
+) -> f32 {
+    // The baked skill level table already includes the base multiplier.
+    let (skill_mult, pc_mult) = setting!(
+        (baked::nearest(baked::LEVEL_EXP_BY_SKILL[skill.skill_slot()], skill_level),
+         baked::nearest(baked::LEVEL_EXP_BY_PC[skill.skill_slot()], player_level)),
+        {
+            let settings = &*SETTINGS;
+            (settings.level_exp_mults.get(skill).get()
+                * settings.level_exp_mults_with_skills.get(skill).get_nearest(skill_level),
+             settings.level_exp_mults_with_pc_lvl.get(skill).get_nearest(player_level))
+        }
+    );
+    return skill_mult * pc_mult;
+}
+
+/// Gets the number of perk points the player should receive for reaching the given level.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_perk_delta(
+    player_level: u32
+) -> u32 {
+    setting!(
+        leveled::cumulative_delta(baked::PERKS_AT_LEVEL_UP, player_level),
+        SETTINGS.perks_at_lvl_up.get_cumulative_delta(player_level)
+    )
+}
+
+/// Gets the number of (hp, mp, sp, cw) points the player should get for the given level and
+/// attribute selection.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_attribute_level_up(
+    player_level: u32,
+    attr: ActorAttribute
+) -> (f32, f32, f32, f32) {
+    #[cfg(feature = "baked_config")]
+    return match attr {
+        ActorAttribute::Health => baked::nearest(baked::ATTRIBUTES, player_level)[0],
+        ActorAttribute::Magicka => baked::nearest(baked::ATTRIBUTES, player_level)[1],
+        ActorAttribute::Stamina => baked::nearest(baked::ATTRIBUTES, player_level)[2],
+        _ => panic!("Cannot get the attribute level up with an invalid choice.")
+    };
+
+    // Read every table from one snapshot, in case the settings are being reloaded.
+    #[cfg(not(feature = "baked_config"))]
+    let settings = &*SETTINGS;
+
+    #[cfg(not(feature = "baked_config"))]
+    match attr {
+        ActorAttribute::Health => (
+            settings.hp_at_lvl_up.get_nearest(player_level) as f32,
+            settings.mp_at_hp_lvl_up.get_nearest(player_level) as f32,
+            settings.sp_at_hp_lvl_up.get_nearest(player_level) as f32,
+            settings.cw_at_hp_lvl_up.get_nearest(player_level) as f32
+        ),
+        ActorAttribute::Magicka => (
+            settings.hp_at_mp_lvl_up.get_nearest(player_level) as f32,
+            settings.mp_at_lvl_up.get_nearest(player_level) as f32,
+            settings.sp_at_mp_lvl_up.get_nearest(player_level) as f32,
+            settings.cw_at_mp_lvl_up.get_nearest(player_level) as f32
+        ),
+        ActorAttribute::Stamina => (
+            settings.hp_at_sp_lvl_up.get_nearest(player_level) as f32,
+            settings.mp_at_sp_lvl_up.get_nearest(player_level) as f32,
+            settings.sp_at_lvl_up.get_nearest(player_level) as f32,
+            settings.cw_at_sp_lvl_up.get_nearest(player_level) as f32
+        ),
+        _ => panic!("Cannot get the attribute level up with an invalid choice.")
+    }
+}
+
+/// Checks if the legendary button should be displayed above a skill with the given level.
+pub fn is_legendary_button_visible(
+    skill_level: u32
+) -> bool {
+    is_legendary_available(skill_level)
+        && !setting!(baked::LEGENDARY_HIDE_BUTTON, SETTINGS.legendary.hide_button.get())
+}
+
+/// Checks if the given skill level is high enough to legendary.
+pub fn is_legendary_available(
+    skill_level: u32
+) -> bool {
+    skill_level >= setting!(
+        baked::LEGENDARY_SKILL_LEVEL_EN,
+        SETTINGS.legendary.skill_level_en.get()
+    )
+}
+
+/// Gets the level a skill should be set to after being legendaried.
+#[cfg_attr(feature = "baked_config", inline)]
+pub fn get_post_legendary_skill_level(
+    default_reset: f32,
+    base_level: f32
+) -> f32 {
+    // Check if legendarying should reset the level at all.
+    if setting!(baked::LEGENDARY_KEEP_SKILL_LEVEL, SETTINGS.legendary.keep_skill_level.get()) {
+        return base_level;
+    }
+
+    // 0 in the conf file means we should use the default value.
+    let mut reset_level = setting!(
+        baked::LEGENDARY_SKILL_LEVEL_AFTER,
+        SETTINGS.legendary.skill_level_after.get()
+    ) as f32;
+    if reset_level == 0.0 {
+        reset_level = default_reset;
+    }
+
+    // Don't allow legendarying to raise the skill level.
+    reset_level.min(base_level)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// The INI file shipped with the plugin.
+    const SHIPPED_INI: &str = include_str!("../../../SkyrimUncapper/SkyrimUncapper.ini");
+
+    /// Replaces the first occurrence of the given text, which must exist.
+    fn edit(
+        text: &str,
+        from: &str,
+        to: &str
+    ) -> String {
+        assert!(text.contains(from));
+        text.replacen(from, to, 1)
+    }
+
+    #[test]
+    fn rebuild_matches_a_fresh_read() {
+        let ini = Ini::from_str(SHIPPED_INI).unwrap();
+        let mut snapshot = SettingsSnapshot::new(&ini);
+
+        // An unchanged file reads nothing again.
+        let (mut same, rebuilt) = snapshot.rebuild(&ini);
+        assert_eq!(rebuilt, 0);
+        assert!(same.to_cache(0) == snapshot.to_cache(0));
+
+        // Edit a flat section, two leveled sections, and the legendary section.
+        let text = edit(
+            SHIPPED_INI,
+            "[SkillCaps]\niOneHanded = 100",
+            "[SkillCaps]\niOneHanded = 150"
+        );
+        let text = edit(
+            &text,
+            "[SkillExpGainMults\\BaseSkillLevel\\OneHanded]\n0 = 1.000000",
+            "[SkillExpGainMults\\BaseSkillLevel\\OneHanded]\n0 = 1.000000\n50 = 2.500000"
+        );
+        let text = edit(&text, "[PerksAtLevelUp]\n0 = 1.000000", "[PerksAtLevelUp]\n0 = 2.000000");
+        let text = edit(
+            &text,
+            "bLegendaryKeepSkillLevel = false",
+            "bLegendaryKeepSkillLevel = true"
+        );
+        let edited = Ini::from_str(&text).unwrap();
+
+        let (mut rebuilt, count) = snapshot.rebuild(&edited);
+        assert!(count > 0);
+        assert!(rebuilt.to_cache(0) == SettingsSnapshot::new(&edited).to_cache(0));
+        assert!(rebuilt.to_cache(0) != snapshot.to_cache(0));
+    }
+}
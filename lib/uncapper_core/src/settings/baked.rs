@@ -0,0 +1,25 @@
+//!
+//! @file baked.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Holds the settings compiled into the plugin by the baked_config feature.
+//! @bug No known bugs.
+//!
+//! The tables are generated by the build script from the INI file given in UNCAPPER_BAKED_INI.
+//! Leveled tables hold one entry per level up to the last level configured in the INI, and
+//! every level past that uses the last entry.
+//!
+
+use super::SkillMult;
+use super::leveled::LevelItem;
+use crate::skyrim::SKILL_COUNT;
+
+include!(concat!(env!("OUT_DIR"), "/baked_config.rs"));
+
+/// Gets the entry for the given level in a dense leveled table.
+#[inline(always)]
+pub fn nearest<T: Copy>(
+    table: &[T],
+    level: u32
+) -> T {
+    table[std::cmp::min(level as usize, table.len() - 1)]
+}
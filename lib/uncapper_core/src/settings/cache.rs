@@ -0,0 +1,319 @@
+//!
+//! @file cache.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Stores fully read settings in a binary cache next to the INI file.
+//! @bug No known bugs.
+//!
+//! The cache is keyed by a hash of the plugin build and of the bytes of the INI file it was
+//! read from. If neither changed since the last launch, the settings are taken from the cache
+//! and the INI file isn't parsed at all. Any edit to the INI file, or any other build of the
+//! plugin, gives a different key, and the cache is then replaced after the INI is read.
+//!
+//! The cache ends with a checksum of its contents, so a cache which was only partly written is
+//! ignored as well.
+//!
+
+use std::path::{Path, PathBuf};
+
+use skse64::log::skse_message;
+
+use super::{fnv1a, SettingsSnapshot, Settings, SkillMult, FNV_OFFSET};
+
+/// The magic number at the start of a settings cache.
+const MAGIC: [u8; 8] = *b"UNCAPSET";
+
+/// The version of the cache layout. Must be changed whenever the layout of a setting changes.
+const FORMAT_VERSION: u32 = 1;
+
+/// Identifies the build of the plugin which wrote a cache.
+pub const BUILD_ID: &str = concat!(env!("CARGO_PKG_VERSION"), "+", env!("UNCAPPER_GIT_VERSION"));
+
+/// The size of the header before the cached settings.
+const HEADER_SIZE: usize = MAGIC.len() + 4 + 8 + 8 + 8;
+
+pub trait Cached {
+    ///
+    /// @brief Writes the config item to the given cache.
+    /// @param out The cache to append to.
+    ///
+    fn save(&self, out: &mut Vec<u8>);
+
+    ///
+    /// @brief Reads the config item back from the given cache.
+    /// @param input The cache to read from, which is advanced past the config item.
+    /// @return An error if the cache ended early.
+    ///
+    fn load(&mut self, input: &mut &[u8]) -> Result<(), ()>;
+}
+
+/// Implements caching for a number, which is stored in little endian.
+macro_rules! cached_num {
+    ( $($ty:ty),* ) => { $(
+        impl Cached for $ty {
+            fn save(
+                &self,
+                out: &mut Vec<u8>
+            ) {
+                out.extend_from_slice(&self.to_le_bytes());
+            }
+
+            fn load(
+                &mut self,
+                input: &mut &[u8]
+            ) -> Result<(), ()> {
+                *self = <$ty>::from_le_bytes(take(input, std::mem::size_of::<$ty>())?
+                    .try_into().unwrap());
+                Ok(())
+            }
+        }
+    )* };
+}
+
+cached_num!(u32, u64, f32);
+
+impl Cached for bool {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        out.push(*self as u8);
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        *self = take(input, 1)?[0] != 0;
+        Ok(())
+    }
+}
+
+impl Cached for SkillMult {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        self.base.save(out);
+        self.offset.save(out);
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        self.base.load(input)?;
+        self.offset.load(input)
+    }
+}
+
+impl SettingsSnapshot {
+    ///
+    /// Writes the snapshot to a cache with the given key.
+    ///
+    /// The settings are reached the same way they are read from the INI, which needs a
+    /// mutable snapshot even though nothing is changed.
+    ///
+    pub fn to_cache(
+        &mut self,
+        key: u64
+    ) -> Vec<u8> {
+        let mut body = Vec::new();
+        for item in self.settings.items_mut() {
+            item.save(&mut body);
+        }
+
+        (self.sections.len() as u32).save(&mut body);
+        for (name, hash) in self.sections.iter() {
+            (name.len() as u32).save(&mut body);
+            body.extend_from_slice(name.as_bytes());
+            hash.save(&mut body);
+        }
+
+        let mut out = Vec::with_capacity(HEADER_SIZE + body.len());
+        out.extend_from_slice(&MAGIC);
+        FORMAT_VERSION.save(&mut out);
+        key.save(&mut out);
+        (body.len() as u64).save(&mut out);
+        fnv1a(FNV_OFFSET, &body).save(&mut out);
+        out.extend_from_slice(&body);
+        out
+    }
+
+    ///
+    /// Reads a snapshot back from a cache, which must have the given key.
+    ///
+    /// Returns an error if the cache was written for another key, by a plugin with another
+    /// cache layout, or is damaged.
+    ///
+    pub fn from_cache(
+        cache: &[u8],
+        key: u64
+    ) -> Result<Self, ()> {
+        let mut input = cache;
+        let (mut version, mut cache_key, mut len, mut checksum) = (0u32, 0u64, 0u64, 0u64);
+        if take(&mut input, MAGIC.len())? != MAGIC {
+            return Err(());
+        }
+
+        version.load(&mut input)?;
+        cache_key.load(&mut input)?;
+        len.load(&mut input)?;
+        checksum.load(&mut input)?;
+        if (version != FORMAT_VERSION) || (cache_key != key) || (len != input.len() as u64)
+                || (checksum != fnv1a(FNV_OFFSET, input)) {
+            return Err(());
+        }
+
+        let mut settings = Settings::new();
+        for item in settings.items_mut() {
+            item.load(&mut input)?;
+        }
+
+        let mut count = 0u32;
+        count.load(&mut input)?;
+        let mut sections = Vec::with_capacity(count as usize);
+        for _ in 0..count {
+            let (mut name_len, mut hash) = (0u32, 0u64);
+            name_len.load(&mut input)?;
+            let name = take(&mut input, name_len as usize)?;
+            hash.load(&mut input)?;
+            sections.push((String::from_utf8(name.to_vec()).map_err(|_| ())?, hash));
+        }
+
+        if !input.is_empty() {
+            return Err(());
+        }
+
+        Ok(Self { settings, sections })
+    }
+}
+
+/// Gets the key of the cache for the given INI file contents, when read by this build.
+pub fn key(
+    ini: &[u8]
+) -> u64 {
+    build_key(BUILD_ID, ini)
+}
+
+/// Gets the key of the cache for the given INI file contents, when read by the given build.
+fn build_key(
+    build: &str,
+    ini: &[u8]
+) -> u64 {
+    fnv1a(fnv1a(fnv1a(FNV_OFFSET, build.as_bytes()), b"\n"), ini)
+}
+
+/// Gets the path of the cache for the INI file at the given path.
+pub fn path(
+    ini_path: &Path
+) -> PathBuf {
+    let mut path = ini_path.as_os_str().to_owned();
+    path.push(".cache");
+    PathBuf::from(path)
+}
+
+/// Loads the cached settings of the INI file at the given path, if the cache has the given key.
+pub fn load(
+    ini_path: &Path,
+    key: u64
+) -> Option<SettingsSnapshot> {
+    let cache = std::fs::read(path(ini_path)).ok()?;
+    SettingsSnapshot::from_cache(&cache, key).ok()
+}
+
+///
+/// Caches the settings of the INI file at the given path under the given key.
+///
+/// Failing to write the cache only means the INI will be read again next time, so it is not
+/// an error.
+///
+pub fn store(
+    ini_path: &Path,
+    key: u64,
+    snapshot: &mut SettingsSnapshot
+) {
+    let path = path(ini_path);
+    if std::fs::write(&path, snapshot.to_cache(key)).is_err() {
+        skse_message!("[WARNING] Could not write the settings cache: {}", path.display());
+    }
+}
+
+/// Takes the given number of bytes from the front of the cache.
+pub fn take<'a>(
+    input: &mut &'a [u8],
+    len: usize
+) -> Result<&'a [u8], ()> {
+    if input.len() < len {
+        return Err(());
+    }
+
+    let (front, back) = input.split_at(len);
+    *input = back;
+    Ok(front)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use plugin_ini::Ini;
+
+    /// The INI file shipped with the plugin.
+    const SHIPPED_INI: &str =
+        include_str!("../../../../SkyrimUncapper/SkyrimUncapper.ini");
+
+    /// Reads the settings of the given INI file contents into a snapshot.
+    fn snapshot(
+        text: &str
+    ) -> SettingsSnapshot {
+        SettingsSnapshot::new(&Ini::from_str(text).unwrap())
+    }
+
+    #[test]
+    fn cache_is_only_reused_for_the_same_file_and_build() {
+        let dir = std::env::temp_dir().join(format!("uncapper-cache-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let ini_path = dir.join("SkyrimUncapper.ini");
+
+        let text = SHIPPED_INI.to_string();
+        let edited = text.replacen("bUseSkillCaps = true", "bUseSkillCaps = false", 1);
+        assert!(edited != text);
+        std::fs::write(&ini_path, &text).unwrap();
+
+        // Nothing is cached until the settings are first stored.
+        assert!(load(&ini_path, key(text.as_bytes())).is_none());
+        let mut stored = snapshot(&text);
+        store(&ini_path, key(text.as_bytes()), &mut stored);
+        assert!(path(&ini_path).exists());
+
+        // An unchanged file, read by the same build, gets back the same settings.
+        let mut cached = load(&ini_path, key(text.as_bytes())).unwrap();
+        assert!(cached.to_cache(0) == stored.to_cache(0));
+
+        // Editing the INI, or updating the plugin, changes the key.
+        std::fs::write(&ini_path, &edited).unwrap();
+        assert!(load(&ini_path, key(edited.as_bytes())).is_none());
+        assert!(build_key("0.0.0+other", text.as_bytes()) != key(text.as_bytes()));
+        assert!(load(&ini_path, build_key("0.0.0+other", text.as_bytes())).is_none());
+
+        // The edited file is then cached in place of the old one.
+        let mut stored = snapshot(&edited);
+        store(&ini_path, key(edited.as_bytes()), &mut stored);
+        let mut cached = load(&ini_path, key(edited.as_bytes())).unwrap();
+        assert!(cached.to_cache(0) == stored.to_cache(0));
+        assert!(load(&ini_path, key(text.as_bytes())).is_none());
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn damaged_caches_are_ignored() {
+        let cache = snapshot(SHIPPED_INI).to_cache(1);
+        assert!(SettingsSnapshot::from_cache(&cache, 1).is_ok());
+        assert!(SettingsSnapshot::from_cache(&cache[..cache.len() - 1], 1).is_err());
+
+        let mut flipped = cache.clone();
+        *flipped.last_mut().unwrap() ^= 1;
+        assert!(SettingsSnapshot::from_cache(&flipped, 1).is_err());
+    }
+}
@@ -8,6 +8,11 @@
 use std::ops::Deref;
 use plugin_ini::Ini;
 
+use super::cache::Cached;
+
+/// The number of times each INI warning is logged, after which further copies are only counted.
+pub const INI_WARNING_LIMIT: usize = 8;
+
 pub trait IniNamedReadable {
     /// @brief The type of the underlying values.
     type Value: Copy;
@@ -19,6 +24,38 @@ pub trait IniNamedReadable {
     /// @param default The default value to assume if none is available.
     ///
     fn read_ini_named(&mut self, ini: &Ini, section: &str, default: Self::Value);
+
+    ///
+    /// @brief Checks if reading from the given section would read the section with the given name.
+    /// @param section The section of the INI the config item is read from.
+    /// @param name The name of the section to check.
+    ///
+    fn reads_section(section: &str, name: &str) -> bool where Self: Sized {
+        section.eq_ignore_ascii_case(name)
+    }
+
+    ///
+    /// @brief Reads the config item again, if it depends on any of the given sections.
+    /// @param ini The INI to read from.
+    /// @param section The section of the INI to read from.
+    /// @param default The default value to assume if none is available.
+    /// @param changed The names of the sections which changed.
+    /// @return The number of values which were read again.
+    ///
+    fn read_ini_named_changed(
+        &mut self,
+        ini: &Ini,
+        section: &str,
+        default: Self::Value,
+        changed: &[&str]
+    ) -> usize where Self: Sized {
+        if changed.iter().any(|name| Self::reads_section(section, name)) {
+            self.read_ini_named(ini, section, default);
+            1
+        } else {
+            0
+        }
+    }
 }
 
 pub trait IniUnnamedReadable {
@@ -35,15 +72,24 @@ pub trait IniUnnamedReadable {
     fn read_ini_unnamed(&mut self, ini: &Ini, section: &str, name: &str, default: Self::Value);
 }
 
-pub trait IniDefaultReadable {
+pub trait IniDefaultReadable: Cached {
     ///
     /// @brief Reads in values from the INI file using a default configuraion.
     /// @param ini The INI to read from.
     ///
     fn read_ini_default(&mut self, ini: &Ini);
+
+    ///
+    /// @brief Reads in the parts of the config item which depend on any of the given sections.
+    /// @param ini The INI to read from.
+    /// @param changed The names of the sections which changed.
+    /// @return The number of values which were read again.
+    ///
+    fn read_ini_changed(&mut self, ini: &Ini, changed: &[&str]) -> usize;
 }
 
 /// Configures an INI section with default values
+#[derive(Clone)]
 pub struct DefaultIniSection<T: IniNamedReadable> {
     field: T,
     section: &'static str,
@@ -51,6 +97,7 @@ pub struct DefaultIniSection<T: IniNamedReadable> {
 }
 
 /// Configures an INI field with default values.
+#[derive(Clone)]
 pub struct DefaultIniField<T: IniUnnamedReadable> {
     field: T,
     section: &'static str,
@@ -72,13 +119,37 @@ impl<T: IniNamedReadable + Default> DefaultIniSection<T> {
     }
 }
 
-impl<T: IniNamedReadable> IniDefaultReadable for DefaultIniSection<T> {
+impl<T: IniNamedReadable + Cached> IniDefaultReadable for DefaultIniSection<T> {
     fn read_ini_default(
         &mut self,
         ini: &Ini
     ) {
         self.field.read_ini_named(ini, self.section, self.default);
     }
+
+    fn read_ini_changed(
+        &mut self,
+        ini: &Ini,
+        changed: &[&str]
+    ) -> usize {
+        self.field.read_ini_named_changed(ini, self.section, self.default, changed)
+    }
+}
+
+impl<T: IniNamedReadable + Cached> Cached for DefaultIniSection<T> {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        self.field.save(out);
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        self.field.load(input)
+    }
 }
 
 impl<T: IniNamedReadable> Deref for DefaultIniSection<T> {
@@ -106,13 +177,42 @@ impl<T: IniUnnamedReadable + Default> DefaultIniField<T> {
     }
 }
 
-impl<T: IniUnnamedReadable> IniDefaultReadable for DefaultIniField<T> {
+impl<T: IniUnnamedReadable + Cached> IniDefaultReadable for DefaultIniField<T> {
     fn read_ini_default(
         &mut self,
         ini: &Ini
     ) {
         self.field.read_ini_unnamed(ini, self.section, self.name, self.default);
     }
+
+    fn read_ini_changed(
+        &mut self,
+        ini: &Ini,
+        changed: &[&str]
+    ) -> usize {
+        if changed.iter().any(|name| self.section.eq_ignore_ascii_case(name)) {
+            self.read_ini_default(ini);
+            1
+        } else {
+            0
+        }
+    }
+}
+
+impl<T: IniUnnamedReadable + Cached> Cached for DefaultIniField<T> {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        self.field.save(out);
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        self.field.load(input)
+    }
 }
 
 impl<T: IniUnnamedReadable> Deref for DefaultIniField<T> {
@@ -12,11 +12,12 @@ use plugin_ini::Ini;
 use skse64::log::skse_message;
 
 use crate::skyrim::{ActorAttribute, HungarianAttribute};
-use super::config::IniUnnamedReadable;
+use super::cache::Cached;
+use super::config::{IniUnnamedReadable, INI_WARNING_LIMIT};
 use super::skills::IniSkillReadable;
 
 /// Wraps a field which can be loaded from an INI file.
-#[derive(Default)]
+#[derive(Default, Clone)]
 pub struct IniField<T: Default>(Option<T>);
 
 impl<T: Copy + Default> IniField<T> {
@@ -39,8 +40,14 @@ impl<T: Copy + FromStr + Default> IniUnnamedReadable for IniField<T>
         name: &str,
         default: Self::Value
     ) {
+        // Each field is read once from each INI, so caching the parse with get_by_handle()
+        // would only cost an allocation per field.
         let val = ini.get(section, name).unwrap_or_else(|| {
-            skse_message!("[WARNING] Failed to load INI value {}: {}", section, name);
+            skse_message!(
+                "[WARNING] Failed to load INI value {}: {}",
+                section,
+                name => limit INI_WARNING_LIMIT
+            );
             default
         });
 
@@ -48,6 +55,35 @@ impl<T: Copy + FromStr + Default> IniUnnamedReadable for IniField<T>
     }
 }
 
+impl<T: Cached + Default> Cached for IniField<T> {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        self.0.is_some().save(out);
+        if let Some(val) = self.0.as_ref() {
+            val.save(out);
+        }
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        let mut is_some = false;
+        is_some.load(input)?;
+        self.0 = if is_some {
+            let mut val = T::default();
+            val.load(input)?;
+            Some(val)
+        } else {
+            None
+        };
+
+        Ok(())
+    }
+}
+
 impl<T: Copy + FromStr + Default + HungarianAttribute> IniSkillReadable for IniField<T>
     where <T as FromStr>::Err: std::fmt::Debug
 {
@@ -61,4 +97,13 @@ impl<T: Copy + FromStr + Default + HungarianAttribute> IniSkillReadable for IniF
     ) {
         self.read_ini_unnamed(ini, section, T::hungarian_attr(skill), default);
     }
+
+    fn reads_skill_section(
+        section: &str,
+        _skill: ActorAttribute,
+        name: &str
+    ) -> bool {
+        // Each skill is a field within the same section.
+        section.eq_ignore_ascii_case(name)
+    }
 }
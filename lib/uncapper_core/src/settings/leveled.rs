@@ -12,17 +12,19 @@ use plugin_ini::Ini;
 use skse64::log::skse_message;
 
 use crate::skyrim::ActorAttribute;
-use super::config::IniNamedReadable;
+use super::cache::Cached;
+use super::config::{IniNamedReadable, INI_WARNING_LIMIT};
 use super::skills::IniSkillReadable;
 
 /// Holds a level and setting pair in the list.
-struct LevelItem<T> {
-    level: u32,
-    item: T
+#[derive(Clone)]
+pub struct LevelItem<T> {
+    pub level: u32,
+    pub item: T
 }
 
 /// Holds a setting which is configured on a per-level basis.
-#[derive(Default)]
+#[derive(Default, Clone)]
 pub struct LeveledIniSection<T>(Vec<LevelItem<T>>);
 
 impl<T: Copy> LeveledIniSection<T> {
@@ -92,33 +94,41 @@ impl<T: Copy> LeveledIniSection<T> {
 }
 
 impl LeveledIniSection<f32> {
-    ///
-    /// Accumulates the values across all previous levels, and determines
-    /// what the increment from the last level was.
-    ///
-    /// This function is intended to be used for the calculation of partial
-    /// perk point awards.
-    ///
+    /// Determines the increment of the accumulated values at the given level.
     pub fn get_cumulative_delta(
         &self,
         level: u32
     ) -> u32 {
-        assert!(self.0.len() > 0);
-
-        let mut acc: f32 = 0.0;
-        let mut pacc: f32 = 0.0;
-        let mut i = 0;
-        while (i < self.0.len()) && (self.0[i].level <= level) {
-            // Update the accumulation. Note the exclusize upper bound on level.
-            let bound = if (i + 1) < self.0.len() { self.0[i + 1].level } else { level + 1 };
-            let this_level = std::cmp::min(level + 1, bound);
-            acc += ((this_level - self.0[i].level) as f32) * self.0[i].item;
-            pacc = acc - self.0[i].item;
-            i += 1;
-        }
+        cumulative_delta(&self.0, level)
+    }
+}
 
-        return (acc as u32) - (pacc as u32);
+///
+/// Accumulates the values across all previous levels of a sorted level list, and determines
+/// what the increment from the last level was.
+///
+/// This function is intended to be used for the calculation of partial
+/// perk point awards.
+///
+pub fn cumulative_delta(
+    items: &[LevelItem<f32>],
+    level: u32
+) -> u32 {
+    assert!(items.len() > 0);
+
+    let mut acc: f32 = 0.0;
+    let mut pacc: f32 = 0.0;
+    let mut i = 0;
+    while (i < items.len()) && (items[i].level <= level) {
+        // Update the accumulation. Note the exclusize upper bound on level.
+        let bound = if (i + 1) < items.len() { items[i + 1].level } else { level + 1 };
+        let this_level = std::cmp::min(level + 1, bound);
+        acc += ((this_level - items[i].level) as f32) * items[i].item;
+        pacc = acc - items[i].item;
+        i += 1;
     }
+
+    return (acc as u32) - (pacc as u32);
 }
 
 impl<T: Copy + FromStr> IniNamedReadable for LeveledIniSection<T>
@@ -131,12 +141,18 @@ impl<T: Copy + FromStr> IniNamedReadable for LeveledIniSection<T>
         section: &str,
         default: Self::Value
     ) {
+        // Discard any levels from a previous read.
+        self.0.clear();
+
         if let Ok(sec) = ini.section(section) {
             for field in sec.fields() {
                 let level = if let Ok(l) = u32::from_str(field.name()) {
                     l
                 } else {
-                    skse_message!("[WARNING] Unable to convert {} to a u32; skipped", field.name());
+                    skse_message!(
+                        "[WARNING] Unable to convert {} to a u32; skipped",
+                        field.name() => limit INI_WARNING_LIMIT
+                    );
                     continue;
                 };
 
@@ -146,6 +162,7 @@ impl<T: Copy + FromStr> IniNamedReadable for LeveledIniSection<T>
                     skse_message!(
                         "[WARNING] Unabled to convert {} to value type; skipped",
                         field.value::<String>().as_ref().map(|s| s.as_ref()).unwrap_or("None")
+                            => limit INI_WARNING_LIMIT
                     );
                     continue;
                 };
@@ -154,11 +171,17 @@ impl<T: Copy + FromStr> IniNamedReadable for LeveledIniSection<T>
             }
 
             if self.0.len() == 0 {
-                skse_message!("[WARNING] No values for in INI file for section {}", section);
+                skse_message!(
+                    "[WARNING] No values for in INI file for section {}",
+                    section => limit INI_WARNING_LIMIT
+                );
                 self.add(0, default);
             }
         } else {
-            skse_message!("[WARNING] Unable to find section [{}] in INI file", section);
+            skse_message!(
+                "[WARNING] Unable to find section [{}] in INI file",
+                section => limit INI_WARNING_LIMIT
+            );
             self.add(0, default);
         }
 
@@ -166,6 +189,38 @@ impl<T: Copy + FromStr> IniNamedReadable for LeveledIniSection<T>
     }
 }
 
+impl<T: Cached + Default> Cached for LeveledIniSection<T> {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        (self.0.len() as u32).save(out);
+        for LevelItem { level, item } in self.0.iter() {
+            level.save(out);
+            item.save(out);
+        }
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        let mut len = 0u32;
+        len.load(input)?;
+
+        self.0.clear();
+        for _ in 0..len {
+            let mut entry = LevelItem { level: 0, item: T::default() };
+            entry.level.load(input)?;
+            entry.item.load(input)?;
+            self.0.push(entry);
+        }
+
+        self.0.shrink_to_fit();
+        Ok(())
+    }
+}
+
 impl<T: Copy + FromStr> IniSkillReadable for LeveledIniSection<T>
     where <T as FromStr>::Err: std::fmt::Debug
 {
@@ -180,4 +235,15 @@ impl<T: Copy + FromStr> IniSkillReadable for LeveledIniSection<T>
         let section = String::from_str(section).unwrap() + "\\" + skill.name();
         self.read_ini_named(ini, &section, default);
     }
+
+    fn reads_skill_section(
+        section: &str,
+        skill: ActorAttribute,
+        name: &str
+    ) -> bool {
+        // Each skill has its own subsection.
+        name.rsplit_once('\\').map(|(sec, sub)| {
+            sec.eq_ignore_ascii_case(section) && sub.eq_ignore_ascii_case(skill.name())
+        }).unwrap_or(false)
+    }
 }
@@ -7,6 +7,7 @@
 
 use plugin_ini::Ini;
 
+use super::cache::Cached;
 use super::config::IniNamedReadable;
 use crate::skyrim::{ActorAttribute, SkillIterator, SKILL_COUNT};
 
@@ -27,10 +28,23 @@ pub trait IniSkillReadable {
         skill: ActorAttribute,
         default: Self::Value
     );
+
+    ///
+    /// @brief Checks if reading a skill from the given section would read the section with the
+    ///        given name.
+    /// @param section The section of the INI skills are read from.
+    /// @param skill The skill which would be read.
+    /// @param name The name of the section to check.
+    ///
+    fn reads_skill_section(
+        section: &str,
+        skill: ActorAttribute,
+        name: &str
+    ) -> bool;
 }
 
 /// Manages per-skill setting groups, allowing them to be read in together.
-#[derive(Default)]
+#[derive(Default, Clone)]
 pub struct IniSkillManager<T: Default>([T; SKILL_COUNT]);
 
 impl<T: IniSkillReadable + Default> IniSkillManager<T> {
@@ -56,4 +70,52 @@ impl<T: IniSkillReadable + Default> IniNamedReadable for IniSkillManager<T> {
             self.0[skill.skill_slot()].read_ini_skill(ini, section, skill, default);
         }
     }
+
+    fn reads_section(
+        section: &str,
+        name: &str
+    ) -> bool {
+        SkillIterator::new().any(|skill| T::reads_skill_section(section, skill, name))
+    }
+
+    fn read_ini_named_changed(
+        &mut self,
+        ini: &Ini,
+        section: &str,
+        default: Self::Value,
+        changed: &[&str]
+    ) -> usize {
+        // Only the skills whose values changed are read again.
+        let mut count = 0;
+        for skill in SkillIterator::new() {
+            if changed.iter().any(|name| T::reads_skill_section(section, skill, name)) {
+                self.0[skill.skill_slot()].read_ini_skill(ini, section, skill, default);
+                count += 1;
+            }
+        }
+
+        count
+    }
+}
+
+impl<T: Cached + Default> Cached for IniSkillManager<T> {
+    fn save(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        for item in self.0.iter() {
+            item.save(out);
+        }
+    }
+
+    fn load(
+        &mut self,
+        input: &mut &[u8]
+    ) -> Result<(), ()> {
+        for item in self.0.iter_mut() {
+            item.load(input)?;
+        }
+
+        Ok(())
+    }
 }
@@ -8,6 +8,7 @@
 mod actor_attribute;
 mod player;
 mod game_objects;
+pub mod standin;
 
 pub use actor_attribute::*;
 pub use player::*;
@@ -12,6 +12,7 @@ use skyrim_patcher::{GameRef, Descriptor, GameLocation};
 use super::PlayerCharacter;
 use super::{ActorValueOwner, ActorAttribute};
 use crate::settings;
+use crate::trace::{self, TraceEffect, TraceValue};
 
 // Game objects.
 static PLAYER_OBJECT: GameRef<*mut *mut PlayerCharacter> = GameRef::new();
@@ -124,6 +125,7 @@ disarray::disarray! {
 }
 
 // C++ wrappers, which catch any exceptions and redirect to us in a defined way.
+#[cfg(windows)]
 extern "system" {
     fn get_level_net(player: *mut PlayerCharacter) -> u16;
     fn player_avo_get_base_net(av: *mut ActorValueOwner, attr: c_int) -> f32;
@@ -142,6 +144,97 @@ extern "system" {
     );
 }
 
+// Host builds have no C++ exceptions to catch, so the entry points are called directly.
+#[cfg(not(windows))]
+unsafe fn get_level_net(
+    player: *mut PlayerCharacter
+) -> u16 {
+    get_level_entry.get()(player)
+}
+
+#[cfg(not(windows))]
+unsafe fn player_avo_get_base_net(
+    av: *mut ActorValueOwner,
+    attr: c_int
+) -> f32 {
+    player_avo_get_base_entry.get()(av, ActorAttribute::from_raw(attr).unwrap())
+}
+
+#[cfg(not(windows))]
+unsafe fn player_avo_get_current_net(
+    av: *mut ActorValueOwner,
+    attr: c_int,
+    _is_se: bool,
+    _patch_en: bool
+) -> f32 {
+    player_avo_get_current_entry.get()(av, attr)
+}
+
+#[cfg(not(windows))]
+unsafe fn player_avo_mod_base_net(
+    av: *mut ActorValueOwner,
+    attr: c_int,
+    delta: f32
+) {
+    player_avo_mod_base_entry.get()(av, ActorAttribute::from_raw(attr).unwrap(), delta)
+}
+
+#[cfg(not(windows))]
+unsafe fn player_avo_mod_current_net(
+    av: *mut ActorValueOwner,
+    unk1: u32,
+    attr: c_int,
+    delta: f32
+) {
+    player_avo_mod_current_entry.get()(av, unk1, ActorAttribute::from_raw(attr).unwrap(), delta)
+}
+
+/// The game objects and native functions a host tool provides in place of the game.
+pub struct HostGame {
+    pub player: &'static *mut PlayerCharacter,
+    pub get_level: fn(*mut PlayerCharacter) -> u16,
+    pub avo_get_base: unsafe extern "system" fn(*mut ActorValueOwner, ActorAttribute) -> f32,
+    pub avo_get_current: unsafe extern "system" fn(*mut ActorValueOwner, c_int) -> f32,
+    pub avo_mod_base: unsafe extern "system" fn(*mut ActorValueOwner, ActorAttribute, f32),
+    pub avo_mod_current: unsafe extern "system" fn(*mut ActorValueOwner, u32, ActorAttribute, f32),
+    pub enchanting_skill_cost_base: &'static f32,
+    pub enchanting_skill_cost_scale: &'static f32,
+    pub enchanting_cost_exponent: &'static f32,
+    pub enchanting_skill_cost_mult: &'static f32,
+    pub xp_per_skill_rank: &'static f32,
+    pub legendary_skill_reset_value: &'static f32
+}
+
+///
+/// Points every game object and function at the ones provided by a host tool.
+///
+/// In order to use this function safely, no other thread may be using the game objects, and
+/// the player given must be large enough to hold every field accessed through it.
+///
+pub unsafe fn use_host_game(
+    game: &HostGame
+) {
+    unsafe fn set<T>(
+        game_ref: &GameRef<T>,
+        val: T
+    ) {
+        *game_ref.inner().as_ref().get() = std::mem::transmute_copy(&val);
+    }
+
+    set(&PLAYER_OBJECT, game.player as *const _ as *mut *mut PlayerCharacter);
+    set(&get_level_entry, game.get_level);
+    set(&player_avo_get_base_entry, game.avo_get_base);
+    set(&player_avo_get_current_entry, game.avo_get_current);
+    set(&player_avo_mod_base_entry, game.avo_mod_base);
+    set(&player_avo_mod_current_entry, game.avo_mod_current);
+    set(&ENCHANTING_SKILL_COST_BASE, game.enchanting_skill_cost_base);
+    set(&ENCHANTING_SKILL_COST_SCALE, game.enchanting_skill_cost_scale);
+    set(&ENCHANTING_COST_EXPONENT, game.enchanting_cost_exponent);
+    set(&ENCHANTING_SKILL_COST_MULT, game.enchanting_skill_cost_mult);
+    set(&XP_PER_SKILL_RANK, game.xp_per_skill_rank);
+    set(&LEGENDARY_SKILL_RESET_VALUE, game.legendary_skill_reset_value);
+}
+
 /// Handles a C++ exception by just panicking.
 #[no_mangle]
 unsafe extern "system" fn handle_ffi_exception(
@@ -182,7 +275,7 @@ pub fn get_player_perk_pool() -> &'static core::cell::Cell<u8> {
 
 /// Gets the current level of the player.
 pub fn get_player_level() -> u32 {
-    unsafe { get_level_net(*(PLAYER_OBJECT.get())) as u32 }
+    trace::native(unsafe { get_level_net(*(PLAYER_OBJECT.get())) } as u32)
 }
 
 ///
@@ -195,7 +288,7 @@ pub unsafe extern "system" fn player_avo_get_base_unchecked(
     av: *mut ActorValueOwner,
     attr: c_int
 ) -> f32 {
-    player_avo_get_base_net(av, attr)
+    trace::native(player_avo_get_base_net(av, attr))
 }
 
 ///
@@ -209,7 +302,12 @@ pub unsafe extern "system" fn player_avo_get_current_unchecked(
     attr: c_int
 ) -> f32 {
     let is_se = skse64::version::current_runtime() <= skse64::version::RUNTIME_VERSION_1_5_97;
-    player_avo_get_current_net(av, attr, is_se, settings::is_skill_formula_cap_enabled())
+    trace::native(player_avo_get_current_net(
+        av,
+        attr,
+        is_se,
+        settings::is_skill_formula_cap_enabled()
+    ))
 }
 
 /// Gets the base value of the given attribute.
@@ -231,6 +329,7 @@ pub fn player_avo_mod_base(
     attr: ActorAttribute,
     val: f32
 ) {
+    trace::effect(TraceEffect::ModBase, attr as c_int, val.to_word());
     unsafe { player_avo_mod_base_net(get_player_avo(), attr as c_int, val) }
 }
 
@@ -240,5 +339,6 @@ pub fn player_avo_mod_current(
     val: f32
 ) {
     // No idea what second arg does; just match game calls.
+    trace::effect(TraceEffect::ModCurrent, attr as c_int, val.to_word());
     unsafe { player_avo_mod_current_net(get_player_avo(), 0, attr as c_int, val) }
 }
@@ -0,0 +1,248 @@
+//!
+//! @file standin.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Stands in for the game, so that the hooks can be driven outside of it.
+//! @bug No known bugs.
+//!
+//! The natives the hooks call are replaced by functions which operate on a single stand-in
+//! player. The player structure itself is a zeroed block of memory, which is only large enough
+//! to hold the fields the plugin reads from it (such as the perk pool).
+//!
+//! The stand-in is shared by every host tool and test. The plugin never uses it, so it is left
+//! out of the plugin when it is linked. It is not thread safe, so only one thread may use it
+//! at a time.
+//!
+
+use std::ffi::c_int;
+
+use racy_cell::RacyCell;
+use skse64::version::SkseVersion;
+
+use super::{use_host_game, ActorAttribute, ActorValueOwner, HostGame, PlayerCharacter};
+
+/// The number of actor values tracked for the player. Enough to index the carry weight.
+pub const VALUE_COUNT: usize = ActorAttribute::CarryWeight as usize + 1;
+
+/// The size of the stand-in player structure.
+const PLAYER_SIZE: usize = 0x1000;
+
+/// The game settings the hooks read.
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub struct GameSettings {
+    pub enchanting_skill_cost_base: f32,
+    pub enchanting_skill_cost_scale: f32,
+    pub enchanting_skill_cost_mult: f32,
+    pub enchanting_cost_exponent: f32,
+    pub xp_per_skill_rank: f32,
+    pub legendary_skill_reset_value: f32
+}
+
+/// The natives the hooks call, which may be replaced by a host tool.
+#[derive(Copy, Clone)]
+pub struct Natives {
+    pub get_level: fn(*mut PlayerCharacter) -> u16,
+    pub avo_get_base: unsafe extern "system" fn(*mut ActorValueOwner, ActorAttribute) -> f32,
+    pub avo_get_current: unsafe extern "system" fn(*mut ActorValueOwner, c_int) -> f32,
+    pub avo_mod_base: unsafe extern "system" fn(*mut ActorValueOwner, ActorAttribute, f32),
+    pub avo_mod_current: unsafe extern "system" fn(*mut ActorValueOwner, u32, ActorAttribute, f32)
+}
+
+/// The state of the stand-in player.
+struct PlayerState {
+    level: u16,
+    base: [f32; VALUE_COUNT],
+    modifiers: [f32; VALUE_COUNT]
+}
+
+/// The values of the stand-in player, as seen by the natives.
+static STATE: RacyCell<PlayerState> = RacyCell::new(PlayerState {
+    level: 1,
+    base: [0.0; VALUE_COUNT],
+    modifiers: [0.0; VALUE_COUNT]
+});
+
+/// The game settings given to install(), which the game objects point at.
+static SETTINGS: RacyCell<GameSettings> = RacyCell::new(GameSettings::VANILLA);
+
+/// The memory of the stand-in player structure.
+static PLAYER_DATA: RacyCell<[u64; PLAYER_SIZE / 8]> = RacyCell::new([0; PLAYER_SIZE / 8]);
+
+/// The global player pointer, as the game would hold it.
+static PLAYER: RacyCell<*mut PlayerCharacter> = RacyCell::new(std::ptr::null_mut());
+
+impl GameSettings {
+    /// The values the game ships with.
+    pub const VANILLA: Self = Self {
+        enchanting_skill_cost_base: 0.005,
+        enchanting_skill_cost_scale: 0.5,
+        enchanting_skill_cost_mult: 3.0,
+        enchanting_cost_exponent: 1.1,
+        xp_per_skill_rank: 1.0,
+        legendary_skill_reset_value: 15.0
+    };
+
+    /// Creates the settings from the order they are stored in a trace header.
+    pub fn from_array(
+        settings: [f32; 6]
+    ) -> Self {
+        Self {
+            enchanting_skill_cost_base: settings[0],
+            enchanting_skill_cost_scale: settings[1],
+            enchanting_skill_cost_mult: settings[2],
+            enchanting_cost_exponent: settings[3],
+            xp_per_skill_rank: settings[4],
+            legendary_skill_reset_value: settings[5]
+        }
+    }
+
+    /// Gets the settings in the order they are stored in a trace header.
+    pub fn to_array(
+        &self
+    ) -> [f32; 6] {
+        [
+            self.enchanting_skill_cost_base,
+            self.enchanting_skill_cost_scale,
+            self.enchanting_skill_cost_mult,
+            self.enchanting_cost_exponent,
+            self.xp_per_skill_rank,
+            self.legendary_skill_reset_value
+        ]
+    }
+}
+
+impl Natives {
+    /// The natives of the stand-in player, which read and change its values.
+    pub const STAND_IN: Self = Self {
+        get_level,
+        avo_get_base,
+        avo_get_current,
+        avo_mod_base,
+        avo_mod_current
+    };
+}
+
+///
+/// Points the plugin at the stand-in game, emulating the given runtime.
+///
+/// Must be called before any hook is used. The runtime can only be set once per process, so
+/// later calls must give the same one.
+///
+pub fn install(
+    runtime: SkseVersion,
+    settings: GameSettings,
+    natives: Natives
+) {
+    skse64::version::init_host_runtime(runtime);
+    unsafe {
+        // SAFETY: The player memory is larger than any offset the plugin reads, and only one
+        //         thread uses the stand-in.
+        *SETTINGS.get() = settings;
+        *PLAYER.get() = PLAYER_DATA.get().cast();
+        let settings = &*SETTINGS.get();
+        use_host_game(&HostGame {
+            player: &*PLAYER.get(),
+            get_level: natives.get_level,
+            avo_get_base: natives.avo_get_base,
+            avo_get_current: natives.avo_get_current,
+            avo_mod_base: natives.avo_mod_base,
+            avo_mod_current: natives.avo_mod_current,
+            enchanting_skill_cost_base: &settings.enchanting_skill_cost_base,
+            enchanting_skill_cost_scale: &settings.enchanting_skill_cost_scale,
+            enchanting_cost_exponent: &settings.enchanting_cost_exponent,
+            enchanting_skill_cost_mult: &settings.enchanting_skill_cost_mult,
+            xp_per_skill_rank: &settings.xp_per_skill_rank,
+            legendary_skill_reset_value: &settings.legendary_skill_reset_value
+        });
+    }
+}
+
+/// Gets the level of the player.
+pub fn level() -> u32 {
+    unsafe { (*STATE.get()).level as u32 }
+}
+
+/// Sets the level of the player.
+pub fn set_level(
+    level: u32
+) {
+    unsafe { (*STATE.get()).level = level as u16; }
+}
+
+/// Gets the base value of a player attribute.
+pub fn base(
+    attr: ActorAttribute
+) -> f32 {
+    unsafe { (*STATE.get()).base[attr as usize] }
+}
+
+/// Sets the base value of a player attribute.
+pub fn set_base(
+    attr: ActorAttribute,
+    val: f32
+) {
+    unsafe { (*STATE.get()).base[attr as usize] = val; }
+}
+
+/// Sets the base value of every player attribute, and clears their modifiers.
+pub fn set_all_base(
+    val: f32
+) {
+    unsafe {
+        (*STATE.get()).base = [val; VALUE_COUNT];
+        (*STATE.get()).modifiers = [0.0; VALUE_COUNT];
+    }
+}
+
+/// Gets the current value of a player attribute, including any modifiers.
+pub fn current(
+    attr: ActorAttribute
+) -> f32 {
+    unsafe { (*STATE.get()).base[attr as usize] + (*STATE.get()).modifiers[attr as usize] }
+}
+
+/// Gets the current value of every player attribute, indexed by actor value.
+pub fn values() -> [f32; VALUE_COUNT] {
+    unsafe { std::array::from_fn(|i| (*STATE.get()).base[i] + (*STATE.get()).modifiers[i]) }
+}
+
+/// Stands in for PlayerCharacter::GetLevel().
+fn get_level(
+    _player: *mut PlayerCharacter
+) -> u16 {
+    unsafe { (*STATE.get()).level }
+}
+
+/// Stands in for ActorValueOwner::GetBase().
+unsafe extern "system" fn avo_get_base(
+    _av: *mut ActorValueOwner,
+    attr: ActorAttribute
+) -> f32 {
+    (*STATE.get()).base[attr as usize]
+}
+
+/// Stands in for ActorValueOwner::GetCurrent().
+unsafe extern "system" fn avo_get_current(
+    _av: *mut ActorValueOwner,
+    attr: c_int
+) -> f32 {
+    current(ActorAttribute::from_raw(attr).unwrap())
+}
+
+/// Stands in for ActorValueOwner::ModBase().
+unsafe extern "system" fn avo_mod_base(
+    _av: *mut ActorValueOwner,
+    attr: ActorAttribute,
+    delta: f32
+) {
+    (*STATE.get()).base[attr as usize] += delta;
+}
+
+/// Stands in for ActorValueOwner::ModCurrent().
+unsafe extern "system" fn avo_mod_current(
+    _av: *mut ActorValueOwner,
+    _unk1: u32,
+    attr: ActorAttribute,
+    delta: f32
+) {
+    (*STATE.get()).modifiers[attr as usize] += delta;
+}
@@ -0,0 +1,408 @@
+//!
+//! @file trace.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Captures the inputs of each hook, so that they can be replayed outside of the game.
+//! @bug No known bugs.
+//!
+//! When built with the trace_capture feature, each hook call is appended to a trace file as a
+//! record. A record holds the arguments of the hook, the values native game functions returned
+//! to it, the changes it made to the player, and its result. Host tools can then feed the same
+//! arguments and native values back through the hooks, and check the changes and results.
+//!
+//! Every value in a record is stored as a 32-bit little endian word, with floats stored as
+//! their bits. Without the feature, the capture functions do nothing and compile away.
+//!
+
+use std::ffi::c_int;
+
+use skse64::version::SkseVersion;
+
+#[cfg(feature = "trace_capture")] use std::cell::{Cell, RefCell};
+#[cfg(feature = "trace_capture")] use std::fs::File;
+#[cfg(feature = "trace_capture")] use std::io::{BufWriter, Write};
+#[cfg(feature = "trace_capture")] use std::path::Path;
+#[cfg(feature = "trace_capture")] use std::sync::Mutex;
+
+/// The magic number at the start of every trace file.
+pub const TRACE_MAGIC: u32 = u32::from_le_bytes(*b"UCTR");
+
+/// The version of the trace file format.
+pub const TRACE_VERSION: u32 = 1;
+
+/// The number of game settings stored in the trace header.
+pub const TRACE_SETTING_COUNT: usize = 6;
+
+/// The hooks which are captured, in the order of their IDs in the trace.
+#[repr(u8)]
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub enum TraceHook {
+    GetSkillCap,
+    MaxChargeBegin,
+    MaxChargeEnd,
+    CalculateChargePointsPerUse,
+    PlayerAvoGetCurrent,
+    ImprovePlayerSkillPoints,
+    ModifyPerkPool,
+    ImproveLevelExpBySkillLevel,
+    ImproveAttributeWhenLevelUp,
+    LegendaryResetSkillLevel,
+    CheckConditionForLegendarySkill,
+    HideLegendaryButton,
+    ClearLegendaryButton
+}
+
+/// The kinds of changes a hook can make to the player.
+#[repr(u32)]
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub enum TraceEffect {
+    ModBase,
+    ModCurrent,
+    PerkPool
+}
+
+/// The header of a trace, which holds the game state every record shares.
+pub struct TraceHeader {
+    pub runtime: SkseVersion,
+    /// The skill cost base/scale/mult, cost exponent, XP per rank, and legendary reset value.
+    pub settings: [f32; TRACE_SETTING_COUNT]
+}
+
+/// A single captured hook call.
+#[derive(Clone, PartialEq)]
+pub struct TraceRecord {
+    pub hook: TraceHook,
+    pub args: Vec<u32>,
+    pub natives: Vec<u32>,
+    /// The kind and attribute of each change (packed as kind << 16 | attr), and its value.
+    pub effects: Vec<(u32, u32)>,
+    pub result: u32
+}
+
+/// Values which can be stored as a word in a trace.
+pub trait TraceValue: Copy {
+    fn to_word(self) -> u32;
+}
+
+#[cfg(feature = "trace_capture")]
+thread_local! {
+    /// Whether a hook is being captured on this thread.
+    static ACTIVE: Cell<bool> = const { Cell::new(false) };
+
+    /// The record being built by the hook being captured on this thread.
+    static RECORD: RefCell<TraceRecord> = const { RefCell::new(TraceRecord {
+        hook: TraceHook::GetSkillCap,
+        args: Vec::new(),
+        natives: Vec::new(),
+        effects: Vec::new(),
+        result: 0
+    }) };
+}
+
+/// The file records are written to, once capture has begun.
+#[cfg(feature = "trace_capture")]
+static TRACE_FILE: Mutex<Option<(BufWriter<File>, usize)>> = Mutex::new(None);
+
+impl TraceHook {
+    /// The number of hooks which can be captured.
+    pub const COUNT: usize = Self::ClearLegendaryButton as usize + 1;
+
+    /// Every hook which can be captured, in ID order.
+    pub const ALL: [Self; Self::COUNT] = [
+        Self::GetSkillCap,
+        Self::MaxChargeBegin,
+        Self::MaxChargeEnd,
+        Self::CalculateChargePointsPerUse,
+        Self::PlayerAvoGetCurrent,
+        Self::ImprovePlayerSkillPoints,
+        Self::ModifyPerkPool,
+        Self::ImproveLevelExpBySkillLevel,
+        Self::ImproveAttributeWhenLevelUp,
+        Self::LegendaryResetSkillLevel,
+        Self::CheckConditionForLegendarySkill,
+        Self::HideLegendaryButton,
+        Self::ClearLegendaryButton
+    ];
+
+    /// Converts a hook ID from a trace back into a hook.
+    pub fn from_raw(
+        id: u8
+    ) -> Option<Self> {
+        Self::ALL.get(id as usize).copied()
+    }
+
+    /// Gets the name of the hook, for reports.
+    pub fn name(
+        &self
+    ) -> &'static str {
+        match self {
+            Self::GetSkillCap => "GetSkillCap",
+            Self::MaxChargeBegin => "MaxChargeBegin",
+            Self::MaxChargeEnd => "MaxChargeEnd",
+            Self::CalculateChargePointsPerUse => "CalculateChargePointsPerUse",
+            Self::PlayerAvoGetCurrent => "PlayerAvoGetCurrent",
+            Self::ImprovePlayerSkillPoints => "ImprovePlayerSkillPoints",
+            Self::ModifyPerkPool => "ModifyPerkPool",
+            Self::ImproveLevelExpBySkillLevel => "ImproveLevelExpBySkillLevel",
+            Self::ImproveAttributeWhenLevelUp => "ImproveAttributeWhenLevelUp",
+            Self::LegendaryResetSkillLevel => "LegendaryResetSkillLevel",
+            Self::CheckConditionForLegendarySkill => "CheckConditionForLegendarySkill",
+            Self::HideLegendaryButton => "HideLegendaryButton",
+            Self::ClearLegendaryButton => "ClearLegendaryButton"
+        }
+    }
+}
+
+impl TraceHeader {
+    /// Encodes the header at the start of a trace.
+    pub fn encode(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        let runtime = (self.runtime.major() << 24) | (self.runtime.minor() << 16)
+            | (self.runtime.build() << 4) | self.runtime.runtime_type();
+        out.extend_from_slice(&TRACE_MAGIC.to_le_bytes());
+        out.extend_from_slice(&TRACE_VERSION.to_le_bytes());
+        out.extend_from_slice(&runtime.to_le_bytes());
+        for setting in self.settings.iter() {
+            out.extend_from_slice(&setting.to_bits().to_le_bytes());
+        }
+    }
+}
+
+impl TraceRecord {
+    ///
+    /// Encodes a record into the trace.
+    ///
+    /// Each record begins with its hook ID and the number of args, natives and effects, as
+    /// bytes. The words of each follow, and the result is last.
+    ///
+    pub fn encode(
+        &self,
+        out: &mut Vec<u8>
+    ) {
+        out.extend_from_slice(&[
+            self.hook as u8,
+            self.args.len() as u8,
+            self.natives.len() as u8,
+            self.effects.len() as u8
+        ]);
+        for word in self.args.iter().chain(self.natives.iter()) {
+            out.extend_from_slice(&word.to_le_bytes());
+        }
+        for (kind, value) in self.effects.iter() {
+            out.extend_from_slice(&kind.to_le_bytes());
+            out.extend_from_slice(&value.to_le_bytes());
+        }
+        out.extend_from_slice(&self.result.to_le_bytes());
+    }
+}
+
+impl TraceValue for () {
+    fn to_word(self) -> u32 { 0 }
+}
+
+impl TraceValue for f32 {
+    fn to_word(self) -> u32 { self.to_bits() }
+}
+
+impl TraceValue for u32 {
+    fn to_word(self) -> u32 { self }
+}
+
+impl TraceValue for c_int {
+    fn to_word(self) -> u32 { self as u32 }
+}
+
+impl TraceValue for u16 {
+    fn to_word(self) -> u32 { self as u32 }
+}
+
+impl TraceValue for u8 {
+    fn to_word(self) -> u32 { self as u32 }
+}
+
+impl TraceValue for i8 {
+    fn to_word(self) -> u32 { self as i32 as u32 }
+}
+
+///
+/// Parses a trace file into its header and records.
+///
+/// A record cut short at the end of the file, such as when the game exits before the trace is
+/// flushed, is dropped.
+///
+pub fn parse(
+    bytes: &[u8]
+) -> Result<(TraceHeader, Vec<TraceRecord>), ()> {
+    let word = |pos: &mut usize| -> Option<u32> {
+        let w = bytes.get(*pos..*pos + 4)?;
+        *pos += 4;
+        Some(u32::from_le_bytes(w.try_into().unwrap()))
+    };
+
+    let mut pos = 0;
+    if (word(&mut pos) != Some(TRACE_MAGIC)) || (word(&mut pos) != Some(TRACE_VERSION)) {
+        return Err(());
+    }
+
+    let runtime = SkseVersion::from_raw(word(&mut pos).ok_or(())?);
+    let mut settings = [0.0; TRACE_SETTING_COUNT];
+    for setting in settings.iter_mut() {
+        *setting = f32::from_bits(word(&mut pos).ok_or(())?);
+    }
+
+    let mut records = Vec::new();
+    while let Some(head) = bytes.get(pos..pos + 4) {
+        let mut next = pos + 4;
+        let hook = TraceHook::from_raw(head[0]).ok_or(())?;
+        let mut record = || -> Option<TraceRecord> {
+            let args = (0..head[1]).map(|_| word(&mut next)).collect::<Option<Vec<_>>>()?;
+            let natives = (0..head[2]).map(|_| word(&mut next)).collect::<Option<Vec<_>>>()?;
+            let effects = (0..head[3]).map(|_| {
+                Some((word(&mut next)?, word(&mut next)?))
+            }).collect::<Option<Vec<_>>>()?;
+            let result = word(&mut next)?;
+            Some(TraceRecord { hook, args, natives, effects, result })
+        };
+
+        let Some(record) = record() else { break };
+        records.push(record);
+        pos = next;
+    }
+
+    Ok((TraceHeader { runtime, settings }, records))
+}
+
+///
+/// Begins capturing hook calls to the given file.
+///
+/// Records are flushed to the file in batches, and whenever flush() is called. Calls made
+/// after the last flush are lost if the game exits without closing the trace.
+///
+#[cfg(feature = "trace_capture")]
+pub fn open(
+    path: &Path,
+    header: &TraceHeader
+) {
+    let mut buf = Vec::new();
+    header.encode(&mut buf);
+
+    let mut file = BufWriter::with_capacity(1 << 16, File::create(path).unwrap());
+    file.write_all(&buf).unwrap();
+    *TRACE_FILE.lock().unwrap() = Some((file, 0));
+}
+
+/// Writes any records which are still buffered to the trace file.
+#[cfg(feature = "trace_capture")]
+pub fn flush() {
+    if let Some((file, _)) = TRACE_FILE.lock().unwrap().as_mut() {
+        let _ = file.flush();
+    }
+}
+
+/// Stops capturing hook calls, flushing any records which have not been written.
+#[cfg(feature = "trace_capture")]
+pub fn close() {
+    if let Some((mut file, _)) = TRACE_FILE.lock().unwrap().take() {
+        let _ = file.flush();
+    }
+}
+
+///
+/// Captures a call to the given hook, which runs the given function.
+///
+/// Calls made by a hook which is already being captured on the same thread are considered part
+/// of the outer call.
+///
+#[cfg(feature = "trace_capture")]
+pub fn hook<R: TraceValue>(
+    hook: TraceHook,
+    args: &[u32],
+    func: impl FnOnce() -> R
+) -> R {
+    /// The number of records between each flush of the trace file.
+    const FLUSH_RECORDS: usize = 1024;
+
+    if ACTIVE.with(|a| a.replace(true)) {
+        return func();
+    }
+
+    RECORD.with(|r| {
+        let mut r = r.borrow_mut();
+        r.hook = hook;
+        r.args.clear();
+        r.args.extend_from_slice(args);
+        r.natives.clear();
+        r.effects.clear();
+    });
+
+    let result = func();
+    ACTIVE.with(|a| a.set(false));
+
+    let mut buf = Vec::new();
+    RECORD.with(|r| {
+        let mut r = r.borrow_mut();
+        r.result = result.to_word();
+        r.encode(&mut buf);
+    });
+
+    if let Some((file, count)) = TRACE_FILE.lock().unwrap().as_mut() {
+        let _ = file.write_all(&buf);
+        *count += 1;
+        if *count % FLUSH_RECORDS == 0 {
+            let _ = file.flush();
+        }
+    }
+
+    result
+}
+
+/// Captures the value a native function returned to the running hook.
+#[cfg(feature = "trace_capture")]
+pub fn native<T: TraceValue>(
+    val: T
+) -> T {
+    if ACTIVE.with(|a| a.get()) {
+        RECORD.with(|r| r.borrow_mut().natives.push(val.to_word()));
+    }
+    val
+}
+
+/// Captures a change the running hook made to the player.
+#[cfg(feature = "trace_capture")]
+pub fn effect(
+    kind: TraceEffect,
+    attr: c_int,
+    val: u32
+) {
+    if ACTIVE.with(|a| a.get()) {
+        let kind = ((kind as u32) << 16) | (attr as u32 & 0xFFFF);
+        RECORD.with(|r| r.borrow_mut().effects.push((kind, val)));
+    }
+}
+
+#[cfg(not(feature = "trace_capture"))]
+#[inline(always)]
+pub fn hook<R: TraceValue>(
+    _hook: TraceHook,
+    _args: &[u32],
+    func: impl FnOnce() -> R
+) -> R {
+    func()
+}
+
+#[cfg(not(feature = "trace_capture"))]
+#[inline(always)]
+pub fn native<T: TraceValue>(
+    val: T
+) -> T {
+    val
+}
+
+#[cfg(not(feature = "trace_capture"))]
+#[inline(always)]
+pub fn effect(
+    _kind: TraceEffect,
+    _attr: c_int,
+    _val: u32
+) {}
@@ -0,0 +1,165 @@
+//!
+//! @file lib.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Defines the interface other plugins use to extend the hooks of the uncapper.
+//! @bug No known bugs.
+//!
+//! Mods which change experience or level-ups would otherwise patch the same game code as the
+//! uncapper, and one of the two would be disabled as a conflict. Instead, such a plugin can
+//! register callbacks which the uncapper runs from its own hooks. A pre callback runs before
+//! the uncapper computes its result, and may change the values the game gave the hook. A post
+//! callback runs once the result is computed, and may change it before the game sees it.
+//!
+//! Callbacks are registered by sending an ExtensionRequest to the uncapper, which is answered
+//! synchronously. Requests must be sent while the game is loading, during SKSE_POST_LOAD, as
+//! the uncapper freezes its callbacks once every plugin has loaded. Callbacks are then run in
+//! the order they were registered, on whichever thread calls the hook, and are never removed.
+//! The callbacks of an event whose hook is disabled in the settings of the uncapper never run.
+//!
+//! Requests are sent through the Messenger of skse64_common::messaging.
+//!
+
+use std::ffi::c_int;
+
+pub use skse64_common::messaging::{LocalBroker, Messenger};
+
+/// The message type used to register extension callbacks.
+pub const EXTENSION_MESSAGE: u32 = u32::from_le_bytes(*b"UCX1");
+
+/// The version of the layout of the request, the callbacks, and the events.
+pub const EXTENSION_ABI: u32 = 1;
+
+/// A callback run by a hook of the uncapper, which is given the event of that hook.
+pub type Callback<E> = unsafe extern "C" fn(*mut E);
+
+///
+/// Skill experience being given to the player.
+///
+/// The experience is computed as (base * base_mult) + (offset * offset_mult). Post callbacks
+/// are given the scaled base and offset, and the experience which will be given.
+///
+#[repr(C)]
+#[derive(Copy, Clone, Debug, Default)]
+pub struct SkillExpEvent {
+    pub skill: c_int,
+    pub base: f32,
+    pub offset: f32,
+    pub exp: f32
+}
+
+///
+/// Level experience being given to the player for a skill level up.
+///
+/// The skill experience is the base game's level experience for the new skill level. Post
+/// callbacks are given the experience which will be given, after the level multiplier.
+///
+#[repr(C)]
+#[derive(Copy, Clone, Debug, Default)]
+pub struct LevelExpEvent {
+    pub skill: c_int,
+    pub skill_exp: f32,
+    pub exp: f32
+}
+
+///
+/// A change to the perk pool of the player.
+///
+/// The count is the change requested by the game, which is positive on a level up. Post
+/// callbacks are given the change which will be made to the pool, which is clamped to 0-255.
+///
+#[repr(C)]
+#[derive(Copy, Clone, Debug, Default)]
+pub struct PerkDeltaEvent {
+    pub count: c_int,
+    pub delta: c_int
+}
+
+///
+/// The attributes being given to the player at a level up.
+///
+/// The choice is the actor value of the attribute the player chose. Post callbacks are given
+/// the change which will be made to each attribute.
+///
+#[repr(C)]
+#[derive(Copy, Clone, Debug, Default)]
+pub struct AttributeGainEvent {
+    pub choice: c_int,
+    pub health: f32,
+    pub magicka: f32,
+    pub stamina: f32,
+    pub carry_weight: f32
+}
+
+/// The callbacks of a single event, either of which may be left empty.
+#[repr(C)]
+pub struct EventCallbacks<E> {
+    pub pre: Option<Callback<E>>,
+    pub post: Option<Callback<E>>
+}
+
+/// The callbacks a plugin registers, for each event the uncapper hooks.
+#[repr(C)]
+#[derive(Copy, Clone, Default)]
+pub struct ExtensionCallbacks {
+    pub skill_exp: EventCallbacks<SkillExpEvent>,
+    pub level_exp: EventCallbacks<LevelExpEvent>,
+    pub perk_delta: EventCallbacks<PerkDeltaEvent>,
+    pub attribute_gain: EventCallbacks<AttributeGainEvent>
+}
+
+///
+/// A request to register callbacks, whose status is filled in by the uncapper.
+///
+/// A request with another ABI version is left unanswered.
+///
+#[repr(C)]
+pub struct ExtensionRequest {
+    pub abi: u32,
+    pub status: u32,
+    pub callbacks: ExtensionCallbacks
+}
+
+// Derived impls would bound E, which the callbacks only take behind a pointer.
+impl<E> Copy for EventCallbacks<E> {}
+impl<E> Clone for EventCallbacks<E> {
+    fn clone(
+        &self
+    ) -> Self {
+        *self
+    }
+}
+
+impl<E> Default for EventCallbacks<E> {
+    fn default() -> Self {
+        Self { pre: None, post: None }
+    }
+}
+
+impl ExtensionRequest {
+    /// The request was not answered, as the uncapper is not loaded or has another ABI.
+    pub const UNANSWERED: u32 = 0;
+
+    /// The callbacks were registered.
+    pub const REGISTERED: u32 = 1;
+
+    /// The callbacks were not registered, as the uncapper had already frozen its callbacks.
+    pub const TOO_LATE: u32 = 2;
+
+    /// Creates a new, unanswered, request to register the given callbacks.
+    pub fn new(
+        callbacks: ExtensionCallbacks
+    ) -> Self {
+        Self {
+            abi: EXTENSION_ABI,
+            status: Self::UNANSWERED,
+            callbacks
+        }
+    }
+
+    /// Checks if the callbacks in the request were registered.
+    pub fn is_registered(
+        &self
+    ) -> bool {
+        self.status == Self::REGISTERED
+    }
+}
@@ -0,0 +1,427 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Main file for the version database differ.
+//! @bug No known bugs.
+//!
+//! Compares two version databases by merge-joining them in id order. For the whole database,
+//! the diff reports the regions of consecutive ids which were relocated by the same amount,
+//! the ids which are missing from either side, and the ids whose item changed size. The size
+//! of an item is taken to be the distance to the next offset in the same database.
+//!
+//! When a list of ids is given, only those ids are reported. If the game executables are also
+//! given, the signature of each id is checked against both of them.
+//!
+
+use std::ffi::OsString;
+use std::io::{BufWriter, Write};
+use std::path::Path;
+use std::str::FromStr;
+
+use pe_file::PeFile;
+use sigscan::{Pattern, read_descriptors};
+use versionlib::*;
+
+/// The size of the output buffer.
+const OUT_BUFFER_SIZE: usize = 1 << 20;
+
+/// An id which was requested on the command line, along with the signature expected there.
+struct Query {
+    name: String,
+    id: usize,
+    offset: usize,
+    sig: Pattern
+}
+
+/// An id which is in both databases.
+#[derive(Copy, Clone)]
+struct Common {
+    id: usize,
+    old: usize,
+    new: usize
+}
+
+/// A loaded database, along with its offsets in sorted order for computing item sizes.
+struct Side {
+    db: VersionDb,
+    offsets: Vec<usize>,
+    format: u32
+}
+
+/// The result of merge-joining two databases.
+#[derive(Default)]
+struct Join {
+    common: Vec<Common>,
+    only_old: Vec<(usize, usize)>,
+    only_new: Vec<(usize, usize)>
+}
+
+///
+/// Compares two version databases.
+///
+/// Usage: vdb-diff [options] <old db> <new db>
+///
+/// Options:
+/// - --ids-from=FILE: Reports only the ids in the file. Each line holds an id, optionally
+///   followed by a hex offset into that id and the hex bytes of a signature, where ?? matches
+///   any byte. Anything after a # is ignored.
+/// - --sigs-from=FILE: Reports only the locations described in a rust source file holding
+///   patcher descriptors, such as lib/uncapper_core/src/hooks.rs.
+/// - --exes=OLD,NEW: Checks the signature of each reported id in the given executables.
+///
+fn main() {
+    let mut positional = Vec::new();
+    let mut queries: Option<Vec<Query>> = None;
+    let mut sources = Vec::new();
+    let mut exes = None;
+    for arg in std::env::args_os().skip(1) {
+        let s = arg.to_str().unwrap_or("");
+        if let Some(path) = s.strip_prefix("--ids-from=") {
+            queries.get_or_insert_with(Vec::new).extend(read_ids(Path::new(path)));
+        } else if let Some(path) = s.strip_prefix("--sigs-from=") {
+            sources.push(OsString::from(path));
+        } else if let Some(paths) = s.strip_prefix("--exes=") {
+            let (old, new) = paths.split_once(',').expect("--exes takes two paths");
+            exes = Some((
+                PeFile::open(Path::new(old)).expect("Could not read old executable"),
+                PeFile::open(Path::new(new)).expect("Could not read new executable")
+            ));
+        } else {
+            assert!(!s.starts_with("--"), "Unknown option {}", s);
+            positional.push(arg);
+        }
+    }
+
+    assert!(positional.len() == 2, "Expected an old and new database");
+    let old = Side::load(Path::new(&positional[0]));
+    let new = Side::load(Path::new(&positional[1]));
+
+    // Descriptors hold an id for each game, so pick the one matching the new database.
+    for src in sources.iter() {
+        let src = std::fs::read_to_string(src).unwrap();
+        let found = read_descriptors(&src).into_iter().filter_map(|d| {
+            let (id, offset) = d.loc(new.format)?;
+            Some(Query { name: d.name, id, offset, sig: d.sig })
+        });
+        queries.get_or_insert_with(Vec::new).extend(found);
+    }
+
+    let stdout = std::io::stdout();
+    let mut out = BufWriter::with_capacity(OUT_BUFFER_SIZE, stdout.lock());
+    if let Some(queries) = queries {
+        report_queries(&mut out, &old, &new, &queries, exes.as_ref()).unwrap();
+    } else {
+        report_full(&mut out, &old, &new, &merge_join(&old.db, &new.db)).unwrap();
+    }
+    out.flush().unwrap();
+}
+
+impl Side {
+    /// Loads a database in id order.
+    fn load(
+        path: &Path
+    ) -> Self {
+        let (_, format) = VersionDb::version_from_path(path);
+        Self::from_db(VersionDb::new_from_path_with_layout(path, DbLayout::Sorted), format)
+    }
+
+    /// Wraps a database in the given format, which must be in id order.
+    fn from_db(
+        db: VersionDb,
+        format: u32
+    ) -> Self {
+        let mut offsets: Vec<usize> = db.iter().map(|(_, a)| a.offset()).collect();
+        offsets.sort_unstable();
+        offsets.dedup();
+        Self { db, offsets, format }
+    }
+
+    /// Gets the size of the item at the given offset, if it isn't the last one in the database.
+    fn size_of(
+        &self,
+        offset: usize
+    ) -> Option<usize> {
+        let next = self.offsets.partition_point(|o| *o <= offset);
+        self.offsets.get(next).map(|n| n - offset)
+    }
+}
+
+/// Joins two id ordered databases in a single pass.
+fn merge_join(
+    old: &VersionDb,
+    new: &VersionDb
+) -> Join {
+    let mut join = Join::default();
+    let mut old_it = old.iter().map(|(id, a)| (id, a.offset())).peekable();
+    let mut new_it = new.iter().map(|(id, a)| (id, a.offset())).peekable();
+    loop {
+        match (old_it.peek().copied(), new_it.peek().copied()) {
+            (Some(o), Some(n)) if o.0 == n.0 => {
+                join.common.push(Common { id: o.0, old: o.1, new: n.1 });
+                old_it.next();
+                new_it.next();
+            },
+            (Some(o), Some(n)) if o.0 < n.0 => {
+                join.only_old.push(o);
+                old_it.next();
+            },
+            (Some(o), None) => {
+                join.only_old.push(o);
+                old_it.next();
+            },
+            (_, Some(n)) => {
+                join.only_new.push(n);
+                new_it.next();
+            },
+            (None, None) => break
+        }
+    }
+
+    join
+}
+
+/// Formats a signed difference between two offsets.
+fn delta(
+    old: usize,
+    new: usize
+) -> String {
+    if new >= old { format!("+{:x}", new - old) } else { format!("-{:x}", old - new) }
+}
+
+/// Formats an optional size.
+fn size(
+    s: Option<usize>
+) -> String {
+    s.map(|s| format!("{:x}", s)).unwrap_or_else(|| String::from("-"))
+}
+
+/// Reports the differences between the whole of both databases.
+fn report_full(
+    out: &mut impl Write,
+    old: &Side,
+    new: &Side,
+    join: &Join
+) -> std::io::Result<()> {
+    let resized: Vec<&Common> = join.common.iter().filter(|c| {
+        old.size_of(c.old) != new.size_of(c.new)
+    }).collect();
+    let moved = join.common.iter().filter(|c| c.old != c.new).count();
+
+    writeln!(out, "Old ids:      {}", old.db.len())?;
+    writeln!(out, "New ids:      {}", new.db.len())?;
+    writeln!(out, "Common ids:   {}", join.common.len())?;
+    writeln!(out, "Moved ids:    {}", moved)?;
+    writeln!(out, "Resized ids:  {}", resized.len())?;
+    writeln!(out, "Only in old:  {}", join.only_old.len())?;
+    writeln!(out, "Only in new:  {}", join.only_new.len())?;
+
+    // A region is a run of consecutive common ids, which all moved by the same amount.
+    writeln!(out, "\nRelocated regions:")?;
+    writeln!(out, "| FIRST ID | LAST ID  |  COUNT   | OLD OFF  | NEW OFF  |  DELTA   |")?;
+    let mut start = 0;
+    for i in 1..=join.common.len() {
+        let c = &join.common;
+        let split = (i == c.len())
+            || (delta(c[i].old, c[i].new) != delta(c[start].old, c[start].new));
+        if split {
+            writeln!(
+                out,
+                "| {:08} | {:08} | {:8} | {:08x} | {:08x} | {:>8} |",
+                c[start].id,
+                c[i - 1].id,
+                i - start,
+                c[start].old,
+                c[start].new,
+                delta(c[start].old, c[start].new)
+            )?;
+            start = i;
+        }
+    }
+
+    writeln!(out, "\nOnly in old:")?;
+    for (id, offset) in join.only_old.iter() {
+        writeln!(out, "| {:08} | {:08x} |", id, offset)?;
+    }
+
+    writeln!(out, "\nOnly in new:")?;
+    for (id, offset) in join.only_new.iter() {
+        writeln!(out, "| {:08} | {:08x} |", id, offset)?;
+    }
+
+    writeln!(out, "\nResized:")?;
+    writeln!(out, "|    ID    | OLD SIZE | NEW SIZE |")?;
+    for c in resized.into_iter() {
+        writeln!(
+            out,
+            "| {:08} | {:>8} | {:>8} |",
+            c.id,
+            size(old.size_of(c.old)),
+            size(new.size_of(c.new))
+        )?;
+    }
+
+    Ok(())
+}
+
+/// Reports only the requested ids, checking their signatures if the executables were given.
+fn report_queries(
+    out: &mut impl Write,
+    old: &Side,
+    new: &Side,
+    queries: &[Query],
+    exes: Option<&(PeFile, PeFile)>
+) -> std::io::Result<()> {
+    writeln!(
+        out,
+        "| {:<32} |    ID    | OLD OFF  | NEW OFF  |  DELTA   | OLD SIZE | NEW SIZE | OLD SIG | NEW SIG |",
+        "NAME"
+    )?;
+
+    for q in queries.iter() {
+        let o = old.db.find_addr_by_id(q.id).ok().map(|a| a.offset());
+        let n = new.db.find_addr_by_id(q.id).ok().map(|a| a.offset());
+        let sig = |side: Option<usize>, exe: Option<&PeFile>| -> &str {
+            match (side, exe) {
+                (Some(off), Some(exe)) if !q.sig.is_empty() => {
+                    let code = exe.read(off + q.offset, q.sig.len());
+                    if code.map(|c| q.sig.matches(c)).unwrap_or(false) { "ok" } else { "BAD" }
+                },
+                _ => "-"
+            }
+        };
+
+        writeln!(
+            out,
+            "| {:<32} | {:08} | {:>8} | {:>8} | {:>8} | {:>8} | {:>8} | {:>7} | {:>7} |",
+            q.name,
+            q.id,
+            o.map(|o| format!("{:08x}", o)).unwrap_or_else(|| String::from("missing")),
+            n.map(|n| format!("{:08x}", n)).unwrap_or_else(|| String::from("missing")),
+            o.zip(n).map(|(o, n)| delta(o, n)).unwrap_or_else(|| String::from("-")),
+            size(o.and_then(|o| old.size_of(o))),
+            size(n.and_then(|n| new.size_of(n))),
+            sig(o, exes.map(|e| &e.0)),
+            sig(n, exes.map(|e| &e.1))
+        )?;
+    }
+
+    Ok(())
+}
+
+/// Parses an integer with an optional 0x prefix.
+fn parse_int(
+    s: &str
+) -> usize {
+    match s.strip_prefix("0x") {
+        Some(hex) => usize::from_str_radix(hex, 16).unwrap(),
+        None => usize::from_str(s).unwrap()
+    }
+}
+
+/// Reads a list of ids, offsets, and signatures from a file.
+fn read_ids(
+    path: &Path
+) -> Vec<Query> {
+    std::fs::read_to_string(path).unwrap().lines().filter_map(|l| {
+        let mut parts = l.split('#').next().unwrap().split_whitespace();
+        let id = usize::from_str(parts.next()?).unwrap();
+        let offset = parts.next().map(parse_int).unwrap_or(0);
+        let sig = Pattern::parse(&parts.collect::<Vec<_>>().join(" ")).unwrap();
+        Some(Query { name: format!("{}", id), id, offset, sig })
+    }).collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use std::collections::BTreeMap;
+
+    use super::*;
+    use skse64_common::version::SkseVersion;
+    use synth::SynthConfig;
+
+    /// The version the test databases are encoded with.
+    const TEST_VERSION: SkseVersion = SkseVersion::new(1, 6, 640, 0);
+
+    /// Builds a database from the given (id, offset) pairs.
+    fn side(
+        pairs: &[(usize, usize)]
+    ) -> Side {
+        let data = writer::encode_db(pairs, TEST_VERSION, 2, writer::DEFAULT_PTR_SIZE);
+        Side::from_db(VersionDb::new_from_bytes(&data, TEST_VERSION, 2, DbLayout::Sorted), 2)
+    }
+
+    /// Gets the rows of the table under the given title of a full report.
+    fn rows<'a>(
+        report: &'a str,
+        title: &str
+    ) -> Vec<&'a str> {
+        let start = report.find(&format!("{}:\n", title)).unwrap() + title.len() + 2;
+        let table = report[start..].lines().take_while(|l| !l.is_empty());
+        table.filter(|l| !l.contains(" ID ")).collect()
+    }
+
+    #[test]
+    fn merge_join_matches_a_lookup_of_each_id() {
+        let pairs = synth::generate(&SynthConfig { count: 3000, ..SynthConfig::default() });
+        let last = pairs.last().unwrap().0;
+
+        // Drop some ids, move the rest, and add new ones in the gaps and past the end.
+        let mut moved = pairs.iter().enumerate().filter(|(i, _)| i % 7 != 3)
+            .map(|(i, (id, offset))| (*id, offset + (i / 500) * 0x10)).collect::<Vec<_>>();
+        moved.extend((1..=20).map(|i| (last + i, 0x2000 + i * 8)));
+        let known = pairs.iter().map(|p| p.0).collect::<Vec<_>>();
+        let gaps = (1..last).filter(|id| known.binary_search(id).is_err()).step_by(5);
+        moved.extend(gaps.map(|id| (id, 0x3000)).collect::<Vec<_>>());
+        moved.sort_unstable();
+
+        let (old, new) = (side(&pairs), side(&moved));
+        let join = merge_join(&old.db, &new.db);
+
+        let old_map = pairs.iter().copied().collect::<BTreeMap<_, _>>();
+        let new_map = moved.iter().copied().collect::<BTreeMap<_, _>>();
+        let common = join.common.iter().map(|c| (c.id, c.old, c.new)).collect::<Vec<_>>();
+        let expected = old_map.iter().filter_map(|(id, o)| Some((*id, *o, *new_map.get(id)?)));
+        assert!(common == expected.collect::<Vec<_>>());
+        let only = |a: &BTreeMap<usize, usize>, b: &BTreeMap<usize, usize>| -> Vec<_> {
+            a.iter().filter(|(id, _)| !b.contains_key(id)).map(|(i, o)| (*i, *o)).collect()
+        };
+        assert!(join.only_old == only(&old_map, &new_map));
+        assert!(join.only_new == only(&new_map, &old_map));
+        assert!(!join.only_old.is_empty() && !join.only_new.is_empty());
+    }
+
+    #[test]
+    fn full_report_lists_runs_missing_ids_and_resized_items() {
+        let old = side(&[
+            (1, 0x1000), (2, 0x1010), (3, 0x1020), (4, 0x1040), (5, 0x1080), (7, 0x1100)
+        ]);
+        let new = side(&[
+            (1, 0x1000), (2, 0x1010), (3, 0x1030), (4, 0x1050), (5, 0x1090), (6, 0x10a0),
+            (8, 0x1200)
+        ]);
+
+        let mut out = Vec::new();
+        report_full(&mut out, &old, &new, &merge_join(&old.db, &new.db)).unwrap();
+        let report = String::from_utf8(out).unwrap();
+
+        // Ids 1 and 2 stayed put, and 3 through 5 moved by the same amount.
+        assert!(report.contains("Common ids:   5\n"));
+        assert!(report.contains("Moved ids:    3\n"));
+        assert_eq!(rows(&report, "Relocated regions"), [
+            "| 00000001 | 00000002 |        2 | 00001000 | 00001000 |       +0 |",
+            "| 00000003 | 00000005 |        3 | 00001020 | 00001030 |      +10 |"
+        ]);
+
+        assert_eq!(rows(&report, "Only in old"), ["| 00000007 | 00001100 |"]);
+        assert_eq!(rows(&report, "Only in new"), [
+            "| 00000006 | 000010a0 |",
+            "| 00000008 | 00001200 |"
+        ]);
+
+        // Sizes run to the next offset, so 2 grows as 3 moves away, and 5 shrinks as 6 is added.
+        assert_eq!(rows(&report, "Resized"), [
+            "| 00000002 |       10 |       20 |",
+            "| 00000005 |       80 |       10 |"
+        ]);
+    }
+}
@@ -6,59 +6,285 @@
 //!
 
 use std::ffi::OsString;
+use std::io::{BufWriter, Write};
+use std::str::FromStr;
 use std::vec::Vec;
 
 use versionlib::*;
+use skse64_common::reloc::RelocAddr;
 
-struct GameLocation(usize, usize);
+/// The usage of the dumper.
+const USAGE: &str = "Usage: vdb-dump [--format=text|csv|json|bin] [--min-id=N] [--max-id=N]
+                [--min-offset=X] [--max-offset=X] [--ids-from=FILE] <db> [hex offsets...]";
 
-impl PartialEq for GameLocation {
-    fn eq(
-        &self,
-        other: &Self
-    ) -> bool {
-        self.0 == other.0
-    }
+/// The size of the output buffer. Large enough that a full dump takes only a few writes.
+const OUT_BUFFER_SIZE: usize = 1 << 20;
+
+/// The formats the dump can be written in.
+#[derive(Copy, Clone, PartialEq, Eq)]
+enum Format {
+    Text,
+    Csv,
+    Json,
+    Bin
 }
 
-impl Eq for GameLocation {}
+/// The options given on the command line.
+struct Options {
+    path: OsString,
+    format: Format,
+    ids: std::ops::RangeInclusive<usize>,
+    offsets: std::ops::RangeInclusive<usize>,
+    ids_from: Option<OsString>,
+    symbolize: Vec<OsString>
+}
+
+/// Writes out entries in the selected format.
+struct Dumper<W: Write> {
+    out: W,
+    format: Format,
+    count: usize,
+    pairs: Vec<(usize, usize)>
+}
+
+///
+/// Dumps the contents of the version db to stdout.
+///
+/// Usage: vdb-dump [options] <db> [hex offsets...]
+///
+/// Options:
+/// - --format=text|csv|json|bin: Selects the output format. The bin format is a version
+///   database holding only the selected entries.
+/// - --min-id=N, --max-id=N: Limits the dump to ids within the given bounds.
+/// - --min-offset=X, --max-offset=X: Limits the dump to the given hex offsets.
+/// - --ids-from=FILE: Dumps only the ids listed in the file, one per line. Ids which aren't
+///   in the database are still listed, but without an offset.
+///
+/// If any hex offsets are given after the database path, they are instead symbolized
+/// to the id which contains them.
+///
+/// Entries are written in id order, or in the order --ids-from lists them. They are only
+/// sorted if the database doesn't store them in id order already.
+/// Malformed options print the usage and exit with an error.
+///
+fn main() {
+    let opts = parse_args();
+    let path = std::path::Path::new(&opts.path);
+    let full_ids = (*opts.ids.start() == 0) && (*opts.ids.end() == usize::MAX);
+    let ids = if full_ids {
+        None
+    } else {
+        Some(*opts.ids.start()..opts.ids.end().saturating_add(1))
+    };
+
+    // Searches need a loaded database, but the hashed layout at least never sorts the ids.
+    let load = || match ids.clone() {
+        Some(ids) => VersionDb::new_from_path_with_range(path, DbLayout::Hashed, ids),
+        None => VersionDb::new_from_path_with_layout(path, DbLayout::Hashed)
+    };
 
-impl PartialOrd for GameLocation {
-    fn partial_cmp(
-        &self,
-        other: &Self
-    ) -> Option<std::cmp::Ordering> {
-        self.0.partial_cmp(&other.0)
+    if !opts.symbolize.is_empty() {
+        symbolize(&load(), &opts.symbolize);
+        return;
     }
+
+    let (version, _) = VersionDb::version_from_path(path);
+    let stdout = std::io::stdout();
+    let mut dumper = Dumper::new(
+        BufWriter::with_capacity(OUT_BUFFER_SIZE, stdout.lock()),
+        opts.format
+    );
+
+    if let Some(ids_from) = opts.ids_from.as_ref() {
+        let db = load();
+        for id in read_ids(ids_from).into_iter() {
+            let offset = db.find_addr_by_id(id).ok().map(|a| a.offset());
+            let in_range = opts.ids.contains(&id)
+                && offset.map(|o| opts.offsets.contains(&o)).unwrap_or(true);
+            if in_range {
+                dumper.entry(id, offset);
+            }
+        }
+    } else {
+        // The decoded pairs are in file order, which is almost always id order.
+        let mut pairs = VersionDb::pairs_from_path(path, ids);
+        if pairs.windows(2).any(|w| w[0].0 > w[1].0) {
+            pairs.sort_unstable_by_key(|p| p.0);
+        }
+
+        for (id, offset) in pairs.into_iter() {
+            if opts.offsets.contains(&offset) {
+                dumper.entry(id, Some(offset));
+            }
+        }
+    }
+
+    dumper.finish(version, path);
 }
 
-impl Ord for GameLocation {
-    fn cmp(
-        &self,
-        other: &Self
-    ) -> std::cmp::Ordering {
-        self.0.cmp(&other.0)
+/// Parses the command line, exiting with the usage on any malformed option.
+fn parse_args() -> Options {
+    let mut opts = Options {
+        path: OsString::new(),
+        format: Format::Text,
+        ids: 0..=usize::MAX,
+        offsets: 0..=usize::MAX,
+        ids_from: None,
+        symbolize: Vec::new()
+    };
+
+    let mut positional = Vec::new();
+    for arg in std::env::args_os().skip(1) {
+        let Some(s) = arg.to_str() else {
+            positional.push(arg);
+            continue;
+        };
+
+        let Some((key, val)) = s.strip_prefix("--").and_then(|s| s.split_once('=')) else {
+            if s.starts_with("--") {
+                usage();
+            }
+            positional.push(arg);
+            continue;
+        };
+
+        match key {
+            "format" => {
+                opts.format = match val {
+                    "text" => Format::Text,
+                    "csv" => Format::Csv,
+                    "json" => Format::Json,
+                    "bin" => Format::Bin,
+                    _ => usage()
+                };
+            },
+            "min-id" => opts.ids = parse_id(val)..=*opts.ids.end(),
+            "max-id" => opts.ids = *opts.ids.start()..=parse_id(val),
+            "min-offset" => opts.offsets = parse_hex(val)..=*opts.offsets.end(),
+            "max-offset" => opts.offsets = *opts.offsets.start()..=parse_hex(val),
+            "ids-from" => opts.ids_from = Some(OsString::from(val)),
+            _ => usage()
+        }
     }
+
+    if positional.is_empty() {
+        usage();
+    }
+    opts.path = positional.remove(0);
+    opts.symbolize = positional;
+    opts
 }
 
-/// Dumps the contents of the version db to stdout.
-fn main() {
-    let args: Vec<OsString> = std::env::args_os().collect();
-    assert!(args.len() == 2);
+/// Prints the usage of the dumper, and exits with an error.
+fn usage() -> ! {
+    eprintln!("{}", USAGE);
+    std::process::exit(2);
+}
 
-    let path = std::path::Path::new(&args[1]);
-    let db = VersionDb::new_from_path(path);
-    let mut dump = Vec::new();
+/// Parses a decimal id, exiting with the usage if it is malformed.
+fn parse_id(
+    s: &str
+) -> usize {
+    usize::from_str(s).unwrap_or_else(|_| usage())
+}
+
+/// Parses a hex value, with an optional 0x prefix, exiting with the usage if it is malformed.
+fn parse_hex(
+    s: &str
+) -> usize {
+    usize::from_str_radix(s.strip_prefix("0x").unwrap_or(s), 16).unwrap_or_else(|_| usage())
+}
+
+/// Reads a list of decimal ids from a file, one per line. Blank lines and #-comments are skipped.
+fn read_ids(
+    path: &OsString
+) -> Vec<usize> {
+    std::fs::read_to_string(path).unwrap().lines().filter_map(|l| {
+        let l = l.split('#').next().unwrap().trim();
+        if l.is_empty() { None } else { Some(usize::from_str(l).unwrap()) }
+    }).collect()
+}
 
-    for (id, offset) in db.as_map().iter() {
-        dump.push(GameLocation(*id, offset.offset()));
+impl<W: Write> Dumper<W> {
+    /// Creates a new dumper, writing out the header of the format.
+    fn new(
+        mut out: W,
+        format: Format
+    ) -> Self {
+        match format {
+            Format::Text => writeln!(out, "|----ID----|--OFFSET--|").unwrap(),
+            Format::Csv => writeln!(out, "id,offset").unwrap(),
+            Format::Json => write!(out, "[").unwrap(),
+            Format::Bin => ()
+        }
+
+        Self { out, format, count: 0, pairs: Vec::new() }
+    }
+
+    /// Writes out a single entry. Entries without an offset are written as missing.
+    fn entry(
+        &mut self,
+        id: usize,
+        offset: Option<usize>
+    ) {
+        let out = &mut self.out;
+        match (self.format, offset) {
+            (Format::Text, Some(o)) => writeln!(out, "| {:08} | {:08x} |", id, o).unwrap(),
+            (Format::Text, None) => writeln!(out, "| {:08} | -------- |", id).unwrap(),
+            (Format::Csv, Some(o)) => writeln!(out, "{},0x{:x}", id, o).unwrap(),
+            (Format::Csv, None) => writeln!(out, "{},", id).unwrap(),
+            (Format::Json, o) => {
+                let sep = if self.count == 0 { "" } else { "," };
+                match o {
+                    Some(o) => write!(out, "{}\n  {{\"id\": {}, \"offset\": {}}}", sep, id, o),
+                    None => write!(out, "{}\n  {{\"id\": {}, \"offset\": null}}", sep, id)
+                }.unwrap();
+            },
+            (Format::Bin, Some(o)) => self.pairs.push((id, o)),
+            (Format::Bin, None) => ()
+        }
+
+        self.count += 1;
     }
 
-    dump.sort();
+    /// Writes out the footer of the format, and flushes the output.
+    fn finish(
+        mut self,
+        version: skse64_common::version::SkseVersion,
+        path: &std::path::Path
+    ) {
+        match self.format {
+            Format::Text => writeln!(self.out, "|----------|----------|").unwrap(),
+            Format::Csv => (),
+            Format::Json => writeln!(self.out, "\n]").unwrap(),
+            Format::Bin => {
+                let (_, format) = VersionDb::version_from_path(path);
+                let ptr_size = writer::DEFAULT_PTR_SIZE;
+                let data = writer::encode_db(&self.pairs, version, format, ptr_size);
+                self.out.write_all(&data).unwrap();
+            }
+        }
+
+        self.out.flush().unwrap();
+    }
+}
+
+/// Prints the id and delta containing each of the given hex offsets.
+fn symbolize(
+    db: &VersionDb,
+    offsets: &[OsString]
+) {
+    let addrs: Vec<RelocAddr> = offsets.iter().map(|o| {
+        RelocAddr::from_offset(parse_hex(o.to_str().unwrap_or_else(|| usage())))
+    }).collect();
 
-    println!("|----ID----|--OFFSET--|");
-    for GameLocation(id, offset) in dump.iter() {
-        println!("| {:08} | {:08x} |", id, offset);
+    println!("|--OFFSET--|----ID----|--DELTA---|");
+    for (addr, res) in addrs.iter().zip(db.find_ids_by_addrs(&addrs).iter()) {
+        if let Ok((id, delta)) = res {
+            println!("| {:08x} | {:08} | {:08x} |", addr.offset(), id, delta);
+        } else {
+            println!("| {:08x} | -------- | -------- |", addr.offset());
+        }
     }
-    println!("|----------|----------|");
+    println!("|----------|----------|----------|");
 }
@@ -0,0 +1,81 @@
+//!
+//! @file main.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Main file for the synthetic version database generator.
+//! @bug No known bugs.
+//!
+
+use std::path::Path;
+use std::str::FromStr;
+
+use versionlib::*;
+use versionlib::synth::SynthConfig;
+
+/// The usage of the generator.
+const USAGE: &str = "Usage: vdb-gen <db> [count] [seed]\n       vdb-gen --index <db>";
+
+///
+/// Generates a synthetic version database at the given path.
+///
+/// The version and format are taken from the file name, as with a real database. An entry
+/// count and seed may optionally follow the path. The written file is then loaded back and
+/// checked against the generated pairs.
+///
+/// When given --index, the sidecar index of an existing database is written instead. The
+/// loaders never write the sidecar themselves.
+///
+fn main() {
+    let args: Vec<String> = std::env::args().skip(1).collect();
+    match args.iter().map(|a| a.as_str()).collect::<Vec<_>>().as_slice() {
+        ["--index", path] => write_index(Path::new(path)),
+        [path, rest @ ..] if !path.starts_with("--") && (rest.len() <= 2) => {
+            let mut config = SynthConfig::default();
+            if let Some(count) = rest.get(0) {
+                config.count = usize::from_str(count).unwrap_or_else(|_| usage());
+            }
+            if let Some(seed) = rest.get(1) {
+                config.seed = u64::from_str(seed).unwrap_or_else(|_| usage());
+            }
+            generate(Path::new(path), &config);
+        },
+        _ => usage()
+    }
+}
+
+/// Generates a synthetic database at the given path, checking that it loads back.
+fn generate(
+    path: &Path,
+    config: &SynthConfig
+) {
+    let (version, format) = VersionDb::version_from_path(path);
+    let pairs = synth::generate(config);
+    let data = writer::encode_db(&pairs, version, format, writer::DEFAULT_PTR_SIZE);
+    std::fs::write(path, &data).unwrap();
+
+    let db = VersionDb::new_from_bytes(&data, version, format, DbLayout::Sorted);
+    assert!(db.len() == pairs.len());
+    for ((id, offset), (db_id, db_addr)) in pairs.iter().zip(db.iter()) {
+        assert!((*id == db_id) && (*offset == db_addr.offset()));
+    }
+
+    println!("Wrote {} entries ({} bytes) to {}", pairs.len(), data.len(), path.display());
+}
+
+/// Writes the sidecar index of the database at the given path.
+fn write_index(
+    path: &Path
+) {
+    match VersionDb::write_index(path) {
+        Ok(count) => println!("Wrote {} checkpoints for {}", count, path.display()),
+        Err(_) => {
+            eprintln!("Could not write the sidecar index of {}", path.display());
+            std::process::exit(1);
+        }
+    }
+}
+
+/// Prints the usage of the generator, and exits with an error.
+fn usage() -> ! {
+    eprintln!("{}", USAGE);
+    std::process::exit(2);
+}
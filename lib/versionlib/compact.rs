@@ -0,0 +1,315 @@
+//!
+//! @file compact.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Succinct storage for the (id, offset) pairs of a version database.
+//! @bug No known bugs.
+//!
+//! The ids are stored as a monotone Elias-Fano sequence. Each id is split into a high part,
+//! which is stored in unary in a bit vector, and a fixed-width low part, which is stored in a
+//! packed array. The offset of each id is stored in a second packed array at the same index.
+//!
+//! The width of the low part is chosen such that each high bucket holds around one id, so
+//! a search only needs a single select on the high bits followed by a short scan.
+//!
+
+use std::mem::size_of;
+
+/// The number of bits in each word of the packed arrays.
+const WORD_BITS: usize = u64::BITS as usize;
+
+/// The number of zeros in the high bits between each sampled select position.
+const SELECT_SAMPLE_RATE: usize = 256;
+
+/// A fixed-width array of unsigned integers, packed into u64 words.
+struct PackedArray {
+    words: Vec<u64>,
+    width: u32
+}
+
+/// A bit vector with sampled select0 positions, holding the high parts of each id.
+struct HighBits {
+    words: Vec<u64>,
+    len: usize,
+    zero_samples: Vec<usize>
+}
+
+/// An Elias-Fano encoded version database.
+pub (in crate) struct CompactDb {
+    high: HighBits,
+    low: PackedArray,
+    offsets: PackedArray,
+    low_width: u32,
+    max_high: usize,
+    len: usize
+}
+
+/// Iterates over the (id, offset) pairs in a compact database, in id order.
+pub struct CompactIter<'a> {
+    db: &'a CompactDb,
+    pos: usize,
+    rank: usize,
+    high: usize
+}
+
+/// Gets a mask for the low width bits of a word.
+const fn low_mask(
+    width: u32
+) -> u64 {
+    if width as usize >= WORD_BITS { !0 } else { (1 << width) - 1 }
+}
+
+/// Gets the number of bits necessary to represent the given value.
+const fn bit_width(
+    val: usize
+) -> u32 {
+    usize::BITS - val.leading_zeros()
+}
+
+impl PackedArray {
+    /// Creates a new array of len zeroed integers, each width bits wide.
+    fn new(
+        width: u32,
+        len: usize
+    ) -> Self {
+        assert!(width as usize <= WORD_BITS);
+        let bits = (width as usize) * len;
+        Self {
+            words: vec![0; (bits + WORD_BITS - 1) / WORD_BITS],
+            width
+        }
+    }
+
+    /// Gets the integer at the given index.
+    fn get(
+        &self,
+        i: usize
+    ) -> u64 {
+        if self.width == 0 { return 0; }
+
+        let bit = i * (self.width as usize);
+        let (word, shift) = (bit / WORD_BITS, bit % WORD_BITS);
+        let mut val = self.words[word] >> shift;
+        if shift + (self.width as usize) > WORD_BITS {
+            val |= self.words[word + 1] << (WORD_BITS - shift);
+        }
+
+        val & low_mask(self.width)
+    }
+
+    /// Sets the integer at the given index, which must be currently zero.
+    fn set(
+        &mut self,
+        i: usize,
+        val: u64
+    ) {
+        if self.width == 0 { return; }
+        assert!(val & !low_mask(self.width) == 0);
+
+        let bit = i * (self.width as usize);
+        let (word, shift) = (bit / WORD_BITS, bit % WORD_BITS);
+        self.words[word] |= val << shift;
+        if shift + (self.width as usize) > WORD_BITS {
+            self.words[word + 1] |= val >> (WORD_BITS - shift);
+        }
+    }
+
+    /// Gets the number of bytes this array holds on the heap.
+    fn heap_size(
+        &self
+    ) -> usize {
+        self.words.capacity() * size_of::<u64>()
+    }
+}
+
+impl HighBits {
+    /// Creates a new, zeroed, bit vector with the given length.
+    fn new(
+        len: usize
+    ) -> Self {
+        Self {
+            words: vec![0; (len + WORD_BITS - 1) / WORD_BITS],
+            len,
+            zero_samples: Vec::new()
+        }
+    }
+
+    /// Gets the bit at the given position.
+    fn get(
+        &self,
+        pos: usize
+    ) -> bool {
+        (self.words[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1 != 0
+    }
+
+    /// Sets the bit at the given position.
+    fn set(
+        &mut self,
+        pos: usize
+    ) {
+        self.words[pos / WORD_BITS] |= 1 << (pos % WORD_BITS);
+    }
+
+    /// Samples the position of every SELECT_SAMPLE_RATE'th zero. Must be called after all sets.
+    fn build_samples(
+        &mut self
+    ) {
+        let mut zeros = 0;
+        for pos in 0..self.len {
+            if !self.get(pos) {
+                if zeros % SELECT_SAMPLE_RATE == 0 {
+                    self.zero_samples.push(pos);
+                }
+                zeros += 1;
+            }
+        }
+        self.zero_samples.shrink_to_fit();
+    }
+
+    ///
+    /// Gets the position of the k'th zero (counting from 0) in the bit vector.
+    ///
+    /// The zero must exist.
+    ///
+    fn select0(
+        &self,
+        k: usize
+    ) -> usize {
+        let pos = self.zero_samples[k / SELECT_SAMPLE_RATE];
+        let mut remain = k % SELECT_SAMPLE_RATE;
+
+        // Scan forward a word at a time, skipping any bits before the sample.
+        let mut word = pos / WORD_BITS;
+        let mut zeros = !self.words[word] & (!0 << (pos % WORD_BITS));
+        loop {
+            let count = zeros.count_ones() as usize;
+            if remain < count {
+                break;
+            }
+
+            remain -= count;
+            word += 1;
+            zeros = !self.words[word];
+        }
+
+        // Drop the lower zeros in the word until the one we want is the lowest.
+        for _ in 0..remain {
+            zeros &= zeros - 1;
+        }
+
+        let res = word * WORD_BITS + (zeros.trailing_zeros() as usize);
+        assert!(res < self.len);
+        res
+    }
+
+    /// Gets the number of bytes this bit vector holds on the heap.
+    fn heap_size(
+        &self
+    ) -> usize {
+        self.words.capacity() * size_of::<u64>()
+            + self.zero_samples.capacity() * size_of::<usize>()
+    }
+}
+
+impl CompactDb {
+    /// Encodes the given (id, offset) pairs, which must be sorted by unique id.
+    pub (in crate) fn new(
+        pairs: &[(usize, usize)]
+    ) -> Self {
+        let len = pairs.len();
+        let max_id = pairs.last().map(|p| p.0).unwrap_or(0);
+        let max_offset = pairs.iter().map(|p| p.1).max().unwrap_or(0);
+
+        // Choose the low width such that there is around one id per high bucket.
+        let universe = max_id + 1;
+        let low_width = if universe > len && len > 0 { bit_width(universe / len) - 1 } else { 0 };
+        let max_high = max_id >> low_width;
+
+        let mut high = HighBits::new(len + max_high + 1);
+        let mut low = PackedArray::new(low_width, len);
+        let mut offsets = PackedArray::new(bit_width(max_offset), len);
+        let mut prev = None;
+        for (i, (id, offset)) in pairs.iter().enumerate() {
+            assert!(prev.map(|p| p < *id).unwrap_or(true));
+            prev = Some(*id);
+
+            high.set((id >> low_width) + i);
+            low.set(i, (*id as u64) & low_mask(low_width));
+            offsets.set(i, *offset as u64);
+        }
+        high.build_samples();
+
+        Self { high, low, offsets, low_width, max_high, len }
+    }
+
+    /// Searches for the offset of the given id.
+    pub (in crate) fn get(
+        &self,
+        id: usize
+    ) -> Option<usize> {
+        let high = id >> self.low_width;
+        let low = (id as u64) & low_mask(self.low_width);
+        if high > self.max_high {
+            return None;
+        }
+
+        // The ids in this bucket begin just after the zero which ends the previous bucket.
+        let mut pos = if high == 0 { 0 } else { self.high.select0(high - 1) + 1 };
+        let mut rank = pos - high;
+        while (pos < self.high.len) && self.high.get(pos) {
+            let found = self.low.get(rank);
+            if found == low {
+                return Some(self.offsets.get(rank) as usize);
+            } else if found > low {
+                return None;
+            }
+
+            pos += 1;
+            rank += 1;
+        }
+
+        None
+    }
+
+    /// Gets the number of ids in the database.
+    pub (in crate) fn len(
+        &self
+    ) -> usize {
+        self.len
+    }
+
+    /// Gets an iterator over the (id, offset) pairs in the database.
+    pub (in crate) fn iter(
+        &self
+    ) -> CompactIter<'_> {
+        CompactIter { db: self, pos: 0, rank: 0, high: 0 }
+    }
+
+    /// Gets the number of bytes the database holds on the heap.
+    pub (in crate) fn heap_size(
+        &self
+    ) -> usize {
+        self.high.heap_size() + self.low.heap_size() + self.offsets.heap_size()
+    }
+}
+
+impl<'a> Iterator for CompactIter<'a> {
+    type Item = (usize, usize);
+    fn next(
+        &mut self
+    ) -> Option<Self::Item> {
+        while self.rank < self.db.len {
+            if self.db.high.get(self.pos) {
+                let id = (self.high << self.db.low_width) | (self.db.low.get(self.rank) as usize);
+                let offset = self.db.offsets.get(self.rank) as usize;
+                self.pos += 1;
+                self.rank += 1;
+                return Some((id, offset));
+            }
+
+            self.pos += 1;
+            self.high += 1;
+        }
+
+        None
+    }
+}
@@ -0,0 +1,211 @@
+//!
+//! @file index.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Seekable checkpoint index for version database files.
+//! @bug No known bugs.
+//!
+//! Each address in a version database is delta encoded against the one before it, so the file
+//! can only be decoded from the beginning. To get around this, we store a sidecar file next to
+//! the database which holds the decoder state every CHECKPOINT_INTERVAL entries. Each chunk
+//! between two checkpoints can then be decoded on its own, allowing for parallel loading and
+//! for ranges of ids to be decoded without touching the rest of the file.
+//!
+//! The sidecar is only written on request, by vdb-gen, as the directory holding the database
+//! may not be writable. It is tied to the database by a hash of its contents, and its
+//! checkpoints are covered by a checksum of their own. A sidecar which doesn't match either
+//! is ignored, and the database is decoded sequentially instead.
+//!
+//! The sidecar file format is as follows, with all values being little endian:
+//! - A u32 magic number, followed by a u32 format version.
+//! - A u64 hash of the database file, followed by the u64 length of the database file.
+//! - A u32 checkpoint interval, followed by a u32 checkpoint count.
+//! - A u64 hash of the checkpoints which follow.
+//! - Each checkpoint, as six u64s: the file position, entry number, previous id, previous
+//!   offset, and the minimum and maximum id within the chunk.
+//!
+
+use std::io::Write;
+use std::path::{Path, PathBuf};
+
+use crate::Reader;
+
+/// The number of entries between each checkpoint.
+pub (in crate) const CHECKPOINT_INTERVAL: usize = 4096;
+
+/// Identifies a sidecar index file.
+const INDEX_MAGIC: u32 = u32::from_le_bytes(*b"VDBI");
+
+/// The version of the sidecar format. Must be changed whenever the format changes.
+const INDEX_VERSION: u32 = 2;
+
+/// The number of u64 values in each serialized checkpoint.
+const CHECKPOINT_FIELDS: usize = 6;
+
+/// The size of the header before the checkpoints.
+const HEADER_SIZE: usize = std::mem::size_of::<u32>() * 4 + std::mem::size_of::<u64>() * 3;
+
+/// The decoder state at the start of a chunk of the database.
+#[derive(Copy, Clone)]
+pub (in crate) struct Checkpoint {
+    pub (in crate) pos: usize,
+    pub (in crate) entry: usize,
+    pub (in crate) pid: usize,
+    pub (in crate) poffset: usize,
+    pub (in crate) min_id: usize,
+    pub (in crate) max_id: usize
+}
+
+/// A checkpoint index over a version database file.
+pub (in crate) struct DbIndex {
+    checkpoints: Vec<Checkpoint>,
+    interval: usize
+}
+
+/// Hashes the given data with 64-bit FNV-1a.
+fn hash(
+    data: &[u8]
+) -> u64 {
+    const FNV_OFFSET: u64 = 0xcbf29ce484222325;
+    const FNV_PRIME: u64 = 0x100000001b3;
+    data.iter().fold(FNV_OFFSET, |h, b| (h ^ (*b as u64)).wrapping_mul(FNV_PRIME))
+}
+
+impl DbIndex {
+    /// Creates a new, empty, index.
+    pub (in crate) fn new() -> Self {
+        Self {
+            checkpoints: Vec::new(),
+            interval: CHECKPOINT_INTERVAL
+        }
+    }
+
+    /// Gets the path of the sidecar index for the given database.
+    pub (in crate) fn sidecar_path(
+        path: &Path
+    ) -> PathBuf {
+        let mut name = path.as_os_str().to_owned();
+        name.push(".idx");
+        PathBuf::from(name)
+    }
+
+    ///
+    /// Attempts to load the sidecar index for the given database.
+    ///
+    /// Fails if the sidecar doesn't exist, is malformed or damaged, or was built for a different
+    /// file. The database is only hashed once the sidecar is found.
+    ///
+    pub (in crate) fn load(
+        path: &Path,
+        data: &[u8],
+        addr_count: usize
+    ) -> Result<Self, ()> {
+        let sidecar = std::fs::read(Self::sidecar_path(path)).map_err(|_| ())?;
+        let mut r = Reader::new(&sidecar, 0);
+
+        if (sidecar.len() < HEADER_SIZE)
+                || (r.read::<u32>() != INDEX_MAGIC)
+                || (r.read::<u32>() != INDEX_VERSION)
+                || (r.read::<u64>() != hash(data))
+                || (r.read::<u64>() != data.len() as u64) {
+            return Err(());
+        }
+
+        let interval = r.read::<u32>() as usize;
+        let count = r.read::<u32>() as usize;
+        let checksum = r.read::<u64>();
+        let expected = (addr_count + interval.max(1) - 1) / interval.max(1);
+        let body_size = count * CHECKPOINT_FIELDS * std::mem::size_of::<u64>();
+        if (interval == 0) || (count != expected) || (sidecar.len() != HEADER_SIZE + body_size)
+                || (checksum != hash(&sidecar[HEADER_SIZE..])) {
+            return Err(());
+        }
+
+        let mut checkpoints = Vec::with_capacity(count);
+        for i in 0..count {
+            let cp = Checkpoint {
+                pos: r.read::<u64>() as usize,
+                entry: r.read::<u64>() as usize,
+                pid: r.read::<u64>() as usize,
+                poffset: r.read::<u64>() as usize,
+                min_id: r.read::<u64>() as usize,
+                max_id: r.read::<u64>() as usize
+            };
+
+            if (cp.entry != i * interval) || (cp.pos >= data.len()) {
+                return Err(());
+            }
+
+            checkpoints.push(cp);
+        }
+
+        Ok(Self { checkpoints, interval })
+    }
+
+    /// Writes out the sidecar index for the given database.
+    pub (in crate) fn save(
+        &self,
+        path: &Path,
+        data: &[u8]
+    ) -> Result<(), ()> {
+        let mut body = Vec::with_capacity(
+            self.checkpoints.len() * CHECKPOINT_FIELDS * std::mem::size_of::<u64>()
+        );
+        for cp in self.checkpoints.iter() {
+            for val in [cp.pos, cp.entry, cp.pid, cp.poffset, cp.min_id, cp.max_id] {
+                body.extend_from_slice(&(val as u64).to_le_bytes());
+            }
+        }
+
+        let mut out = Vec::with_capacity(HEADER_SIZE + body.len());
+        out.extend_from_slice(&INDEX_MAGIC.to_le_bytes());
+        out.extend_from_slice(&INDEX_VERSION.to_le_bytes());
+        out.extend_from_slice(&hash(data).to_le_bytes());
+        out.extend_from_slice(&(data.len() as u64).to_le_bytes());
+        out.extend_from_slice(&(self.interval as u32).to_le_bytes());
+        out.extend_from_slice(&(self.checkpoints.len() as u32).to_le_bytes());
+        out.extend_from_slice(&hash(&body).to_le_bytes());
+        out.extend_from_slice(&body);
+
+        // Write to a temporary file first, so a partial write never leaves a bad sidecar.
+        let sidecar = Self::sidecar_path(path);
+        let mut tmp = sidecar.clone().into_os_string();
+        tmp.push(".tmp");
+        let mut f = std::fs::File::create(&tmp).map_err(|_| ())?;
+        f.write_all(&out).map_err(|_| ())?;
+        drop(f);
+        std::fs::rename(&tmp, &sidecar).map_err(|_| ())
+    }
+
+    /// Gets the number of entries between each checkpoint.
+    pub (in crate) fn interval(
+        &self
+    ) -> usize {
+        self.interval
+    }
+
+    /// Gets the checkpoints in the index.
+    pub (in crate) fn checkpoints(
+        &self
+    ) -> &[Checkpoint] {
+        &self.checkpoints
+    }
+
+    /// Adds a checkpoint to the end of the index.
+    pub (in crate) fn push(
+        &mut self,
+        cp: Checkpoint
+    ) {
+        assert!(cp.entry == self.checkpoints.len() * self.interval);
+        self.checkpoints.push(cp);
+    }
+
+    /// Updates the id bounds of the last checkpoint in the index.
+    pub (in crate) fn note_id(
+        &mut self,
+        id: usize
+    ) {
+        let cp = self.checkpoints.last_mut().unwrap();
+        cp.min_id = cp.min_id.min(id);
+        cp.max_id = cp.max_id.max(id);
+    }
+}
@@ -5,20 +5,69 @@
 //! @bug No known bugs.
 //!
 
+mod compact;
+mod index;
+pub mod shared;
+pub mod synth;
+pub mod writer;
+
 use std::collections::HashMap;
-use std::fs::File;
-use std::io::{Read, Seek, SeekFrom};
 use std::mem::size_of;
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::sync::OnceLock;
 
 use skse64_common::version::{SkseVersion, RUNTIME_VERSION_1_6_317};
 use skse64_common::reloc::RelocAddr;
 
+use compact::{CompactDb, CompactIter};
+use index::{Checkpoint, DbIndex};
+use shared::{Messenger, SharedDbRequest, SharedDbTable};
+
 /// A version database, which allows for offsets/ids to be searched for by each other.
 pub struct VersionDb {
-    pub (in crate) by_id: HashMap<usize, RelocAddr>,
+    by_id: Storage,
+    by_offset: OnceLock<Vec<(RelocAddr, usize)>>,
     version: SkseVersion
 }
 
+///
+/// Selects how the (id, offset) pairs of a version database are held in memory.
+///
+/// The hashed layout has the fastest searches, but the database will hold several megabytes
+/// of memory while it is loaded. The sorted layout is around half that size and can be
+/// iterated in id order. The compact layout is an order of magnitude smaller than the hashed
+/// layout, at the cost of a slightly slower search.
+///
+#[derive(Copy, Clone, PartialEq, Eq, Debug)]
+pub enum DbLayout {
+    Hashed,
+    Sorted,
+    Compact
+}
+
+/// The underlying storage of each database layout.
+enum Storage {
+    Hashed(HashMap<usize, RelocAddr>),
+    Sorted(Vec<(usize, RelocAddr)>),
+    Compact(CompactDb),
+    Shared(&'static SharedDbTable)
+}
+
+///
+/// Iterates over the (id, offset) pairs in a version database.
+///
+/// The sorted and compact layouts are iterated in id order. The order of the hashed
+/// layout is undefined. A shared database is copied out before it is iterated, in the order
+/// of the layout it was published in.
+///
+pub enum Iter<'a> {
+    Hashed(std::collections::hash_map::Iter<'a, usize, RelocAddr>),
+    Sorted(std::slice::Iter<'a, (usize, RelocAddr)>),
+    Compact(CompactIter<'a>),
+    Shared(std::vec::IntoIter<(usize, RelocAddr)>)
+}
+
 ///
 /// An enumeration used to encode how the data in an address is stored in the database.
 ///
@@ -38,6 +87,12 @@ enum AddrEncoding {
     NegDelta16 = 5
 }
 
+/// A cursor over the bytes of a version database file.
+struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize
+}
+
 // Trait used to ensure read only works on unsigned ints.
 trait Unsigned {}
 impl Unsigned for u8 {}
@@ -49,6 +104,14 @@ impl VersionDb {
     /// Attempts to create a new version database, loading it with the specified version
     pub fn new(
         version: SkseVersion
+    ) -> Self {
+        Self::new_with_layout(version, DbLayout::Hashed)
+    }
+
+    /// Creates a new version database for the specified version, using the given layout.
+    pub fn new_with_layout(
+        version: SkseVersion,
+        layout: DbLayout
     ) -> Self {
         // Figure out what kind of version db we're loading, so we can enforce the format later.
         // It also effects the base of the file name.
@@ -64,21 +127,153 @@ impl VersionDb {
         // The SKSE64 team uses it to denote which store the game was obtained from, so
         // we can't just pull it from our version structure.
         //
-        let mut f = std::fs::File::open(std::path::PathBuf::from(format!(
+        let path = PathBuf::from(format!(
             "Data\\SKSE\\Plugins\\{}-{}-{}-{}-0.bin",
             file_base,
             version.major(),
             version.minor(),
             version.build()
-        ))).unwrap();
+        ));
 
-        Self::new_from_file(&mut f, version, format)
+        Self::load(&path, version, format, layout, None)
     }
 
     /// Creates a version database from the given path, setting the version based on the file.
     pub fn new_from_path(
-        path: &std::path::Path
+        path: &Path
+    ) -> Self {
+        Self::new_from_path_with_layout(path, DbLayout::Hashed)
+    }
+
+    /// Creates a version database from the given path, using the given layout.
+    pub fn new_from_path_with_layout(
+        path: &Path,
+        layout: DbLayout
+    ) -> Self {
+        let (version, format) = Self::version_from_path(path);
+        Self::load(path, version, format, layout, None)
+    }
+
+    ///
+    /// Creates a version database from the given path, holding only the ids within the given
+    /// range.
+    ///
+    /// When the sidecar index of the database is available, only the chunks of the file
+    /// which may contain the requested ids are decoded.
+    ///
+    pub fn new_from_path_with_range(
+        path: &Path,
+        layout: DbLayout,
+        ids: Range<usize>
+    ) -> Self {
+        let (version, format) = Self::version_from_path(path);
+        Self::load(path, version, format, layout, Some(ids))
+    }
+
+    ///
+    /// Creates a version database from the contents of a database file.
+    ///
+    /// The data is always decoded sequentially, as there is no file to keep a sidecar next to.
+    ///
+    pub fn new_from_bytes(
+        data: &[u8],
+        version: SkseVersion,
+        format: u32,
+        layout: DbLayout
     ) -> Self {
+        let mut r = Reader::new(data, 0);
+        let (ptr_size, addr_count) = Self::parse_header(&mut r, format);
+        let (pairs, _) = Self::decode_all(r, ptr_size, addr_count as usize);
+
+        Self {
+            by_id: Storage::new(pairs, layout),
+            by_offset: OnceLock::new(),
+            version: version
+        }
+    }
+
+    ///
+    /// Requests a database of the given version from any plugin which shares one.
+    ///
+    /// If no plugin answers the request, the database is loaded from disk with the given layout.
+    ///
+    pub fn new_shared(
+        version: SkseVersion,
+        layout: DbLayout,
+        messenger: &dyn Messenger<SharedDbRequest>
+    ) -> Self {
+        Self::shared_or(version, messenger, || Self::new_with_layout(version, layout))
+    }
+
+    /// Requests a shared database, creating one with the given function if nobody answers.
+    fn shared_or(
+        version: SkseVersion,
+        messenger: &dyn Messenger<SharedDbRequest>,
+        fallback: impl FnOnce() -> Self
+    ) -> Self {
+        let mut request = SharedDbRequest::new(version);
+        messenger.send(&mut request);
+        match request.answer() {
+            Some(table) => Self::from_shared(table),
+            None => fallback()
+        }
+    }
+
+    /// Creates a database which searches the given shared database.
+    pub fn from_shared(
+        table: &'static SharedDbTable
+    ) -> Self {
+        Self {
+            by_id: Storage::Shared(table),
+            by_offset: OnceLock::new(),
+            version: table.version
+        }
+    }
+
+    ///
+    /// Writes the sidecar index of the database at the given path, so that later loads of it
+    /// can be decoded in parallel.
+    ///
+    /// Returns the number of checkpoints written, or an error if the sidecar could not be
+    /// written.
+    ///
+    pub fn write_index(
+        path: &Path
+    ) -> Result<usize, ()> {
+        let (_, format) = Self::version_from_path(path);
+        let data = std::fs::read(path).map_err(|_| ())?;
+        let mut r = Reader::new(&data, 0);
+        let (ptr_size, addr_count) = Self::parse_header(&mut r, format);
+        let (_, index) = Self::decode_all(r, ptr_size, addr_count as usize);
+        index.save(path, &data)?;
+        Ok(index.checkpoints().len())
+    }
+
+    ///
+    /// Decodes the (id, offset) pairs of the database at the given path, in the order they are
+    /// stored in the file.
+    ///
+    /// Unlike a loaded database, the pairs are never sorted or hashed, so tools which only walk
+    /// the database once can stream them out directly. If a range of ids is given, only the
+    /// pairs within it are returned.
+    ///
+    pub fn pairs_from_path(
+        path: &Path,
+        ids: Option<Range<usize>>
+    ) -> Vec<(usize, usize)> {
+        let (_, format) = Self::version_from_path(path);
+        Self::decode_file(path, format, ids)
+    }
+
+    ///
+    /// Gets the version and format of a database from its file name.
+    ///
+    /// The name must be of the form "version-A-B-C-0.bin" for SE databases, which are format 1,
+    /// or "versionlib-A-B-C-0.bin" for AE databases, which are format 2.
+    ///
+    pub fn version_from_path(
+        path: &Path
+    ) -> (SkseVersion, u32) {
         use std::str::FromStr;
 
         const DB_NAME_PARTS: usize = 5;
@@ -97,7 +292,6 @@ impl VersionDb {
         let build = u32::from_str(parts[4].unwrap()).unwrap();
         assert!(build == 0);
 
-        let mut f = std::fs::File::open(path).unwrap();
         let version = SkseVersion::new(major, minor, revision, build);
         let format = if version < RUNTIME_VERSION_1_6_317 {
             assert!(base == "version");
@@ -107,7 +301,7 @@ impl VersionDb {
             2
         };
 
-        Self::new_from_file(&mut f, version, format)
+        (version, format)
     }
 
     /// Gets the version that is currently loaded into the database.
@@ -122,39 +316,315 @@ impl VersionDb {
         &self,
         id: usize
     ) -> Result<RelocAddr, ()> {
-        self.by_id.get(&id).ok_or(()).copied()
+        match &self.by_id {
+            Storage::Hashed(map) => map.get(&id).copied(),
+            Storage::Sorted(v) => {
+                v.binary_search_by_key(&id, |e| e.0).ok().map(|i| v[i].1)
+            },
+            Storage::Compact(db) => db.get(id).map(RelocAddr::from_offset),
+            Storage::Shared(table) => table.find_addr_by_id(id).ok()
+        }.ok_or(())
+    }
+
+    ///
+    /// Attempts to find the address independent id which contains the given offset.
+    ///
+    /// The id returned is the one with the greatest offset less than or equal to the given
+    /// address, along with the distance from that offset to the address. If several ids share
+    /// the same offset, the lowest id is returned.
+    ///
+    /// The offset index is built the first time this function (or its batch variant) is called.
+    ///
+    pub fn find_id_by_addr(
+        &self,
+        addr: RelocAddr
+    ) -> Result<(usize, usize), ()> {
+        if let Storage::Shared(table) = &self.by_id {
+            return table.find_id_by_addr(addr);
+        }
+
+        let index = self.offset_index();
+        Self::nearest_id(index, index.partition_point(|e| e.0 <= addr), addr)
     }
 
-    /// Gets the underlying map associated with the database.
-    pub fn as_map(
+    ///
+    /// Finds the containing id of each of the given offsets, as find_id_by_addr() would.
+    ///
+    /// The addresses are sorted and then matched against the offset index in a single merge
+    /// pass, which is much cheaper than searching the index for each address when there are many
+    /// of them. Results are returned in the same order as the given addresses.
+    ///
+    pub fn find_ids_by_addrs(
+        &self,
+        addrs: &[RelocAddr]
+    ) -> Vec<Result<(usize, usize), ()>> {
+        if let Storage::Shared(table) = &self.by_id {
+            return addrs.iter().map(|a| table.find_id_by_addr(*a)).collect();
+        }
+
+        let index = self.offset_index();
+        let mut order: Vec<usize> = (0..addrs.len()).collect();
+        order.sort_unstable_by_key(|i| addrs[*i]);
+
+        let mut res = vec![Err(()); addrs.len()];
+        let mut next = 0;
+        for i in order.into_iter() {
+            // Advance to the first entry past the address. Since the addresses are sorted,
+            // we never need to move backwards.
+            while (next < index.len()) && (index[next].0 <= addrs[i]) {
+                next += 1;
+            }
+
+            res[i] = Self::nearest_id(index, next, addrs[i]);
+        }
+
+        res
+    }
+
+    /// Gets an iterator over the (id, offset) pairs in the database.
+    pub fn iter(
+        &self
+    ) -> Iter<'_> {
+        match &self.by_id {
+            Storage::Hashed(map) => Iter::Hashed(map.iter()),
+            Storage::Sorted(v) => Iter::Sorted(v.iter()),
+            Storage::Compact(db) => Iter::Compact(db.iter()),
+            Storage::Shared(table) => Iter::Shared(table.pairs().into_iter())
+        }
+    }
+
+    /// Gets the number of ids in the database.
+    pub fn len(
         &self
-    ) -> &HashMap<usize, RelocAddr> {
-        &self.by_id
+    ) -> usize {
+        match &self.by_id {
+            Storage::Hashed(map) => map.len(),
+            Storage::Sorted(v) => v.len(),
+            Storage::Compact(db) => db.len(),
+            Storage::Shared(table) => table.len
+        }
     }
 
+    /// Gets the layout the database is stored in.
+    pub fn layout(
+        &self
+    ) -> DbLayout {
+        match &self.by_id {
+            Storage::Hashed(_) => DbLayout::Hashed,
+            Storage::Sorted(_) => DbLayout::Sorted,
+            Storage::Compact(_) => DbLayout::Compact,
+            Storage::Shared(table) => table.layout()
+        }
+    }
+
+    ///
+    /// Gets the number of bytes the database holds on the heap.
+    ///
+    /// The size of the hashed layout is an estimate, as the standard library doesn't expose the
+    /// real size of its tables. The offset index is not included, nor is a shared database,
+    /// as it is owned by the plugin which published it.
+    ///
+    pub fn heap_size(
+        &self
+    ) -> usize {
+        match &self.by_id {
+            // Each bucket holds a pair and a control byte.
+            Storage::Hashed(map) => map.capacity() * (size_of::<(usize, RelocAddr)>() + 1),
+            Storage::Sorted(v) => v.capacity() * size_of::<(usize, RelocAddr)>(),
+            Storage::Compact(db) => db.heap_size(),
+            Storage::Shared(_) => 0
+        }
+    }
+
+    ///
     /// Loads in a version database from the given file and version.
-    fn new_from_file(
-        f: &mut File,
+    ///
+    /// If the sidecar index of the file is valid, it is used to decode the file in parallel.
+    /// Otherwise, the file is decoded sequentially. The sidecar is never written here, as the
+    /// directory of the database may not be writable; see write_index().
+    ///
+    fn load(
+        path: &Path,
         version: SkseVersion,
-        format: u32
+        format: u32,
+        layout: DbLayout,
+        ids: Option<Range<usize>>
     ) -> Self {
-        let mut by_id = HashMap::<usize, RelocAddr>::new();
+        let pairs = Self::decode_file(path, format, ids);
+        Self {
+            by_id: Storage::new(pairs, layout),
+            by_offset: OnceLock::new(),
+            version: version
+        }
+    }
 
-        let (ptr_size, addr_count) = Self::parse_header(f, format);
+    ///
+    /// Decodes the addresses in the given database file, in file order.
+    ///
+    /// If the sidecar index of the file is valid, it is used to decode the file in parallel.
+    /// Otherwise, the file is decoded sequentially.
+    ///
+    fn decode_file(
+        path: &Path,
+        format: u32,
+        ids: Option<Range<usize>>
+    ) -> Vec<(usize, usize)> {
+        let data = std::fs::read(path).unwrap();
+        let mut r = Reader::new(&data, 0);
+        let (ptr_size, addr_count) = Self::parse_header(&mut r, format);
+        let addr_count = addr_count as usize;
+
+        if let Ok(index) = DbIndex::load(path, &data, addr_count) {
+            Self::decode_indexed(&data, &index, ptr_size, addr_count, ids)
+        } else {
+            let (mut pairs, _) = Self::decode_all(r, ptr_size, addr_count);
+            if let Some(ids) = ids {
+                pairs.retain(|p| ids.contains(&p.0));
+            }
+
+            pairs
+        }
+    }
+
+    /// Decodes every address in the database, building a checkpoint index along the way.
+    fn decode_all(
+        mut r: Reader,
+        ptr_size: u32,
+        addr_count: usize
+    ) -> (Vec<(usize, usize)>, DbIndex) {
+        let mut index = DbIndex::new();
+        let mut pairs = Vec::with_capacity(addr_count);
         let (mut pid, mut poffset) = (0, 0);
-        for _ in 0..addr_count {
-            let (id, offset) = Self::parse_addr(f, pid, poffset, ptr_size);
+        for i in 0..addr_count {
+            if i % index.interval() == 0 {
+                index.push(Checkpoint {
+                    pos: r.pos(),
+                    entry: i,
+                    pid,
+                    poffset,
+                    min_id: usize::MAX,
+                    max_id: 0
+                });
+            }
 
-            assert!(by_id.insert(id, RelocAddr::from_offset(offset)).is_none());
+            let (id, offset) = Self::parse_addr(&mut r, pid, poffset, ptr_size);
+            index.note_id(id);
+            pairs.push((id, offset));
+            pid = id;
+            poffset = offset;
+        }
 
+        (pairs, index)
+    }
+
+    ///
+    /// Decodes the addresses in the database using its checkpoint index.
+    ///
+    /// Each chunk is decoded independently, with the chunks being split evenly between the
+    /// available threads. If a range of ids is given, chunks which can't contain any of them
+    /// are skipped.
+    ///
+    fn decode_indexed(
+        data: &[u8],
+        index: &DbIndex,
+        ptr_size: u32,
+        addr_count: usize,
+        ids: Option<Range<usize>>
+    ) -> Vec<(usize, usize)> {
+        let chunks: Vec<&Checkpoint> = index.checkpoints().iter().filter(|cp| {
+            ids.as_ref().map(|ids| (cp.min_id < ids.end) && (ids.start <= cp.max_id))
+                .unwrap_or(true)
+        }).collect();
+
+        let threads = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+        let per_thread = (chunks.len() + threads - 1) / threads;
+        if per_thread == 0 {
+            return Vec::new();
+        }
+
+        let decode = |chunks: &[&Checkpoint]| {
+            let mut pairs = Vec::with_capacity(chunks.len() * index.interval());
+            for cp in chunks.iter() {
+                let count = index.interval().min(addr_count - cp.entry);
+                Self::decode_chunk(data, cp, count, ptr_size, &mut pairs);
+            }
+            pairs
+        };
+
+        let mut pairs = std::thread::scope(|s| {
+            let workers: Vec<_> = chunks.chunks(per_thread).map(|c| {
+                s.spawn(move || decode(c))
+            }).collect();
+
+            let mut pairs = Vec::with_capacity(chunks.len() * index.interval());
+            for w in workers.into_iter() {
+                pairs.append(&mut w.join().unwrap());
+            }
+            pairs
+        });
+
+        if let Some(ids) = ids {
+            pairs.retain(|p| ids.contains(&p.0));
+        }
+
+        pairs
+    }
+
+    /// Decodes count addresses, starting from the given checkpoint.
+    fn decode_chunk(
+        data: &[u8],
+        cp: &Checkpoint,
+        count: usize,
+        ptr_size: u32,
+        out: &mut Vec<(usize, usize)>
+    ) {
+        let mut r = Reader::new(data, cp.pos);
+        let (mut pid, mut poffset) = (cp.pid, cp.poffset);
+        for _ in 0..count {
+            let (id, offset) = Self::parse_addr(&mut r, pid, poffset, ptr_size);
+            out.push((id, offset));
             pid = id;
             poffset = offset;
         }
+    }
 
-        Self {
-            by_id,
-            version: version
+    /// Gets the offset sorted index of the database, building it if necessary.
+    fn offset_index(
+        &self
+    ) -> &[(RelocAddr, usize)] {
+        self.by_offset.get_or_init(|| {
+            let mut index: Vec<(RelocAddr, usize)> = self.iter().map(|(id, addr)| {
+                (addr, id)
+            }).collect();
+            index.sort_unstable();
+            index
+        })
+    }
+
+    ///
+    /// Finds the nearest (id, delta) pair at or below the given address.
+    ///
+    /// The given index must be sorted, and end must be the number of entries in the index
+    /// whose offset is less than or equal to the address.
+    ///
+    fn nearest_id(
+        index: &[(RelocAddr, usize)],
+        end: usize,
+        addr: RelocAddr
+    ) -> Result<(usize, usize), ()> {
+        let mut i = end;
+        if i == 0 {
+            return Err(());
         }
+
+        // Several ids may share an offset, in which case we report the lowest.
+        let offset = index[i - 1].0;
+        while (i > 1) && (index[i - 2].0 == offset) {
+            i -= 1;
+        }
+
+        let (found, id) = index[i - 1];
+        Ok((id, addr.offset() - found.offset()))
     }
 
     ///
@@ -170,15 +640,15 @@ impl VersionDb {
     /// - The remainder of the database is the addresses contained within it.
     ///
     fn parse_header(
-        f: &mut File,
+        r: &mut Reader,
         format: u32
     ) -> (u32, u32) {
-        assert!(Self::read::<u32>(f) == format); // version
-        Self::skip(f, (size_of::<u32>() * 4) as u32); // Runtime version
-        let mod_len = Self::read::<u32>(f); // Module name length
-        Self::skip(f, mod_len); // Module name.
-        let ptr_size = Self::read::<u32>(f);
-        let addr_count = Self::read::<u32>(f);
+        assert!(r.read::<u32>() == format); // version
+        r.skip(size_of::<u32>() * 4); // Runtime version
+        let mod_len = r.read::<u32>(); // Module name length
+        r.skip(mod_len as usize); // Module name.
+        let ptr_size = r.read::<u32>();
+        let addr_count = r.read::<u32>();
         (ptr_size, addr_count)
     }
 
@@ -196,14 +666,14 @@ impl VersionDb {
     ///   we can just use poffset).
     ///
     fn parse_addr(
-        f: &mut File,
+        r: &mut Reader,
         pid: usize,
         poffset: usize,
         ptr_size: u32
     ) -> (usize, usize) {
         // SAFETY: This is the defined encoding of the control byte. The enum is sized to always
         //         be in range.
-        let control = Self::read::<u8>(f);
+        let control = r.read::<u8>();
         assert!(control & 0x08 == 0);
         let id_enc = unsafe { std::mem::transmute::<u8, AddrEncoding>(control & 0x07) };
         let offset_enc = unsafe { std::mem::transmute::<u8, AddrEncoding>((control >> 4) & 0x07) };
@@ -211,31 +681,94 @@ impl VersionDb {
         let is_by_ptr = (control & 0x80) != 0;
         let poffset = if is_by_ptr { poffset / (ptr_size as usize) } else { poffset };
 
-        let id = id_enc.read(f, pid);
-        let offset = offset_enc.read(f, poffset);
+        let id = id_enc.read(r, pid);
+        let offset = offset_enc.read(r, poffset);
         let offset = if is_by_ptr { offset * (ptr_size as usize) } else { offset };
         (id, offset)
     }
+}
+
+impl<'a> Reader<'a> {
+    /// Creates a new reader over the given data, starting at the given position.
+    fn new(
+        data: &'a [u8],
+        pos: usize
+    ) -> Self {
+        Self { data, pos }
+    }
+
+    /// Gets the current position of the reader.
+    fn pos(
+        &self
+    ) -> usize {
+        self.pos
+    }
 
-    /// Read T from file.
+    /// Read a little endian T from the data.
     fn read<T: Unsigned>(
-        f: &mut File
+        &mut self
     ) -> T {
-        let mut b: [u8; size_of::<u64>()] = [0; size_of::<u64>()];
-        assert!(f.read(b.split_at_mut(size_of::<T>()).0).unwrap() == size_of::<T>());
-        unsafe {
-            // SAFETY: We only read integer types, and ensure that the buffer is the right size.
-            std::ptr::read_unaligned(b.as_ptr() as *mut T)
-        }
+        let end = self.pos + size_of::<T>();
+        assert!(end <= self.data.len());
+        let val = unsafe {
+            // SAFETY: We only read integer types, and ensure that the data is large enough.
+            std::ptr::read_unaligned(self.data[self.pos..end].as_ptr() as *const T)
+        };
+        self.pos = end;
+        val
     }
 
-    /// Skips bytes in a file.
+    /// Skips bytes in the data.
     fn skip(
-        f: &mut File,
-        n: u32
+        &mut self,
+        n: usize
     ) {
-        let pos = f.seek(SeekFrom::Current(0)).unwrap();
-        assert!(f.seek(SeekFrom::Current(n as i64)).unwrap() == pos + (n as u64));
+        assert!(self.pos + n <= self.data.len());
+        self.pos += n;
+    }
+}
+
+impl Storage {
+    /// Creates the storage for the given layout from the list of (id, offset) pairs.
+    fn new(
+        mut pairs: Vec<(usize, usize)>,
+        layout: DbLayout
+    ) -> Self {
+        if let DbLayout::Hashed = layout {
+            let mut map = HashMap::with_capacity(pairs.len());
+            for (id, offset) in pairs.into_iter() {
+                assert!(map.insert(id, RelocAddr::from_offset(offset)).is_none());
+            }
+            return Self::Hashed(map);
+        }
+
+        // Both of the other layouts require the ids to be sorted and unique.
+        pairs.sort_unstable_by_key(|p| p.0);
+        for w in pairs.windows(2) {
+            assert!(w[0].0 != w[1].0);
+        }
+
+        match layout {
+            DbLayout::Sorted => Self::Sorted(pairs.into_iter().map(|(id, offset)| {
+                (id, RelocAddr::from_offset(offset))
+            }).collect()),
+            DbLayout::Compact => Self::Compact(CompactDb::new(&pairs)),
+            DbLayout::Hashed => unreachable!()
+        }
+    }
+}
+
+impl<'a> Iterator for Iter<'a> {
+    type Item = (usize, RelocAddr);
+    fn next(
+        &mut self
+    ) -> Option<Self::Item> {
+        match self {
+            Self::Hashed(i) => i.next().map(|(id, addr)| (*id, *addr)),
+            Self::Sorted(i) => i.next().copied(),
+            Self::Compact(i) => i.next().map(|(id, offset)| (id, RelocAddr::from_offset(offset))),
+            Self::Shared(i) => i.next()
+        }
     }
 }
 
@@ -243,18 +776,142 @@ impl AddrEncoding {
     /// Uses an address encoding to read in new data from the file, returning the result.
     fn read(
         self,
-        f: &mut File,
+        r: &mut Reader,
         prev: usize
     ) -> usize {
         match self {
-            Self::Raw64 => VersionDb::read::<u64>(f) as usize,
-            Self::Raw32 => VersionDb::read::<u32>(f) as usize,
-            Self::Raw16 => VersionDb::read::<u16>(f) as usize,
+            Self::Raw64 => r.read::<u64>() as usize,
+            Self::Raw32 => r.read::<u32>() as usize,
+            Self::Raw16 => r.read::<u16>() as usize,
             Self::Inc => prev + 1,
-            Self::PosDelta8 => prev + (VersionDb::read::<u8>(f) as usize),
-            Self::NegDelta8 => prev - (VersionDb::read::<u8>(f) as usize),
-            Self::PosDelta16 => prev + (VersionDb::read::<u16>(f) as usize),
-            Self::NegDelta16 => prev - (VersionDb::read::<u16>(f) as usize)
+            Self::PosDelta8 => prev + (r.read::<u8>() as usize),
+            Self::NegDelta8 => prev - (r.read::<u8>() as usize),
+            Self::PosDelta16 => prev + (r.read::<u16>() as usize),
+            Self::NegDelta16 => prev - (r.read::<u16>() as usize)
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use synth::SynthConfig;
+
+    /// The version the test databases are encoded with.
+    const TEST_VERSION: SkseVersion = SkseVersion::new(1, 6, 640, 0);
+
+    /// Builds a small synthetic database with the given layout.
+    fn synth_db(
+        count: usize,
+        layout: DbLayout
+    ) -> (Vec<(usize, usize)>, VersionDb) {
+        let pairs = synth::generate(&SynthConfig { count, ..SynthConfig::default() });
+        let data = writer::encode_db(&pairs, TEST_VERSION, 2, writer::DEFAULT_PTR_SIZE);
+        (pairs, VersionDb::new_from_bytes(&data, TEST_VERSION, 2, layout))
+    }
+
+    /// Finds the id containing the given offset by searching every pair.
+    fn nearest_by_scan(
+        pairs: &[(usize, usize)],
+        addr: usize
+    ) -> Result<(usize, usize), ()> {
+        pairs.iter().filter(|(_, offset)| *offset <= addr)
+            .max_by(|a, b| a.1.cmp(&b.1).then(b.0.cmp(&a.0)))
+            .map(|(id, offset)| (*id, addr - offset)).ok_or(())
+    }
+
+    #[test]
+    fn find_id_by_addr_matches_scan() {
+        for layout in [DbLayout::Hashed, DbLayout::Sorted, DbLayout::Compact] {
+            let (pairs, db) = synth_db(2000, layout);
+            let addrs = (0..0x0360_0000).step_by(0x1_1111).chain([0, 0xfff, 0x1000]);
+            let addrs = addrs.map(RelocAddr::from_offset).collect::<Vec<_>>();
+
+            let batch = db.find_ids_by_addrs(&addrs);
+            for (addr, batched) in addrs.iter().zip(batch.iter()) {
+                let expected = nearest_by_scan(&pairs, addr.offset());
+                assert_eq!(db.find_id_by_addr(*addr), expected);
+                assert_eq!(*batched, expected);
+            }
+        }
+    }
+
+    #[test]
+    fn sidecar_is_only_used_when_intact() {
+        let dir = std::env::temp_dir().join(format!("vdb-sidecar-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("versionlib-1-6-640-0.bin");
+        let sidecar = DbIndex::sidecar_path(&path);
+        let pairs = synth::generate(&SynthConfig { count: 20_000, ..SynthConfig::default() });
+        writer::write_db(&path, &pairs, TEST_VERSION, 2, writer::DEFAULT_PTR_SIZE).unwrap();
+
+        let tail = pairs[pairs.len() - 10].0..usize::MAX;
+        let load = || {
+            let full = VersionDb::new_from_path_with_layout(&path, DbLayout::Sorted);
+            let part = VersionDb::new_from_path_with_range(&path, DbLayout::Sorted, tail.clone());
+            (full.iter().map(|(id, a)| (id, a.offset())).collect::<Vec<_>>(), part.len())
+        };
+
+        // Loading never writes the sidecar.
+        assert!(load() == (pairs.clone(), 10));
+        assert!(!sidecar.exists());
+
+        assert_eq!(VersionDb::write_index(&path), Ok((pairs.len() + 4095) / 4096));
+        assert!(load() == (pairs.clone(), 10));
+
+        // Clearing the id bound of the last chunk would skip it in a range load, so the
+        // damaged sidecar must be ignored.
+        let mut bytes = std::fs::read(&sidecar).unwrap();
+        let len = bytes.len();
+        bytes[len - 8..].fill(0);
+        std::fs::write(&sidecar, &bytes).unwrap();
+        assert!(DbIndex::load(&path, &std::fs::read(&path).unwrap(), pairs.len()).is_err());
+        assert!(load() == (pairs.clone(), 10));
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn pairs_from_path_keeps_file_order() {
+        let dir = std::env::temp_dir().join(format!("vdb-pairs-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("versionlib-1-6-640-0.bin");
+
+        // Swap neighbouring entries, so that the file is not in id order.
+        let mut pairs = synth::generate(&SynthConfig { count: 10_000, ..SynthConfig::default() });
+        for w in pairs.chunks_mut(2) {
+            w.reverse();
+        }
+        writer::write_db(&path, &pairs, TEST_VERSION, 2, writer::DEFAULT_PTR_SIZE).unwrap();
+
+        let range = pairs[100].0..pairs[9000].0;
+        let in_range = pairs.iter().copied().filter(|p| range.contains(&p.0)).collect::<Vec<_>>();
+        assert!(VersionDb::pairs_from_path(&path, None) == pairs);
+        assert!(VersionDb::pairs_from_path(&path, Some(range.clone())) == in_range);
+
+        // The parallel decode of an indexed file must keep the same order.
+        VersionDb::write_index(&path).unwrap();
+        assert!(VersionDb::pairs_from_path(&path, None) == pairs);
+        assert!(VersionDb::pairs_from_path(&path, Some(range)) == in_range);
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn offset_index_builds_once_across_threads() {
+        let (pairs, db) = synth_db(50_000, DbLayout::Sorted);
+        let addr = RelocAddr::from_offset(pairs[pairs.len() / 2].1 + 1);
+        let expected = nearest_by_scan(&pairs, addr.offset());
+
+        // Every thread races to be the first to build the index.
+        let barrier = std::sync::Barrier::new(4);
+        std::thread::scope(|s| {
+            for _ in 0..4 {
+                s.spawn(|| {
+                    barrier.wait();
+                    assert_eq!(db.find_id_by_addr(addr), expected);
+                });
+            }
+        });
+    }
+}
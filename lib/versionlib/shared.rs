@@ -0,0 +1,351 @@
+//!
+//! @file shared.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Shares a loaded version database between plugins.
+//! @bug No known bugs.
+//!
+//! Every plugin which uses the address library would otherwise parse the same database file
+//! when it loads. Instead, one plugin can publish its database, and any other plugin can send
+//! it a request message to get the table of functions used to search it. The request is
+//! answered synchronously, so the requesting plugin knows right away if it must fall back
+//! to parsing the file itself.
+//!
+//! Requests are sent through the Messenger of skse64_common::messaging.
+//!
+
+use std::ffi::c_void;
+
+use skse64_common::version::SkseVersion;
+use skse64_common::reloc::RelocAddr;
+pub use skse64_common::messaging::{LocalBroker, Messenger};
+
+use crate::{DbLayout, VersionDb};
+
+/// The message type used to request a shared database.
+pub const SHARED_DB_MESSAGE: u32 = u32::from_le_bytes(*b"VDB1");
+
+/// The version of the layout of the request and table structures.
+pub const SHARED_DB_ABI: u32 = 1;
+
+/// A request for a shared database, which is filled in by the provider.
+#[repr(C)]
+pub struct SharedDbRequest {
+    pub abi: u32,
+    pub version: SkseVersion,
+    pub table: *const SharedDbTable
+}
+
+///
+/// The functions used to search a database owned by another plugin.
+///
+/// The table, and the database it refers to, are never freed once published.
+///
+#[repr(C)]
+pub struct SharedDbTable {
+    pub abi: u32,
+    pub version: SkseVersion,
+    pub layout: u32,
+    pub len: usize,
+    pub db: *const c_void,
+    pub find_addr_by_id: unsafe extern "C" fn(*const c_void, usize, *mut usize) -> bool,
+    pub find_id_by_addr: unsafe extern "C" fn(
+        *const c_void,
+        usize,
+        *mut usize,
+        *mut usize
+    ) -> bool,
+    pub for_each: unsafe extern "C" fn(
+        *const c_void,
+        *mut c_void,
+        unsafe extern "C" fn(*mut c_void, usize, usize)
+    )
+}
+
+impl SharedDbRequest {
+    /// Creates a new, unanswered, request for a database of the given version.
+    pub fn new(
+        version: SkseVersion
+    ) -> Self {
+        Self {
+            abi: SHARED_DB_ABI,
+            version,
+            table: std::ptr::null()
+        }
+    }
+
+    /// Gets the table which answered the request, if it can be used.
+    pub fn answer(
+        &self
+    ) -> Option<&'static SharedDbTable> {
+        // SAFETY: Published tables are never freed.
+        let table = unsafe { self.table.as_ref()? };
+        if (table.abi == SHARED_DB_ABI) && (table.version == self.version) {
+            Some(table)
+        } else {
+            None
+        }
+    }
+}
+
+impl SharedDbTable {
+    ///
+    /// Publishes the given database, so that it can be shared with other plugins.
+    ///
+    /// The database is leaked, as other plugins may use it for the rest of the game. Its offset
+    /// index is built up front, so that the first search by another plugin does not pay for it.
+    ///
+    pub fn publish(
+        db: VersionDb
+    ) -> &'static Self {
+        let _ = db.find_id_by_addr(RelocAddr::from_offset(0));
+        let db: &'static VersionDb = Box::leak(Box::new(db));
+        Box::leak(Box::new(Self {
+            abi: SHARED_DB_ABI,
+            version: db.loaded_version(),
+            layout: db.layout() as u32,
+            len: db.len(),
+            db: db as *const VersionDb as *const c_void,
+            find_addr_by_id: shared_find_addr_by_id,
+            find_id_by_addr: shared_find_id_by_addr,
+            for_each: shared_for_each
+        }))
+    }
+
+    /// Answers the given request with this table, if it was not already answered.
+    pub fn answer(
+        &'static self,
+        request: &mut SharedDbRequest
+    ) {
+        let matches = (request.abi == SHARED_DB_ABI) && (request.version == self.version);
+        if matches && request.table.is_null() {
+            request.table = self;
+        }
+    }
+
+    /// Gets the layout of the shared database.
+    pub (in crate) fn layout(
+        &self
+    ) -> DbLayout {
+        match self.layout {
+            l if l == DbLayout::Sorted as u32 => DbLayout::Sorted,
+            l if l == DbLayout::Compact as u32 => DbLayout::Compact,
+            _ => DbLayout::Hashed
+        }
+    }
+
+    /// Finds the offset of the given id in the shared database.
+    pub (in crate) fn find_addr_by_id(
+        &self,
+        id: usize
+    ) -> Result<RelocAddr, ()> {
+        let mut offset = 0;
+        // SAFETY: The table was made by publish(), so the functions match the db.
+        if unsafe { (self.find_addr_by_id)(self.db, id, &mut offset) } {
+            Ok(RelocAddr::from_offset(offset))
+        } else {
+            Err(())
+        }
+    }
+
+    /// Finds the id containing the given offset in the shared database.
+    pub (in crate) fn find_id_by_addr(
+        &self,
+        addr: RelocAddr
+    ) -> Result<(usize, usize), ()> {
+        let (mut id, mut delta) = (0, 0);
+        // SAFETY: As above.
+        if unsafe { (self.find_id_by_addr)(self.db, addr.offset(), &mut id, &mut delta) } {
+            Ok((id, delta))
+        } else {
+            Err(())
+        }
+    }
+
+    /// Copies out every (id, offset) pair in the shared database.
+    pub (in crate) fn pairs(
+        &self
+    ) -> Vec<(usize, RelocAddr)> {
+        unsafe extern "C" fn push(
+            ctx: *mut c_void,
+            id: usize,
+            offset: usize
+        ) {
+            (*(ctx as *mut Vec<(usize, RelocAddr)>)).push((id, RelocAddr::from_offset(offset)));
+        }
+
+        let mut pairs = Vec::with_capacity(self.len);
+        // SAFETY: As above, and the callback is only given our vector.
+        unsafe { (self.for_each)(self.db, &mut pairs as *mut _ as *mut c_void, push) };
+        pairs
+    }
+}
+
+// SAFETY: The published database is never modified, and its offset index is built at most once.
+unsafe impl Sync for SharedDbTable {}
+unsafe impl Send for SharedDbTable {}
+
+/// Searches a published database by id.
+unsafe extern "C" fn shared_find_addr_by_id(
+    db: *const c_void,
+    id: usize,
+    offset: *mut usize
+) -> bool {
+    let db = &*(db as *const VersionDb);
+    db.find_addr_by_id(id).map(|a| *offset = a.offset()).is_ok()
+}
+
+/// Searches a published database by offset.
+unsafe extern "C" fn shared_find_id_by_addr(
+    db: *const c_void,
+    offset: usize,
+    id: *mut usize,
+    delta: *mut usize
+) -> bool {
+    let db = &*(db as *const VersionDb);
+    db.find_id_by_addr(RelocAddr::from_offset(offset)).map(|(i, d)| {
+        *id = i;
+        *delta = d;
+    }).is_ok()
+}
+
+/// Calls the given function with every pair in a published database.
+unsafe extern "C" fn shared_for_each(
+    db: *const c_void,
+    ctx: *mut c_void,
+    func: unsafe extern "C" fn(*mut c_void, usize, usize)
+) {
+    let db = &*(db as *const VersionDb);
+    for (id, addr) in db.iter() {
+        func(ctx, id, addr.offset());
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::{synth, writer, Storage};
+    use synth::SynthConfig;
+
+    /// The version the test databases are encoded with.
+    const TEST_VERSION: SkseVersion = SkseVersion::new(1, 6, 640, 0);
+
+    /// A messenger which no plugin answers.
+    struct Nobody;
+
+    impl Messenger<SharedDbRequest> for Nobody {
+        fn send(
+            &self,
+            _request: &mut SharedDbRequest
+        ) {}
+    }
+
+    /// Builds a small synthetic database with the given layout.
+    fn synth_db(
+        count: usize,
+        layout: DbLayout
+    ) -> (Vec<(usize, usize)>, VersionDb) {
+        let pairs = synth::generate(&SynthConfig { count, ..SynthConfig::default() });
+        let data = writer::encode_db(&pairs, TEST_VERSION, 2, writer::DEFAULT_PTR_SIZE);
+        (pairs, VersionDb::new_from_bytes(&data, TEST_VERSION, 2, layout))
+    }
+
+    /// Checks if the given database searches a shared database.
+    fn is_shared(
+        db: &VersionDb
+    ) -> bool {
+        matches!(db.by_id, Storage::Shared(_))
+    }
+
+    #[test]
+    fn published_tables_answer_matching_requests() {
+        let table = SharedDbTable::publish(synth_db(100, DbLayout::Sorted).1);
+        assert!((table.abi == SHARED_DB_ABI) && (table.version == TEST_VERSION));
+        assert_eq!(table.len, 100);
+        assert_eq!(table.layout(), DbLayout::Sorted);
+
+        let mut request = SharedDbRequest::new(TEST_VERSION);
+        assert!(request.answer().is_none());
+        table.answer(&mut request);
+        assert!(std::ptr::eq(request.answer().unwrap(), table));
+
+        // The first provider to answer keeps the request.
+        let other = SharedDbTable::publish(synth_db(10, DbLayout::Hashed).1);
+        other.answer(&mut request);
+        assert!(std::ptr::eq(request.answer().unwrap(), table));
+    }
+
+    #[test]
+    fn mismatched_abi_or_version_is_refused() {
+        let table = SharedDbTable::publish(synth_db(100, DbLayout::Sorted).1);
+
+        // Providers don't answer requests they can't serve.
+        let mut request = SharedDbRequest::new(SkseVersion::new(1, 6, 1170, 0));
+        table.answer(&mut request);
+        assert!(request.table.is_null());
+        let mut request = SharedDbRequest::new(TEST_VERSION);
+        request.abi = SHARED_DB_ABI + 1;
+        table.answer(&mut request);
+        assert!(request.table.is_null());
+
+        // Requesters don't use an answer they can't read.
+        let wrong = |abi, version| -> &'static SharedDbTable {
+            Box::leak(Box::new(SharedDbTable { abi, version, ..*table }))
+        };
+        let mut request = SharedDbRequest::new(TEST_VERSION);
+        request.table = wrong(SHARED_DB_ABI + 1, TEST_VERSION);
+        assert!(request.answer().is_none());
+        request.table = wrong(SHARED_DB_ABI, SkseVersion::new(1, 5, 97, 0));
+        assert!(request.answer().is_none());
+    }
+
+    #[test]
+    fn new_shared_falls_back_when_nobody_answers() {
+        let (pairs, db) = synth_db(100, DbLayout::Compact);
+        let table = SharedDbTable::publish(db);
+        let fallback = || synth_db(10, DbLayout::Sorted).1;
+
+        let db = VersionDb::shared_or(TEST_VERSION, &Nobody, fallback);
+        assert!(!is_shared(&db) && (db.len() == 10));
+
+        // A broker only answers with the databases it was given, of the version requested.
+        let broker = LocalBroker::new();
+        assert!(!is_shared(&VersionDb::shared_or(TEST_VERSION, &broker, fallback)));
+        broker.listen(|request| table.answer(request));
+        let other = SkseVersion::new(1, 6, 1170, 0);
+        assert!(!is_shared(&VersionDb::shared_or(other, &broker, fallback)));
+
+        let db = VersionDb::shared_or(TEST_VERSION, &broker, || panic!("Nobody answered!"));
+        assert!(is_shared(&db) && (db.len() == pairs.len()));
+        assert!(db.loaded_version() == TEST_VERSION);
+    }
+
+    #[test]
+    fn shared_lookups_match_the_published_db() {
+        for layout in [DbLayout::Hashed, DbLayout::Sorted, DbLayout::Compact] {
+            let (pairs, local) = synth_db(2000, layout);
+            let db = VersionDb::from_shared(SharedDbTable::publish(synth_db(2000, layout).1));
+            assert_eq!(db.layout(), layout);
+            assert_eq!(db.len(), local.len());
+
+            for (id, offset) in pairs.iter().step_by(7) {
+                assert_eq!(db.find_addr_by_id(*id), Ok(RelocAddr::from_offset(*offset)));
+            }
+            assert!(db.find_addr_by_id(usize::MAX).is_err());
+
+            let addrs = (0..0x0360_0000).step_by(0x1_1111).map(RelocAddr::from_offset);
+            let addrs = addrs.collect::<Vec<_>>();
+            for addr in addrs.iter() {
+                assert_eq!(db.find_id_by_addr(*addr), local.find_id_by_addr(*addr));
+            }
+            assert_eq!(db.find_ids_by_addrs(&addrs), local.find_ids_by_addrs(&addrs));
+
+            // Hashed databases iterate in an arbitrary order.
+            let mut shared = db.iter().collect::<Vec<_>>();
+            let mut own = local.iter().collect::<Vec<_>>();
+            shared.sort();
+            own.sort();
+            assert!(shared == own);
+        }
+    }
+}
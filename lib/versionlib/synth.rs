@@ -0,0 +1,132 @@
+//!
+//! @file synth.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Generates synthetic version databases.
+//! @bug No known bugs.
+//!
+//! The generated databases are shaped like the real address libraries: the ids are sorted and
+//! mostly consecutive, and most offsets land near the offset of the previous id. Generation is
+//! fully determined by the configuration, so the same seed always produces the same database.
+//!
+
+/// Controls the size and shape of a synthetic database.
+#[derive(Copy, Clone, Debug)]
+pub struct SynthConfig {
+    /// The number of ids in the database.
+    pub count: usize,
+    /// The seed of the random number generator.
+    pub seed: u64,
+    /// The chance, in percent, of an id directly following the previous one.
+    pub inc_percent: u32,
+    /// The largest gap between two consecutive ids.
+    pub max_id_gap: usize,
+    /// The chance, in percent, of an offset being near the offset of the previous id.
+    pub local_percent: u32,
+    /// The largest distance between two nearby offsets.
+    pub max_local_delta: usize,
+    /// The chance, in percent, of an offset being aligned to the pointer size.
+    pub aligned_percent: u32,
+    /// The size of the image which the offsets are within.
+    pub image_size: usize
+}
+
+/// A xorshift64* random number generator.
+struct Rng(u64);
+
+impl Default for SynthConfig {
+    /// Creates a configuration roughly matching an AE address library.
+    fn default() -> Self {
+        Self {
+            count: 430_000,
+            seed: 0x5eed,
+            inc_percent: 85,
+            max_id_gap: 64,
+            local_percent: 70,
+            max_local_delta: 0x400,
+            aligned_percent: 60,
+            image_size: 0x0360_0000
+        }
+    }
+}
+
+impl Rng {
+    /// Creates a new generator. The state of a xorshift generator can't be zero.
+    fn new(
+        seed: u64
+    ) -> Self {
+        Self(if seed == 0 { 0x9e3779b97f4a7c15 } else { seed })
+    }
+
+    /// Gets the next random value.
+    fn next(
+        &mut self
+    ) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545f4914f6cdd1d)
+    }
+
+    /// Gets a random value in [lo, hi].
+    fn range(
+        &mut self,
+        lo: usize,
+        hi: usize
+    ) -> usize {
+        assert!(lo <= hi);
+        lo + (self.next() % ((hi - lo) as u64 + 1)) as usize
+    }
+
+    /// Returns true with the given percent chance.
+    fn chance(
+        &mut self,
+        percent: u32
+    ) -> bool {
+        (self.next() % 100) < (percent as u64)
+    }
+}
+
+///
+/// Generates a synthetic set of (id, offset) pairs, sorted by id.
+///
+/// All offsets are within the first page and the end of the image, as in a real database.
+///
+pub fn generate(
+    config: &SynthConfig
+) -> Vec<(usize, usize)> {
+    const MIN_OFFSET: usize = 0x1000;
+    const PTR_SIZE: usize = 8;
+
+    assert!(config.max_id_gap >= 1);
+    assert!(config.image_size > MIN_OFFSET + config.max_local_delta);
+
+    let mut rng = Rng::new(config.seed);
+    let mut pairs = Vec::with_capacity(config.count);
+    let (mut id, mut offset) = (0, MIN_OFFSET);
+    for _ in 0..config.count {
+        id += if rng.chance(config.inc_percent) {
+            1
+        } else {
+            rng.range(2, config.max_id_gap.max(2))
+        };
+
+        offset = if rng.chance(config.local_percent) {
+            let delta = rng.range(1, config.max_local_delta);
+            if (offset + delta < config.image_size) && rng.chance(90) {
+                offset + delta
+            } else {
+                offset.saturating_sub(delta).max(MIN_OFFSET)
+            }
+        } else {
+            rng.range(MIN_OFFSET, config.image_size - 1)
+        };
+
+        if rng.chance(config.aligned_percent) {
+            offset &= !(PTR_SIZE - 1);
+        }
+
+        pairs.push((id, offset));
+    }
+
+    pairs
+}
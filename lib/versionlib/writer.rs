@@ -0,0 +1,230 @@
+//!
+//! @file writer.rs
+//! @author Andrew Spaulding (Kasplat)
+//! @brief Encodes version databases in the address library binary format.
+//! @bug No known bugs.
+//!
+//! The encoder mirrors the decoder in lib.rs. Each id and offset is written with the smallest
+//! address encoding which can represent it, and the by-pointer flag is set whenever dividing
+//! the offset by the pointer size makes that encoding smaller.
+//!
+
+use skse64_common::version::SkseVersion;
+
+use crate::AddrEncoding;
+
+/// The module name written to the header of each database.
+const MODULE_NAME: &str = "SkyrimSE.exe";
+
+/// The pointer size written to the header of each database.
+pub const DEFAULT_PTR_SIZE: u32 = 8;
+
+impl AddrEncoding {
+    /// Gets the number of bytes this encoding uses.
+    fn size(
+        self
+    ) -> usize {
+        match self {
+            Self::Inc => 0,
+            Self::PosDelta8 | Self::NegDelta8 => 1,
+            Self::PosDelta16 | Self::NegDelta16 | Self::Raw16 => 2,
+            Self::Raw32 => 4,
+            Self::Raw64 => 8
+        }
+    }
+
+    /// Finds the smallest encoding which can represent val, given the previous value.
+    fn choose(
+        val: usize,
+        prev: usize
+    ) -> Self {
+        let (delta, is_pos) = if val >= prev { (val - prev, true) } else { (prev - val, false) };
+
+        if is_pos && (delta == 1) {
+            Self::Inc
+        } else if delta <= u8::MAX as usize {
+            if is_pos { Self::PosDelta8 } else { Self::NegDelta8 }
+        } else if val <= u16::MAX as usize {
+            Self::Raw16
+        } else if delta <= u16::MAX as usize {
+            if is_pos { Self::PosDelta16 } else { Self::NegDelta16 }
+        } else if val <= u32::MAX as usize {
+            Self::Raw32
+        } else {
+            Self::Raw64
+        }
+    }
+
+    /// Writes out val using this encoding, given the previous value.
+    fn write(
+        self,
+        out: &mut Vec<u8>,
+        val: usize,
+        prev: usize
+    ) {
+        match self {
+            Self::Raw64 => out.extend_from_slice(&(val as u64).to_le_bytes()),
+            Self::Raw32 => out.extend_from_slice(&(val as u32).to_le_bytes()),
+            Self::Raw16 => out.extend_from_slice(&(val as u16).to_le_bytes()),
+            Self::Inc => (),
+            Self::PosDelta8 => out.push((val - prev) as u8),
+            Self::NegDelta8 => out.push((prev - val) as u8),
+            Self::PosDelta16 => out.extend_from_slice(&((val - prev) as u16).to_le_bytes()),
+            Self::NegDelta16 => out.extend_from_slice(&((prev - val) as u16).to_le_bytes())
+        }
+    }
+}
+
+///
+/// Encodes the given (id, offset) pairs as a version database file.
+///
+/// The pairs are written in the order given, and the ids must be unique. The format must be
+/// 1 for SE databases or 2 for AE databases, matching the given version.
+///
+pub fn encode_db(
+    pairs: &[(usize, usize)],
+    version: SkseVersion,
+    format: u32,
+    ptr_size: u32
+) -> Vec<u8> {
+    assert!((format == 1) || (format == 2));
+    assert!(ptr_size > 0);
+
+    let mut out = Vec::with_capacity(64 + pairs.len() * 4);
+    out.extend_from_slice(&format.to_le_bytes());
+    for part in [version.major(), version.minor(), version.build(), 0] {
+        out.extend_from_slice(&part.to_le_bytes());
+    }
+    out.extend_from_slice(&(MODULE_NAME.len() as u32).to_le_bytes());
+    out.extend_from_slice(MODULE_NAME.as_bytes());
+    out.extend_from_slice(&ptr_size.to_le_bytes());
+    out.extend_from_slice(&u32::try_from(pairs.len()).unwrap().to_le_bytes());
+
+    let ptr_size = ptr_size as usize;
+    let (mut pid, mut poffset) = (0, 0);
+    for (id, offset) in pairs.iter().copied() {
+        let id_enc = AddrEncoding::choose(id, pid);
+
+        // The decoder divides the previous offset by the pointer size when the flag is set,
+        // so we can only use it when the offset survives the round trip.
+        let offset_enc = AddrEncoding::choose(offset, poffset);
+        let ptr_enc = AddrEncoding::choose(offset / ptr_size, poffset / ptr_size);
+        let is_by_ptr = (offset % ptr_size == 0) && (ptr_enc.size() < offset_enc.size());
+
+        let control = (id_enc as u8)
+            | (if is_by_ptr { ptr_enc } else { offset_enc } as u8) << 4
+            | if is_by_ptr { 0x80 } else { 0 };
+        out.push(control);
+
+        id_enc.write(&mut out, id, pid);
+        if is_by_ptr {
+            ptr_enc.write(&mut out, offset / ptr_size, poffset / ptr_size);
+        } else {
+            offset_enc.write(&mut out, offset, poffset);
+        }
+
+        pid = id;
+        poffset = offset;
+    }
+
+    out
+}
+
+/// Encodes the given (id, offset) pairs, and writes them out to the given path.
+pub fn write_db(
+    path: &std::path::Path,
+    pairs: &[(usize, usize)],
+    version: SkseVersion,
+    format: u32,
+    ptr_size: u32
+) -> Result<(), ()> {
+    std::fs::write(path, encode_db(pairs, version, format, ptr_size)).map_err(|_| ())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::synth::{self, SynthConfig};
+    use crate::{DbLayout, VersionDb};
+
+    /// The size of the header written by encode_db().
+    const HEADER_SIZE: usize = 4 * 8 + MODULE_NAME.len();
+
+    /// Encodes the given pairs, then decodes them again, sorted by id.
+    fn round_trip(
+        pairs: &[(usize, usize)],
+        version: SkseVersion,
+        format: u32
+    ) -> Vec<(usize, usize)> {
+        let data = encode_db(pairs, version, format, DEFAULT_PTR_SIZE);
+        let db = VersionDb::new_from_bytes(&data, version, format, DbLayout::Sorted);
+        db.iter().map(|(id, addr)| (id, addr.offset())).collect()
+    }
+
+    #[test]
+    fn choose_picks_smallest_encoding() {
+        use AddrEncoding::*;
+        for (val, prev, enc) in [
+            (11, 10, Inc),
+            (10, 10, PosDelta8),
+            (0x1ff, 0x100, PosDelta8),
+            (0x100, 0x1ff, NegDelta8),
+            (0x1000, 0, Raw16),
+            (0x2_0000, 0x1_8000, PosDelta16),
+            (0x1_8000, 0x2_0000, NegDelta16),
+            (0x10_0000, 0, Raw32),
+            (0x1_0000_0000, 0, Raw64)
+        ] {
+            assert_eq!(AddrEncoding::choose(val, prev) as u8, enc as u8, "{:#x} {:#x}", val, prev);
+        }
+    }
+
+    #[test]
+    fn by_ptr_flag_is_set_only_when_smaller() {
+        // Both entries have consecutive ids, so the first is a control byte and a 16-bit offset.
+        // The second offset is 0x400 past the first, which needs a 16-bit delta, but only an
+        // 8-bit one once divided by the pointer size.
+        let data = encode_db(&[(1, 0x1_0000), (2, 0x1_0400)], SkseVersion::new(1, 6, 640, 0),
+                             2, DEFAULT_PTR_SIZE);
+        let second = &data[HEADER_SIZE + 1 + 2..];
+        assert_eq!(second[0], 0x80 | ((AddrEncoding::PosDelta8 as u8) << 4) | 1);
+        assert_eq!(second.len(), 2);
+
+        // An unaligned offset can't be divided, so the flag must not be set.
+        let data = encode_db(&[(1, 0x1_0000), (2, 0x1_0401)], SkseVersion::new(1, 6, 640, 0),
+                             2, DEFAULT_PTR_SIZE);
+        let second = &data[HEADER_SIZE + 1 + 2..];
+        assert_eq!(second[0], ((AddrEncoding::PosDelta16 as u8) << 4) | 1);
+    }
+
+    #[test]
+    fn encode_round_trips_both_formats() {
+        let edges = [
+            (1, 0x1000), (2, 0x1000), (0x300, 0xff), (0x200, 0x1_0000_0008),
+            (0x1_0000, 0x7), (0x9_0000, 0x1_2345), (0x1_0000_0000, 0x1_2340)
+        ];
+        let synth = synth::generate(&SynthConfig { count: 50_000, ..SynthConfig::default() });
+
+        for (version, format) in [
+            (SkseVersion::new(1, 5, 97, 0), 1),
+            (SkseVersion::new(1, 6, 640, 0), 2)
+        ] {
+            let mut sorted = edges.to_vec();
+            sorted.sort_unstable();
+            assert_eq!(round_trip(&edges, version, format), sorted);
+            assert!(round_trip(&synth, version, format) == synth);
+        }
+    }
+
+    #[test]
+    fn synth_is_deterministic_and_well_formed() {
+        let config = SynthConfig { count: 100_000, ..SynthConfig::default() };
+        let pairs = synth::generate(&config);
+        assert!(pairs == synth::generate(&config));
+        assert!(pairs != synth::generate(&SynthConfig { seed: 1, ..config }));
+
+        assert_eq!(pairs.len(), config.count);
+        assert!(pairs.windows(2).all(|w| w[0].0 < w[1].0));
+        assert!(pairs.iter().all(|(_, offset)| (0x1000..config.image_size).contains(offset)));
+    }
+}